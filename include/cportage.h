@@ -172,7 +172,8 @@ cp_repository_unref(
 ) /*@modifies self@*/;
 
 /**
- * \return readonly canonical path to \a self root
+ * \return readonly canonical path to \a self root, or to tar archive
+ *         \a self is read from if it's a snapshot
  */
 /*@observer@*/ const char *
 cp_repository_path(const CPRepository self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
@@ -185,7 +186,8 @@ cp_repository_name(const CPRepository self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
 
 /**
  * Synchronizes repository contents from remote location (rsync or VCS).
- * Synchronization method depends on repository settings.
+ * Synchronization method depends on repository settings. Snapshots are
+ * synchronized by renaming downloaded "<path>.new" archive over old one.
  *
  * ATTENTION: after returning from this function, all #CPSettings instances
  * that own repository with same path as \a self become invalid and need to be
@@ -202,6 +204,83 @@ cp_repository_sync(
 ) G_GNUC_WARN_UNUSED_RESULT
 /*@modifies *error,*stdout,*stderr,errno,fileSystem@*/;
 
+/**
+ * Checks files of \a self against its Manifests. If repository has
+ * top-level Manifest, it and all Manifests it lists, compressed ones
+ * included, are followed and files no Manifest lists or ignores are
+ * reported, as GLEP 74 requires. Otherwise Manifests of all packages
+ * are followed. Each file is read once
+ * by a pool of \a jobs threads, computing all its digests in one pass.
+ * Distfiles aren't checked, see cp_manifest_verify_distfiles() for that.
+ * Snapshots aren't checked either, they are expected to be verified
+ * as a whole when downloaded. Binary caches of #CPPorttree that are
+ * kept inside repository aren't reported as unlisted.
+ *
+ * \param failed return location for sorted list of paths (relative to
+ *               repository root) of files that are missing, unlisted
+ *               or don't match their Manifest entries,
+ *               free it using g_slist_free_full()
+ * \param error  return location for a %GError, or %NULL
+ * \return       %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_repository_verify(
+    const CPRepository self,
+    guint jobs,
+    /*@out@*/ GSList/*<char *>*/ **failed,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *failed,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Parsed Manifest file.
+ */
+typedef struct CPManifestS *CPManifest;
+
+/**
+ * Reads Manifest at \a path, decompressing it if name ends with \c .gz.
+ * OpenPGP signature, if any, isn't checked.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      a #CPManifest or %NULL if an error occurred,
+ *              free it using cp_manifest_destroy()
+ */
+/*@null@*/ /*@only@*/ CPManifest
+cp_manifest_new(
+    const char *path,
+    /*@null@*/ GError **error
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *error,errno@*/ /*@globals fileSystem@*/;
+
+void
+cp_manifest_destroy(
+    /*@null@*/ /*@only@*/ CPManifest self
+) /*@modifies self@*/;
+
+/**
+ * Checks distfiles in \a distdir against DIST entries of \a self,
+ * using a pool of \a jobs threads. Every file is read once
+ * and all its digests are computed in that pass.
+ *
+ * \param files  %NULL-terminated list of distfile names to check,
+ *               or %NULL to check all of them
+ * \param failed return location for sorted list of names of distfiles
+ *               that are missing, don't match their entries or aren't
+ *               listed in \a self, free it using g_slist_free_full()
+ * \param error  return location for a %GError, or %NULL
+ * \return       %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_manifest_verify_distfiles(
+    const CPManifest self,
+    const char *distdir,
+    /*@null@*/ const char * const *files,
+    guint jobs,
+    /*@out@*/ GSList/*<char *>*/ **failed,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *failed,*error,errno@*/ /*@globals fileSystem@*/;
+
 /**
  * Central immutable storage of cportage configuration.
  */
@@ -296,6 +375,41 @@ cp_settings_get_required(
     /*@null@*/ GError **error
 ) G_GNUC_WARN_UNUSED_RESULT /*@modifies *error@*/;
 
+/**
+ * Parses \a key variable as a non-negative decimal number.
+ *
+ * \param value return location for the number, \a fallback if variable
+ *              is not set
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if value isn't a valid number
+ */
+gboolean
+cp_settings_get_uint(
+    const CPSettings self,
+    const char *key,
+    guint fallback,
+    /*@out@*/ guint *value,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *value,*error,errno@*/;
+
+/**
+ * Parses \a key variable as a boolean: one of "true", "t", "yes", "y",
+ * "1", "on" or "false", "f", "no", "n", "0", "off".
+ *
+ * \param value return location for the value, \a fallback if variable
+ *              is not set
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if value isn't a valid boolean
+ */
+gboolean
+cp_settings_get_boolean(
+    const CPSettings self,
+    const char *key,
+    gboolean fallback,
+    /*@out@*/ gboolean *value,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *value,*error@*/;
+
 /**
  * \return readonly value of \a key variable
  *         or %NULL if variable is not set
@@ -437,6 +551,12 @@ typedef enum CPEapi {
     CP_EAPI_UNKNOWN = -1
 } CPEapi;
 
+/**
+ * \return EAPI of \a self
+ */
+CPEapi
+cp_package_eapi(const CPPackage self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
 /**
  * Structure, describing a single atom.
  */
@@ -510,6 +630,39 @@ cp_atom_new(
 ) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT
 /*@modifies *factory,*error@*/;
 
+/**
+ * Package pattern like "dev-lang/python", "*\/python", "dev-lang/\*" or
+ * "dev-*\/py*". Both parts may contain \c * and \c ? wildcards, pattern
+ * without category matches any category.
+ */
+typedef struct CPPatternS *CPPattern;
+
+/**
+ * Creates a #CPPattern structure for \a value.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      a #CPPattern, free it using cp_pattern_destroy()
+ */
+/*@null@*/ /*@only@*/ CPPattern
+cp_pattern_new(
+    const char *value,
+    /*@null@*/ GError **error
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT /*@modifies *error@*/;
+
+void
+cp_pattern_destroy(
+    /*@null@*/ /*@only@*/ CPPattern self
+) /*@modifies self@*/;
+
+/**
+ * \return %TRUE if \a self matches \a package, %FALSE otherwise
+ */
+gboolean
+cp_pattern_matches(
+    const CPPattern self,
+    const CPPackage package
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
 typedef struct CPConfigProtectS *CPConfigProtect;
 
 CPConfigProtect
@@ -540,11 +693,37 @@ typedef gboolean (*CPTreeFindPackagesFunc)(
     /*@null@*/ GError **error
 );
 
+/**
+ * Called by cp_tree_foreach() for every package.
+ *
+ * \return %TRUE to continue iteration, %FALSE to stop it
+ */
+typedef gboolean (*CPTreeFindPatternFunc)(
+    void *priv,
+    const CPPattern pattern,
+    /*@out@*/ GSList/*<CPPackage>*/ **match,
+    /*@null@*/ GError **error
+);
+
+typedef gboolean (*CPTreeForeachFunc)(
+    const CPPackage package,
+    void *user_data
+);
+
+typedef gboolean (*CPTreeForeachPackageFunc)(
+    void *priv,
+    CPTreeForeachFunc func,
+    void *user_data,
+    /*@null@*/ GError **error
+);
+
 typedef void (*CPTreeDestroyFunc)(/*@only@*/ void *priv) /*@modifies priv@*/;
 
 typedef const struct CPTreeOps {
   /*@null@*/ const CPTreeDestroyFunc destructor;
   const CPTreeFindPackagesFunc find_packages;
+  const CPTreeForeachPackageFunc foreach_package;
+  const CPTreeFindPatternFunc find_pattern;
 } *CPTreeOps;
 
 /*@newref@*/ CPTree
@@ -594,6 +773,50 @@ cp_tree_find_packages(
 ) G_GNUC_WARN_UNUSED_RESULT
 /*@modifies self,*match,*error,errno@*/ /*@globals fileSystem@*/;
 
+/**
+ * Searches for packages matching \a pattern in \a self. Unlike
+ * cp_tree_find_packages(), category and package name may be wildcards.
+ *
+ * \param pattern   pattern to match against
+ * \param ascending if %TRUE, \a match will be sorted in ascending order,
+ *                  otherwise in descending
+ * \param match     return location for matched packages list,
+ *                  free it using cp_package_list_free()
+ * \param error     return location for a %GError, or %NULL
+ * \return          %TRUE on success, %FALSE if an error occurred
+ *
+ * \see cp_pattern_matches()
+ */
+gboolean
+cp_tree_find_pattern(
+    CPTree self,
+    const CPPattern pattern,
+    gboolean ascending,
+    /*@out@*/ GSList/*<CPPackage>*/ **match,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies self,*match,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Calls \a func for every package in \a self without building a list
+ * of them. Packages are passed sorted by category, name and version.
+ *
+ * \param func      function to call, \a package passed to it is only
+ *                  valid during the call, use cp_package_ref() to keep it
+ * \param user_data data to pass to \a func
+ * \param error     return location for a %GError, or %NULL
+ * \return          %TRUE on success (including iteration stopped by
+ *                  \a func), %FALSE if an error occurred
+ */
+gboolean
+cp_tree_foreach(
+    CPTree self,
+    CPTreeForeachFunc func,
+    void *user_data,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies self,*error,errno@*/ /*@globals fileSystem@*/;
+
 /**
  * Installed packages tree.
  */
@@ -633,11 +856,219 @@ cp_vartree_path(const CPVartree self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
 /*@newref@*/ CPTree
 cp_vartree_get_tree(CPVartree self) /*@modifies *self@*/;
 
-/** TODO: documentation. */
+/**
+ * Applies vdb changes that happened since last call. Only has effect when
+ * \c CPORTAGE_VARTREE_WATCH is enabled: categories where packages were
+ * merged or unmerged are reread on next access, added and removed
+ * categories are tracked. Searches in vartree call it implicitly.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_vartree_sync(
+    CPVartree self,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Writes index of packages loaded by \a self, so that later instances read
+ * unchanged categories from it instead of scanning vdb, together with
+ * metadata columns built by cp_vartree_get_metadata(). Does nothing
+ * unless \c CPORTAGE_VARTREE_INDEX is enabled or if nothing changed since
+ * index was read. Index is never written implicitly.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_vartree_save_index(
+    CPVartree self,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * \return counter that is increased every time cached vdb contents change,
+ *         caches that depend on \a self can compare it to detect staleness
+ */
+guint64
+cp_vartree_generation(const CPVartree self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * Looks up vdb metadata \a key (like "USE", "COUNTER" or "NEEDED.ELF.2")
+ * of installed \a package. First request for a key reads it for all
+ * installed packages at once and keeps values packed in memory, other keys
+ * aren't read. When \c CPORTAGE_VARTREE_INDEX is enabled,
+ * cp_vartree_save_index() also stores values next to the index, so only
+ * changed categories are reread later.
+ *
+ * \param value return location for readonly value, set to %NULL if
+ *              \a package isn't installed or doesn't have \a key.
+ *              It stays valid until vdb changes are applied.
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_vartree_get_metadata(
+    CPVartree self,
+    const CPPackage package,
+    const char *key,
+    /*@out@*/ /*@null@*/ const char **value,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*value,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Immutable view of installed packages, safe to share between threads.
+ */
+typedef /*@refcounted@*/ struct CPVartreeSnapshotS *CPVartreeSnapshot;
+
+/**
+ * Loads every vdb category of \a self and atomically replaces snapshot
+ * returned by cp_vartree_snapshot_acquire(). Readers holding previous
+ * snapshot keep using it until they release it. Like every other
+ * #CPVartree function except cp_vartree_snapshot_acquire(), it must not
+ * be called concurrently on the same \a self.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_vartree_publish(
+    CPVartree self,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Returns latest snapshot published by cp_vartree_publish(), or an empty
+ * one if nothing was published yet. Can be called from any thread, even
+ * while \a self publishes a new snapshot, and never blocks.
+ *
+ * \return a #CPVartreeSnapshot, free it using cp_vartree_snapshot_unref()
+ */
+/*@newref@*/ CPVartreeSnapshot
+cp_vartree_snapshot_acquire(
+    CPVartree self
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *self@*/;
+
+/*@newref@*/ CPVartreeSnapshot
+cp_vartree_snapshot_ref(
+    CPVartreeSnapshot self
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *self@*/;
+
+void
+cp_vartree_snapshot_unref(
+    /*@killref@*/ /*@null@*/ CPVartreeSnapshot self
+) /*@modifies self@*/;
+
+/**
+ * \return value of cp_vartree_generation() when \a self was published
+ */
+guint64
+cp_vartree_snapshot_generation(
+    const CPVartreeSnapshot self
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return tree view of \a self. Searches in it never touch vdb and never
+ *         take locks. Returned tree itself must only be used from one
+ *         thread, other threads should create their own.
+ */
+/*@newref@*/ CPTree
+cp_vartree_snapshot_get_tree(
+    CPVartreeSnapshot self
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *self@*/;
+
+/**
+ * Index of files installed by packages, built from vdb CONTENTS files.
+ */
+typedef /*@refcounted@*/ struct CPOwnersS *CPOwners;
+
+/**
+ * Loads file ownership index of \a vartree. When \c CPORTAGE_VARTREE_INDEX
+ * is enabled, index saved by cp_owners_save() is reused and only CONTENTS
+ * of packages whose vdb directories changed since it was written are reread.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      a #CPOwners or %NULL if an error occurred,
+ *              free it using cp_owners_unref()
+ */
+/*@newref@*/ /*@null@*/ CPOwners
+cp_owners_new(
+    const CPSettings settings,
+    const CPVartree vartree,
+    /*@null@*/ GError **error
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *error,errno,fileSystem@*/ /*@globals fileSystem@*/;
+
+/**
+ * Increases reference count of \a self by 1.
+ *
+ * \param self a #CPOwners structure
+ * \return \a self
+ */
+/*@newref@*/ CPOwners
+cp_owners_ref(CPOwners self) G_GNUC_WARN_UNUSED_RESULT /*@modifies *self@*/;
+
+/**
+ * Decreases reference count of \a self by 1. When reference count drops
+ * to zero, it frees all the memory associated with the structure.
+ *
+ * \param self a #CPOwners
+ */
+void
+cp_owners_unref(/*@killref@*/ /*@null@*/ CPOwners self) /*@modifies self@*/;
+
+/**
+ * Stores \a self next to vdb for cp_owners_new() to reuse. Does nothing
+ * unless \c CPORTAGE_VARTREE_INDEX is enabled or if \a self was loaded
+ * from up-to-date index. Index is never written implicitly.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_owners_save(
+    CPOwners self,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*error,errno,fileSystem@*/ /*@globals fileSystem@*/;
+
+/**
+ * \param path absolute path to a file
+ * \return     sorted list of "category/name-version" strings of packages
+ *             that own \a path. Strings belong to \a self,
+ *             free list itself using g_slist_free().
+ */
+/*@only@*/ GSList/*<const char *>*/ *
+cp_owners_find(
+    const CPOwners self,
+    const char *path
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * Same as cp_owners_find(), but also returns owners of all files
+ * below directory \a dir.
+ */
+/*@only@*/ GSList/*<const char *>*/ *
+cp_owners_find_dir(
+    const CPOwners self,
+    const char *dir
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * Tree of ebuilds available in repositories, read from their
+ * metadata/md5-cache directories.
+ */
 typedef /*@refcounted@*/ struct CPPorttreeS *CPPorttree;
 
 /**
- * TODO: documentation.
+ * Creates porttree for repositories of \a settings. Nothing is read
+ * upfront: category directories are listed on first lookup in them, and
+ * cache entries of a package are only parsed when it is queried.
  */
 /*@newref@*/ /*@null@*/ CPPorttree
 cp_porttree_new(
@@ -646,6 +1077,319 @@ cp_porttree_new(
 ) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT
 /*@modifies *error,errno*/ /*@globals fileSystem@*/;
 
+/**
+ * Increases reference count of \a self by 1.
+ *
+ * \param self a #CPPorttree structure
+ * \return \a self
+ */
+/*@newref@*/ CPPorttree
+cp_porttree_ref(CPPorttree self) G_GNUC_WARN_UNUSED_RESULT /*@modifies *self@*/;
+
+/**
+ * Decreases reference count of \a self by 1. When reference count drops
+ * to zero, it frees all the memory associated with the structure.
+ *
+ * \param self a #CPPorttree
+ */
+void
+cp_porttree_unref(/*@killref@*/ /*@null@*/ CPPorttree self) /*@modifies self@*/;
+
+/*@newref@*/ CPTree
+cp_porttree_get_tree(CPPorttree self) /*@modifies *self@*/;
+
+/**
+ * Reads metadata \a keys (like "KEYWORDS" or "IUSE") of available
+ * \a package from its md5-cache entry. Entry is read once and kept in
+ * memory by \a self, with values shared between packages, so later
+ * calls don't touch the filesystem. Packages of repositories without
+ * md5-cache only have EAPI, SLOT and KEYWORDS, read from their ebuilds.
+ *
+ * \param keys   %NULL-terminated array of keys
+ * \param values return location for newly allocated values, one per key,
+ *               %NULL for keys missing from the entry (md5-cache omits
+ *               empty keys). Free them using g_free().
+ * \param error  return location for a %GError, or %NULL
+ * \return       %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_porttree_get_metadata(
+    CPPorttree self,
+    const CPPackage package,
+    const char * const *keys,
+    /*@out@*/ char **values,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*values,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Brings binary metadata caches of all repositories up to date, see
+ * CPORTAGE_PORTTREE_CACHE in cportage(3). Every category is listed, and
+ * only md5-cache entries whose mtime or _md5_ changed are parsed again.
+ * Caches are also written when \a self is freed, but only categories
+ * that were looked at are refreshed then.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_porttree_update_cache(
+    CPPorttree self,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*error,errno,fileSystem@*/ /*@globals fileSystem@*/;
+
+/**
+ * Checks that md5-cache of every repository is current: each entry's
+ * _md5_ must match its ebuild, and _eclasses_ digests must match
+ * eclasses. Eclasses are resolved through repository masters from
+ * metadata/layout.conf (overlays without it inherit from the main
+ * repository). Every eclass is hashed once and its digest is reused by
+ * later calls until its eclass directory is modified. Ebuilds are hashed
+ * by CPORTAGE_PORTTREE_JOBS threads, see cportage(3).
+ *
+ * \param stale return location for sorted list of "category/pf::repo"
+ *              strings of outdated entries, free it using
+ *              g_slist_free_full() with g_free()
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_porttree_validate_cache(
+    CPPorttree self,
+    /*@out@*/ GSList/*<char *>*/ **stale,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*stale,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Reasons why an ebuild isn't visible, combined as bit flags.
+ */
+typedef enum CPMaskReason {
+    CP_MASK_NONE = 0,
+    /** Matched by package.mask, but not by package.unmask */
+    CP_MASK_PACKAGE_MASK = 1 << 0,
+    /** None of KEYWORDS is accepted by ACCEPT_KEYWORDS or
+        package.accept_keywords */
+    CP_MASK_KEYWORDS = 1 << 1,
+    /** LICENSE isn't satisfied by ACCEPT_LICENSE or is malformed */
+    CP_MASK_LICENSE = 1 << 2
+} CPMaskReason;
+
+/**
+ * Decides which ebuilds of a #CPPorttree are visible. Keywords are
+ * interned into bit positions, so a package is checked against
+ * ACCEPT_KEYWORDS with a bitset intersection, and results are memoized
+ * per package. ACCEPT_LICENSE is compiled into a bitset over interned
+ * licenses with @GROUP items expanded, and LICENSE of each package is
+ * compiled once, so evaluating it doesn't compare any strings.
+ */
+typedef /*@refcounted@*/ struct CPVisibilityS *CPVisibility;
+
+/**
+ * Creates visibility engine for \a porttree from ACCEPT_KEYWORDS, ARCH,
+ * ACCEPT_LICENSE and USE of \a settings, package.mask and license_groups
+ * files of repositories, package.mask files of profiles, and
+ * package.mask, package.unmask and package.accept_keywords files
+ * in /etc/portage. Invalid atoms in these files are skipped with a warning.
+ * USE conditionals in LICENSE are evaluated against global USE. Empty
+ * ACCEPT_LICENSE accepts every license.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      a #CPVisibility, free it using cp_visibility_unref()
+ */
+/*@newref@*/ /*@null@*/ CPVisibility
+cp_visibility_new(
+    const CPSettings settings,
+    CPPorttree porttree,
+    /*@null@*/ GError **error
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *porttree,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Increases reference count of \a self by 1.
+ *
+ * \param self a #CPVisibility structure
+ * \return \a self
+ */
+/*@newref@*/ CPVisibility
+cp_visibility_ref(CPVisibility self) G_GNUC_WARN_UNUSED_RESULT /*@modifies *self@*/;
+
+/**
+ * Decreases reference count of \a self by 1. When reference count drops
+ * to zero, it frees all the memory associated with the structure.
+ *
+ * \param self a #CPVisibility
+ */
+void
+cp_visibility_unref(/*@killref@*/ /*@null@*/ CPVisibility self) /*@modifies self@*/;
+
+/**
+ * Rereads visibility configuration from \a settings. Memoized results
+ * are kept per settings fingerprint, so switching back to configuration
+ * that was already used doesn't evaluate anything again.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_visibility_reload(
+    CPVisibility self,
+    const CPSettings settings,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * \return hash of everything that affects visibility in current
+ *         configuration of \a self
+ */
+guint64
+cp_visibility_fingerprint(const CPVisibility self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * Evaluates visibility of every package in porttree in one pass, so that
+ * later queries are answered from memo.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_visibility_compute(
+    CPVisibility self,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Checks whether available \a package is visible.
+ *
+ * \param reason return location for combination of #CPMaskReason flags,
+ *               #CP_MASK_NONE if \a package is visible
+ * \param error  return location for a %GError, or %NULL
+ * \return       %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_visibility_check(
+    CPVisibility self,
+    const CPPackage package,
+    /*@out@*/ CPMaskReason *reason,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*reason,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Finds the highest visible version matching \a atom.
+ *
+ * \param best  return location for the package or %NULL if there is no
+ *              visible match, free it using cp_package_unref()
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_visibility_best_visible(
+    CPVisibility self,
+    const CPAtom atom,
+    /*@out@*/ CPPackage *best,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*best,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Computes effective USE of available packages. Profile and user
+ * configuration is compiled into ordered deltas over bitsets of interned
+ * flags, indexed by package name of their atoms, so USE of a package is
+ * evaluated in one pass over deltas that may apply to it. Results are
+ * memoized per package and configuration fingerprint.
+ */
+typedef /*@refcounted@*/ struct CPUseS *CPUse;
+
+/**
+ * Creates USE engine for \a porttree from USE (as it was before
+ * use.force and use.mask were applied), flags negated in USE and ARCH of
+ * \a settings, package.use, use.force, use.stable.force, package.use.force,
+ * package.use.stable.force and the same mask files of profiles, and
+ * package.use in /etc/portage.
+ * Effective USE of a package starts with global USE plus IUSE defaults
+ * ("+flag") not disabled in USE, then package.use lines matching the
+ * package are applied in order, then forced flags are added and masked
+ * ones removed. Global and package force and mask files are stacked
+ * together, so "-flag" in package.use.force or package.use.mask lifts
+ * a force or mask of use.force or use.mask. Stable variants only apply to
+ * packages with ARCH in KEYWORDS. Flags of "NAME: flag" items in
+ * package.use are prefixed with lowercase NAME, as USE_EXPAND values are.
+ * Invalid atoms in these files are skipped with a warning.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      a #CPUse, free it using cp_use_unref()
+ */
+/*@newref@*/ /*@null@*/ CPUse
+cp_use_new(
+    const CPSettings settings,
+    CPPorttree porttree,
+    /*@null@*/ GError **error
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *porttree,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Increases reference count of \a self by 1.
+ *
+ * \param self a #CPUse structure
+ * \return \a self
+ */
+/*@newref@*/ CPUse
+cp_use_ref(CPUse self) G_GNUC_WARN_UNUSED_RESULT /*@modifies *self@*/;
+
+/**
+ * Decreases reference count of \a self by 1. When reference count drops
+ * to zero, it frees all the memory associated with the structure.
+ *
+ * \param self a #CPUse
+ */
+void
+cp_use_unref(/*@killref@*/ /*@null@*/ CPUse self) /*@modifies self@*/;
+
+/**
+ * Rereads USE configuration from \a settings. Memoized results are kept
+ * per settings fingerprint, so switching back to configuration that was
+ * already used doesn't evaluate anything again.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_use_reload(
+    CPUse self,
+    const CPSettings settings,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * \return hash of everything that affects USE in current configuration
+ *         of \a self
+ */
+guint64
+cp_use_fingerprint(const CPUse self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * Computes effective USE of available \a package. Result isn't limited
+ * to IUSE of \a package, global USE flags it doesn't use are there too.
+ *
+ * \param flags return location for sorted %NULL-terminated array of
+ *              enabled flags, free it using g_strfreev()
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_use_get_flags(
+    CPUse self,
+    const CPPackage package,
+    /*@out@*/ char ***flags,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*flags,*error,errno@*/ /*@globals fileSystem@*/;
+
 /** TODO: documentation. */
 typedef /*@refcounted@*/ struct CPBintreeS *CPBintree;
 
@@ -17,10 +17,67 @@
     along with cportage.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "config.h"
+
 #include <stdlib.h>
 
+#if HAVE_UNISTD_H
+#   include <unistd.h>
+#endif
+
 #include "actions.h"
 
+/**
+ * Checks Manifests of just synced \a repo.
+ */
+static int
+verify_repository(
+    const CPSettings settings,
+    const CPRepository repo,
+    GError **error
+) /*@modifies *error,*stderr,errno@*/ /*@globals fileSystem@*/ {
+    GSList *failed;
+    GSList *iter;
+    gboolean enabled;
+    guint jobs;
+
+    if (!cp_settings_get_boolean(settings, "CPORTAGE_MANIFEST_VERIFY", TRUE, &enabled, error)
+            || !cp_settings_get_uint(settings, "CPORTAGE_MANIFEST_JOBS", 0, &jobs, error)) {
+        return EXIT_FAILURE;
+    }
+
+    if (!enabled) {
+        return EXIT_SUCCESS;
+    }
+
+#if HAVE_UNISTD_H
+    if (jobs == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = online > 0 ? (guint)online : 0;
+    }
+#endif
+    if (jobs == 0) {
+        jobs = 1;
+    }
+
+    if (!cp_repository_verify(repo, jobs, &failed, error)) {
+        return EXIT_FAILURE;
+    }
+
+    if (failed == NULL) {
+        return EXIT_SUCCESS;
+    }
+
+    for (iter = failed; iter != NULL; iter = iter->next) {
+        g_warning(_("%s: Manifest verification failed"), (char *)iter->data);
+    }
+    g_set_error(error, G_FILE_ERROR, (gint)G_FILE_ERROR_FAILED,
+        _("Manifest verification of %u files in %s failed"),
+        g_slist_length(failed), cp_repository_path(repo));
+    g_slist_free_full(failed, g_free);
+    return EXIT_FAILURE;
+}
+
 int
 cmerge_sync_action(
     CPContext ctx,
@@ -34,6 +91,11 @@ cmerge_sync_action(
         if (retval != EXIT_SUCCESS) {
             return retval;
         }
+
+        retval = verify_repository(ctx->settings, repo, error);
+        if (retval != EXIT_SUCCESS) {
+            return retval;
+        }
     } end_CP_GSLIST_ITER
 
     return EXIT_SUCCESS;
@@ -86,4 +86,21 @@ cp_atom_pv_split(
     /*@null@*/ GError **error
 ) G_GNUC_WARN_UNUSED_RESULT /*@modifies *name,*version,*error@*/;
 
+/**
+ * Narrows \a packages to the range that can contain matches of \a self.
+ * Packages outside of [\a from, \a to) never match, packages inside
+ * still need to be checked with cp_atom_matches().
+ *
+ * \param packages array of \a n packages with same category and name
+ *                 as \a self, sorted by version in ascending order
+ */
+void
+cp_atom_match_range(
+    const CPAtom self,
+    CPPackage const *packages,
+    guint n,
+    /*@out@*/ guint *from,
+    /*@out@*/ guint *to
+) /*@modifies *from,*to@*/;
+
 #endif
@@ -134,7 +134,8 @@ struct CPVersionS {
     GSList/*<VersionSuffix>*/ *suffixes;
     char *revision;
     char *major;
-    /*@refs@*/ unsigned int refs;
+    /** Changed atomically, versions are shared by vartree snapshots */
+    /*@refs@*/ gint refs;
     char letter;
 };
 
@@ -485,7 +486,7 @@ cp_version_new(const char *value, GError **error) {
 
 CPVersion
 cp_version_ref(CPVersion self) {
-    ++self->refs;
+    g_atomic_int_inc(&self->refs);
     /*@-refcounttrans@*/
     return self;
     /*@=refcounttrans@*/
@@ -499,8 +500,8 @@ cp_version_unref(CPVersion self) {
         /*@=mustfreeonly@*/
     }
 
-    g_assert(self->refs > 0);
-    if (--self->refs > 0) {
+    g_assert(g_atomic_int_get(&self->refs) > 0);
+    if (!g_atomic_int_dec_and_test(&self->refs)) {
         return;
     }
 
@@ -788,7 +789,7 @@ cp_atom_matches(const CPAtom self, const CPPackage package) {
         return FALSE;
     }
     if (self->subslot != NULL
-            && g_strcmp0(self->slot, cp_package_subslot(package)) != 0) {
+            && g_strcmp0(self->subslot, cp_package_subslot(package)) != 0) {
         return FALSE;
     }
     /*
@@ -806,19 +807,19 @@ cp_atom_matches(const CPAtom self, const CPPackage package) {
             result = TRUE;
             break;
         case OP_LT:
-            result = cp_version_cmp(self->version, pkg_version) < 0;
+            result = cp_version_cmp(pkg_version, self->version) < 0;
             break;
         case OP_LE:
-            result = cp_version_cmp(self->version, pkg_version) <= 0;
+            result = cp_version_cmp(pkg_version, self->version) <= 0;
             break;
         case OP_EQ:
-            result = cp_version_cmp(self->version, pkg_version) == 0;
+            result = cp_version_cmp(pkg_version, self->version) == 0;
             break;
         case OP_GE:
-            result = cp_version_cmp(self->version, pkg_version) >= 0;
+            result = cp_version_cmp(pkg_version, self->version) >= 0;
             break;
         case OP_GT:
-            result = cp_version_cmp(self->version, pkg_version) > 0;
+            result = cp_version_cmp(pkg_version, self->version) > 0;
             break;
         case OP_TILDE:
             result = cp_version_tilde_match(self->version, pkg_version);
@@ -836,6 +837,83 @@ cp_atom_matches(const CPAtom self, const CPPackage package) {
     return result;
 }
 
+/**
+ * \return index of first of \a n \a packages whose version is greater than
+ *         (if \a strict) or not less than \a version
+ */
+static guint
+partition_point(
+    CPPackage const *packages,
+    guint n,
+    const CPVersion version,
+    gboolean check_revision,
+    gboolean strict
+) /*@*/ {
+    guint lo = 0;
+    guint hi = n;
+
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        CPVersion pkg_version = cp_package_version(packages[mid]);
+        int cmp = cp_version_cmp_internal(pkg_version, version, check_revision);
+
+        cp_version_unref(pkg_version);
+        if (strict ? cmp <= 0 : cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+void
+cp_atom_match_range(
+    const CPAtom self,
+    CPPackage const *packages,
+    guint n,
+    guint *from,
+    guint *to
+) {
+    *from = 0;
+    *to = n;
+
+    switch (self->op) {
+        case OP_NONE:
+        case OP_GLOB:
+            /* Glob matches aren't contiguous: 1.2* matches 1.20, but not 1.3 */
+            break;
+        case OP_LT:
+            *to = partition_point(packages, n, self->version, TRUE, FALSE);
+            break;
+        case OP_LE:
+            *to = partition_point(packages, n, self->version, TRUE, TRUE);
+            break;
+        case OP_EQ:
+            *from = partition_point(packages, n, self->version, TRUE, FALSE);
+            *to = partition_point(packages, n, self->version, TRUE, TRUE);
+            break;
+        case OP_GE:
+            *from = partition_point(packages, n, self->version, TRUE, FALSE);
+            break;
+        case OP_GT:
+            *from = partition_point(packages, n, self->version, TRUE, TRUE);
+            break;
+        case OP_TILDE:
+            /* Same version with not smaller revision, see cp_version_tilde_match */
+            *from = partition_point(packages, n, self->version, TRUE, FALSE);
+            *to = partition_point(packages, n, self->version, FALSE, TRUE);
+            break;
+        default:
+            g_assert_not_reached();
+    }
+
+    if (*from > *to) {
+        *from = *to;
+    }
+}
+
 typedef struct CPAtomFactoryEntry {
     /*@null@*/ CPAtom atom;
     /*@null@*/ GError *error;
@@ -0,0 +1,163 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "blake2b.h"
+
+/*@unchecked@*/ static const guint64 blake2b_iv[8] = {
+    G_GUINT64_CONSTANT(0x6a09e667f3bcc908), G_GUINT64_CONSTANT(0xbb67ae8584caa73b),
+    G_GUINT64_CONSTANT(0x3c6ef372fe94f82b), G_GUINT64_CONSTANT(0xa54ff53a5f1d36f1),
+    G_GUINT64_CONSTANT(0x510e527fade682d1), G_GUINT64_CONSTANT(0x9b05688c2b3e6c1f),
+    G_GUINT64_CONSTANT(0x1f83d9abfb41bd6b), G_GUINT64_CONSTANT(0x5be0cd19137e2179)
+};
+
+/*@unchecked@*/ static const guint8 blake2b_sigma[12][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+#define ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+#define G(v, a, b, c, d, x, y) \
+    do { \
+        v[a] = v[a] + v[b] + (x); \
+        v[d] = ROTR64(v[d] ^ v[a], 32); \
+        v[c] = v[c] + v[d]; \
+        v[b] = ROTR64(v[b] ^ v[c], 24); \
+        v[a] = v[a] + v[b] + (y); \
+        v[d] = ROTR64(v[d] ^ v[a], 16); \
+        v[c] = v[c] + v[d]; \
+        v[b] = ROTR64(v[b] ^ v[c], 63); \
+    } while (0)
+
+static guint64
+load64(const guint8 *src) /*@*/ {
+    return (guint64)src[0] | ((guint64)src[1] << 8)
+        | ((guint64)src[2] << 16) | ((guint64)src[3] << 24)
+        | ((guint64)src[4] << 32) | ((guint64)src[5] << 40)
+        | ((guint64)src[6] << 48) | ((guint64)src[7] << 56);
+}
+
+static void
+compress(CPBlake2b *self, const guint8 *block, gboolean last) /*@modifies *self@*/ {
+    guint64 m[16];
+    guint64 v[16];
+    size_t i;
+
+    for (i = 0; i < 16; ++i) {
+        m[i] = load64(&block[i * 8]);
+    }
+    for (i = 0; i < 8; ++i) {
+        v[i] = self->h[i];
+        v[i + 8] = blake2b_iv[i];
+    }
+    v[12] ^= self->t[0];
+    v[13] ^= self->t[1];
+    if (last) {
+        v[14] = ~v[14];
+    }
+
+    for (i = 0; i < 12; ++i) {
+        const guint8 *s = blake2b_sigma[i];
+
+        G(v, 0, 4,  8, 12, m[s[0]], m[s[1]]);
+        G(v, 1, 5,  9, 13, m[s[2]], m[s[3]]);
+        G(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+        G(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+        G(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+        G(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+        G(v, 2, 7,  8, 13, m[s[12]], m[s[13]]);
+        G(v, 3, 4,  9, 14, m[s[14]], m[s[15]]);
+    }
+
+    for (i = 0; i < 8; ++i) {
+        self->h[i] ^= v[i] ^ v[i + 8];
+    }
+}
+
+static void
+increment_counter(CPBlake2b *self, size_t len) /*@modifies *self@*/ {
+    self->t[0] += (guint64)len;
+    if (self->t[0] < (guint64)len) {
+        ++self->t[1];
+    }
+}
+
+void
+cp_blake2b_init(CPBlake2b *self) {
+    size_t i;
+
+    for (i = 0; i < 8; ++i) {
+        self->h[i] = blake2b_iv[i];
+    }
+    /* Parameter block: digest length, no key, fanout and depth of 1 */
+    self->h[0] ^= G_GUINT64_CONSTANT(0x01010000) ^ CP_BLAKE2B_DIGEST_SIZE;
+    self->t[0] = 0;
+    self->t[1] = 0;
+    self->buf_len = 0;
+}
+
+void
+cp_blake2b_update(CPBlake2b *self, const void *data, size_t len) {
+    const guint8 *in = data;
+
+    while (len > 0) {
+        size_t n;
+
+        /* Last block is kept until final, it has to be flagged */
+        if (self->buf_len == CP_BLAKE2B_BLOCK_SIZE) {
+            increment_counter(self, CP_BLAKE2B_BLOCK_SIZE);
+            compress(self, self->buf, FALSE);
+            self->buf_len = 0;
+        }
+
+        n = CP_BLAKE2B_BLOCK_SIZE - self->buf_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&self->buf[self->buf_len], in, n);
+        self->buf_len += n;
+        in += n;
+        len -= n;
+    }
+}
+
+void
+cp_blake2b_final(CPBlake2b *self, guint8 digest[CP_BLAKE2B_DIGEST_SIZE]) {
+    size_t i;
+
+    increment_counter(self, self->buf_len);
+    memset(&self->buf[self->buf_len], 0, CP_BLAKE2B_BLOCK_SIZE - self->buf_len);
+    compress(self, self->buf, TRUE);
+
+    for (i = 0; i < CP_BLAKE2B_DIGEST_SIZE; ++i) {
+        digest[i] = (guint8)(self->h[i / 8] >> (8 * (i % 8)));
+    }
+}
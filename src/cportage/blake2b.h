@@ -0,0 +1,63 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** BLAKE2b-512 hash function (RFC 7693), GChecksum lacks it. */
+
+#ifndef CP_BLAKE2B_H
+#define CP_BLAKE2B_H
+
+#include <glib.h>
+
+/*@-exportany@*/
+
+#define CP_BLAKE2B_DIGEST_SIZE 64
+
+#define CP_BLAKE2B_BLOCK_SIZE 128
+
+/**
+ * Streaming BLAKE2b state, 512-bit digest without a key.
+ */
+typedef struct CPBlake2b {
+    guint64 h[8];
+    /** Number of bytes hashed so far */
+    guint64 t[2];
+    guint8 buf[CP_BLAKE2B_BLOCK_SIZE];
+    size_t buf_len;
+} CPBlake2b;
+
+void
+cp_blake2b_init(/*@out@*/ CPBlake2b *self) /*@modifies *self@*/;
+
+void
+cp_blake2b_update(
+    CPBlake2b *self,
+    const void *data,
+    size_t len
+) /*@modifies *self@*/;
+
+/**
+ * Finishes hashing, \a self can't be updated afterwards.
+ */
+void
+cp_blake2b_final(
+    CPBlake2b *self,
+    /*@out@*/ guint8 digest[CP_BLAKE2B_DIGEST_SIZE]
+) /*@modifies *self,digest@*/;
+
+#endif
@@ -131,3 +131,98 @@ cp_stack_dict(GTree *tree, char **items) /*@modifies *tree@*/ {
         }
     } end_CP_STRV_ITER
 }
+
+gboolean
+cp_bitset_get(const GArray *bitset, guint bit) {
+    return bit / 32 < bitset->len
+        && (g_array_index(bitset, guint32, bit / 32) & (1U << (bit % 32))) != 0;
+}
+
+void
+cp_bitset_set(GArray *bitset, guint bit) {
+    if (bit / 32 >= bitset->len) {
+        (void)g_array_set_size(bitset, bit / 32 + 1);
+    }
+    g_array_index(bitset, guint32, bit / 32) |= 1U << (bit % 32);
+}
+
+void
+cp_bitset_clear(GArray *bitset, guint bit) {
+    if (bit / 32 < bitset->len) {
+        g_array_index(bitset, guint32, bit / 32) &= ~(1U << (bit % 32));
+    }
+}
+
+void
+cp_bitset_or(GArray *into, const GArray *from) {
+    guint i;
+
+    if (into->len < from->len) {
+        (void)g_array_set_size(into, from->len);
+    }
+    for (i = 0; i < from->len; ++i) {
+        g_array_index(into, guint32, i) |= g_array_index(from, guint32, i);
+    }
+}
+
+void
+cp_bitset_and_not(GArray *into, const GArray *from) {
+    guint i;
+
+    for (i = 0; i < into->len && i < from->len; ++i) {
+        g_array_index(into, guint32, i) &= ~g_array_index(from, guint32, i);
+    }
+}
+
+void
+cp_bitset_free(void *data) {
+    (void)g_array_free(data, TRUE);
+}
+
+gboolean
+cp_collect_lines(
+    const char *path,
+    CPLinesFunc func,
+    void *user_data,
+    GError **error
+) {
+    gboolean result = TRUE;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+        GDir *dir = g_dir_open(path, 0, error);
+        GList *names = NULL;
+        GList *iter;
+
+        if (dir == NULL) {
+            return FALSE;
+        }
+        CP_GDIR_ITER(dir, name) {
+            if (name[0] != '.' && !g_str_has_suffix(name, "~")) {
+                names = g_list_prepend(names, g_strdup(name));
+            }
+        } end_CP_GDIR_ITER
+        g_dir_close(dir);
+
+        names = g_list_sort(names, (GCompareFunc)strcmp);
+        for (iter = names; iter != NULL && result; iter = iter->next) {
+            char *file = g_build_filename(path, iter->data, NULL);
+
+            result = cp_collect_lines(file, func, user_data, error);
+            g_free(file);
+        }
+        g_list_free_full(names, g_free);
+    } else if (g_file_test(path, G_FILE_TEST_EXISTS)) {
+        char **lines = cp_io_getlines(path, TRUE, error);
+
+        if (lines == NULL) {
+            result = FALSE;
+        } else {
+            func(lines, user_data);
+            g_strfreev(lines);
+        }
+    }
+
+    return result;
+}
@@ -50,4 +50,55 @@ cp_true_filter(void *key, void *value, /*@null@*/ void *user_data) /*@*/;
 void
 cp_stack_dict(GTree *tree, char **items) /*@modifies *tree@*/;
 
+/**
+ * \return %TRUE if \a bit is set in \a bitset of guint32 words
+ *         created with g_array_new(FALSE, TRUE, sizeof(guint32))
+ */
+gboolean
+cp_bitset_get(const GArray/*<guint32>*/ *bitset, guint bit) /*@*/;
+
+/** Sets \a bit in \a bitset, growing it as needed. */
+void
+cp_bitset_set(GArray/*<guint32>*/ *bitset, guint bit) /*@modifies *bitset@*/;
+
+void
+cp_bitset_clear(GArray/*<guint32>*/ *bitset, guint bit) /*@modifies *bitset@*/;
+
+/** Adds bits of \a from to \a into, growing it as needed. */
+void
+cp_bitset_or(
+    GArray/*<guint32>*/ *into,
+    const GArray/*<guint32>*/ *from
+) /*@modifies *into@*/;
+
+/** Clears bits of \a from in \a into. */
+void
+cp_bitset_and_not(
+    GArray/*<guint32>*/ *into,
+    const GArray/*<guint32>*/ *from
+) /*@modifies *into@*/;
+
+/** Frees bitset \a data, usable as %GDestroyNotify. */
+void
+cp_bitset_free(/*@only@*/ void *data) /*@modifies data@*/;
+
+typedef void (*CPLinesFunc) (char **lines, /*@null@*/ void *user_data);
+
+/**
+ * Passes lines of config file at \a path to \a func, comments stripped.
+ * Directories are read file by file in alphabetical order, skipping
+ * hidden and backup files. Missing \a path is ignored.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_collect_lines(
+    const char *path,
+    CPLinesFunc func,
+    /*@null@*/ void *user_data,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *user_data,*error,errno@*/ /*@globals fileSystem@*/;
+
 #endif
@@ -0,0 +1,564 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Nodes live in one array and are found through an open addressing
+  hash table of their IDs, keyed by kind, atom, flag and IDs of children.
+  Children are always created before their parent, so equal subtrees get
+  equal IDs and comparing two nodes never needs to descend into them.
+ */
+
+#include <string.h>
+
+#include "dep.h"
+#include "eapi.h"
+#include "error.h"
+
+struct dep_node {
+    CPDepKind kind;
+    /** Flag ID of USE conditionals, 0 otherwise */
+    guint flag;
+    /** Atom of atoms and blockers, %NULL otherwise */
+    /*@only@*/ /*@null@*/ CPAtom atom;
+    /** Offset of IDs of children in CPDepTableS.lists */
+    guint32 children;
+    guint32 n_children;
+    /** Offset of sorted IDs of flags tested in subtree in CPDepTableS.lists */
+    guint32 flags;
+    guint32 n_flags;
+    guint32 hash;
+};
+
+struct CPDepTableS {
+    /*@only@*/ CPAtomFactory factory;
+    /*@only@*/ GArray/*<struct dep_node>*/ *nodes;
+    /** Children and flag lists of all nodes */
+    /*@only@*/ GArray/*<guint32>*/ *lists;
+    /** Node ID + 1 for used slots, 0 for empty ones */
+    /*@only@*/ guint32 *slots;
+    /** Number of slots, a power of 2 */
+    guint32 capacity;
+    /** USE flag->(ID + 1) map */
+    /*@only@*/ GHashTable *flag_ids;
+    /*@only@*/ GPtrArray/*<char *>*/ *flag_names;
+};
+
+static guint32
+hash_node(
+    CPDepKind kind,
+    guint flag,
+    /*@null@*/ const CPAtom atom,
+    const CPDepId *children,
+    guint n_children
+) /*@*/ {
+    guint32 hash = 2166136261U;
+    guint i;
+
+    hash = (hash ^ (guint32)kind) * 16777619U;
+    hash = (hash ^ flag) * 16777619U;
+    hash = (hash ^ g_direct_hash(atom)) * 16777619U;
+    for (i = 0; i < n_children; ++i) {
+        hash = (hash ^ children[i]) * 16777619U;
+    }
+
+    return hash;
+}
+
+/**
+ * \return slot with ID of node equal to the one described by arguments,
+ *         or empty slot where it should be put
+ */
+static guint32 *
+find_slot(
+    const CPDepTable self,
+    guint32 hash,
+    CPDepKind kind,
+    guint flag,
+    /*@null@*/ const CPAtom atom,
+    const CPDepId *children,
+    guint n_children
+) /*@*/ {
+    guint32 mask = self->capacity - 1;
+    guint32 i = hash & mask;
+
+    for (;; i = (i + 1) & mask) {
+        const struct dep_node *node;
+
+        if (self->slots[i] == 0) {
+            return &self->slots[i];
+        }
+
+        node = &g_array_index(self->nodes, struct dep_node, self->slots[i] - 1);
+        if (node->hash == hash && node->kind == kind && node->flag == flag
+                && node->atom == atom && node->n_children == n_children
+                && (n_children == 0 || memcmp(
+                    &g_array_index(self->lists, guint32, node->children),
+                    children, n_children * sizeof(CPDepId)) == 0)) {
+            return &self->slots[i];
+        }
+    }
+}
+
+static void
+grow_slots(CPDepTable self) /*@modifies *self@*/ {
+    guint32 mask;
+    guint i;
+
+    g_free(self->slots);
+    self->capacity *= 2;
+    self->slots = g_new0(guint32, self->capacity);
+    mask = self->capacity - 1;
+
+    for (i = 0; i < self->nodes->len; ++i) {
+        const struct dep_node *node = &g_array_index(self->nodes, struct dep_node, i);
+        guint32 j = node->hash & mask;
+
+        while (self->slots[j] != 0) {
+            j = (j + 1) & mask;
+        }
+        self->slots[j] = i + 1;
+    }
+}
+
+static gint
+flag_cmp(const void *a, const void *b) /*@*/ {
+    guint32 flag_a = *(const guint32 *)a;
+    guint32 flag_b = *(const guint32 *)b;
+
+    return flag_a < flag_b ? -1 : flag_a > flag_b;
+}
+
+/**
+ * \return ID of the node described by arguments, created unless
+ *         it already exists
+ */
+static CPDepId
+make_node(
+    CPDepTable self,
+    CPDepKind kind,
+    guint flag,
+    /*@null@*/ CPAtom atom,
+    const CPDepId *children,
+    guint n_children
+) /*@modifies *self,*atom@*/ {
+    guint32 hash = hash_node(kind, flag, atom, children, n_children);
+    guint32 *slot = find_slot(self, hash, kind, flag, atom, children, n_children);
+    struct dep_node node;
+    GArray *flags;
+    guint i;
+
+    if (*slot != 0) {
+        return *slot - 1;
+    }
+
+    /* Keeps load factor at most 1/2 */
+    if (self->nodes->len + 1 > self->capacity / 2) {
+        grow_slots(self);
+        slot = find_slot(self, hash, kind, flag, atom, children, n_children);
+    }
+
+    flags = g_array_new(FALSE, FALSE, sizeof(guint32));
+    if (kind == CP_DEP_USE || kind == CP_DEP_NOT_USE) {
+        guint32 own = flag;
+
+        (void)g_array_append_val(flags, own);
+    }
+    for (i = 0; i < n_children; ++i) {
+        const struct dep_node *child =
+            &g_array_index(self->nodes, struct dep_node, children[i]);
+
+        (void)g_array_append_vals(flags,
+            &g_array_index(self->lists, guint32, child->flags), child->n_flags);
+    }
+    g_array_sort(flags, flag_cmp);
+
+    node.kind = kind;
+    node.flag = flag;
+    node.atom = atom == NULL ? NULL : cp_atom_ref(atom);
+    node.children = self->lists->len;
+    node.n_children = n_children;
+    (void)g_array_append_vals(self->lists, children, n_children);
+    node.flags = self->lists->len;
+    node.n_flags = 0;
+    for (i = 0; i < flags->len; ++i) {
+        guint32 id = g_array_index(flags, guint32, i);
+
+        if (i == 0 || id != g_array_index(flags, guint32, i - 1)) {
+            (void)g_array_append_val(self->lists, id);
+            ++node.n_flags;
+        }
+    }
+    node.hash = hash;
+    (void)g_array_append_val(self->nodes, node);
+    (void)g_array_free(flags, TRUE);
+
+    *slot = self->nodes->len;
+    return self->nodes->len - 1;
+}
+
+CPDepId
+cp_dep_table_group(
+    CPDepTable self,
+    CPDepKind kind,
+    guint flag,
+    const CPDepId *children,
+    guint n_children
+) {
+    GArray *merged = g_array_new(FALSE, FALSE, sizeof(CPDepId));
+    CPDepId id;
+    guint i;
+
+    g_assert(kind != CP_DEP_ATOM && kind != CP_DEP_WEAK_BLOCKER
+        && kind != CP_DEP_STRONG_BLOCKER);
+
+    /* Copied first, children may point into lists that grow below */
+    for (i = 0; i < n_children; ++i) {
+        CPDepId child = children[i];
+        const struct dep_node *node = &g_array_index(self->nodes, struct dep_node, child);
+
+        if (kind != CP_DEP_ANY_OF && node->kind == CP_DEP_ALL_OF) {
+            (void)g_array_append_vals(merged,
+                &g_array_index(self->lists, guint32, node->children),
+                node->n_children);
+        } else {
+            (void)g_array_append_val(merged, child);
+        }
+    }
+
+    if (merged->len == 1 && (kind == CP_DEP_ALL_OF || kind == CP_DEP_ANY_OF)) {
+        id = g_array_index(merged, CPDepId, 0);
+    } else {
+        id = make_node(self, kind, flag, NULL,
+            &g_array_index(merged, CPDepId, 0), merged->len);
+    }
+
+    (void)g_array_free(merged, TRUE);
+    return id;
+}
+
+CPDepTable
+cp_dep_table_new(CPAtomFactory factory) {
+    CPDepTable self;
+    CPDepId empty;
+
+    self = g_new0(struct CPDepTableS, 1);
+    g_assert(self->factory == NULL);
+    self->factory = cp_atom_factory_ref(factory);
+    g_assert(self->nodes == NULL);
+    self->nodes = g_array_new(FALSE, FALSE, sizeof(struct dep_node));
+    g_assert(self->lists == NULL);
+    self->lists = g_array_new(FALSE, FALSE, sizeof(guint32));
+    self->capacity = 1024;
+    g_assert(self->slots == NULL);
+    self->slots = g_new0(guint32, self->capacity);
+    g_assert(self->flag_ids == NULL);
+    self->flag_ids = g_hash_table_new(g_str_hash, g_str_equal);
+    g_assert(self->flag_names == NULL);
+    self->flag_names = g_ptr_array_new_with_free_func(g_free);
+
+    empty = make_node(self, CP_DEP_ALL_OF, 0, NULL, NULL, 0);
+    g_assert(empty == CP_DEP_EMPTY);
+
+    return self;
+}
+
+void
+cp_dep_table_destroy(CPDepTable self) {
+    guint i;
+
+    if (self == NULL) {
+        /*@-mustfreeonly@*/
+        return;
+        /*@=mustfreeonly@*/
+    }
+
+    for (i = 0; i < self->nodes->len; ++i) {
+        cp_atom_unref(g_array_index(self->nodes, struct dep_node, i).atom);
+    }
+
+    /* Keys are owned by flag_names */
+    g_hash_table_destroy(self->flag_ids);
+    g_ptr_array_unref(self->flag_names);
+    g_free(self->slots);
+    (void)g_array_free(self->lists, TRUE);
+    (void)g_array_free(self->nodes, TRUE);
+    cp_atom_factory_unref(self->factory);
+    g_free(self);
+}
+
+guint
+cp_dep_table_size(const CPDepTable self) {
+    return self->nodes->len;
+}
+
+guint
+cp_dep_table_intern_flag(CPDepTable self, const char *flag) {
+    guint id = GPOINTER_TO_UINT(g_hash_table_lookup(self->flag_ids, flag));
+
+    if (id == 0) {
+        char *name = g_strdup(flag);
+
+        g_ptr_array_add(self->flag_names, name);
+        id = self->flag_names->len;
+        g_hash_table_insert(self->flag_ids, name, GUINT_TO_POINTER(id));
+    }
+
+    return id - 1;
+}
+
+guint
+cp_dep_table_n_flags(const CPDepTable self) {
+    return self->flag_names->len;
+}
+
+const char *
+cp_dep_table_flag_name(const CPDepTable self, guint flag) {
+    return g_ptr_array_index(self->flag_names, flag);
+}
+
+struct parse_state {
+    /*@dependent@*/ CPDepTable table;
+    CPEapi eapi;
+    /*@dependent@*/ const char *deps;
+    /*@dependent@*/ char **tokens;
+    guint pos;
+};
+
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+parse_group(
+    struct parse_state *state,
+    gboolean nested,
+    GArray/*<CPDepId>*/ *children,
+    /*@null@*/ GError **error
+) /*@modifies *state,*children,*error@*/;
+
+/**
+ * Parses "( ... )" group after \a token into node of \a kind with \a flag
+ * and adds its ID to \a children.
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+parse_nested(
+    struct parse_state *state,
+    const char *token,
+    CPDepKind kind,
+    guint flag,
+    GArray/*<CPDepId>*/ *children,
+    /*@null@*/ GError **error
+) /*@modifies *state,*children,*error@*/ {
+    GArray *nested;
+    CPDepId id;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (kind != CP_DEP_ALL_OF) {
+        const char *next = state->tokens[state->pos];
+
+        if (next == NULL || strcmp(next, "(") != 0) {
+            g_set_error(error, CP_ERROR, (gint)CP_ERROR_DEP_SYNTAX,
+                _("'%s' isn't followed by '(' in dependencies '%s'"),
+                token, state->deps);
+            return FALSE;
+        }
+        ++state->pos;
+    }
+
+    nested = g_array_new(FALSE, FALSE, sizeof(CPDepId));
+    if (!parse_group(state, TRUE, nested, error)) {
+        (void)g_array_free(nested, TRUE);
+        return FALSE;
+    }
+
+    id = cp_dep_table_group(state->table, kind, flag,
+        &g_array_index(nested, CPDepId, 0), nested->len);
+    (void)g_array_append_val(children, id);
+
+    (void)g_array_free(nested, TRUE);
+    return TRUE;
+}
+
+/**
+ * Parses atom or blocker \a token and adds its ID to \a children.
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+parse_atom(
+    struct parse_state *state,
+    const char *token,
+    GArray/*<CPDepId>*/ *children,
+    /*@null@*/ GError **error
+) /*@modifies *state,*children,*error@*/ {
+    CPDepKind kind = CP_DEP_ATOM;
+    CPAtom atom;
+    CPDepId id;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (token[0] == '!' && token[1] == '!'
+            && cp_eapi_has_strong_blocks(state->eapi)) {
+        kind = CP_DEP_STRONG_BLOCKER;
+        token += 2;
+    } else if (token[0] == '!') {
+        kind = CP_DEP_WEAK_BLOCKER;
+        token += 1;
+    }
+
+    atom = cp_atom_new(state->table->factory, state->eapi, token, error);
+    if (atom == NULL) {
+        return FALSE;
+    }
+
+    id = make_node(state->table, kind, 0, atom, NULL, 0);
+    (void)g_array_append_val(children, id);
+
+    cp_atom_unref(atom);
+    return TRUE;
+}
+
+static gboolean
+parse_group(
+    struct parse_state *state,
+    gboolean nested,
+    GArray *children,
+    GError **error
+) {
+    const char *token;
+
+    g_assert(error == NULL || *error == NULL);
+
+    while ((token = state->tokens[state->pos]) != NULL) {
+        size_t len = strlen(token);
+        gboolean result;
+
+        ++state->pos;
+
+        if (strcmp(token, ")") == 0) {
+            if (!nested) {
+                break;
+            }
+            return TRUE;
+        }
+
+        if (strcmp(token, "(") == 0) {
+            result = parse_nested(state, token, CP_DEP_ALL_OF, 0, children, error);
+        } else if (strcmp(token, "||") == 0) {
+            result = parse_nested(state, token, CP_DEP_ANY_OF, 0, children, error);
+        } else if (token[len - 1] == '?') {
+            gboolean negate = token[0] == '!';
+            char *flag = g_strndup(&token[negate ? 1 : 0], len - (negate ? 2 : 1));
+
+            if (flag[0] == '\0') {
+                g_set_error(error, CP_ERROR, (gint)CP_ERROR_DEP_SYNTAX,
+                    _("Invalid USE conditional '%s' in dependencies '%s'"),
+                    token, state->deps);
+                result = FALSE;
+            } else {
+                result = parse_nested(state, token,
+                    negate ? CP_DEP_NOT_USE : CP_DEP_USE,
+                    cp_dep_table_intern_flag(state->table, flag), children, error);
+            }
+            g_free(flag);
+        } else {
+            result = parse_atom(state, token, children, error);
+        }
+
+        if (!result) {
+            return FALSE;
+        }
+    }
+
+    if (nested || token != NULL) {
+        g_set_error(error, CP_ERROR, (gint)CP_ERROR_DEP_SYNTAX,
+            _("Unbalanced parentheses in dependencies '%s'"), state->deps);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+gboolean
+cp_dep_table_parse(
+    CPDepTable self,
+    CPEapi eapi,
+    const char *deps,
+    CPDepId *id,
+    GError **error
+) {
+    struct parse_state state;
+    GArray *children;
+    char **tokens;
+    gboolean result;
+
+    g_assert(error == NULL || *error == NULL);
+
+    tokens = cp_strings_pysplit(deps);
+    if (tokens == NULL) {
+        *id = CP_DEP_EMPTY;
+        return TRUE;
+    }
+
+    state.table = self;
+    state.eapi = eapi;
+    state.deps = deps;
+    state.tokens = tokens;
+    state.pos = 0;
+    children = g_array_new(FALSE, FALSE, sizeof(CPDepId));
+
+    result = parse_group(&state, FALSE, children, error);
+    if (result) {
+        *id = cp_dep_table_group(self, CP_DEP_ALL_OF, 0,
+            &g_array_index(children, CPDepId, 0), children->len);
+    }
+
+    (void)g_array_free(children, TRUE);
+    g_strfreev(tokens);
+    return result;
+}
+
+CPDepKind
+cp_dep_kind(const CPDepTable self, CPDepId id) {
+    return g_array_index(self->nodes, struct dep_node, id).kind;
+}
+
+CPAtom
+cp_dep_atom(const CPDepTable self, CPDepId id) {
+    CPAtom atom = g_array_index(self->nodes, struct dep_node, id).atom;
+
+    g_assert(atom != NULL);
+    return atom;
+}
+
+guint
+cp_dep_flag(const CPDepTable self, CPDepId id) {
+    return g_array_index(self->nodes, struct dep_node, id).flag;
+}
+
+const CPDepId *
+cp_dep_children(const CPDepTable self, CPDepId id, guint *n) {
+    const struct dep_node *node = &g_array_index(self->nodes, struct dep_node, id);
+
+    *n = node->n_children;
+    return &g_array_index(self->lists, guint32, node->children);
+}
+
+const guint32 *
+cp_dep_flags(const CPDepTable self, CPDepId id, guint *n) {
+    const struct dep_node *node = &g_array_index(self->nodes, struct dep_node, id);
+
+    *n = node->n_flags;
+    return &g_array_index(self->lists, guint32, node->flags);
+}
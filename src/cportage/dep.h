@@ -0,0 +1,184 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Hash-consed dependency specifications. */
+
+#ifndef CP_DEP_H
+#define CP_DEP_H
+
+#include <cportage.h>
+
+/*@-exportany@*/
+
+/**
+ * ID of a node in #CPDepTable. Equal subtrees have equal IDs, so IDs
+ * can key caches of anything computed from a dependency specification.
+ */
+typedef guint32 CPDepId;
+
+/** ID of empty all-of group, which is what empty *DEPEND parses to. */
+#define CP_DEP_EMPTY ((CPDepId)0)
+
+typedef enum CPDepKind {
+    /** Atom that must be satisfied */
+    CP_DEP_ATOM,
+    /** "!atom" */
+    CP_DEP_WEAK_BLOCKER,
+    /** "!!atom" */
+    CP_DEP_STRONG_BLOCKER,
+    /** "( ... )", all children must be satisfied */
+    CP_DEP_ALL_OF,
+    /** "|| ( ... )", one of children must be satisfied */
+    CP_DEP_ANY_OF,
+    /** "flag? ( ... )", children apply if flag is enabled */
+    CP_DEP_USE,
+    /** "!flag? ( ... )", children apply if flag is disabled */
+    CP_DEP_NOT_USE
+} CPDepKind;
+
+/**
+ * Store of dependency nodes where every distinct node exists once.
+ * Nodes are never freed before the table, IDs are dense and never change.
+ */
+typedef struct CPDepTableS *CPDepTable;
+
+/**
+ * \param factory creates atoms of parsed dependencies
+ */
+/*@only@*/ CPDepTable
+cp_dep_table_new(
+    CPAtomFactory factory
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT /*@modifies *factory@*/;
+
+void
+cp_dep_table_destroy(/*@null@*/ /*@only@*/ CPDepTable self) /*@modifies self@*/;
+
+/**
+ * Parses \a deps, like RDEPEND of a package with \a eapi, into nodes
+ * of \a self. Groups with one child are replaced by the child, all-of
+ * groups nested into all-of groups or USE conditionals are merged into
+ * them, so that trivially different specifications share nodes.
+ * Atoms come from the factory \a self was created with, which returns
+ * the same atom for the same string and EAPI.
+ *
+ * \param id    return location for ID of the root node, only set
+ *              on success. It is an all-of group unless \a deps has a
+ *              single top-level element: that element is returned then,
+ *              so it may be an atom, a blocker, an any-of group or a USE
+ *              conditional. Check cp_dep_kind() before treating it
+ *              as a group
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if \a deps is malformed
+ */
+gboolean
+cp_dep_table_parse(
+    CPDepTable self,
+    CPEapi eapi,
+    const char *deps,
+    /*@out@*/ CPDepId *id,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *self,*id,*error@*/;
+
+/**
+ * Makes group or USE conditional of \a kind with \a flag and \a children,
+ * normalized like cp_dep_table_parse() does.
+ *
+ * \return ID of the node, or of the only child for groups of one child
+ */
+CPDepId
+cp_dep_table_group(
+    CPDepTable self,
+    CPDepKind kind,
+    guint flag,
+    const CPDepId *children,
+    guint n_children
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *self@*/;
+
+/**
+ * \return number of nodes in \a self, IDs are below it
+ */
+guint
+cp_dep_table_size(const CPDepTable self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return ID of USE \a flag, flags of conditionals are interned
+ *         when they are parsed
+ */
+guint
+cp_dep_table_intern_flag(
+    CPDepTable self,
+    const char *flag
+) /*@modifies *self@*/;
+
+/**
+ * \return number of interned USE flags, their IDs are below it
+ */
+guint
+cp_dep_table_n_flags(const CPDepTable self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return readonly name of USE flag with ID \a flag
+ */
+/*@observer@*/ const char *
+cp_dep_table_flag_name(
+    const CPDepTable self,
+    guint flag
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+CPDepKind
+cp_dep_kind(const CPDepTable self, CPDepId id) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return atom of atom or blocker node \a id, valid as long as \a self
+ *         exists
+ */
+/*@observer@*/ CPAtom
+cp_dep_atom(const CPDepTable self, CPDepId id) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return flag ID of USE conditional \a id
+ */
+guint
+cp_dep_flag(const CPDepTable self, CPDepId id) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \param n return location for number of children
+ * \return  readonly IDs of children of group or USE conditional \a id,
+ *          valid until next node is added to \a self
+ */
+/*@observer@*/ const CPDepId *
+cp_dep_children(
+    const CPDepTable self,
+    CPDepId id,
+    /*@out@*/ guint *n
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *n@*/;
+
+/**
+ * \param n return location for number of flags
+ * \return  readonly sorted IDs of USE flags that conditionals in subtree
+ *          of \a id test, valid until next node is added to \a self
+ */
+/*@observer@*/ const guint32 *
+cp_dep_flags(
+    const CPDepTable self,
+    CPDepId id,
+    /*@out@*/ guint *n
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *n@*/;
+
+#endif
@@ -0,0 +1,290 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Results are keyed by node ID and a bitset with one bit per flag that
+  the node tests, in order of cp_dep_flags(), so USE changes that don't
+  affect a node don't miss its cached result. Entries are kept in a
+  queue from most to least recently used, and are dropped from its tail
+  before new results are added.
+ */
+
+#include <string.h>
+
+#include "collections.h"
+#include "dep_eval.h"
+
+/** Estimated overhead of a hash table slot */
+#define SLOT_SIZE (3 * sizeof(void *))
+
+struct eval_entry {
+    CPDepId id;
+    guint32 hash;
+    /** Bitset of tested flags that are enabled */
+    /*@only@*/ guint32 *bits;
+    guint n_words;
+    /*@only@*/ CPDepId *nodes;
+    guint n_nodes;
+    /** Link in CPDepEvalS.lru, data points to entry */
+    GList link;
+};
+
+struct CPDepEvalS {
+    /*@dependent@*/ CPDepTable table;
+    gsize max_memory;
+    /** Entries hashed by node ID and flag state */
+    /*@only@*/ GHashTable *entries;
+    /** Entries from most to least recently used */
+    GQueue lru;
+    /** Key of lookup in progress */
+    /*@only@*/ GArray/*<guint32>*/ *key;
+    CPDepEvalStats stats;
+};
+
+static guint
+entry_hash(const void *entry) /*@*/ {
+    return ((const struct eval_entry *)entry)->hash;
+}
+
+static gboolean
+entry_equal(const void *a, const void *b) /*@*/ {
+    const struct eval_entry *entry_a = a;
+    const struct eval_entry *entry_b = b;
+
+    return entry_a->id == entry_b->id && entry_a->n_words == entry_b->n_words
+        && memcmp(entry_a->bits, entry_b->bits,
+            entry_a->n_words * sizeof(guint32)) == 0;
+}
+
+static gsize
+entry_memory(const struct eval_entry *entry) /*@*/ {
+    return sizeof(*entry) + SLOT_SIZE + entry->n_words * sizeof(guint32)
+        + entry->n_nodes * sizeof(CPDepId);
+}
+
+static void
+entry_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct eval_entry *entry = data;
+
+    g_free(entry->bits);
+    g_free(entry->nodes);
+    g_free(entry);
+}
+
+CPDepEval
+cp_dep_eval_new(CPDepTable table, gsize max_memory) {
+    CPDepEval self;
+
+    self = g_new0(struct CPDepEvalS, 1);
+    self->table = table;
+    self->max_memory = max_memory;
+    g_assert(self->entries == NULL);
+    self->entries = g_hash_table_new_full(entry_hash, entry_equal, entry_free, NULL);
+    g_queue_init(&self->lru);
+    g_assert(self->key == NULL);
+    self->key = g_array_new(FALSE, TRUE, sizeof(guint32));
+
+    return self;
+}
+
+void
+cp_dep_eval_destroy(CPDepEval self) {
+    if (self == NULL) {
+        /*@-mustfreeonly@*/
+        return;
+        /*@=mustfreeonly@*/
+    }
+
+    g_debug("Dependency evaluation cache: %" G_GUINT64_FORMAT " hits, %"
+        G_GUINT64_FORMAT " misses, %" G_GUINT64_FORMAT " evictions",
+        self->stats.hits, self->stats.misses, self->stats.evictions);
+
+    /* Links are embedded into entries */
+    g_hash_table_destroy(self->entries);
+    (void)g_array_free(self->key, TRUE);
+    g_free(self);
+}
+
+/**
+ * Appends flattened node \a id to \a out.
+ */
+static void
+flatten(
+    CPDepEval self,
+    CPDepId id,
+    const GArray *use,
+    GArray/*<CPDepId>*/ *out
+) /*@modifies *self,*out@*/ {
+    CPDepTable table = self->table;
+    CPDepKind kind = cp_dep_kind(table, id);
+    GArray *alternatives;
+    guint n_flags;
+    guint n;
+    guint i;
+
+    switch (kind) {
+        case CP_DEP_ATOM:
+        case CP_DEP_WEAK_BLOCKER:
+        case CP_DEP_STRONG_BLOCKER:
+            (void)g_array_append_val(out, id);
+            return;
+        case CP_DEP_USE:
+        case CP_DEP_NOT_USE:
+        case CP_DEP_ALL_OF:
+            if (kind != CP_DEP_ALL_OF && cp_bitset_get(use,
+                    cp_dep_flag(table, id)) != (kind == CP_DEP_USE)) {
+                return;
+            }
+            /* Children are fetched again, flattening may add nodes */
+            (void)cp_dep_children(table, id, &n);
+            for (i = 0; i < n; ++i) {
+                flatten(self, cp_dep_children(table, id, &n)[i], use, out);
+            }
+            return;
+        case CP_DEP_ANY_OF:
+            break;
+        default:
+            g_assert_not_reached();
+    }
+
+    /* Any-of group without conditionals is already flat */
+    (void)cp_dep_flags(table, id, &n_flags);
+    if (n_flags == 0) {
+        (void)g_array_append_val(out, id);
+        return;
+    }
+
+    alternatives = g_array_new(FALSE, FALSE, sizeof(CPDepId));
+    (void)cp_dep_children(table, id, &n);
+    for (i = 0; i < n; ++i) {
+        GArray *alternative = g_array_new(FALSE, FALSE, sizeof(CPDepId));
+        CPDepId flat;
+
+        flatten(self, cp_dep_children(table, id, &n)[i], use, alternative);
+        /* Disabled conditionals aren't alternatives */
+        if (alternative->len > 0) {
+            flat = cp_dep_table_group(table, CP_DEP_ALL_OF, 0,
+                &g_array_index(alternative, CPDepId, 0), alternative->len);
+            (void)g_array_append_val(alternatives, flat);
+        }
+        (void)g_array_free(alternative, TRUE);
+    }
+
+    if (alternatives->len > 0) {
+        CPDepId group = cp_dep_table_group(table, CP_DEP_ANY_OF, 0,
+            &g_array_index(alternatives, CPDepId, 0), alternatives->len);
+
+        if (cp_dep_kind(table, group) == CP_DEP_ALL_OF) {
+            /* Single alternative of several nodes */
+            const CPDepId *children = cp_dep_children(table, group, &n);
+
+            (void)g_array_append_vals(out, children, n);
+        } else {
+            (void)g_array_append_val(out, group);
+        }
+    }
+
+    (void)g_array_free(alternatives, TRUE);
+}
+
+/** Drops least recently used entries until \a needed bytes fit. */
+static void
+evict(CPDepEval self, gsize needed) /*@modifies *self@*/ {
+    while (self->stats.memory + needed > self->max_memory
+            && self->lru.tail != NULL) {
+        struct eval_entry *entry = self->lru.tail->data;
+
+        g_queue_unlink(&self->lru, &entry->link);
+        self->stats.memory -= entry_memory(entry);
+        --self->stats.size;
+        ++self->stats.evictions;
+        (void)g_hash_table_remove(self->entries, entry);
+    }
+}
+
+const CPDepId *
+cp_dep_eval_flatten(CPDepEval self, CPDepId id, const GArray *use, guint *n) {
+    struct eval_entry probe;
+    struct eval_entry *entry;
+    const guint32 *flags;
+    guint n_flags;
+    GArray *nodes;
+    guint32 hash = 2166136261U;
+    guint i;
+
+    /* Key only has flags that node tests */
+    flags = cp_dep_flags(self->table, id, &n_flags);
+    g_array_set_size(self->key, 0);
+    g_array_set_size(self->key, (n_flags + 31) / 32);
+    for (i = 0; i < n_flags; ++i) {
+        if (cp_bitset_get(use, flags[i])) {
+            cp_bitset_set(self->key, i);
+        }
+    }
+
+    hash = (hash ^ id) * 16777619U;
+    for (i = 0; i < self->key->len; ++i) {
+        hash = (hash ^ g_array_index(self->key, guint32, i)) * 16777619U;
+    }
+
+    probe.id = id;
+    probe.hash = hash;
+    probe.bits = &g_array_index(self->key, guint32, 0);
+    probe.n_words = self->key->len;
+
+    entry = g_hash_table_lookup(self->entries, &probe);
+    if (entry != NULL) {
+        ++self->stats.hits;
+        g_queue_unlink(&self->lru, &entry->link);
+        g_queue_push_head_link(&self->lru, &entry->link);
+        *n = entry->n_nodes;
+        return entry->nodes;
+    }
+
+    ++self->stats.misses;
+    nodes = g_array_new(FALSE, FALSE, sizeof(CPDepId));
+    flatten(self, id, use, nodes);
+
+    entry = g_new0(struct eval_entry, 1);
+    entry->id = id;
+    entry->hash = hash;
+    entry->n_words = self->key->len;
+    entry->bits = g_new(guint32, entry->n_words);
+    memcpy(entry->bits, probe.bits, entry->n_words * sizeof(guint32));
+    entry->n_nodes = nodes->len;
+    entry->nodes = g_new(CPDepId, entry->n_nodes);
+    memcpy(entry->nodes, nodes->data, entry->n_nodes * sizeof(CPDepId));
+    entry->link.data = entry;
+    (void)g_array_free(nodes, TRUE);
+
+    /* New entry is kept even if it alone exceeds the limit */
+    evict(self, entry_memory(entry));
+    g_hash_table_add(self->entries, entry);
+    g_queue_push_head_link(&self->lru, &entry->link);
+    self->stats.memory += entry_memory(entry);
+    ++self->stats.size;
+
+    *n = entry->n_nodes;
+    return entry->nodes;
+}
+
+void
+cp_dep_eval_get_stats(const CPDepEval self, CPDepEvalStats *stats) {
+    *stats = self->stats;
+}
@@ -0,0 +1,91 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Cache of dependency specifications evaluated under USE. */
+
+#ifndef CP_DEP_EVAL_H
+#define CP_DEP_EVAL_H
+
+#include <cportage.h>
+
+#include "dep.h"
+
+/*@-exportany@*/
+
+/**
+ * Bounded cache of flattened dependency specifications, keyed by node ID
+ * and state of USE flags that the node tests. Least recently used
+ * results are dropped first.
+ */
+typedef struct CPDepEvalS *CPDepEval;
+
+typedef struct CPDepEvalStats {
+    guint64 hits;
+    guint64 misses;
+    /** Results dropped to stay within memory limit */
+    guint64 evictions;
+    /** Number of cached results */
+    guint size;
+    /** Approximate memory used by cached results, in bytes */
+    gsize memory;
+} CPDepEvalStats;
+
+/**
+ * \param table      table evaluated nodes belong to, must outlive
+ *                   the cache
+ * \param max_memory approximate limit of memory used by cached results,
+ *                   in bytes
+ */
+/*@only@*/ CPDepEval
+cp_dep_eval_new(
+    CPDepTable table,
+    gsize max_memory
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+void
+cp_dep_eval_destroy(/*@null@*/ /*@only@*/ CPDepEval self) /*@modifies self@*/;
+
+/**
+ * Flattens node \a id under \a use: all-of groups are expanded, enabled
+ * USE conditionals are replaced by their children and disabled ones
+ * are dropped. Any-of groups are kept, with their alternatives
+ * evaluated the same way. Any-of groups left without alternatives
+ * are satisfied and dropped, ones left with a single alternative are
+ * replaced by it.
+ *
+ * \param use bitset of enabled USE flags, by IDs of table of \a self
+ * \param n   return location for number of returned nodes
+ * \return    readonly IDs of atoms, blockers and USE-free any-of groups,
+ *            valid until next call
+ */
+/*@observer@*/ const CPDepId *
+cp_dep_eval_flatten(
+    CPDepEval self,
+    CPDepId id,
+    const GArray/*<guint32>*/ *use,
+    /*@out@*/ guint *n
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *self,*n@*/;
+
+void
+cp_dep_eval_get_stats(
+    const CPDepEval self,
+    /*@out@*/ CPDepEvalStats *stats
+) /*@modifies *stats@*/;
+
+#endif
@@ -89,14 +89,17 @@ CPEapi
 cp_eapi_parse_file(const char *file, GError **error) {
     char *data;
     CPEapi result;
+    GError *read_error = NULL;
 
     g_assert(error == NULL || *error == NULL);
 
-    if (!g_file_test(file, G_FILE_TEST_EXISTS)) {
-        return CP_EAPI_LATEST;
-    }
-
-    if (!g_file_get_contents(file, &data, NULL, error)) {
+    /* Missing file is detected by read itself, saves a stat() */
+    if (!g_file_get_contents(file, &data, NULL, &read_error)) {
+        if (g_error_matches(read_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            g_error_free(read_error);
+            return CP_EAPI_LATEST;
+        }
+        g_propagate_error(error, read_error);
         return CP_EAPI_UNKNOWN;
     }
 
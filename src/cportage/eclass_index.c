@@ -0,0 +1,279 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "eclass_index.h"
+#include "io.h"
+#include "md5_cache.h"
+#include "repository.h"
+
+/** Stored as digest of eclass that couldn't be read */
+/*@unchecked@*/ static char no_digest[] = "";
+
+struct eclass {
+    /*@only@*/ char *path;
+    /** Path relative to repository root */
+    /*@only@*/ char *relpath;
+    /*@dependent@*/ CPRepository repo;
+    /**
+     * Hex MD5 digest of contents or #no_digest, %NULL until it's asked for.
+     * Published with g_once_init_leave(), so every eclass is hashed once.
+     */
+    /*@only@*/ /*@null@*/ char *digest;
+};
+
+/** Eclass directory of a single repository. */
+struct eclass_dir {
+    /*@only@*/ CPRepository repo;
+    /*@only@*/ char *path;
+    /** %TRUE once directory was listed */
+    gboolean listed;
+    /** Modification time of directory when it was listed */
+    CPTimestamp mtime;
+    /** Eclass name->eclass map, without ".eclass" suffix */
+    /*@only@*/ GHashTable *eclasses;
+    /** Indexes of directories eclasses are looked up in, own one first */
+    /*@only@*/ GArray/*<guint>*/ *chain;
+};
+
+struct CPEclassIndexS {
+    /** One per repository, in the same order */
+    /*@only@*/ GPtrArray/*<struct eclass_dir>*/ *dirs;
+
+    /** Changed atomically, index is shared by settings and porttrees */
+    /*@refs@*/ gint refs;
+};
+
+static void
+eclass_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct eclass *eclass = data;
+
+    g_free(eclass->path);
+    g_free(eclass->relpath);
+    if (eclass->digest != no_digest) {
+        g_free(eclass->digest);
+    }
+    g_free(eclass);
+}
+
+static void
+eclass_dir_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct eclass_dir *dir = data;
+
+    cp_repository_unref(dir->repo);
+    g_free(dir->path);
+    g_hash_table_destroy(dir->eclasses);
+    (void)g_array_free(dir->chain, TRUE);
+    g_free(dir);
+}
+
+/** Appends \a repo to \a chain unless it's already there. */
+static void
+chain_add(GArray *chain, guint repo) /*@modifies *chain@*/ {
+    guint i;
+
+    for (i = 0; i < chain->len; ++i) {
+        if (g_array_index(chain, guint, i) == repo) {
+            return;
+        }
+    }
+    (void)g_array_append_val(chain, repo);
+}
+
+CPEclassIndex
+cp_eclass_index_new(GSList *repos) {
+    CPEclassIndex self;
+    GHashTable *name2index;
+    guint i = 0;
+
+    self = g_new0(struct CPEclassIndexS, 1);
+    self->refs = 1;
+    g_assert(self->dirs == NULL);
+    self->dirs = g_ptr_array_new_with_free_func(eclass_dir_free);
+
+    /* Values are indexes plus one, so that NULL means unknown */
+    name2index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    CP_GSLIST_ITER(repos, repo) {
+        struct eclass_dir *dir = g_new0(struct eclass_dir, 1);
+
+        dir->repo = cp_repository_ref(repo);
+        dir->path = g_build_filename(cp_repository_path(repo), "eclass", NULL);
+        dir->eclasses = g_hash_table_new_full(
+            g_str_hash, g_str_equal, g_free, eclass_free
+        );
+        dir->chain = g_array_new(FALSE, FALSE, sizeof(guint));
+        g_ptr_array_add(self->dirs, dir);
+        g_hash_table_insert(name2index,
+            g_strdup(cp_repository_name(repo)), GUINT_TO_POINTER(++i));
+    } end_CP_GSLIST_ITER
+
+    i = 0;
+    CP_GSLIST_ITER(repos, repo) {
+        struct eclass_dir *dir = g_ptr_array_index(self->dirs, i);
+        char **masters = cp_repository_masters(repo);
+        guint n;
+
+        chain_add(dir->chain, i);
+        if (masters == NULL) {
+            /* Overlays without layout.conf rely on main repository */
+            chain_add(dir->chain, 0);
+        }
+
+        /* Later masters override earlier ones */
+        for (n = masters == NULL ? 0 : g_strv_length(masters); n > 0; --n) {
+            guint master = GPOINTER_TO_UINT(
+                g_hash_table_lookup(name2index, masters[n - 1])
+            );
+
+            if (master == 0) {
+                g_debug("Repository '%s' has unknown master '%s'",
+                    cp_repository_name(repo), masters[n - 1]);
+            } else {
+                chain_add(dir->chain, master - 1);
+            }
+        }
+        ++i;
+    } end_CP_GSLIST_ITER
+
+    g_hash_table_destroy(name2index);
+    return self;
+}
+
+CPEclassIndex
+cp_eclass_index_ref(CPEclassIndex self) {
+    g_atomic_int_inc(&self->refs);
+    /*@-refcounttrans@*/
+    return self;
+    /*@=refcounttrans@*/
+}
+
+void
+cp_eclass_index_unref(CPEclassIndex self) {
+    /*@-mustfreeonly@*/
+    if (self == NULL) {
+        return;
+    }
+
+    g_assert(g_atomic_int_get(&self->refs) > 0);
+    if (!g_atomic_int_dec_and_test(&self->refs)) {
+        return;
+    }
+    /*@=mustfreeonly@*/
+
+    g_ptr_array_unref(self->dirs);
+
+    /*@-refcounttrans@*/
+    g_free(self);
+    /*@=refcounttrans@*/
+}
+
+void
+cp_eclass_index_refresh(CPEclassIndex self) {
+    guint i;
+
+    for (i = 0; i < self->dirs->len; ++i) {
+        struct eclass_dir *dir = g_ptr_array_index(self->dirs, i);
+        CPTimestamp mtime = { 0, 0 };
+        gboolean is_dir;
+        char **files;
+
+        if (!cp_repository_stat(dir->repo, "eclass", &mtime, &is_dir) || !is_dir) {
+            mtime.sec = 0;
+            mtime.nsec = 0;
+        }
+
+        if (dir->listed && dir->mtime.sec == mtime.sec
+                && dir->mtime.nsec == mtime.nsec) {
+            continue;
+        }
+
+        g_hash_table_remove_all(dir->eclasses);
+        dir->listed = TRUE;
+        dir->mtime = mtime;
+
+        /* Repositories without eclass directory have no eclasses */
+        files = cp_repository_list(dir->repo, "eclass", NULL);
+        if (files == NULL) {
+            continue;
+        }
+
+        CP_STRV_ITER(files, file) {
+            struct eclass *eclass;
+
+            if (!g_str_has_suffix(file, ".eclass")) {
+                continue;
+            }
+
+            eclass = g_new0(struct eclass, 1);
+            eclass->repo = dir->repo;
+            eclass->path = g_build_filename(dir->path, file, NULL);
+            eclass->relpath = g_build_filename("eclass", file, NULL);
+            g_hash_table_insert(dir->eclasses,
+                g_strndup(file, strlen(file) - strlen(".eclass")), eclass);
+        } end_CP_STRV_ITER
+
+        g_strfreev(files);
+    }
+}
+
+static /*@dependent@*/ /*@null@*/ struct eclass *
+find_eclass(const CPEclassIndex self, guint repo, const char *name) /*@*/ {
+    const struct eclass_dir *dir = g_ptr_array_index(self->dirs, repo);
+    guint i;
+
+    g_assert(dir->listed);
+
+    for (i = 0; i < dir->chain->len; ++i) {
+        const struct eclass_dir *candidate =
+            g_ptr_array_index(self->dirs, g_array_index(dir->chain, guint, i));
+        struct eclass *eclass = g_hash_table_lookup(candidate->eclasses, name);
+
+        if (eclass != NULL) {
+            return eclass;
+        }
+    }
+
+    return NULL;
+}
+
+const char *
+cp_eclass_index_path(CPEclassIndex self, guint repo, const char *eclass) {
+    const struct eclass *found = find_eclass(self, repo, eclass);
+
+    return found == NULL ? NULL : found->path;
+}
+
+const char *
+cp_eclass_index_digest(CPEclassIndex self, guint repo, const char *eclass) {
+    struct eclass *found = find_eclass(self, repo, eclass);
+
+    if (found == NULL) {
+        return NULL;
+    }
+
+    /* Racing threads wait for the first one instead of hashing again */
+    if (g_once_init_enter(&found->digest)) {
+        char *digest = cp_md5_cache_digest(found->repo, found->relpath);
+
+        g_once_init_leave(&found->digest, digest == NULL ? no_digest : digest);
+    }
+
+    return found->digest == no_digest ? NULL : found->digest;
+}
@@ -0,0 +1,96 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Eclass locations and digests across repositories. */
+
+#ifndef CP_ECLASS_INDEX_H
+#define CP_ECLASS_INDEX_H
+
+#include <cportage.h>
+
+/*@-exportany@*/
+
+/**
+ * Maps eclass names to files and their MD5 digests for every repository,
+ * following repository masters. Lookups may run concurrently, but not
+ * together with cp_eclass_index_refresh().
+ */
+typedef struct CPEclassIndexS *CPEclassIndex;
+
+/**
+ * Creates an index of eclasses of \a repos. Repositories are ordered by
+ * priority, ascending, the first one is the main repository. Eclass
+ * directories aren't read until cp_eclass_index_refresh() is called.
+ *
+ * Eclasses of a repository are looked up in its own eclass directory,
+ * then in directories of its masters (metadata/layout.conf), last one
+ * first. Repositories that don't list masters inherit from the main one.
+ *
+ * \return a #CPEclassIndex, free it using cp_eclass_index_unref()
+ */
+/*@newref@*/ CPEclassIndex
+cp_eclass_index_new(
+    GSList/*<CPRepository>*/ *repos
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/*@newref@*/ CPEclassIndex
+cp_eclass_index_ref(CPEclassIndex self) /*@modifies *self@*/;
+
+void
+cp_eclass_index_unref(/*@killref@*/ /*@null@*/ CPEclassIndex self) /*@modifies self@*/;
+
+/**
+ * Lists eclass directories whose modification time changed since they
+ * were last listed. Paths and digests of their eclasses are forgotten,
+ * other directories keep theirs.
+ */
+void
+cp_eclass_index_refresh(
+    CPEclassIndex self
+) /*@modifies *self,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * \param repo index of repository in the list \a self was created from
+ * \return     readonly path to \a eclass (without ".eclass" suffix) as seen
+ *             from \a repo, or %NULL if it isn't found. It stays valid until
+ *             next cp_eclass_index_refresh().
+ */
+/*@observer@*/ /*@null@*/ const char *
+cp_eclass_index_path(
+    CPEclassIndex self,
+    guint repo,
+    const char *eclass
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *self@*/;
+
+/**
+ * Same as cp_eclass_index_path(), but returns hex MD5 digest of eclass
+ * contents, as md5-cache stores it. Each eclass is hashed once, when its
+ * digest is first asked for. Concurrent callers wait for that hash, and
+ * an eclass that couldn't be read stays without a digest.
+ *
+ * \return readonly digest or %NULL if \a eclass isn't found or can't be read
+ */
+/*@observer@*/ /*@null@*/ const char *
+cp_eclass_index_digest(
+    CPEclassIndex self,
+    guint repo,
+    const char *eclass
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *self,errno@*/ /*@globals fileSystem@*/;
+
+#endif
@@ -38,8 +38,12 @@ enum CPError {
     CP_ERROR_ATOM_SYNTAX,
     CP_ERROR_SHELLCONFIG_SOURCE_DISABLED,
     CP_ERROR_SHELLCONFIG_SYNTAX,
+    CP_ERROR_MANIFEST_SYNTAX,
+    CP_ERROR_LICENSE_SYNTAX,
+    CP_ERROR_DEP_SYNTAX,
     /*@=enummemuse@*/
-    CP_ERROR_SETTINGS_REQUIRED_MISSING
+    CP_ERROR_SETTINGS_REQUIRED_MISSING,
+    CP_ERROR_SETTINGS_INVALID_VALUE
 };
 
 #endif
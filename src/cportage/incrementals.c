@@ -29,6 +29,21 @@ struct CPIncrementals {
     /*@only@*/ GTree/*<char *, GTree<char *, NULL>>*/ *incrementals;
     /*@only@*/ GTree/*<char *, NULL>*/ *use_mask;
     /*@only@*/ GTree/*<char *, NULL>*/ *use_force;
+    /**
+     * Flags negated in USE since last "-*", or "*" if there was one.
+     * IUSE defaults of packages don't enable them.
+     */
+    /*@only@*/ GTree/*<char *, NULL>*/ *use_disabled;
+    /** USE before use.force and use.mask, set once config is finished */
+    /*@only@*/ /*@null@*/ char *configured_use;
+    /** Items of #use_disabled, set once config is finished */
+    /*@only@*/ /*@null@*/ char *disabled_use;
+    /**
+     * ACCEPT_LICENSE items in order since last "-*". Stacking them
+     * into a set would lose "-@GROUP" items, which negate items that
+     * aren't there literally.
+     */
+    /*@only@*/ GPtrArray/*<char *>*/ *accept_license;
 };
 
 /*@observer@*/ /*@unchecked@*/ static const char * const
@@ -87,6 +102,28 @@ add_incremental(
 
     cp_stack_dict(values, items);
 
+    if (strcmp(key, "ACCEPT_LICENSE") == 0) {
+        CP_STRV_ITER(items, item) {
+            if (strcmp(item, "-*") == 0) {
+                g_ptr_array_set_size(self->accept_license, 0);
+            }
+            g_ptr_array_add(self->accept_license, g_strdup(item));
+        } end_CP_STRV_ITER
+    }
+
+    if (strcmp(key, "USE") == 0) {
+        CP_STRV_ITER(items, item) {
+            if (strcmp(item, "-*") == 0) {
+                cp_tree_foreach_remove(self->use_disabled, cp_true_filter, NULL);
+                g_tree_insert(self->use_disabled, g_strdup("*"), NULL);
+            } else if (item[0] == '-') {
+                g_tree_insert(self->use_disabled, g_strdup(&item[1]), NULL);
+            } else {
+                (void)g_tree_remove(self->use_disabled, item);
+            }
+        } end_CP_STRV_ITER
+    }
+
     g_strfreev(items);
 }
 
@@ -298,6 +335,16 @@ post_process_incremental(
         data.self = self;
         data.use_no_expand = use_no_expand;
 
+        /*
+          USE engine applies use.{force,mask} again per package, together
+          with package.use.{force,mask}, so that "-flag" there can lift
+          a global mask or force. It needs USE before they were applied.
+         */
+        g_free(self->configured_use);
+        self->configured_use = concat_keys(value);
+        g_free(self->disabled_use);
+        self->disabled_use = concat_keys(self->use_disabled);
+
         /* PMS, section 5.2.12 */
         g_tree_foreach(self->use_force, force_use, value);
         g_tree_foreach(self->use_mask, remove_masked_use, value);
@@ -323,6 +370,17 @@ post_process_incremental(
         g_tree_destroy(use_no_expand);
     }
 
+    if (strcmp(key, "ACCEPT_LICENSE") == 0) {
+        GString *str = g_string_new("");
+        guint i;
+
+        for (i = 0; i < self->accept_license->len; ++i) {
+            (void)concat_key(g_ptr_array_index(self->accept_license, i), NULL, str);
+        }
+        g_tree_insert(self->config, g_strdup(key), g_string_free(str, FALSE));
+        return FALSE;
+    }
+
     /*
      * Since PMS doesn't say when incremental stacking and use.{mask,force}
      * handling should happen and what values variables should have until it
@@ -336,34 +394,20 @@ post_process_incremental(
     return FALSE;
 }
 
-static gboolean G_GNUC_WARN_UNUSED_RESULT
-collect_profile_list(
-    const char *profile_dir,
-    const char *file,
-    GTree *into,
-    /*@null@*/ GError **error
-) /*@modifies *into,*error,errno@*/ /*@globals fileSystem@*/ {
-    char *config_file;
-    gboolean result = FALSE;
-
-    g_assert(error == NULL || *error == NULL);
-
-    config_file = g_build_filename(profile_dir, file, NULL);
+static void
+stack_profile_list(
+    /*@null@*/ const char *data,
+    GTree *into
+) /*@modifies *into@*/ {
+    char **lines;
 
-    if (g_file_test(config_file, G_FILE_TEST_EXISTS)) {
-        char **lines = cp_io_getlines(config_file, TRUE, error);
-        if (lines == NULL) {
-            goto ERR;
-        }
-        cp_stack_dict(into, lines);
-        g_strfreev(lines);
+    if (data == NULL) {
+        return;
     }
 
-    result = TRUE;
-
-ERR:
-    g_free(config_file);
-    return result;
+    lines = cp_string_lines(data, TRUE);
+    cp_stack_dict(into, lines);
+    g_strfreev(lines);
 }
 
 CPIncrementals
@@ -394,6 +438,14 @@ cp_incrementals_new(GTree *config) {
         (GCompareDataFunc)strcmp, NULL, g_free, NULL
     );
 
+    g_assert(self->use_disabled == NULL);
+    self->use_disabled = g_tree_new_full(
+        (GCompareDataFunc)strcmp, NULL, g_free, NULL
+    );
+
+    g_assert(self->accept_license == NULL);
+    self->accept_license = g_ptr_array_new_with_free_func(g_free);
+
     return self;
 }
 
@@ -408,29 +460,24 @@ cp_incrementals_destroy(CPIncrementals self) {
     cp_tree_destroy(self->incrementals);
     cp_tree_destroy(self->use_mask);
     cp_tree_destroy(self->use_force);
+    cp_tree_destroy(self->use_disabled);
+    g_free(self->configured_use);
+    g_free(self->disabled_use);
+    g_ptr_array_unref(self->accept_license);
 
     /*@-refcounttrans@*/
     g_free(self);
     /*@=refcounttrans@*/
 }
 
-gboolean
+void
 cp_incrementals_process_profile(
     CPIncrementals self,
-    const char *dir,
-    GError **error
+    const char *use_mask,
+    const char *use_force
 ) {
-    g_assert(error == NULL || *error == NULL);
-
-    if (!collect_profile_list(dir, "use.mask", self->use_mask, error)) {
-        return FALSE;
-    }
-
-    if (!collect_profile_list(dir, "use.force", self->use_force, error)) {
-        return FALSE;
-    }
-
-    return TRUE;
+    stack_profile_list(use_mask, self->use_mask);
+    stack_profile_list(use_force, self->use_force);
 }
 
 void
@@ -480,3 +527,13 @@ cp_incrementals_contains(
 
     return g_tree_lookup_extended(values, value, NULL, NULL);
 }
+
+const char *
+cp_incrementals_configured_use(const CPIncrementals self) {
+    return self->configured_use == NULL ? "" : self->configured_use;
+}
+
+const char *
+cp_incrementals_disabled_use(const CPIncrementals self) {
+    return self->disabled_use == NULL ? "" : self->disabled_use;
+}
@@ -36,13 +36,16 @@ cp_incrementals_destroy(
     /*@null@*/ /*@only@*/ CPIncrementals self
 ) /*@modifies self@*/;
 
-gboolean
+/**
+ * Stacks contents of use.mask and use.force files of a profile,
+ * %NULL stands for missing file.
+ */
+void
 cp_incrementals_process_profile(
     CPIncrementals self,
-    const char *dir,
-    /*@null@*/ GError **error
-) G_GNUC_WARN_UNUSED_RESULT
-/*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/;
+    /*@null@*/ const char *use_mask,
+    /*@null@*/ const char *use_force
+) /*@modifies *self@*/;
 
 void
 cp_incrementals_config_changed(
@@ -60,4 +63,22 @@ cp_incrementals_contains(
     const char *value
 ) G_GNUC_WARN_UNUSED_RESULT /*@*/; 
 
+/**
+ * \return readonly USE before use.force and use.mask were applied,
+ *         empty until config is finished
+ */
+/*@observer@*/ const char *
+cp_incrementals_configured_use(
+    const CPIncrementals self
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return readonly flags negated in USE since last "-*", or "*" if there
+ *         was one, empty until config is finished
+ */
+/*@observer@*/ const char *
+cp_incrementals_disabled_use(
+    const CPIncrementals self
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
 #endif
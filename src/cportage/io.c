@@ -22,6 +22,8 @@
 
 #include <cportage.h>
 
+#include "strings.h"
+
 FILE *
 cp_io_fopen(const char *path, const char *mode, GError **error) {
     FILE *result = NULL;
@@ -98,27 +100,7 @@ cp_io_getlines(const char *path, const gboolean ignore_comments, GError **error)
 
     g_assert(data != NULL);
 
-    if (ignore_comments) {
-        char **lines = g_strsplit(data, "\n", -1);
-        char *line;
-        size_t i = 0;
-        size_t j = 0;
-        result = g_new(char *, g_strv_length(lines) + 1);
-        while ((line = lines[i++]) != NULL) {
-            char *comment = g_utf8_strchr(line, (gssize)-1, (gunichar)'#');
-            if (comment != NULL) {
-                *comment = '\0';
-            }
-            (void)g_strstrip(line);
-            if (line[0] != '\0') {
-                result[j++] = g_strdup(line);
-            }
-        }
-        result[j] = NULL;
-        g_strfreev(lines);
-    } else {
-        result = g_strsplit(data, "\n", -1);
-    }
+    result = cp_string_lines(data, ignore_comments);
 
 ERR:
     g_free(data);
@@ -0,0 +1,37 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** File system helpers shared by on-disk caches and indexes. */
+
+#ifndef CP_IO_H
+#define CP_IO_H
+
+#include <glib.h>
+
+/*@-exportany@*/
+
+/**
+ * Modification time of a file or directory.
+ */
+typedef struct CPTimestamp {
+    guint64 sec;
+    guint64 nsec;
+} CPTimestamp;
+
+#endif
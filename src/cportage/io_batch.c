@@ -0,0 +1,481 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if HAVE_LIBURING
+#   include <liburing.h>
+#endif
+
+#include "io_batch.h"
+
+/**
+ * Size of the first read of every file. Almost all vdb and profile files
+ * fit into it, bigger ones are finished with plain read() calls.
+ */
+#define FIRST_READ_SIZE 4096
+
+/**
+ * Reads rest of \a fd into \a buf, growing it as needed.
+ *
+ * \param len in: number of bytes already in \a buf, out: total length
+ * \return    0 on success, errno value otherwise
+ */
+static int
+read_rest(
+    int fd,
+    char **buf,
+    gsize *len,
+    gsize capacity
+) /*@modifies *buf,*len,errno@*/ /*@globals fileSystem@*/ {
+    for (;;) {
+        ssize_t n;
+
+        /* Keep space for terminating NUL */
+        if (*len + 1 >= capacity) {
+            capacity *= 2;
+            *buf = g_realloc(*buf, capacity);
+        }
+
+        n = read(fd, *buf + *len, capacity - 1 - *len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        *len += (gsize)n;
+    }
+}
+
+/**
+ * Reads \a fd from current position to \a req and closes it.
+ */
+static void
+read_fd(CPIOBatchRequest *req, int fd) /*@modifies *req,errno@*/ /*@globals fileSystem@*/ {
+    char *buf = g_malloc(FIRST_READ_SIZE + 1);
+    gsize len = 0;
+
+    req->error = read_rest(fd, &buf, &len, FIRST_READ_SIZE + 1);
+    (void)close(fd);
+
+    if (req->error != 0) {
+        g_free(buf);
+        return;
+    }
+
+    buf[len] = '\0';
+    req->contents = buf;
+    req->length = len;
+}
+
+static int
+open_request(const CPIOBatchRequest *req) /*@modifies errno@*/ /*@globals fileSystem@*/ {
+    return openat(req->dir_fd, req->path, O_RDONLY | O_CLOEXEC);
+}
+
+static void
+read_one(CPIOBatchRequest *req) /*@modifies *req,errno@*/ /*@globals fileSystem@*/ {
+    int fd = open_request(req);
+
+    if (fd < 0) {
+        req->error = errno;
+        return;
+    }
+    read_fd(req, fd);
+}
+
+#if HAVE_LIBURING
+/** Number of requests submitted to the ring at once */
+#define URING_DEPTH 64
+
+static void
+ring_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct io_uring *ring = data;
+
+    io_uring_queue_exit(ring);
+    g_free(ring);
+}
+
+/*@unchecked@*/ static GPrivate thread_ring = G_PRIVATE_INIT(ring_free);
+
+/**
+ * \return ring of calling thread, created on first use and reused by later
+ *         batches, or %NULL if io_uring can't be used
+ */
+static /*@null@*/ /*@dependent@*/ struct io_uring *
+get_ring(void) /*@globals thread_ring@*/ /*@modifies thread_ring@*/ {
+    struct io_uring *ring;
+
+    if (!cp_io_batch_is_async()) {
+        return NULL;
+    }
+
+    ring = g_private_get(&thread_ring);
+    if (ring == NULL) {
+        ring = g_new(struct io_uring, 1);
+        if (io_uring_queue_init(URING_DEPTH, ring, 0) < 0) {
+            g_free(ring);
+            return NULL;
+        }
+        g_private_set(&thread_ring, ring);
+    }
+
+    return ring;
+}
+
+/**
+ * Submits \a count prepared entries and collects their results by index.
+ * Results of entries that didn't complete are left untouched.
+ *
+ * \param submitted return location for number of entries, in order of
+ *                  preparation, that were passed to the kernel. Those whose
+ *                  completions weren't collected may still be in flight.
+ * \return          %FALSE if not all entries completed
+ */
+static gboolean
+uring_complete(
+    struct io_uring *ring,
+    guint count,
+    int *results,
+    /*@out@*/ guint *submitted
+) /*@modifies *ring,*results,*submitted,errno@*/ {
+    int ret;
+    guint done = 0;
+
+    *submitted = 0;
+
+    do {
+        ret = io_uring_submit_and_wait(ring, count);
+    } while (ret == -EINTR);
+    if (ret <= 0) {
+        return FALSE;
+    }
+    *submitted = (guint)ret;
+
+    while (done < *submitted) {
+        struct io_uring_cqe *cqe;
+
+        ret = io_uring_wait_cqe(ring, &cqe);
+        if (ret == -EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            return FALSE;
+        }
+        results[GPOINTER_TO_UINT(io_uring_cqe_get_data(cqe))] = cqe->res;
+        io_uring_cqe_seen(ring, cqe);
+        ++done;
+    }
+
+    return done == count;
+}
+
+/**
+ * Reads \a count requests with two ring submissions: one opening all files
+ * and one doing first read of each of them.
+ *
+ * \return %FALSE if ring became unusable, requests it didn't finish
+ *         are left untouched then
+ */
+static gboolean
+uring_read_chunk(
+    struct io_uring *ring,
+    CPIOBatchRequest *requests,
+    guint count
+) /*@modifies *ring,*requests,errno@*/ /*@globals fileSystem@*/ {
+    int fds[URING_DEPTH];
+    int results[URING_DEPTH];
+    char *bufs[URING_DEPTH];
+    /* Request index of every prepared read, in order of preparation */
+    guint order[URING_DEPTH];
+    guint n_open = 0;
+    guint submitted;
+    gboolean ring_ok = TRUE;
+    guint i;
+
+    for (i = 0; i < count; ++i) {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+
+        /* Not a valid descriptor or -errno, marks unfinished open */
+        fds[i] = G_MININT;
+        g_assert(sqe != NULL);
+        io_uring_prep_openat(
+            sqe, requests[i].dir_fd, requests[i].path, O_RDONLY | O_CLOEXEC, 0
+        );
+        io_uring_sqe_set_data(sqe, GUINT_TO_POINTER(i));
+    }
+
+    if (!uring_complete(ring, count, fds, &submitted)) {
+        /* Descriptors of opens still in flight are lost */
+        for (i = 0; i < count; ++i) {
+            if (fds[i] >= 0) {
+                (void)close(fds[i]);
+            }
+        }
+        return FALSE;
+    }
+
+    for (i = 0; i < count; ++i) {
+        struct io_uring_sqe *sqe;
+
+        bufs[i] = NULL;
+        /* Not a byte count or -errno, marks unfinished read */
+        results[i] = G_MININT;
+
+        if (fds[i] == -EINVAL) {
+            /* Kernel doesn't support IORING_OP_OPENAT */
+            fds[i] = open_request(&requests[i]);
+            if (fds[i] < 0) {
+                fds[i] = -errno;
+            }
+        }
+        if (fds[i] < 0) {
+            requests[i].error = -fds[i];
+            continue;
+        }
+
+        bufs[i] = g_malloc(FIRST_READ_SIZE + 1);
+        sqe = io_uring_get_sqe(ring);
+        g_assert(sqe != NULL);
+        io_uring_prep_read(sqe, fds[i], bufs[i], FIRST_READ_SIZE, 0);
+        io_uring_sqe_set_data(sqe, GUINT_TO_POINTER(i));
+        order[n_open++] = i;
+    }
+
+    if (n_open > 0 && !uring_complete(ring, n_open, results, &submitted)) {
+        guint k;
+
+        ring_ok = FALSE;
+        for (k = 0; k < n_open; ++k) {
+            i = order[k];
+            if (results[i] != G_MININT) {
+                continue;
+            }
+            if (k < submitted) {
+                /*
+                 * Kernel may still write into the buffer, so it is leaked
+                 * together with descriptor and file is read again.
+                 */
+                read_one(&requests[i]);
+            } else {
+                /* Read wasn't submitted, descriptor is still at offset 0 */
+                g_free(bufs[i]);
+                read_fd(&requests[i], fds[i]);
+            }
+            fds[i] = -1;
+        }
+    }
+
+    for (i = 0; i < count; ++i) {
+        gsize len;
+
+        if (fds[i] < 0) {
+            continue;
+        }
+
+        if (results[i] < 0) {
+            requests[i].error = -results[i];
+            g_free(bufs[i]);
+            (void)close(fds[i]);
+            continue;
+        }
+
+        len = (gsize)results[i];
+        if (len == FIRST_READ_SIZE) {
+            requests[i].error = read_rest(fds[i], &bufs[i], &len, FIRST_READ_SIZE + 1);
+        }
+        (void)close(fds[i]);
+
+        if (requests[i].error != 0) {
+            g_free(bufs[i]);
+            continue;
+        }
+        bufs[i][len] = '\0';
+        requests[i].contents = bufs[i];
+        requests[i].length = len;
+    }
+
+    return ring_ok;
+}
+
+/**
+ * \return %FALSE if io_uring can't be used, nothing is read then
+ */
+static gboolean
+uring_read(
+    CPIOBatchRequest *requests,
+    guint n_requests
+) /*@modifies *requests,errno@*/ /*@globals fileSystem,thread_ring@*/ {
+    struct io_uring *ring = get_ring();
+    guint start;
+
+    if (ring == NULL) {
+        return FALSE;
+    }
+
+    for (start = 0; start < n_requests; start += URING_DEPTH) {
+        guint count = MIN(URING_DEPTH, n_requests - start);
+        guint i;
+
+        if (!uring_read_chunk(ring, &requests[start], count)) {
+            /*
+             * Ring may hold unsubmitted entries or pending completions,
+             * so next batch gets a new one. Rest is read synchronously.
+             */
+            g_private_replace(&thread_ring, NULL);
+            for (i = start; i < n_requests; ++i) {
+                if (requests[i].contents == NULL && requests[i].error == 0) {
+                    read_one(&requests[i]);
+                }
+            }
+            break;
+        }
+    }
+
+    return TRUE;
+}
+#endif
+
+/** Number of files readahead_read() keeps open at once */
+#define READAHEAD_WINDOW 64
+
+/**
+ * Opens files of a window first and asks kernel to start reading them,
+ * so that reads issued later find data in page cache. Windows keep
+ * number of open descriptors bounded however big the batch is.
+ */
+static void
+readahead_read(
+    CPIOBatchRequest *requests,
+    guint n_requests
+) /*@modifies *requests,errno@*/ /*@globals fileSystem@*/ {
+    int fds[READAHEAD_WINDOW];
+    guint start;
+
+    for (start = 0; start < n_requests; start += READAHEAD_WINDOW) {
+        guint count = MIN(READAHEAD_WINDOW, n_requests - start);
+        guint i;
+
+        for (i = 0; i < count; ++i) {
+            fds[i] = open_request(&requests[start + i]);
+            if (fds[i] < 0) {
+                requests[start + i].error = errno;
+                continue;
+            }
+#if HAVE_POSIX_FADVISE
+            (void)posix_fadvise(fds[i], 0, 0, POSIX_FADV_WILLNEED);
+#endif
+        }
+
+        for (i = 0; i < count; ++i) {
+            if (fds[i] >= 0) {
+                read_fd(&requests[start + i], fds[i]);
+            }
+        }
+    }
+}
+
+static void
+read_job(void *data, /*@unused@*/ void *user_data G_GNUC_UNUSED)
+/*@modifies *data,errno@*/ /*@globals fileSystem@*/ {
+    read_one(data);
+}
+
+void
+cp_io_batch_read(
+    CPIOBatchRequest *requests,
+    guint n_requests,
+    unsigned int jobs
+) {
+    GThreadPool *pool = NULL;
+    guint i;
+
+    for (i = 0; i < n_requests; ++i) {
+        requests[i].contents = NULL;
+        requests[i].length = 0;
+        requests[i].error = 0;
+    }
+
+    if (n_requests == 0) {
+        return;
+    }
+
+#if HAVE_LIBURING
+    if (uring_read(requests, n_requests)) {
+        return;
+    }
+#endif
+
+    if (jobs > 1 && n_requests > 1) {
+        /* Failure to create threads isn't fatal, files are read anyway */
+        pool = g_thread_pool_new(read_job, NULL, (gint)jobs, TRUE, NULL);
+    }
+
+    if (pool == NULL) {
+        readahead_read(requests, n_requests);
+        return;
+    }
+
+    for (i = 0; i < n_requests; ++i) {
+        /* Pool owns its threads, so pushing can't fail */
+        (void)g_thread_pool_push(pool, &requests[i], NULL);
+    }
+    /* Waits for all queued files to be read */
+    g_thread_pool_free(pool, FALSE, TRUE);
+}
+
+gboolean
+cp_io_batch_is_async(void) {
+#if HAVE_LIBURING
+    /* 1 if ring can't be created, 2 if it can */
+    static gsize usable = 0;
+
+    if (g_once_init_enter(&usable)) {
+        struct io_uring ring;
+        gsize value = 1;
+
+        if (io_uring_queue_init(URING_DEPTH, &ring, 0) == 0) {
+            io_uring_queue_exit(&ring);
+            value = 2;
+        }
+        g_once_init_leave(&usable, value);
+    }
+    return usable == 2;
+#else
+    return FALSE;
+#endif
+}
+
+void
+cp_io_batch_clear(CPIOBatchRequest *requests, guint n_requests) {
+    guint i;
+
+    for (i = 0; i < n_requests; ++i) {
+        g_free(requests[i].contents);
+        requests[i].contents = NULL;
+    }
+}
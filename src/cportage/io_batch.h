@@ -0,0 +1,78 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Batched reading of many small files. */
+
+#ifndef CP_IO_BATCH_H
+#define CP_IO_BATCH_H
+
+#include <cportage.h>
+
+/*@-exportany@*/
+
+/**
+ * Single file read by cp_io_batch_read().
+ */
+typedef struct CPIOBatchRequest {
+    /** Directory \a path is relative to, or \c AT_FDCWD */
+    int dir_fd;
+    /*@observer@*/ const char *path;
+
+    /** NUL-terminated file contents, only set on success */
+    /*@null@*/ /*@only@*/ char *contents;
+    gsize length;
+    /** errno value if file couldn't be read, 0 on success */
+    int error;
+} CPIOBatchRequest;
+
+/**
+ * Reads all files of \a requests, submitting them to the kernel together
+ * instead of one blocking open/read/close sequence after another.
+ * Uses io_uring when it is available. Otherwise, files are opened and
+ * announced with posix_fadvise() first and read afterwards, or read by
+ * a pool of \a jobs threads if \a jobs is greater than one.
+ *
+ * Failures are reported per request, free contents using
+ * cp_io_batch_clear().
+ */
+void
+cp_io_batch_read(
+    CPIOBatchRequest *requests,
+    guint n_requests,
+    unsigned int jobs
+) /*@modifies *requests,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Tells whether cp_io_batch_read() submits files to the kernel
+ * asynchronously. If it doesn't, callers reading a few tiny files
+ * at a time are better off reading them in place.
+ */
+gboolean
+cp_io_batch_is_async(void) /*@globals internalState@*/;
+
+/**
+ * Frees contents of \a requests.
+ */
+void
+cp_io_batch_clear(
+    CPIOBatchRequest *requests,
+    guint n_requests
+) /*@modifies *requests@*/;
+
+#endif
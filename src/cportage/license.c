@@ -0,0 +1,550 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  LICENSE is compiled into a flat array of ops in prefix order. Group ops
+  ("||", "( )" and USE conditionals) store index of the first op after
+  them, so evaluation walks the array without any string comparisons.
+ */
+
+#include <string.h>
+
+#include "collections.h"
+#include "error.h"
+#include "license.h"
+
+/** Group from profiles/license_groups. */
+struct license_group {
+    /** Members as listed, "@" prefix marks nested groups */
+    /*@only@*/ GPtrArray/*<char *>*/ *members;
+    /** License IDs of expanded group, %NULL until it's expanded */
+    /*@only@*/ /*@null@*/ GArray/*<guint>*/ *ids;
+    /** Nesting level while group is being expanded, to detect cycles, 0 otherwise */
+    guint depth;
+};
+
+struct CPLicensesS {
+    /** License name->(ID + 1) map */
+    /*@only@*/ GHashTable *license_ids;
+    /** Interns USE flags of conditionals */
+    /*@dependent@*/ CPDepTable flags;
+    /** Name->license_group map */
+    /*@only@*/ GHashTable *groups;
+};
+
+struct CPLicenseAcceptS {
+    /** Bitset of accepted license IDs below n_ids */
+    /*@only@*/ GArray/*<guint32>*/ *accepted;
+    /** Number of licenses interned when ACCEPT_LICENSE was compiled */
+    guint n_ids;
+    /** Whether licenses interned later are accepted */
+    gboolean rest;
+};
+
+enum op_kind {
+    OP_LICENSE,
+    OP_ALL_OF,
+    OP_ANY_OF,
+    OP_USE,
+    OP_NOT_USE
+};
+
+struct license_op {
+    enum op_kind kind;
+    /** License ID for OP_LICENSE, flag ID for conditionals */
+    guint id;
+    /** Index of the first op after group ops */
+    guint end;
+};
+
+struct CPLicenseExprS {
+    /*@only@*/ GArray/*<struct license_op>*/ *ops;
+};
+
+static void
+license_group_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct license_group *group = data;
+
+    g_ptr_array_unref(group->members);
+    if (group->ids != NULL) {
+        (void)g_array_free(group->ids, TRUE);
+    }
+    g_free(group);
+}
+
+static guint
+intern(GHashTable *ids, const char *name) /*@modifies *ids@*/ {
+    guint id = GPOINTER_TO_UINT(g_hash_table_lookup(ids, name));
+
+    if (id == 0) {
+        id = g_hash_table_size(ids) + 1;
+        g_hash_table_insert(ids, g_strdup(name), GUINT_TO_POINTER(id));
+    }
+
+    return id - 1;
+}
+
+CPLicenses
+cp_licenses_new(CPDepTable flags) {
+    CPLicenses self;
+
+    self = g_new0(struct CPLicensesS, 1);
+    g_assert(self->license_ids == NULL);
+    self->license_ids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    self->flags = flags;
+    g_assert(self->groups == NULL);
+    self->groups = g_hash_table_new_full(g_str_hash, g_str_equal,
+        g_free, license_group_free);
+
+    return self;
+}
+
+void
+cp_licenses_destroy(CPLicenses self) {
+    if (self == NULL) {
+        /*@-mustfreeonly@*/
+        return;
+        /*@=mustfreeonly@*/
+    }
+
+    g_hash_table_destroy(self->license_ids);
+    g_hash_table_destroy(self->groups);
+    g_free(self);
+}
+
+gboolean
+cp_licenses_add_groups(CPLicenses self, const CPRepository repo, GError **error) {
+    GError *tmp_error = NULL;
+    char **lines;
+
+    g_assert(error == NULL || *error == NULL);
+
+    lines = cp_repository_getlines(repo, "profiles/license_groups", &tmp_error);
+    if (lines == NULL) {
+        if (g_error_matches(tmp_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)
+                || g_error_matches(tmp_error, G_FILE_ERROR, G_FILE_ERROR_NOTDIR)) {
+            g_error_free(tmp_error);
+            return TRUE;
+        }
+        g_propagate_error(error, tmp_error);
+        return FALSE;
+    }
+
+    CP_STRV_ITER(lines, line) {
+        char **items = cp_strings_pysplit(line);
+        struct license_group *group;
+        guint i;
+
+        if (items == NULL || items[0] == NULL) {
+            g_strfreev(items);
+            continue;
+        }
+
+        group = g_hash_table_lookup(self->groups, items[0]);
+        if (group == NULL) {
+            group = g_new0(struct license_group, 1);
+            group->members = g_ptr_array_new_with_free_func(g_free);
+            g_hash_table_insert(self->groups, g_strdup(items[0]), group);
+        }
+        for (i = 1; items[i] != NULL; ++i) {
+            g_ptr_array_add(group->members, g_strdup(items[i]));
+        }
+
+        g_strfreev(items);
+    } end_CP_STRV_ITER
+
+    g_strfreev(lines);
+    return TRUE;
+}
+
+/**
+ * Appends IDs of licenses of group \a name to \a ids, interning them.
+ * Expanded groups are cached, except for ones that were cut short by
+ * a cycle through an outer group: they miss members of that group.
+ *
+ * \param depth nesting level of group \a name, starting from 1
+ * \param cut   lowered to nesting level of group found to include itself
+ */
+static void
+expand_group(
+    CPLicenses self,
+    const char *name,
+    guint depth,
+    GArray/*<guint>*/ *ids,
+    guint *cut
+) /*@modifies *self,*ids,*cut@*/ {
+    struct license_group *group = g_hash_table_lookup(self->groups, name);
+    guint start = ids->len;
+    guint nested_cut = G_MAXUINT;
+    guint i;
+
+    if (group == NULL) {
+        g_warning("Unknown license group '%s'", name);
+        return;
+    }
+    if (group->ids != NULL) {
+        (void)g_array_append_vals(ids, group->ids->data, group->ids->len);
+        return;
+    }
+    if (group->depth != 0) {
+        g_warning("License group '%s' includes itself", name);
+        *cut = MIN(*cut, group->depth);
+        return;
+    }
+
+    group->depth = depth;
+    for (i = 0; i < group->members->len; ++i) {
+        const char *member = g_ptr_array_index(group->members, i);
+
+        if (member[0] == '@') {
+            expand_group(self, &member[1], depth + 1, ids, &nested_cut);
+        } else {
+            guint id = intern(self->license_ids, member);
+
+            (void)g_array_append_val(ids, id);
+        }
+    }
+    group->depth = 0;
+
+    /* Cycles back to this group don't make it incomplete */
+    if (nested_cut >= depth) {
+        group->ids = g_array_sized_new(FALSE, FALSE, sizeof(guint), ids->len - start);
+        (void)g_array_append_vals(group->ids,
+            &g_array_index(ids, guint, start), ids->len - start);
+    }
+    *cut = MIN(*cut, nested_cut);
+}
+
+static void
+accept_set(CPLicenseAccept self, guint id, gboolean accept) /*@modifies *self@*/ {
+    if (accept) {
+        cp_bitset_set(self->accepted, id);
+    } else {
+        cp_bitset_clear(self->accepted, id);
+    }
+}
+
+CPLicenseAccept
+cp_license_accept_new(CPLicenses licenses, const char *accept_license) {
+    CPLicenseAccept self;
+    char **items = cp_strings_pysplit(accept_license);
+    guint id;
+    guint i;
+
+    self = g_new0(struct CPLicenseAcceptS, 1);
+    self->accepted = g_array_new(FALSE, TRUE, sizeof(guint32));
+    self->rest = FALSE;
+
+    if (items == NULL) {
+        return self;
+    }
+
+    /* Interns everything first, so that "*" covers named licenses too */
+    CP_STRV_ITER(items, item) {
+        const char *name = item[0] == '-' ? &item[1] : item;
+
+        if (name[0] == '@') {
+            GArray *ids = g_array_new(FALSE, FALSE, sizeof(guint));
+            guint cut = G_MAXUINT;
+
+            /* Outermost group is never cut short, so it gets cached */
+            expand_group(licenses, &name[1], 1, ids, &cut);
+            (void)g_array_free(ids, TRUE);
+        } else if (strcmp(name, "*") != 0) {
+            (void)intern(licenses->license_ids, name);
+        }
+    } end_CP_STRV_ITER
+    self->n_ids = g_hash_table_size(licenses->license_ids);
+
+    CP_STRV_ITER(items, item) {
+        gboolean accept = item[0] != '-';
+        const char *name = accept ? item : &item[1];
+
+        if (strcmp(name, "*") == 0) {
+            self->rest = accept;
+            for (id = 0; id < self->n_ids; ++id) {
+                accept_set(self, id, accept);
+            }
+        } else if (name[0] == '@') {
+            const struct license_group *group =
+                g_hash_table_lookup(licenses->groups, &name[1]);
+
+            /* Unknown groups were reported above */
+            for (i = 0; group != NULL && group->ids != NULL && i < group->ids->len; ++i) {
+                accept_set(self, g_array_index(group->ids, guint, i), accept);
+            }
+        } else {
+            accept_set(self, intern(licenses->license_ids, name), accept);
+        }
+    } end_CP_STRV_ITER
+
+    g_strfreev(items);
+    return self;
+}
+
+void
+cp_license_accept_destroy(CPLicenseAccept self) {
+    if (self == NULL) {
+        /*@-mustfreeonly@*/
+        return;
+        /*@=mustfreeonly@*/
+    }
+
+    (void)g_array_free(self->accepted, TRUE);
+    g_free(self);
+}
+
+struct parse_state {
+    /*@dependent@*/ CPLicenses licenses;
+    /*@dependent@*/ const char *license;
+    /*@dependent@*/ char **tokens;
+    guint pos;
+    /*@dependent@*/ GArray/*<struct license_op>*/ *ops;
+};
+
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+parse_group(
+    struct parse_state *state,
+    gboolean nested,
+    /*@null@*/ GError **error
+) /*@modifies *state,*error@*/;
+
+/**
+ * Parses "( ... )" group after \a token into op of \a kind with \a id.
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+parse_nested(
+    struct parse_state *state,
+    const char *token,
+    enum op_kind kind,
+    guint id,
+    /*@null@*/ GError **error
+) /*@modifies *state,*error@*/ {
+    struct license_op op;
+    guint index = state->ops->len;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (kind != OP_ALL_OF) {
+        const char *next = state->tokens[state->pos];
+
+        if (next == NULL || strcmp(next, "(") != 0) {
+            g_set_error(error, CP_ERROR, (gint)CP_ERROR_LICENSE_SYNTAX,
+                _("'%s' isn't followed by '(' in LICENSE '%s'"),
+                token, state->license);
+            return FALSE;
+        }
+        ++state->pos;
+    }
+
+    op.kind = kind;
+    op.id = id;
+    op.end = 0;
+    (void)g_array_append_val(state->ops, op);
+
+    if (!parse_group(state, TRUE, error)) {
+        return FALSE;
+    }
+
+    g_array_index(state->ops, struct license_op, index).end = state->ops->len;
+    return TRUE;
+}
+
+static gboolean
+parse_group(struct parse_state *state, gboolean nested, GError **error) {
+    const char *token;
+
+    g_assert(error == NULL || *error == NULL);
+
+    while ((token = state->tokens[state->pos]) != NULL) {
+        size_t len = strlen(token);
+        gboolean result;
+
+        ++state->pos;
+
+        if (strcmp(token, ")") == 0) {
+            if (!nested) {
+                break;
+            }
+            return TRUE;
+        }
+
+        if (strcmp(token, "(") == 0) {
+            result = parse_nested(state, token, OP_ALL_OF, 0, error);
+        } else if (strcmp(token, "||") == 0) {
+            result = parse_nested(state, token, OP_ANY_OF, 0, error);
+        } else if (token[len - 1] == '?') {
+            gboolean negate = token[0] == '!';
+            char *flag = g_strndup(&token[negate ? 1 : 0], len - (negate ? 2 : 1));
+
+            if (flag[0] == '\0') {
+                g_set_error(error, CP_ERROR, (gint)CP_ERROR_LICENSE_SYNTAX,
+                    _("Invalid USE conditional '%s' in LICENSE '%s'"),
+                    token, state->license);
+                result = FALSE;
+            } else {
+                result = parse_nested(state, token, negate ? OP_NOT_USE : OP_USE,
+                    cp_dep_table_intern_flag(state->licenses->flags, flag), error);
+            }
+            g_free(flag);
+        } else {
+            struct license_op op;
+
+            op.kind = OP_LICENSE;
+            op.id = intern(state->licenses->license_ids, token);
+            op.end = 0;
+            (void)g_array_append_val(state->ops, op);
+            result = TRUE;
+        }
+
+        if (!result) {
+            return FALSE;
+        }
+    }
+
+    if (nested || token != NULL) {
+        g_set_error(error, CP_ERROR, (gint)CP_ERROR_LICENSE_SYNTAX,
+            _("Unbalanced parentheses in LICENSE '%s'"), state->license);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+CPLicenseExpr
+cp_license_expr_new(CPLicenses licenses, const char *license, GError **error) {
+    struct parse_state state;
+    CPLicenseExpr self;
+    char **tokens;
+    gboolean result;
+
+    g_assert(error == NULL || *error == NULL);
+
+    tokens = cp_strings_pysplit(license);
+    self = g_new0(struct CPLicenseExprS, 1);
+    self->ops = g_array_new(FALSE, FALSE, sizeof(struct license_op));
+
+    if (tokens == NULL) {
+        return self;
+    }
+
+    state.licenses = licenses;
+    state.license = license;
+    state.tokens = tokens;
+    state.pos = 0;
+    state.ops = self->ops;
+    result = parse_group(&state, FALSE, error);
+    g_strfreev(tokens);
+
+    if (!result) {
+        cp_license_expr_destroy(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+void
+cp_license_expr_destroy(CPLicenseExpr self) {
+    if (self == NULL) {
+        /*@-mustfreeonly@*/
+        return;
+        /*@=mustfreeonly@*/
+    }
+
+    (void)g_array_free(self->ops, TRUE);
+    g_free(self);
+}
+
+/**
+ * Evaluates ops from \a begin to \a end as children of all-of or, if
+ * \a any_of, any-of group. Enabled USE conditionals are flattened into
+ * the group, disabled ones don't count as children, and any-of group
+ * without children is satisfied.
+ *
+ * \param seen set to %TRUE if group has at least one child
+ */
+static gboolean
+eval_range(
+    const struct license_op *ops,
+    guint begin,
+    guint end,
+    gboolean any_of,
+    const CPLicenseAccept accept,
+    const GArray *use,
+    gboolean *seen
+) /*@modifies *seen@*/ {
+    guint i = begin;
+
+    while (i < end) {
+        const struct license_op *op = &ops[i];
+        gboolean child_seen = TRUE;
+        gboolean nested_seen = FALSE;
+        gboolean result;
+
+        switch (op->kind) {
+            case OP_LICENSE:
+                result = op->id < accept->n_ids
+                    ? cp_bitset_get(accept->accepted, op->id) : accept->rest;
+                ++i;
+                break;
+            case OP_ALL_OF:
+            case OP_ANY_OF:
+                result = eval_range(ops, i + 1, op->end, op->kind == OP_ANY_OF,
+                    accept, use, &nested_seen);
+                i = op->end;
+                break;
+            case OP_USE:
+            case OP_NOT_USE:
+                if (cp_bitset_get(use, op->id) == (op->kind == OP_USE)) {
+                    child_seen = FALSE;
+                    result = eval_range(ops, i + 1, op->end, any_of,
+                        accept, use, &child_seen);
+                } else {
+                    child_seen = FALSE;
+                    result = !any_of;
+                }
+                i = op->end;
+                break;
+            default:
+                g_assert_not_reached();
+        }
+
+        if (child_seen) {
+            *seen = TRUE;
+            if (result == any_of) {
+                return any_of;
+            }
+        }
+    }
+
+    return any_of ? !*seen : TRUE;
+}
+
+gboolean
+cp_license_expr_accepted(
+    const CPLicenseExpr self,
+    const CPLicenseAccept accept,
+    const GArray *use
+) {
+    gboolean seen = FALSE;
+
+    return eval_range(&g_array_index(self->ops, struct license_op, 0),
+        0, self->ops->len, FALSE, accept, use, &seen);
+}
@@ -0,0 +1,129 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Compiled ACCEPT_LICENSE and LICENSE evaluation. */
+
+#ifndef CP_LICENSE_H
+#define CP_LICENSE_H
+
+#include <cportage.h>
+
+#include "dep.h"
+#include "repository.h"
+
+/*@-exportany@*/
+
+/**
+ * Registry of interned license names and USE flags, and of license groups
+ * from profiles/license_groups. IDs are dense and never change, so sets
+ * of licenses and flags are bitsets over them.
+ */
+typedef struct CPLicensesS *CPLicenses;
+
+/**
+ * \param flags interns USE flags of LICENSE conditionals, must outlive
+ *              the result
+ */
+/*@only@*/ CPLicenses
+cp_licenses_new(
+    /*@dependent@*/ CPDepTable flags
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+void
+cp_licenses_destroy(/*@null@*/ /*@only@*/ CPLicenses self) /*@modifies self@*/;
+
+/**
+ * Adds groups from profiles/license_groups of \a repo to \a self. Groups
+ * with the same name in several repositories are merged. Missing file
+ * is ignored. Groups must be added before anything is compiled.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_licenses_add_groups(
+    CPLicenses self,
+    const CPRepository repo,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * ACCEPT_LICENSE flattened into a bitset over license IDs.
+ */
+typedef struct CPLicenseAcceptS *CPLicenseAccept;
+
+/**
+ * Compiles \a accept_license items in order: "*" and "-*" accept or
+ * reject everything, "@GROUP" and "-@GROUP" whole groups (expanded
+ * recursively), other items single licenses. Licenses interned later
+ * are accepted if the last "*" or "-*" item was "*". Unknown groups
+ * are skipped with a warning.
+ *
+ * \return a #CPLicenseAccept, free it using cp_license_accept_destroy()
+ */
+/*@only@*/ CPLicenseAccept
+cp_license_accept_new(
+    CPLicenses licenses,
+    const char *accept_license
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT /*@modifies *licenses@*/;
+
+void
+cp_license_accept_destroy(
+    /*@null@*/ /*@only@*/ CPLicenseAccept self
+) /*@modifies self@*/;
+
+/**
+ * LICENSE of a package with names and USE flags replaced by their IDs.
+ */
+typedef struct CPLicenseExprS *CPLicenseExpr;
+
+/**
+ * Compiles \a license, which may contain "||" groups and "flag?" and
+ * "!flag?" conditionals.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      a #CPLicenseExpr or %NULL if \a license is malformed,
+ *              free it using cp_license_expr_destroy()
+ */
+/*@null@*/ /*@only@*/ CPLicenseExpr
+cp_license_expr_new(
+    CPLicenses licenses,
+    const char *license,
+    /*@null@*/ GError **error
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT /*@modifies *licenses,*error@*/;
+
+void
+cp_license_expr_destroy(
+    /*@null@*/ /*@only@*/ CPLicenseExpr self
+) /*@modifies self@*/;
+
+/**
+ * \param use bitset of enabled USE flags, by IDs of table licenses
+ *            of \a self were created with
+ * \return    %TRUE if \a self is satisfied by licenses \a accept accepts
+ */
+gboolean
+cp_license_expr_accepted(
+    const CPLicenseExpr self,
+    const CPLicenseAccept accept,
+    const GArray/*<guint32>*/ *use
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+#endif
@@ -0,0 +1,793 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Manifest2 files list one file per line:
+
+      TYPE NAME SIZE [HASH DIGEST]...
+
+  Package Manifests use DIST, EBUILD, AUX (relative to files/) and MISC
+  entries. GLEP 74 repository Manifests add DATA, EXEC, MANIFEST (nested
+  Manifest, possibly gzip-compressed) and IGNORE (path that isn't verified)
+  entries. Every file under a GLEP 74 Manifest has to be listed or ignored.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+
+#include <cportage.h>
+
+#include "blake2b.h"
+#include "error.h"
+#include "repository.h"
+#include "strings.h"
+
+/** Files are read and hashed in chunks of this size */
+#define READ_CHUNK_SIZE (1024 * 1024)
+
+/** Read buffers are page-aligned */
+#define READ_ALIGNMENT 4096
+
+enum entry_type {
+    ENTRY_DIST,
+    ENTRY_EBUILD,
+    ENTRY_AUX,
+    ENTRY_MISC,
+    ENTRY_DATA,
+    ENTRY_EXEC,
+    ENTRY_MANIFEST,
+    ENTRY_IGNORE
+};
+
+/*@unchecked@*/ static const char * const entry_types[] = {
+    "DIST", "EBUILD", "AUX", "MISC", "DATA", "EXEC", "MANIFEST", "IGNORE"
+};
+
+/** Supported digests, other ones are ignored */
+enum entry_hash {
+    /* Computed with GChecksum */
+    HASH_SHA256,
+    HASH_SHA512,
+    /* Computed in-tree */
+    HASH_BLAKE2B,
+    N_HASHES
+};
+
+#define N_CHECKSUMS HASH_BLAKE2B
+
+/*@unchecked@*/ static const char * const hash_names[N_HASHES] = {
+    "SHA256", "SHA512", "BLAKE2B"
+};
+
+/*@unchecked@*/ static const GChecksumType hash_checksums[N_CHECKSUMS] = {
+    G_CHECKSUM_SHA256, G_CHECKSUM_SHA512
+};
+
+struct manifest_entry {
+    enum entry_type type;
+    /** Path relative to Manifest directory, or distfile name */
+    /*@only@*/ char *name;
+    guint64 size;
+    /** Lowercase hex digests, %NULL if not listed */
+    /*@only@*/ /*@null@*/ char *digests[N_HASHES];
+};
+
+struct CPManifestS {
+    /*@only@*/ GPtrArray/*<struct manifest_entry>*/ *entries;
+    /** Distfile name->entry map */
+    /*@only@*/ GHashTable/*<char *, struct manifest_entry>*/ *dist;
+};
+
+static void
+entry_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct manifest_entry *entry = data;
+    guint i;
+
+    for (i = 0; i < N_HASHES; ++i) {
+        g_free(entry->digests[i]);
+    }
+    g_free(entry->name);
+    g_free(entry);
+}
+
+/**
+ * Adds entry described by \a line to \a self. Lines of unknown types
+ * (TIMESTAMP, for example) are skipped.
+ *
+ * \return %FALSE if \a line is malformed
+ */
+static gboolean
+parse_line(CPManifest self, const char *line) /*@modifies *self@*/ {
+    char **tokens = cp_strings_pysplit(line);
+    guint n_tokens = g_strv_length(tokens);
+    struct manifest_entry *entry;
+    gboolean result = TRUE;
+    char *end;
+    guint type;
+    guint i;
+    guint hash;
+
+    for (type = 0; type < G_N_ELEMENTS(entry_types); ++type) {
+        if (n_tokens > 0 && strcmp(tokens[0], entry_types[type]) == 0) {
+            break;
+        }
+    }
+
+    if (type == G_N_ELEMENTS(entry_types)) {
+        goto OUT;
+    }
+
+    /* Ignored paths only have a name */
+    if (type == (guint)ENTRY_IGNORE) {
+        result = n_tokens == 2;
+        if (result) {
+            entry = g_new0(struct manifest_entry, 1);
+            entry->type = ENTRY_IGNORE;
+            entry->name = g_strdup(tokens[1]);
+            g_ptr_array_add(self->entries, entry);
+        }
+        goto OUT;
+    }
+
+    /* Name, size and digest pairs */
+    if (n_tokens < 3 || n_tokens % 2 == 0 || !g_ascii_isdigit(tokens[2][0])) {
+        result = FALSE;
+        goto OUT;
+    }
+
+    entry = g_new0(struct manifest_entry, 1);
+    entry->type = (enum entry_type)type;
+    entry->name = entry->type == ENTRY_AUX
+        ? g_build_filename("files", tokens[1], NULL)
+        : g_strdup(tokens[1]);
+    entry->size = g_ascii_strtoull(tokens[2], &end, 10);
+    result = *end == '\0';
+
+    for (i = 3; result && tokens[i] != NULL; i += 2) {
+        for (hash = 0; hash < N_HASHES; ++hash) {
+            if (strcmp(tokens[i], hash_names[hash]) == 0) {
+                g_free(entry->digests[hash]);
+                entry->digests[hash] = g_ascii_strdown(tokens[i + 1], -1);
+            }
+        }
+    }
+
+    if (!result) {
+        entry_free(entry);
+        goto OUT;
+    }
+
+    g_ptr_array_add(self->entries, entry);
+    if (entry->type == ENTRY_DIST) {
+        g_hash_table_insert(self->dist, entry->name, entry);
+    }
+
+OUT:
+    g_strfreev(tokens);
+    return result;
+}
+
+/**
+ * Reads lines of gzip-compressed file at \a path.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      a %NULL-terminated string array or %NULL if an error
+ *              occurred, free it using g_strfreev()
+ */
+static /*@null@*/ char **
+read_gz_lines(
+    const char *path,
+    /*@null@*/ GError **error
+) /*@modifies *error,errno@*/ /*@globals fileSystem@*/ {
+    GFile *file = g_file_new_for_path(path);
+    GFileInputStream *raw;
+    GZlibDecompressor *decompressor;
+    GInputStream *stream;
+    GString *data;
+    char buffer[8192];
+    gssize len;
+    char **result = NULL;
+
+    g_assert(error == NULL || *error == NULL);
+
+    raw = g_file_read(file, NULL, error);
+    g_object_unref(file);
+    if (raw == NULL) {
+        return NULL;
+    }
+
+    decompressor = g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+    stream = g_converter_input_stream_new(
+        G_INPUT_STREAM(raw), G_CONVERTER(decompressor)
+    );
+    data = g_string_new("");
+
+    while ((len = g_input_stream_read(stream, buffer, sizeof(buffer), NULL, error)) > 0) {
+        (void)g_string_append_len(data, buffer, len);
+    }
+    if (len == 0) {
+        result = cp_string_lines(data->str, FALSE);
+    } else {
+        g_prefix_error(error, _("Can't read '%s': "), path);
+    }
+
+    (void)g_string_free(data, TRUE);
+    g_object_unref(stream);
+    g_object_unref(decompressor);
+    g_object_unref(raw);
+    return result;
+}
+
+CPManifest
+cp_manifest_new(const char *path, GError **error) {
+    CPManifest self;
+    gboolean armor_headers = FALSE;
+    char **lines;
+
+    g_assert(error == NULL || *error == NULL);
+
+    lines = g_str_has_suffix(path, ".gz")
+        ? read_gz_lines(path, error)
+        : cp_io_getlines(path, FALSE, error);
+    if (lines == NULL) {
+        return NULL;
+    }
+
+    self = g_new(struct CPManifestS, 1);
+    self->entries = g_ptr_array_new_with_free_func(entry_free);
+    self->dist = g_hash_table_new(g_str_hash, g_str_equal);
+
+    CP_STRV_ITER(lines, line) {
+        /* Signed Manifests are wrapped into OpenPGP cleartext signature */
+        if (strcmp(line, "-----BEGIN PGP SIGNED MESSAGE-----") == 0) {
+            armor_headers = TRUE;
+            continue;
+        }
+        if (armor_headers && strchr(line, ':') != NULL) {
+            continue;
+        }
+        armor_headers = FALSE;
+        if (strcmp(line, "-----BEGIN PGP SIGNATURE-----") == 0) {
+            break;
+        }
+
+        if (!parse_line(self, g_str_has_prefix(line, "- ") ? line + 2 : line)) {
+            g_set_error(error, CP_ERROR, (gint)CP_ERROR_MANIFEST_SYNTAX,
+                _("%s: invalid Manifest entry '%s'"), path, line);
+            cp_manifest_destroy(self);
+            self = NULL;
+            break;
+        }
+    } end_CP_STRV_ITER
+
+    g_strfreev(lines);
+    return self;
+}
+
+void
+cp_manifest_destroy(CPManifest self) {
+    if (self == NULL) {
+        return;
+    }
+
+    g_hash_table_destroy(self->dist);
+    g_ptr_array_unref(self->entries);
+    g_free(self);
+}
+
+/*@unchecked@*/ static GPrivate read_buffer = G_PRIVATE_INIT(free);
+
+/**
+ * \return per-thread read buffer of #READ_CHUNK_SIZE bytes or %NULL
+ *         if it couldn't be allocated
+ */
+static /*@null@*/ /*@dependent@*/ char *
+get_read_buffer(void) /*@globals read_buffer@*/ /*@modifies read_buffer@*/ {
+    void *buffer = g_private_get(&read_buffer);
+
+    if (buffer == NULL) {
+        if (posix_memalign(&buffer, READ_ALIGNMENT, READ_CHUNK_SIZE) != 0) {
+            return NULL;
+        }
+        g_private_set(&read_buffer, buffer);
+    }
+
+    return buffer;
+}
+
+/**
+ * Reads file at \a path once, feeding every digest listed in \a entry.
+ * Entries without supported digests never match: size alone
+ * doesn't prove anything.
+ *
+ * \return %TRUE if size and all digests of the file match \a entry
+ */
+static gboolean
+verify_file(
+    const char *path,
+    const struct manifest_entry *entry
+) /*@modifies errno@*/ /*@globals fileSystem,read_buffer@*/ {
+    static const char hex_digits[] = "0123456789abcdef";
+    GChecksum *checksums[N_CHECKSUMS];
+    CPBlake2b blake2b;
+    guint8 digest[CP_BLAKE2B_DIGEST_SIZE];
+    char hex[CP_BLAKE2B_DIGEST_SIZE * 2 + 1];
+    gboolean result = FALSE;
+    gboolean any = FALSE;
+    guint64 size = 0;
+    ssize_t len;
+    char *buffer;
+    guint i;
+    int fd;
+
+    buffer = get_read_buffer();
+    if (buffer == NULL) {
+        return FALSE;
+    }
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return FALSE;
+    }
+#if HAVE_POSIX_FADVISE
+    (void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    for (i = 0; i < N_CHECKSUMS; ++i) {
+        checksums[i] = entry->digests[i] == NULL
+            ? NULL : g_checksum_new(hash_checksums[i]);
+    }
+    cp_blake2b_init(&blake2b);
+
+    for (;;) {
+        len = read(fd, buffer, READ_CHUNK_SIZE);
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            break;
+        }
+
+        size += (guint64)len;
+        if (size > entry->size) {
+            break;
+        }
+
+        for (i = 0; i < N_CHECKSUMS; ++i) {
+            if (checksums[i] != NULL) {
+                g_checksum_update(checksums[i], (const guchar *)buffer, (gssize)len);
+            }
+        }
+        if (entry->digests[HASH_BLAKE2B] != NULL) {
+            cp_blake2b_update(&blake2b, buffer, (size_t)len);
+        }
+    }
+
+    if (len < 0 || size != entry->size) {
+        goto OUT;
+    }
+
+    result = TRUE;
+    for (i = 0; i < N_CHECKSUMS; ++i) {
+        if (checksums[i] != NULL) {
+            any = TRUE;
+            result = result
+                && strcmp(g_checksum_get_string(checksums[i]), entry->digests[i]) == 0;
+        }
+    }
+    if (entry->digests[HASH_BLAKE2B] != NULL) {
+        cp_blake2b_final(&blake2b, digest);
+        for (i = 0; i < CP_BLAKE2B_DIGEST_SIZE; ++i) {
+            hex[i * 2] = hex_digits[digest[i] >> 4];
+            hex[i * 2 + 1] = hex_digits[digest[i] & 0xf];
+        }
+        hex[CP_BLAKE2B_DIGEST_SIZE * 2] = '\0';
+        any = TRUE;
+        result = result && strcmp(hex, entry->digests[HASH_BLAKE2B]) == 0;
+    }
+    result = result && any;
+
+OUT:
+    for (i = 0; i < N_CHECKSUMS; ++i) {
+        if (checksums[i] != NULL) {
+            g_checksum_free(checksums[i]);
+        }
+    }
+    (void)close(fd);
+    return result;
+}
+
+/** Verification task: a single file and its Manifest entry. */
+struct verify_job {
+    /*@only@*/ char *path;
+    /** Reported if verification fails */
+    /*@only@*/ char *name;
+    /*@dependent@*/ const struct manifest_entry *entry;
+};
+
+/** State shared between verification jobs. */
+struct verify_data {
+    /** Guards everything below */
+    GMutex lock;
+    /*@only@*/ GSList/*<char *>*/ *failed;
+};
+
+static void
+add_failure(
+    struct verify_data *ctx,
+    /*@only@*/ char *name
+) /*@modifies *ctx@*/ {
+    g_mutex_lock(&ctx->lock);
+    ctx->failed = g_slist_prepend(ctx->failed, name);
+    g_mutex_unlock(&ctx->lock);
+}
+
+static void
+verify_job(
+    /*@only@*/ void *data,
+    void *user_data
+) /*@modifies *user_data,errno@*/ /*@globals fileSystem,read_buffer@*/ {
+    struct verify_job *job = data;
+
+    if (!verify_file(job->path, job->entry)) {
+        add_failure(user_data, job->name);
+        job->name = NULL;
+    }
+
+    g_free(job->name);
+    g_free(job->path);
+    g_free(job);
+}
+
+/**
+ * Pushes job verifying file \a name under \a root against \a entry.
+ */
+static void
+push_job(
+    GThreadPool *pool,
+    const char *root,
+    /*@only@*/ char *name,
+    const struct manifest_entry *entry
+) /*@modifies *pool@*/ {
+    struct verify_job *job = g_new(struct verify_job, 1);
+
+    job->path = g_build_filename(root, name, NULL);
+    job->name = name;
+    job->entry = entry;
+    /* Pool owns its threads, so pushing can't fail */
+    (void)g_thread_pool_push(pool, job, NULL);
+}
+
+gboolean
+cp_manifest_verify_distfiles(
+    const CPManifest self,
+    const char *distdir,
+    const char * const *files,
+    guint jobs,
+    GSList **failed,
+    GError **error
+) {
+    struct verify_data ctx;
+    GThreadPool *pool;
+    guint i;
+
+    g_assert(error == NULL || *error == NULL);
+    g_assert(jobs > 0);
+
+    *failed = NULL;
+
+    g_mutex_init(&ctx.lock);
+    ctx.failed = NULL;
+
+    pool = g_thread_pool_new(verify_job, &ctx, (gint)jobs, TRUE, error);
+    if (pool == NULL) {
+        g_mutex_clear(&ctx.lock);
+        return FALSE;
+    }
+
+    if (files == NULL) {
+        for (i = 0; i < self->entries->len; ++i) {
+            const struct manifest_entry *entry = g_ptr_array_index(self->entries, i);
+
+            if (entry->type == ENTRY_DIST) {
+                push_job(pool, distdir, g_strdup(entry->name), entry);
+            }
+        }
+    } else {
+        for (i = 0; files[i] != NULL; ++i) {
+            const struct manifest_entry *entry =
+                g_hash_table_lookup(self->dist, files[i]);
+
+            if (entry == NULL) {
+                add_failure(&ctx, g_strdup(files[i]));
+            } else {
+                push_job(pool, distdir, g_strdup(files[i]), entry);
+            }
+        }
+    }
+
+    g_thread_pool_free(pool, FALSE, TRUE);
+
+    *failed = g_slist_sort(ctx.failed, (GCompareFunc)strcmp);
+    g_mutex_clear(&ctx.lock);
+    return TRUE;
+}
+
+/** State of repository verification. */
+struct repo_verify {
+    /*@observer@*/ const char *root;
+    /*@only@*/ GThreadPool *pool;
+    struct verify_data data;
+    /** Parsed Manifests, their entries are referenced by pushed jobs */
+    /*@only@*/ GPtrArray/*<CPManifest>*/ *manifests;
+    /**
+     * Paths relative to repository root that are listed or ignored
+     * by GLEP 74 Manifests, %NULL if repository doesn't use them
+     */
+    /*@only@*/ /*@null@*/ GHashTable/*<char *>*/ *covered;
+    /**
+     * Names of binary caches cportage may write into repository,
+     * they are never listed by Manifests
+     */
+    /*@only@*/ char *own_files[2];
+};
+
+/**
+ * Pushes jobs for entries of Manifest at \a rel_path relative
+ * to repository root. Nested Manifests are descended into,
+ * compressed ones included.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean
+push_manifest(
+    struct repo_verify *ctx,
+    const char *rel_path,
+    /*@null@*/ GError **error
+) /*@modifies *ctx,*error,errno@*/ /*@globals fileSystem@*/ {
+    char *path = g_build_filename(ctx->root, rel_path, NULL);
+    char *rel_dir = g_path_get_dirname(rel_path);
+    CPManifest manifest = cp_manifest_new(path, error);
+    gboolean result = manifest != NULL;
+    guint i;
+
+    g_free(path);
+    if (manifest == NULL) {
+        goto OUT;
+    }
+    g_ptr_array_add(ctx->manifests, manifest);
+
+    for (i = 0; result && i < manifest->entries->len; ++i) {
+        const struct manifest_entry *entry = g_ptr_array_index(manifest->entries, i);
+        char *entry_path;
+
+        /* Distfiles are verified before unpacking, not after sync */
+        if (entry->type == ENTRY_DIST) {
+            continue;
+        }
+
+        entry_path = strcmp(rel_dir, ".") == 0
+            ? g_strdup(entry->name)
+            : g_build_filename(rel_dir, entry->name, NULL);
+        if (ctx->covered != NULL) {
+            g_hash_table_add(ctx->covered, g_strdup(entry_path));
+        }
+        if (entry->type == ENTRY_IGNORE) {
+            g_free(entry_path);
+            continue;
+        }
+        if (entry->type == ENTRY_MANIFEST) {
+            result = push_manifest(ctx, entry_path, error);
+        }
+        push_job(ctx->pool, ctx->root, entry_path, entry);
+    }
+
+OUT:
+    g_free(rel_dir);
+    return result;
+}
+
+/**
+ * Reports files under \a rel_dir that no Manifest lists or ignores.
+ * Names starting with a dot are skipped, GLEP 74 excludes them.
+ */
+static void
+find_unlisted(
+    struct repo_verify *ctx,
+    const char *rel_dir
+) /*@modifies *ctx,errno@*/ /*@globals fileSystem@*/ {
+    char *path = g_build_filename(ctx->root, rel_dir, NULL);
+    GDir *dir = g_dir_open(path, 0, NULL);
+
+    g_assert(ctx->covered != NULL);
+
+    g_free(path);
+    /* Missing listed files are reported by their jobs */
+    if (dir == NULL) {
+        return;
+    }
+
+    CP_GDIR_ITER(dir, name) {
+        char *rel_path;
+
+        if (name[0] == '.') {
+            continue;
+        }
+
+        if (strcmp(name, ctx->own_files[0]) == 0
+                || strcmp(name, ctx->own_files[1]) == 0) {
+            continue;
+        }
+
+        rel_path = rel_dir[0] == '\0'
+            ? g_strdup(name)
+            : g_build_filename(rel_dir, name, NULL);
+        if (g_hash_table_contains(ctx->covered, rel_path)) {
+            g_free(rel_path);
+            continue;
+        }
+
+        path = g_build_filename(ctx->root, rel_path, NULL);
+        if (!g_file_test(path, G_FILE_TEST_IS_SYMLINK)
+                && g_file_test(path, G_FILE_TEST_IS_DIR)) {
+            find_unlisted(ctx, rel_path);
+            g_free(rel_path);
+        } else {
+            add_failure(&ctx->data, rel_path);
+        }
+        g_free(path);
+    } end_CP_GDIR_ITER
+
+    g_dir_close(dir);
+}
+
+/**
+ * Pushes jobs for Manifests of all packages in repository
+ * without top-level Manifest.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean
+push_packages(
+    struct repo_verify *ctx,
+    /*@null@*/ GError **error
+) /*@modifies *ctx,*error,errno@*/ /*@globals fileSystem@*/ {
+    char *path = g_build_filename(ctx->root, "profiles", "categories", NULL);
+    char **categories = cp_io_getlines(path, TRUE, NULL);
+    gboolean result = TRUE;
+
+    g_free(path);
+    /* Repository has no packages */
+    if (categories == NULL) {
+        return TRUE;
+    }
+
+    CP_STRV_ITER(categories, category) {
+        char *cat_path = g_build_filename(ctx->root, category, NULL);
+        GDir *dir = g_dir_open(cat_path, 0, NULL);
+
+        g_free(cat_path);
+        if (dir == NULL) {
+            continue;
+        }
+
+        CP_GDIR_ITER(dir, pn) {
+            char *rel_path = g_build_filename(category, pn, "Manifest", NULL);
+            char *manifest_path = g_build_filename(ctx->root, rel_path, NULL);
+
+            if (g_file_test(manifest_path, G_FILE_TEST_IS_REGULAR)) {
+                result = push_manifest(ctx, rel_path, error);
+            }
+
+            g_free(manifest_path);
+            g_free(rel_path);
+            if (!result) {
+                break;
+            }
+        } end_CP_GDIR_ITER
+
+        g_dir_close(dir);
+        if (!result) {
+            break;
+        }
+    } end_CP_STRV_ITER
+
+    g_strfreev(categories);
+    return result;
+}
+
+gboolean
+cp_repository_verify(
+    const CPRepository self,
+    guint jobs,
+    GSList **failed,
+    GError **error
+) {
+    struct repo_verify ctx;
+    gboolean result = FALSE;
+    char *path;
+
+    g_assert(error == NULL || *error == NULL);
+    g_assert(jobs > 0);
+
+    *failed = NULL;
+
+    if (cp_repository_is_snapshot(self)) {
+        g_debug("Not verifying snapshot %s", cp_repository_path(self));
+        return TRUE;
+    }
+
+    ctx.root = cp_repository_path(self);
+    g_mutex_init(&ctx.data.lock);
+    ctx.data.failed = NULL;
+    ctx.manifests = g_ptr_array_new_with_free_func((GDestroyNotify)cp_manifest_destroy);
+    ctx.covered = NULL;
+    /* See CPORTAGE_PORTTREE_CACHE_DIR */
+    ctx.own_files[0] = g_strconcat(cp_repository_name(self), ".cache", NULL);
+    ctx.own_files[1] = g_strconcat(cp_repository_name(self), ".scan-cache", NULL);
+
+    ctx.pool = g_thread_pool_new(verify_job, &ctx.data, (gint)jobs, TRUE, error);
+    if (ctx.pool == NULL) {
+        goto OUT;
+    }
+
+    path = g_build_filename(ctx.root, "Manifest", NULL);
+    if (g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+        ctx.covered = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        g_hash_table_add(ctx.covered, g_strdup("Manifest"));
+        result = push_manifest(&ctx, "Manifest", error);
+    } else {
+        /* Package Manifests are thin, they don't list everything */
+        result = push_packages(&ctx, error);
+    }
+    g_free(path);
+
+    /* Files are walked while pool verifies listed ones */
+    if (result && ctx.covered != NULL) {
+        find_unlisted(&ctx, "");
+    }
+
+    /* Jobs that were already pushed reference parsed Manifests */
+    g_thread_pool_free(ctx.pool, FALSE, TRUE);
+
+    if (result) {
+        *failed = g_slist_sort(ctx.data.failed, (GCompareFunc)strcmp);
+        ctx.data.failed = NULL;
+    }
+
+OUT:
+    g_slist_free_full(ctx.data.failed, g_free);
+    if (ctx.covered != NULL) {
+        g_hash_table_destroy(ctx.covered);
+    }
+    g_ptr_array_unref(ctx.manifests);
+    g_free(ctx.own_files[0]);
+    g_free(ctx.own_files[1]);
+    g_mutex_clear(&ctx.data.lock);
+    return result;
+}
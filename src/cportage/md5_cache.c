@@ -0,0 +1,349 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  md5-cache entries consist of KEY=VALUE lines, one per metadata key.
+  Keys that are empty are omitted.
+ */
+
+#include <string.h>
+
+#include "atom.h"
+#include "md5_cache.h"
+
+guint
+cp_md5_cache_scan(
+    const char *data,
+    size_t length,
+    const char * const *keys,
+    guint n_keys,
+    CPMd5CacheValue *values
+) {
+    const char *end = data + length;
+    const char *line = data;
+    guint found = 0;
+    guint i;
+
+    for (i = 0; i < n_keys; ++i) {
+        values[i].str = NULL;
+        values[i].len = 0;
+    }
+
+    while (line < end && found < n_keys) {
+        const char *eol = memchr(line, '\n', (size_t)(end - line));
+        const char *eq;
+
+        if (eol == NULL) {
+            eol = end;
+        }
+
+        eq = memchr(line, '=', (size_t)(eol - line));
+        if (eq != NULL) {
+            size_t key_len = (size_t)(eq - line);
+
+            for (i = 0; i < n_keys; ++i) {
+                if (values[i].str == NULL
+                        && strncmp(keys[i], line, key_len) == 0
+                        && keys[i][key_len] == '\0') {
+                    values[i].str = eq + 1;
+                    values[i].len = (size_t)(eol - eq - 1);
+                    ++found;
+                    break;
+                }
+            }
+        }
+
+        line = eol + 1;
+    }
+
+    return found;
+}
+
+gboolean
+cp_md5_cache_read(
+    const CPRepository repo,
+    const char *path,
+    const char * const *keys,
+    guint n_keys,
+    char **values,
+    GError **error
+) {
+    GBytes *bytes;
+    CPMd5CacheValue *found;
+    gsize length;
+    const char *data;
+    guint i;
+
+    g_assert(error == NULL || *error == NULL);
+
+    bytes = cp_repository_read(repo, path, error);
+    if (bytes == NULL) {
+        return FALSE;
+    }
+
+    data = g_bytes_get_data(bytes, &length);
+    found = g_new(CPMd5CacheValue, n_keys);
+    (void)cp_md5_cache_scan(data, length, keys, n_keys, found);
+
+    for (i = 0; i < n_keys; ++i) {
+        values[i] = found[i].str == NULL
+            ? NULL : g_strndup(found[i].str, found[i].len);
+    }
+
+    g_free(found);
+    g_bytes_unref(bytes);
+    return TRUE;
+}
+
+/** Validation task: an md5-cache category of a repository. */
+struct validate_job {
+    guint repo;
+    /*@only@*/ char *name;
+};
+
+/** State shared between validation jobs. */
+struct validate_data {
+    /*@dependent@*/ const GPtrArray/*<CPRepository>*/ *repos;
+    /*@dependent@*/ CPEclassIndex eclasses;
+
+    /** Guards everything below */
+    GMutex lock;
+    /*@only@*/ GSList/*<char *>*/ *stale;
+    /** First error that occurred, remaining jobs are skipped after it */
+    /*@null@*/ GError *error;
+};
+
+char *
+cp_md5_cache_digest(const CPRepository repo, const char *path) {
+    GBytes *bytes = cp_repository_read(repo, path, NULL);
+    const char *contents;
+    gsize length;
+    char *result;
+
+    if (bytes == NULL) {
+        return NULL;
+    }
+
+    /* Empty files have no contents */
+    contents = g_bytes_get_data(bytes, &length);
+    result = g_compute_checksum_for_data(G_CHECKSUM_MD5,
+        (const guchar *)(contents == NULL ? "" : contents), length);
+
+    g_bytes_unref(bytes);
+    return result;
+}
+
+/**
+ * \return %TRUE if \a eclasses value of _eclasses_ key (name and digest
+ *         pairs separated by tabs) matches current eclasses of \a repo
+ */
+static gboolean
+eclasses_valid(
+    const struct validate_data *ctx,
+    guint repo,
+    const char *eclasses
+) /*@modifies errno@*/ /*@globals fileSystem@*/ {
+    char **items = g_strsplit(eclasses, "\t", -1);
+    gboolean result = g_strv_length(items) % 2 == 0;
+    guint i;
+
+    for (i = 0; result && items[i] != NULL; i += 2) {
+        const char *digest = cp_eclass_index_digest(ctx->eclasses, repo, items[i]);
+
+        result = digest != NULL && g_ascii_strcasecmp(digest, items[i + 1]) == 0;
+    }
+
+    g_strfreev(items);
+    return result;
+}
+
+static void
+validate_category_job(
+    /*@only@*/ void *data,
+    void *user_data
+) /*@modifies *user_data,errno@*/ /*@globals fileSystem@*/ {
+    static const char * const keys[] = { "_md5_", "_eclasses_" };
+    struct validate_job *job = data;
+    struct validate_data *ctx = user_data;
+    CPRepository repo = g_ptr_array_index(ctx->repos, job->repo);
+    GSList *stale = NULL;
+    GError *error = NULL;
+    gboolean failed;
+    char *path;
+    char **entries;
+
+    g_mutex_lock(&ctx->lock);
+    failed = ctx->error != NULL;
+    g_mutex_unlock(&ctx->lock);
+    if (failed) {
+        goto OUT;
+    }
+
+    path = g_build_filename("metadata", "md5-cache", job->name, NULL);
+    entries = cp_repository_list(repo, path, &error);
+    if (entries == NULL) {
+        g_free(path);
+        goto OUT;
+    }
+
+    CP_STRV_ITER(entries, pf) {
+        char *values[G_N_ELEMENTS(keys)];
+        char *entry_path;
+        char *ebuild_path;
+        char *ebuild;
+        char *digest = NULL;
+        char *name;
+        CPVersion version;
+        gboolean valid;
+
+        /* Skips temporary files left by cache generator too */
+        if (!cp_atom_pv_split(pf, &name, &version, NULL)) {
+            continue;
+        }
+        cp_version_unref(version);
+
+        entry_path = g_build_filename(path, pf, NULL);
+        valid = cp_md5_cache_read(
+            repo, entry_path, keys, G_N_ELEMENTS(keys), values, NULL
+        );
+        g_free(entry_path);
+
+        if (valid) {
+            ebuild = g_strconcat(pf, ".ebuild", NULL);
+            ebuild_path = g_build_filename(job->name, name, ebuild, NULL);
+            digest = cp_md5_cache_digest(repo, ebuild_path);
+            g_free(ebuild_path);
+            g_free(ebuild);
+
+            valid = digest != NULL && values[0] != NULL
+                && g_ascii_strcasecmp(digest, values[0]) == 0
+                && eclasses_valid(ctx, job->repo, values[1] == NULL ? "" : values[1]);
+
+            g_free(values[0]);
+            g_free(values[1]);
+        }
+
+        if (!valid) {
+            stale = g_slist_prepend(stale, g_strdup_printf(
+                "%s/%s::%s", job->name, pf, cp_repository_name(repo)
+            ));
+        }
+
+        g_free(digest);
+        g_free(name);
+    } end_CP_STRV_ITER
+
+    g_strfreev(entries);
+    g_free(path);
+
+OUT:
+    g_mutex_lock(&ctx->lock);
+    if (error != NULL && ctx->error == NULL) {
+        ctx->error = error;
+        error = NULL;
+    }
+    ctx->stale = g_slist_concat(stale, ctx->stale);
+    g_mutex_unlock(&ctx->lock);
+
+    if (error != NULL) {
+        g_error_free(error);
+    }
+    g_free(job->name);
+    g_free(job);
+}
+
+/**
+ * Pushes a job for every md5-cache category of every repository.
+ * Missing directories are skipped.
+ */
+static void
+push_jobs(
+    GThreadPool *pool,
+    const GPtrArray/*<CPRepository>*/ *repos
+) /*@modifies *pool,errno@*/ /*@globals fileSystem@*/ {
+    guint repo;
+
+    for (repo = 0; repo < repos->len; ++repo) {
+        char *path = g_build_filename("metadata", "md5-cache", NULL);
+        char **names = cp_repository_list(
+            g_ptr_array_index(repos, repo), path, NULL
+        );
+
+        g_free(path);
+        if (names == NULL) {
+            continue;
+        }
+
+        CP_STRV_ITER(names, name) {
+            struct validate_job *job = g_new0(struct validate_job, 1);
+
+            job->repo = repo;
+            job->name = g_strdup(name);
+            /* Pool owns its threads, so pushing can't fail */
+            (void)g_thread_pool_push(pool, job, NULL);
+        } end_CP_STRV_ITER
+
+        g_strfreev(names);
+    }
+}
+
+gboolean
+cp_md5_cache_validate(
+    const GPtrArray *repos,
+    CPEclassIndex eclasses,
+    guint jobs,
+    GSList **stale,
+    GError **error
+) {
+    struct validate_data ctx;
+    GThreadPool *pool;
+    gboolean result = TRUE;
+
+    g_assert(error == NULL || *error == NULL);
+    g_assert(repos->len > 0);
+
+    *stale = NULL;
+
+    ctx.repos = repos;
+    ctx.eclasses = eclasses;
+    g_mutex_init(&ctx.lock);
+    ctx.stale = NULL;
+    ctx.error = NULL;
+
+    pool = g_thread_pool_new(validate_category_job, &ctx, (gint)jobs, TRUE, error);
+    if (pool == NULL) {
+        result = FALSE;
+        goto OUT;
+    }
+    push_jobs(pool, repos);
+    g_thread_pool_free(pool, FALSE, TRUE);
+
+    if (ctx.error != NULL) {
+        g_propagate_error(error, ctx.error);
+        result = FALSE;
+    } else {
+        *stale = g_slist_sort(ctx.stale, (GCompareFunc)strcmp);
+        ctx.stale = NULL;
+    }
+
+OUT:
+    g_slist_free_full(ctx.stale, g_free);
+    g_mutex_clear(&ctx.lock);
+    return result;
+}
@@ -0,0 +1,113 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Reader of metadata/md5-cache entries. */
+
+#ifndef CP_MD5_CACHE_H
+#define CP_MD5_CACHE_H
+
+#include <cportage.h>
+
+#include "eclass_index.h"
+#include "repository.h"
+
+/*@-exportany@*/
+
+/**
+ * Value of a single key in md5-cache entry. Points into entry contents
+ * and isn't NUL-terminated.
+ */
+typedef struct CPMd5CacheValue {
+    /*@dependent@*/ /*@null@*/ const char *str;
+    size_t len;
+} CPMd5CacheValue;
+
+/**
+ * Scans md5-cache entry \a data of \a length bytes for \a n_keys \a keys.
+ * Only requested keys are looked at, scanning stops as soon as all of them
+ * are found.
+ *
+ * \param values return location for \a n_keys values, missing keys
+ *               get %NULL \c str
+ * \return       number of found keys
+ */
+guint
+cp_md5_cache_scan(
+    const char *data,
+    size_t length,
+    const char * const *keys,
+    guint n_keys,
+    /*@out@*/ CPMd5CacheValue *values
+) /*@modifies *values@*/;
+
+/**
+ * Reads md5-cache entry at \a path relative to \a repo and extracts
+ * \a n_keys \a keys from it with cp_md5_cache_scan().
+ *
+ * \param values return location for \a n_keys newly allocated values,
+ *               %NULL for missing keys. Only set on success.
+ * \param error  return location for a %GError, or %NULL
+ * \return       %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_md5_cache_read(
+    const CPRepository repo,
+    const char *path,
+    const char * const *keys,
+    guint n_keys,
+    /*@out@*/ char **values,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *values,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * \return newly allocated hex MD5 digest of contents of \a path relative
+ *         to \a repo, as stored in _md5_ and _eclasses_ keys, or %NULL
+ *         if it can't be read
+ */
+/*@null@*/ char *
+cp_md5_cache_digest(
+    const CPRepository repo,
+    const char *path
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT /*@modifies errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Checks md5-cache entries of \a repos against ebuilds and eclasses they
+ * were generated from. Categories are checked by a pool of \a jobs
+ * threads, eclasses are resolved through \a eclasses, which must have
+ * been created from \a repos and refreshed. Each eclass is hashed once
+ * and its digest is kept in \a eclasses for later calls.
+ *
+ * \param stale return location for sorted list of "category/pf::repo"
+ *              strings of entries whose ebuild or any inherited eclass
+ *              changed or is gone, free it using g_slist_free_full()
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_md5_cache_validate(
+    const GPtrArray/*<CPRepository>*/ *repos,
+    CPEclassIndex eclasses,
+    guint jobs,
+    /*@out@*/ GSList/*<char *>*/ **stale,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *eclasses,*stale,*error,errno@*/ /*@globals fileSystem@*/;
+
+#endif
@@ -0,0 +1,847 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Owners index file layout (all integers are in host byte order):
+
+  struct owners_header;
+  struct owners_package[header.n_packages], sorted by id;
+  struct owners_entry[header.n_entries], sorted by path, then by package;
+  char strings[header.strings_size], NUL-terminated strings.
+
+  Sorted entries allow both exact lookups and directory lookups, since all
+  paths below a directory form a contiguous range. Same layout is used for
+  in-memory index when it can't be written to disk.
+ */
+
+#include <sys/stat.h>
+
+#include <string.h>
+
+#include "atom.h"
+#include "io.h"
+#include "strings.h"
+
+#define OWNERS_MAGIC "CPOWNIDX"
+#define OWNERS_VERSION 1
+#define OWNERS_BYTE_ORDER 0x01020304
+
+struct owners_header {
+    char magic[8];
+    guint32 version;
+    guint32 byte_order;
+    guint32 n_packages;
+    guint32 n_entries;
+    guint32 strings_size;
+    guint32 reserved;
+};
+
+struct owners_package {
+    /** "category/pv" */
+    guint32 id;
+    guint32 reserved;
+    /** Modification time of package vdb directory */
+    guint64 mtime_sec;
+    guint64 mtime_nsec;
+};
+
+struct owners_entry {
+    guint32 path;
+    guint32 package;
+};
+
+struct CPOwnersS {
+    /*@refs@*/ unsigned int refs;
+
+    /** Either mapped index file or %NULL if index lives in \a buffer */
+    /*@only@*/ /*@null@*/ GMappedFile *file;
+    /*@only@*/ /*@null@*/ char *buffer;
+    gsize length;
+    /** Where \a buffer is written by cp_owners_save(), %NULL if not needed */
+    /*@only@*/ /*@null@*/ char *save_path;
+
+    /*@dependent@*/ const struct owners_header *header;
+    /*@dependent@*/ const struct owners_package *packages;
+    /*@dependent@*/ const struct owners_entry *entries;
+    /** Not const only to be storable in lists, never modified */
+    /*@dependent@*/ char *strings;
+};
+
+static /*@null@*/ /*@observer@*/ const char *
+get_string(const CPOwners self, guint32 offset) /*@*/ {
+    if (offset >= self->header->strings_size) {
+        return NULL;
+    }
+    return &self->strings[offset];
+}
+
+static gboolean
+check_index(const CPOwners self) /*@*/ {
+    const char *prev = NULL;
+    guint32 i;
+
+    if (self->strings[self->header->strings_size - 1] != '\0') {
+        return FALSE;
+    }
+
+    for (i = 0; i < self->header->n_packages; ++i) {
+        const char *id = get_string(self, self->packages[i].id);
+
+        /* Binary search relies on ordering */
+        if (id == NULL || (prev != NULL && strcmp(prev, id) >= 0)) {
+            return FALSE;
+        }
+        prev = id;
+    }
+
+    prev = NULL;
+    for (i = 0; i < self->header->n_entries; ++i) {
+        const char *path = get_string(self, self->entries[i].path);
+
+        if (path == NULL
+                || self->entries[i].package >= self->header->n_packages
+                || (prev != NULL && strcmp(prev, path) > 0)) {
+            return FALSE;
+        }
+        prev = path;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Sets up pointers of \a self to index \a data.
+ *
+ * \return %TRUE if \a data is a valid index, %FALSE otherwise
+ */
+static gboolean
+init_index(
+    CPOwners self,
+    /*@dependent@*/ /*@null@*/ char *data,
+    gsize length
+) /*@modifies *self@*/ {
+    guint64 expected;
+
+    if (data == NULL || length < sizeof(*self->header)) {
+        return FALSE;
+    }
+
+    /*@-dependenttrans@*/
+    self->header = (const void *)data;
+    /*@=dependenttrans@*/
+    if (memcmp(self->header->magic, OWNERS_MAGIC, sizeof(self->header->magic)) != 0
+            || self->header->version != OWNERS_VERSION
+            || self->header->byte_order != OWNERS_BYTE_ORDER) {
+        return FALSE;
+    }
+
+    expected = sizeof(*self->header)
+        + (guint64)self->header->n_packages * sizeof(*self->packages)
+        + (guint64)self->header->n_entries * sizeof(*self->entries)
+        + self->header->strings_size;
+    if (expected != length || self->header->strings_size == 0) {
+        return FALSE;
+    }
+
+    /*@-dependenttrans@*/
+    self->packages = (const void *)&data[sizeof(*self->header)];
+    self->entries = (const void *)&self->packages[self->header->n_packages];
+    self->strings = &data[sizeof(*self->header)
+        + self->header->n_packages * sizeof(*self->packages)
+        + self->header->n_entries * sizeof(*self->entries)];
+    /*@=dependenttrans@*/
+
+    return check_index(self);
+}
+
+static /*@null@*/ CPOwners
+open_index(const char *path) /*@modifies errno@*/ /*@globals fileSystem@*/ {
+    CPOwners self;
+    GError *error = NULL;
+    GMappedFile *file;
+
+    file = g_mapped_file_new(path, FALSE, &error);
+    if (file == NULL) {
+        g_debug("Can't load owners index: %s", error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    self = g_new0(struct CPOwnersS, 1);
+    self->refs = (unsigned int)1;
+    self->file = file;
+
+    if (!init_index(
+            self,
+            g_mapped_file_get_contents(file),
+            g_mapped_file_get_length(file))) {
+        g_debug("Owners index '%s' is corrupt, ignoring it", path);
+        cp_owners_unref(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+static /*@null@*/ /*@dependent@*/ const struct owners_package *
+find_package(const CPOwners self, const char *id) /*@*/ {
+    guint32 lo = 0;
+    guint32 hi = self->header->n_packages;
+
+    while (lo < hi) {
+        guint32 mid = lo + (hi - lo) / 2;
+        /* Checked in init_index */
+        int cmp = strcmp(&self->strings[self->packages[mid].id], id);
+
+        if (cmp == 0) {
+            return &self->packages[mid];
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * \return index of first entry whose path isn't less than \a path
+ */
+static guint32
+lower_bound(const CPOwners self, const char *path) /*@*/ {
+    guint32 lo = 0;
+    guint32 hi = self->header->n_entries;
+
+    while (lo < hi) {
+        guint32 mid = lo + (hi - lo) / 2;
+
+        if (strcmp(&self->strings[self->entries[mid].path], path) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/** Installed package as seen during vdb scan. */
+struct vdb_package {
+    /*@only@*/ char *id;
+    CPTimestamp mtime;
+};
+
+static void
+vdb_package_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct vdb_package *pkg = data;
+
+    g_free(pkg->id);
+    g_free(pkg);
+}
+
+static gint
+vdb_package_cmp(const void *a, const void *b) /*@*/ {
+    const struct vdb_package * const *pa = a;
+    const struct vdb_package * const *pb = b;
+
+    return strcmp((*pa)->id, (*pb)->id);
+}
+
+static void
+scan_category(
+    const char *vdb_path,
+    const char *category,
+    GPtrArray *into
+) /*@modifies *into,errno@*/ /*@globals fileSystem@*/ {
+    char *cat_path = g_build_filename(vdb_path, category, NULL);
+    GDir *cat_dir = g_dir_open(cat_path, 0, NULL);
+
+    g_free(cat_path);
+    if (cat_dir == NULL) {
+        return;
+    }
+
+    CP_GDIR_ITER(cat_dir, pv) {
+        struct vdb_package *pkg;
+        char *pkg_path;
+        struct stat st;
+        char *name;
+        CPVersion version;
+
+        if (!cp_atom_pv_split(pv, &name, &version, NULL)) {
+            continue;
+        }
+        g_free(name);
+        cp_version_unref(version);
+
+        pkg_path = g_build_filename(vdb_path, category, pv, NULL);
+        if (stat(pkg_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            g_free(pkg_path);
+            continue;
+        }
+        g_free(pkg_path);
+
+        pkg = g_new0(struct vdb_package, 1);
+        pkg->id = g_strconcat(category, "/", pv, NULL);
+        pkg->mtime.sec = (guint64)st.st_mtim.tv_sec;
+        pkg->mtime.nsec = (guint64)st.st_mtim.tv_nsec;
+        g_ptr_array_add(into, pkg);
+    } end_CP_GDIR_ITER
+
+    g_dir_close(cat_dir);
+}
+
+/**
+ * Lists all packages in vdb at \a vdb_path with modification times
+ * of their directories.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      array of vdb_package sorted by id or %NULL if an error occurred
+ */
+static /*@null@*/ GPtrArray *
+scan_vdb(
+    const char *vdb_path,
+    /*@null@*/ GError **error
+) /*@modifies *error,errno@*/ /*@globals fileSystem@*/ {
+    GPtrArray *result;
+    GDir *vdb_dir;
+
+    g_assert(error == NULL || *error == NULL);
+
+    vdb_dir = g_dir_open(vdb_path, 0, error);
+    if (vdb_dir == NULL) {
+        return NULL;
+    }
+
+    result = g_ptr_array_new_with_free_func(vdb_package_free);
+
+    CP_GDIR_ITER(vdb_dir, category) {
+        if (cp_atom_category_validate(category, NULL)) {
+            scan_category(vdb_path, category, result);
+        }
+    } end_CP_GDIR_ITER
+
+    g_dir_close(vdb_dir);
+
+    g_ptr_array_sort(result, vdb_package_cmp);
+    return result;
+}
+
+/**
+ * \return %TRUE if \a index has entries for exactly \a packages
+ *         with same modification times
+ */
+static gboolean
+index_up_to_date(
+    const CPOwners index,
+    const GPtrArray *packages
+) /*@*/ {
+    guint i;
+
+    if (index->header->n_packages != packages->len) {
+        return FALSE;
+    }
+
+    for (i = 0; i < packages->len; ++i) {
+        const struct vdb_package *pkg = g_ptr_array_index(packages, i);
+        const struct owners_package *record = &index->packages[i];
+
+        if (strcmp(&index->strings[record->id], pkg->id) != 0
+                || record->mtime_sec != pkg->mtime.sec
+                || record->mtime_nsec != pkg->mtime.nsec) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+struct owners_builder {
+    /*@dependent@*/ GArray/*<struct owners_package>*/ *packages;
+    /*@dependent@*/ GArray/*<struct owners_entry>*/ *entries;
+    /*@dependent@*/ GString *strings;
+    /** String->(offset + 1) map, used to deduplicate strings */
+    /*@dependent@*/ GHashTable *offsets;
+};
+
+static guint32
+intern_string(
+    struct owners_builder *builder,
+    const char *str,
+    size_t len
+) /*@modifies *builder@*/ {
+    char *key = g_strndup(str, len);
+    gsize offset = GPOINTER_TO_UINT(g_hash_table_lookup(builder->offsets, key));
+
+    if (offset == 0) {
+        offset = builder->strings->len;
+        (void)g_string_append_len(builder->strings, key, (gssize)len + 1);
+        g_hash_table_insert(builder->offsets, key, GUINT_TO_POINTER(offset + 1));
+    } else {
+        g_free(key);
+        --offset;
+    }
+
+    return (guint32)offset;
+}
+
+static void
+add_entry(
+    struct owners_builder *builder,
+    guint32 package,
+    const char *path,
+    size_t len
+) /*@modifies *builder@*/ {
+    struct owners_entry entry;
+
+    /* Paths are absolute and normalized without trailing slash */
+    while (len > 1 && path[len - 1] == '/') {
+        --len;
+    }
+    if (len == 0 || path[0] != '/') {
+        return;
+    }
+
+    entry.path = intern_string(builder, path, len);
+    entry.package = package;
+    (void)g_array_append_val(builder->entries, entry);
+}
+
+/**
+ * Parses CONTENTS of package \a id and adds its entries to \a builder.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+read_contents(
+    struct owners_builder *builder,
+    const char *vdb_path,
+    const char *id,
+    guint32 package,
+    /*@null@*/ GError **error
+) /*@modifies *builder,*error,errno@*/ /*@globals fileSystem@*/ {
+    char *path = g_build_filename(vdb_path, id, "CONTENTS", NULL);
+    GError *read_error = NULL;
+    char *data = NULL;
+    char *line;
+    char *next;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!g_file_get_contents(path, &data, NULL, &read_error)) {
+        g_free(path);
+        /* Packages without files (virtuals) may have no CONTENTS */
+        if (g_error_matches(read_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            g_error_free(read_error);
+            return TRUE;
+        }
+        g_propagate_error(error, read_error);
+        return FALSE;
+    }
+    g_free(path);
+
+    for (line = data; line != NULL && *line != '\0'; line = next) {
+        char *end;
+
+        next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+
+        if (g_str_has_prefix(line, "obj ")) {
+            /* obj <path> <md5> <mtime> */
+            line += 4;
+            end = strrchr(line, ' ');
+            if (end != NULL) {
+                *end = '\0';
+                end = strrchr(line, ' ');
+            }
+        } else if (g_str_has_prefix(line, "sym ")) {
+            /* sym <path> -> <target> <mtime> */
+            line += 4;
+            end = strstr(line, " -> ");
+        } else if (g_str_has_prefix(line, "dir ")
+                || g_str_has_prefix(line, "dev ")
+                || g_str_has_prefix(line, "fif ")) {
+            line += 4;
+            end = line + strlen(line);
+        } else {
+            continue;
+        }
+
+        if (end != NULL) {
+            add_entry(builder, package, line, (size_t)(end - line));
+        }
+    }
+
+    g_free(data);
+    return TRUE;
+}
+
+static gint
+entry_cmp(const void *a, const void *b, void *user_data) /*@*/ {
+    const struct owners_entry *ea = a;
+    const struct owners_entry *eb = b;
+    const GString *strings = user_data;
+    int result = strcmp(&strings->str[ea->path], &strings->str[eb->path]);
+
+    if (result != 0) {
+        return result;
+    }
+    return ea->package < eb->package ? -1 : ea->package > eb->package ? 1 : 0;
+}
+
+/**
+ * Builds index for \a packages, reusing data from \a old for packages
+ * that didn't change.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      serialized index or %NULL if an error occurred
+ */
+static /*@null@*/ GString *
+build_index(
+    const char *vdb_path,
+    const GPtrArray *packages,
+    /*@null@*/ const CPOwners old,
+    /*@null@*/ GError **error
+) /*@modifies *error,errno@*/ /*@globals fileSystem@*/ {
+    struct owners_builder builder;
+    struct owners_header header;
+    /* Old package index -> its first entry in old_entries */
+    guint32 *old_first = NULL;
+    guint32 *old_entries = NULL;
+    GString *result = NULL;
+    guint i;
+
+    g_assert(error == NULL || *error == NULL);
+
+    builder.packages = g_array_new(FALSE, FALSE, sizeof(struct owners_package));
+    builder.entries = g_array_new(FALSE, FALSE, sizeof(struct owners_entry));
+    builder.strings = g_string_new("");
+    builder.offsets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    if (old != NULL) {
+        /* Group old entries by package with a counting sort */
+        guint32 *pos = g_new0(guint32, old->header->n_packages + 1);
+        guint32 j;
+
+        old_first = g_new0(guint32, old->header->n_packages + 1);
+        old_entries = g_new(guint32, old->header->n_entries);
+
+        for (j = 0; j < old->header->n_entries; ++j) {
+            ++old_first[old->entries[j].package + 1];
+        }
+        for (j = 0; j < old->header->n_packages; ++j) {
+            old_first[j + 1] += old_first[j];
+            pos[j] = old_first[j];
+        }
+        for (j = 0; j < old->header->n_entries; ++j) {
+            old_entries[pos[old->entries[j].package]++] = j;
+        }
+
+        g_free(pos);
+    }
+
+    for (i = 0; i < packages->len; ++i) {
+        const struct vdb_package *pkg = g_ptr_array_index(packages, i);
+        const struct owners_package *old_pkg = NULL;
+        struct owners_package record;
+
+        memset(&record, 0, sizeof(record));
+        record.id = intern_string(&builder, pkg->id, strlen(pkg->id));
+        record.mtime_sec = pkg->mtime.sec;
+        record.mtime_nsec = pkg->mtime.nsec;
+        (void)g_array_append_val(builder.packages, record);
+
+        if (old != NULL) {
+            old_pkg = find_package(old, pkg->id);
+        }
+
+        if (old_pkg != NULL
+                && old_pkg->mtime_sec == pkg->mtime.sec
+                && old_pkg->mtime_nsec == pkg->mtime.nsec) {
+            guint32 old_index = (guint32)(old_pkg - old->packages);
+            guint32 j;
+
+            g_assert(old_first != NULL && old_entries != NULL);
+
+            for (j = old_first[old_index]; j < old_first[old_index + 1]; ++j) {
+                const char *path = &old->strings[old->entries[old_entries[j]].path];
+                add_entry(&builder, (guint32)i, path, strlen(path));
+            }
+            continue;
+        }
+
+        if (!read_contents(&builder, vdb_path, pkg->id, (guint32)i, error)) {
+            goto OUT;
+        }
+    }
+
+    g_array_sort_with_data(builder.entries, entry_cmp, builder.strings);
+
+    /* Index with empty strings table is invalid */
+    if (builder.strings->len == 0) {
+        (void)g_string_append_c(builder.strings, '\0');
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, OWNERS_MAGIC, sizeof(header.magic));
+    header.version = OWNERS_VERSION;
+    header.byte_order = OWNERS_BYTE_ORDER;
+    header.n_packages = builder.packages->len;
+    header.n_entries = builder.entries->len;
+    header.strings_size = (guint32)builder.strings->len;
+
+    result = g_string_new_len((const char *)&header, (gssize)sizeof(header));
+    (void)g_string_append_len(
+        result,
+        builder.packages->data,
+        (gssize)(builder.packages->len * sizeof(struct owners_package))
+    );
+    (void)g_string_append_len(
+        result,
+        builder.entries->data,
+        (gssize)(builder.entries->len * sizeof(struct owners_entry))
+    );
+    (void)g_string_append_len(result, builder.strings->str, (gssize)builder.strings->len);
+
+OUT:
+    g_free(old_first);
+    g_free(old_entries);
+    (void)g_array_free(builder.packages, TRUE);
+    (void)g_array_free(builder.entries, TRUE);
+    (void)g_string_free(builder.strings, TRUE);
+    cp_hash_table_destroy(builder.offsets);
+
+    return result;
+}
+
+CPOwners
+cp_owners_new(const CPSettings settings, const CPVartree vartree, GError **error) {
+    const char *vdb_path = cp_vartree_path(vartree);
+    gboolean persistent;
+    char *index_path;
+    CPOwners old;
+    CPOwners self = NULL;
+    GPtrArray *packages;
+    GString *data;
+
+    g_assert(error == NULL || *error == NULL);
+
+    persistent = cp_string_truth(
+        cp_settings_get_default(settings, "CPORTAGE_VARTREE_INDEX", "false")
+    ) == CP_TRUE;
+    index_path = g_strconcat(vdb_path, ".cportage-owners", NULL);
+    old = persistent ? open_index(index_path) : NULL;
+
+    packages = scan_vdb(vdb_path, error);
+    if (packages == NULL) {
+        goto OUT;
+    }
+
+    if (old != NULL && index_up_to_date(old, packages)) {
+        self = old;
+        old = NULL;
+        goto OUT;
+    }
+
+    data = build_index(vdb_path, packages, old, error);
+    if (data == NULL) {
+        goto OUT;
+    }
+
+    self = g_new0(struct CPOwnersS, 1);
+    self->refs = (unsigned int)1;
+    self->length = data->len;
+    g_assert(self->buffer == NULL);
+    self->buffer = g_string_free(data, FALSE);
+    if (persistent) {
+        g_assert(self->save_path == NULL);
+        self->save_path = index_path;
+        index_path = NULL;
+    }
+
+    /* Just built, so it must be valid */
+    if (!init_index(self, self->buffer, self->length)) {
+        g_assert_not_reached();
+    }
+
+OUT:
+    if (packages != NULL) {
+        (void)g_ptr_array_free(packages, TRUE);
+    }
+    cp_owners_unref(old);
+    g_free(index_path);
+
+    return self;
+}
+
+CPOwners
+cp_owners_ref(CPOwners self) {
+    ++self->refs;
+    /*@-refcounttrans@*/
+    return self;
+    /*@=refcounttrans@*/
+}
+
+void
+cp_owners_unref(CPOwners self) {
+    /*@-mustfreeonly@*/
+    if (self == NULL) {
+        return;
+    }
+
+    g_assert(self->refs > 0);
+    if (--self->refs > 0) {
+        return;
+    }
+    /*@=mustfreeonly@*/
+
+    if (self->file != NULL) {
+        g_mapped_file_unref(self->file);
+    }
+    g_free(self->buffer);
+    g_free(self->save_path);
+
+    /*@-refcounttrans@*/
+    g_free(self);
+    /*@=refcounttrans@*/
+}
+
+gboolean
+cp_owners_save(CPOwners self, GError **error) {
+    g_assert(error == NULL || *error == NULL);
+
+    if (self->save_path == NULL) {
+        return TRUE;
+    }
+
+    g_assert(self->buffer != NULL);
+    if (!g_file_set_contents(
+            self->save_path, self->buffer, (gssize)self->length, error)) {
+        return FALSE;
+    }
+
+    g_free(self->save_path);
+    self->save_path = NULL;
+    return TRUE;
+}
+
+/**
+ * \return list of package ids referenced by entries in [\a from, \a to)
+ */
+static /*@only@*/ GSList *
+collect_owners(const CPOwners self, guint32 from, guint32 to) /*@*/ {
+    gboolean *seen;
+    GSList *result = NULL;
+    guint32 i;
+
+    if (from >= to) {
+        return NULL;
+    }
+
+    seen = g_new0(gboolean, self->header->n_packages);
+    for (i = from; i < to; ++i) {
+        seen[self->entries[i].package] = TRUE;
+    }
+
+    /* Packages are sorted, so prepending in reverse gives sorted list */
+    for (i = self->header->n_packages; i > 0; --i) {
+        if (seen[i - 1]) {
+            /*@-dependenttrans@*/
+            result = g_slist_prepend(
+                result, &self->strings[self->packages[i - 1].id]
+            );
+            /*@=dependenttrans@*/
+        }
+    }
+
+    g_free(seen);
+    return result;
+}
+
+/**
+ * \return \a path without trailing slashes, free it using g_free()
+ */
+static /*@only@*/ char *
+normalize_path(const char *path) /*@*/ {
+    size_t len = strlen(path);
+
+    while (len > 1 && path[len - 1] == '/') {
+        --len;
+    }
+
+    return g_strndup(path, len);
+}
+
+GSList *
+cp_owners_find(const CPOwners self, const char *path) {
+    char *key = normalize_path(path);
+    guint32 from = lower_bound(self, key);
+    guint32 to = from;
+    GSList *result;
+
+    while (to < self->header->n_entries
+            && strcmp(&self->strings[self->entries[to].path], key) == 0) {
+        ++to;
+    }
+
+    result = collect_owners(self, from, to);
+
+    g_free(key);
+    return result;
+}
+
+GSList *
+cp_owners_find_dir(const CPOwners self, const char *dir) {
+    char *key = normalize_path(dir);
+    char *prefix;
+    size_t prefix_len;
+    GSList *result;
+    GSList *own;
+    guint32 from;
+    guint32 to;
+
+    prefix = strcmp(key, "/") == 0 ? g_strdup(key) : g_strconcat(key, "/", NULL);
+    prefix_len = strlen(prefix);
+
+    from = lower_bound(self, prefix);
+    to = from;
+    while (to < self->header->n_entries
+            && strncmp(&self->strings[self->entries[to].path], prefix, prefix_len) == 0) {
+        ++to;
+    }
+
+    result = collect_owners(self, from, to);
+
+    /* Directory itself sorts apart from its contents, merge its owners in */
+    own = cp_owners_find(self, key);
+    CP_GSLIST_ITER(own, id) {
+        if (g_slist_find_custom(result, id, (GCompareFunc)strcmp) == NULL) {
+            result = g_slist_insert_sorted(result, id, (GCompareFunc)strcmp);
+        }
+    } end_CP_GSLIST_ITER
+    g_slist_free(own);
+
+    g_free(prefix);
+    g_free(key);
+    return result;
+}
@@ -30,8 +30,10 @@ struct CPPackageS {
     /*@only@*/ char *subslot;
     /*@only@*/ char *repo;
     /*@only@*/ char *str;
+    CPEapi eapi;
 
-    /*@refs@*/ unsigned int refs;
+    /** Changed atomically, packages are shared by vartree snapshots */
+    /*@refs@*/ gint refs;
 };
 
 static void
@@ -53,12 +55,13 @@ cp_package_new(
     const char *name,
     CPVersion version,
     const char *slot,
-    const char *repo
+    const char *repo,
+    CPEapi eapi
 ) {
     CPPackage self;
 
     self = g_new0(struct CPPackageS, 1);
-    self->refs = (unsigned int)1;
+    self->refs = 1;
 
     /* TODO: validate args or make function private */
     g_assert(self->category == NULL);
@@ -72,13 +75,14 @@ cp_package_new(
     self->repo = g_strdup(repo);
     g_assert(self->str == NULL);
     self->str = g_strdup_printf("%s/%s-%s", category, name, cp_version_str(version));
+    self->eapi = eapi;
 
     return self;
 }
 
 CPPackage
 cp_package_ref(CPPackage self) {
-    ++self->refs;
+    g_atomic_int_inc(&self->refs);
     /*@-refcounttrans@*/
     return self;
     /*@=refcounttrans@*/
@@ -91,8 +95,8 @@ cp_package_unref(CPPackage self) {
         return;
     }
 
-    g_assert(self->refs > 0);
-    if (--self->refs > 0) {
+    g_assert(g_atomic_int_get(&self->refs) > 0);
+    if (!g_atomic_int_dec_and_test(&self->refs)) {
         return;
     }
     /*@=mustfreeonly@*/
@@ -144,6 +148,11 @@ cp_package_repo(const CPPackage self) {
     return self->repo;
 }
 
+CPEapi
+cp_package_eapi(const CPPackage self) {
+    return self->eapi;
+}
+
 int
 cp_package_cmp(const CPPackage first, const CPPackage second) {
     int result;
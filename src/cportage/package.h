@@ -35,7 +35,8 @@ cp_package_new(
     const char *name,
     CPVersion version,
     const char *slot,
-    const char *repo
+    const char *repo,
+    CPEapi eapi
 ) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT /*@modifies version@*/;
 
 #endif
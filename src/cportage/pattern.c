@@ -0,0 +1,179 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "error.h"
+#include "pattern.h"
+
+/** Characters allowed in category and package names */
+#define NAME_CHARS \
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789+_.-"
+
+struct pattern_part {
+    CPPatternKind kind;
+    /*@only@*/ char *prefix;
+    /** Compiled glob, only for #CP_PATTERN_GLOB */
+    /*@only@*/ /*@null@*/ GPatternSpec *spec;
+};
+
+struct CPPatternS {
+    struct pattern_part category;
+    struct pattern_part package;
+};
+
+static gboolean
+part_init(
+    /*@out@*/ struct pattern_part *part,
+    const char *value
+) /*@modifies *part@*/ {
+    size_t plain = strspn(value, NAME_CHARS);
+
+    part->spec = NULL;
+
+    if (value[0] == '\0' || strspn(value, NAME_CHARS "*?") != strlen(value)) {
+        part->prefix = NULL;
+        return FALSE;
+    }
+
+    part->prefix = g_strndup(value, plain);
+
+    if (value[plain] == '\0') {
+        part->kind = CP_PATTERN_EXACT;
+    } else if (strcmp(value, "*") == 0) {
+        part->kind = CP_PATTERN_ANY;
+    } else if (strcmp(&value[plain], "*") == 0) {
+        part->kind = CP_PATTERN_PREFIX;
+    } else {
+        part->kind = CP_PATTERN_GLOB;
+        part->spec = g_pattern_spec_new(value);
+    }
+
+    return TRUE;
+}
+
+static void
+part_clear(struct pattern_part *part) /*@modifies *part@*/ {
+    g_free(part->prefix);
+    if (part->spec != NULL) {
+        g_pattern_spec_free(part->spec);
+    }
+}
+
+static gboolean
+part_matches(const struct pattern_part *part, const char *value) /*@*/ {
+    switch (part->kind) {
+        case CP_PATTERN_EXACT:
+            return strcmp(part->prefix, value) == 0;
+        case CP_PATTERN_ANY:
+            return TRUE;
+        case CP_PATTERN_PREFIX:
+            return g_str_has_prefix(value, part->prefix);
+        case CP_PATTERN_GLOB:
+            g_assert(part->spec != NULL);
+            return g_pattern_match_string(part->spec, value);
+        default:
+            g_assert_not_reached();
+    }
+
+    return FALSE;
+}
+
+CPPattern
+cp_pattern_new(const char *value, GError **error) {
+    CPPattern self;
+    const char *slash;
+    gboolean valid;
+
+    g_assert(error == NULL || *error == NULL);
+
+    self = g_new0(struct CPPatternS, 1);
+
+    slash = strchr(value, '/');
+    if (slash == NULL) {
+        valid = part_init(&self->category, "*")
+            && part_init(&self->package, value);
+    } else {
+        char *category = g_strndup(value, (gsize)(slash - value));
+        valid = part_init(&self->category, category)
+            && part_init(&self->package, slash + 1);
+        g_free(category);
+    }
+
+    if (!valid) {
+        g_set_error(error, CP_ERROR, (gint)CP_ERROR_ATOM_SYNTAX,
+            _("'%s': invalid package pattern"), value);
+        cp_pattern_destroy(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+void
+cp_pattern_destroy(CPPattern self) {
+    if (self == NULL) {
+        /*@-mustfreeonly@*/
+        return;
+        /*@=mustfreeonly@*/
+    }
+
+    part_clear(&self->category);
+    part_clear(&self->package);
+
+    /*@-refcounttrans@*/
+    g_free(self);
+    /*@=refcounttrans@*/
+}
+
+gboolean
+cp_pattern_matches(const CPPattern self, const CPPackage package) {
+    return part_matches(&self->category, cp_package_category(package))
+        && part_matches(&self->package, cp_package_name(package));
+}
+
+CPPatternKind
+cp_pattern_category_kind(const CPPattern self) {
+    return self->category.kind;
+}
+
+const char *
+cp_pattern_category_prefix(const CPPattern self) {
+    return self->category.prefix;
+}
+
+gboolean
+cp_pattern_category_matches(const CPPattern self, const char *category) {
+    return part_matches(&self->category, category);
+}
+
+CPPatternKind
+cp_pattern_package_kind(const CPPattern self) {
+    return self->package.kind;
+}
+
+const char *
+cp_pattern_package_prefix(const CPPattern self) {
+    return self->package.prefix;
+}
+
+gboolean
+cp_pattern_package_matches(const CPPattern self, const char *package) {
+    return part_matches(&self->package, package);
+}
@@ -0,0 +1,79 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CP_PATTERN_H
+#define CP_PATTERN_H
+
+#include <cportage.h>
+
+/*@-exportany@*/
+
+/**
+ * How a single part (category or package name) of #CPPattern matches.
+ */
+typedef enum {
+    /** Part is a plain name */
+    CP_PATTERN_EXACT,
+    /** Part is "*" */
+    CP_PATTERN_ANY,
+    /** Part is a plain prefix followed by "*" */
+    CP_PATTERN_PREFIX,
+    /** Part is a plain prefix followed by arbitrary wildcards */
+    CP_PATTERN_GLOB
+} CPPatternKind;
+
+/**
+ * \return kind of category part of \a self
+ */
+CPPatternKind
+cp_pattern_category_kind(const CPPattern self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return readonly category name for #CP_PATTERN_EXACT, text before first
+ *         wildcard otherwise
+ */
+/*@observer@*/ const char *
+cp_pattern_category_prefix(const CPPattern self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+gboolean
+cp_pattern_category_matches(
+    const CPPattern self,
+    const char *category
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return kind of package name part of \a self
+ */
+CPPatternKind
+cp_pattern_package_kind(const CPPattern self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return readonly package name for #CP_PATTERN_EXACT, text before first
+ *         wildcard otherwise
+ */
+/*@observer@*/ const char *
+cp_pattern_package_prefix(const CPPattern self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+gboolean
+cp_pattern_package_matches(
+    const CPPattern self,
+    const char *package
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+#endif
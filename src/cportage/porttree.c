@@ -0,0 +1,1613 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "atom.h"
+#include "eapi.h"
+#include "md5_cache.h"
+#include "package.h"
+#include "pattern.h"
+#include "porttree.h"
+#include "porttree_cache.h"
+#include "porttree_scan.h"
+#include "settings.h"
+#include "string_pool.h"
+#include "strings.h"
+#include "version.h"
+
+/** Single md5-cache entry, not parsed yet. */
+struct porttree_entry {
+    /** Index of repository in CPPorttreeS.repos */
+    guint repo;
+    /** Reference to pf in CPPorttreeS.strings */
+    CPStringRef pf;
+    /**
+     * Offset of entry record in CPPorttreeS.metadata plus one,
+     * 0 until md5-cache entry is read
+     */
+    guint32 metadata;
+    /** %NULL for entries loaded from binary cache until package is queried */
+    /*@only@*/ /*@null@*/ CPVersion version;
+    /** Index of entry in repository binary cache, -1 if it was listed */
+    gint cached;
+    /** Scanned ebuild of repository without md5-cache, %NULL otherwise */
+    /*@dependent@*/ /*@null@*/ const CPPorttreeScanEntry *scanned;
+};
+
+/** All ebuilds of a single package name in one category. */
+struct porttree_name {
+    /** md5-cache entries from all repositories */
+    /*@only@*/ GArray/*<struct porttree_entry>*/ *entries;
+    /**
+     * Packages sorted by version, entries of same version are ordered by
+     * repository priority. %NULL until package is queried.
+     */
+    /*@only@*/ /*@null@*/ GPtrArray/*<CPPackage>*/ *pkgs;
+};
+
+struct CPPorttreeS {
+    CPTree tree;
+
+    /** Repositories ordered by priority, ascending */
+    /*@only@*/ GPtrArray/*<CPRepository>*/ *repos;
+    /**
+     * Category->(package name->porttree_name) cache,
+     * %NULL values for categories that don't exist in any repository
+     */
+    /*@only@*/ GHashTable *categories;
+    /** %TRUE once md5-cache directories of all repositories were listed */
+    gboolean categories_listed;
+    /** Binary caches, one per repository, %NULL if caching is disabled */
+    /*@only@*/ /*@null@*/ GPtrArray/*<struct repo_cache>*/ *caches;
+    /** Directory of binary caches, %NULL if caching is disabled */
+    /*@only@*/ /*@null@*/ char *cache_dir;
+    /**
+     * Ebuild scanners, one per repository, %NULL for repositories
+     * that have md5-cache
+     */
+    /*@only@*/ GPtrArray/*<CPPorttreeScan>*/ *scans;
+    /** Number of threads that validate md5-cache or scan ebuilds */
+    guint jobs;
+    /** Eclasses of #repos, shared with settings */
+    /*@only@*/ CPEclassIndex eclasses;
+    /** Pfs and md5-cache keys and values of all entries */
+    /*@only@*/ CPStringPool strings;
+    /**
+     * Records of read md5-cache entries: number of keys followed
+     * by key and value references for each key
+     */
+    /*@only@*/ GArray/*<guint32>*/ *metadata;
+    /** Number of md5-cache entries kept in #metadata */
+    guint n_entries_read;
+    /** Total size of md5-cache entries kept in #metadata */
+    gsize metadata_read;
+};
+
+/** Binary metadata cache of a single repository. */
+struct repo_cache {
+    /*@only@*/ char *path;
+    /*@only@*/ /*@null@*/ CPPorttreeCache cache;
+    /** Category->loaded_category map of categories found in repository */
+    /*@only@*/ GHashTable *loaded;
+    /** %TRUE if some category wasn't up to date in cache */
+    gboolean dirty;
+};
+
+struct loaded_category {
+    /** Modification time of md5-cache directory of category */
+    CPTimestamp mtime;
+    /** %TRUE if category was listed instead of being read from cache */
+    gboolean listed;
+};
+
+/** Keys needed to create #CPPackage */
+static const char * const package_keys[] = { "EAPI", "SLOT" };
+
+/**
+ * Keys stored in binary cache, dependency keys are in the same order
+ * as in cp_porttree_dep_keys
+ */
+static const char * const cache_keys[] = {
+    "EAPI", "SLOT", "KEYWORDS", "_md5_",
+    "DEPEND", "RDEPEND", "PDEPEND", "BDEPEND"
+};
+
+#define CACHE_KEY_DEPS 4
+
+static void
+porttree_name_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct porttree_name *name = data;
+    guint i;
+
+    for (i = 0; i < name->entries->len; ++i) {
+        struct porttree_entry *entry =
+            &g_array_index(name->entries, struct porttree_entry, i);
+        if (entry->version != NULL) {
+            cp_version_unref(entry->version);
+        }
+    }
+    (void)g_array_free(name->entries, TRUE);
+    if (name->pkgs != NULL) {
+        g_ptr_array_unref(name->pkgs);
+    }
+    g_free(name);
+}
+
+static void
+name2entries_free(/*@null@*/ /*@only@*/ void *data) /*@modifies data@*/ {
+    if (data != NULL) {
+        g_hash_table_unref(data);
+    }
+}
+
+static void
+repo_cache_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct repo_cache *cache = data;
+
+    g_free(cache->path);
+    cp_porttree_cache_destroy(cache->cache);
+    cp_hash_table_destroy(cache->loaded);
+    g_free(cache);
+}
+
+/**
+ * Orders entries by version, then by repository priority. Binary cache
+ * stores rank of every entry among ebuilds of the same package, so
+ * entries of the same repository are compared without parsing versions.
+ */
+static gint
+entry_cmp(const void *a, const void *b, void *user_data) /*@*/ {
+    const struct porttree_entry *entry_a = a;
+    const struct porttree_entry *entry_b = b;
+    const GPtrArray *caches = user_data;
+    int result;
+
+    if (entry_a->repo == entry_b->repo && entry_a->cached >= 0
+            && entry_b->cached >= 0) {
+        const struct repo_cache *cache = g_ptr_array_index(caches, entry_a->repo);
+        guint rank_a = cp_porttree_cache_rank(cache->cache, (guint)entry_a->cached);
+        guint rank_b = cp_porttree_cache_rank(cache->cache, (guint)entry_b->cached);
+
+        return rank_a < rank_b ? -1 : rank_a > rank_b;
+    }
+
+    result = cp_version_cmp(entry_a->version, entry_b->version);
+    if (result != 0) {
+        return result;
+    }
+    return entry_a->repo < entry_b->repo ? -1 : entry_a->repo > entry_b->repo;
+}
+
+/**
+ * \param mtime return location for modification time of \a path
+ *              relative to \a repo
+ * \return      %TRUE if \a path is a directory, %FALSE otherwise
+ */
+static gboolean
+stat_dir(
+    const CPRepository repo,
+    const char *path,
+    /*@out@*/ CPTimestamp *mtime
+) /*@modifies *mtime,errno@*/ /*@globals fileSystem@*/ {
+    gboolean is_dir;
+
+    if (!cp_repository_stat(repo, path, mtime, &is_dir) || !is_dir) {
+        mtime->sec = 0;
+        mtime->nsec = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static /*@dependent@*/ struct porttree_name *
+get_name(GHashTable *name2entries, const char *pkg_name) /*@modifies *name2entries@*/ {
+    struct porttree_name *name = g_hash_table_lookup(name2entries, pkg_name);
+
+    if (name == NULL) {
+        name = g_new0(struct porttree_name, 1);
+        name->entries = g_array_new(FALSE, FALSE, sizeof(struct porttree_entry));
+        g_hash_table_insert(name2entries, g_strdup(pkg_name), name);
+    }
+
+    return name;
+}
+
+/**
+ * Adds entries of \a category from binary cache of \a repo to
+ * \a name2entries if cache is up to date for directory modified at
+ * \a mtime.
+ */
+static gboolean
+load_cached_category(
+    CPPorttree self,
+    guint repo,
+    const char *category,
+    const CPTimestamp *mtime,
+    GHashTable *name2entries
+) /*@modifies *self,*name2entries@*/ {
+    struct repo_cache *cache;
+    struct loaded_category *loaded;
+    guint first;
+    guint n;
+    guint i;
+
+    if (self->caches == NULL) {
+        return FALSE;
+    }
+
+    cache = g_ptr_array_index(self->caches, repo);
+    if (cache->cache == NULL
+            || !cp_porttree_cache_get_category(cache->cache, category, mtime,
+                &first, &n)) {
+        return FALSE;
+    }
+
+    for (i = first; i < first + n; ++i) {
+        struct porttree_entry entry;
+        struct porttree_name *name =
+            get_name(name2entries, cp_porttree_cache_name(cache->cache, i));
+
+        const char *pf = cp_porttree_cache_pf(cache->cache, i);
+
+        entry.repo = repo;
+        entry.pf = cp_string_pool_intern(self->strings, pf, strlen(pf));
+        entry.metadata = 0;
+        entry.version = NULL;
+        entry.cached = (gint)i;
+        entry.scanned = NULL;
+        (void)g_array_append_val(name->entries, entry);
+    }
+
+    loaded = g_new0(struct loaded_category, 1);
+    loaded->mtime = *mtime;
+    loaded->listed = FALSE;
+    g_hash_table_insert(cache->loaded, g_strdup(category), loaded);
+    return TRUE;
+}
+
+/** Remembers that \a category was listed in \a repo. */
+static void
+category_listed(
+    CPPorttree self,
+    guint repo,
+    const char *category,
+    const CPTimestamp *mtime
+) /*@modifies *self@*/ {
+    struct repo_cache *cache;
+    struct loaded_category *loaded;
+
+    if (self->caches == NULL) {
+        return;
+    }
+
+    cache = g_ptr_array_index(self->caches, repo);
+    loaded = g_new0(struct loaded_category, 1);
+    loaded->mtime = *mtime;
+    loaded->listed = TRUE;
+    g_hash_table_insert(cache->loaded, g_strdup(category), loaded);
+    cache->dirty = TRUE;
+}
+
+/**
+ * Adds scanned ebuilds of \a category in \a repo to \a name2entries,
+ * creating it if needed.
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+load_scanned_category(
+    CPPorttree self,
+    guint repo,
+    const char *category,
+    GHashTable **name2entries,
+    /*@null@*/ GError **error
+) /*@modifies *self,*name2entries,*error,errno@*/ /*@globals fileSystem@*/ {
+    const GPtrArray *scanned;
+    guint i;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!cp_porttree_scan_get_category(g_ptr_array_index(self->scans, repo),
+            category, &scanned, error)) {
+        return FALSE;
+    }
+    if (scanned == NULL) {
+        return TRUE;
+    }
+
+    if (*name2entries == NULL) {
+        *name2entries = g_hash_table_new_full(
+            g_str_hash, g_str_equal, g_free, porttree_name_free
+        );
+    }
+
+    for (i = 0; i < scanned->len; ++i) {
+        const CPPorttreeScanEntry *ebuild = g_ptr_array_index(scanned, i);
+        struct porttree_entry entry;
+        struct porttree_name *name = get_name(*name2entries, ebuild->name);
+
+        entry.repo = repo;
+        entry.pf = cp_string_pool_intern(self->strings, ebuild->pf, strlen(ebuild->pf));
+        entry.metadata = 0;
+        entry.version = cp_version_ref(ebuild->version);
+        entry.cached = -1;
+        entry.scanned = ebuild;
+        (void)g_array_append_val(name->entries, entry);
+    }
+
+    return TRUE;
+}
+
+/**
+ * Lists md5-cache entries of \a category in all repositories,
+ * or scans its ebuilds in repositories without md5-cache.
+ * Nonexistent category is cached as %NULL.
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+load_category(
+    CPPorttree self,
+    const char *category,
+    /*@null@*/ GError **error
+) /*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/ {
+    GHashTable *name2entries = NULL;
+    guint repo;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!cp_atom_category_validate(category, NULL)) {
+        g_hash_table_insert(self->categories, g_strdup(category), NULL);
+        return TRUE;
+    }
+
+    for (repo = 0; repo < self->repos->len; ++repo) {
+        CPRepository repository = g_ptr_array_index(self->repos, repo);
+        char *path = g_build_filename("metadata", "md5-cache", category, NULL);
+        GError *tmp_error = NULL;
+        CPTimestamp mtime;
+        char **pfs;
+
+        if (g_ptr_array_index(self->scans, repo) != NULL) {
+            g_free(path);
+            if (!load_scanned_category(self, repo, category, &name2entries, error)) {
+                cp_hash_table_destroy(name2entries);
+                return FALSE;
+            }
+            continue;
+        }
+
+        /* Missing directory is reported by cp_repository_list() below */
+        if (stat_dir(repository, path, &mtime)) {
+            if (name2entries == NULL) {
+                name2entries = g_hash_table_new_full(
+                    g_str_hash, g_str_equal, g_free, porttree_name_free
+                );
+            }
+            if (load_cached_category(self, repo, category, &mtime, name2entries)) {
+                g_free(path);
+                continue;
+            }
+        }
+
+        pfs = cp_repository_list(repository, path, &tmp_error);
+        if (pfs == NULL) {
+            g_free(path);
+            if (g_error_matches(tmp_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)
+                    || g_error_matches(tmp_error, G_FILE_ERROR, G_FILE_ERROR_NOTDIR)) {
+                g_error_free(tmp_error);
+                continue;
+            }
+            g_propagate_error(error, tmp_error);
+            cp_hash_table_destroy(name2entries);
+            return FALSE;
+        }
+
+        if (name2entries == NULL) {
+            name2entries = g_hash_table_new_full(
+                g_str_hash, g_str_equal, g_free, porttree_name_free
+            );
+        }
+
+        CP_STRV_ITER(pfs, pf) {
+            struct porttree_entry entry;
+            struct porttree_name *name;
+            char *pkg_name;
+
+            /* Skips temporary files left by cache generator too */
+            if (!cp_atom_pv_split(pf, &pkg_name, &entry.version, NULL)) {
+                continue;
+            }
+
+            name = get_name(name2entries, pkg_name);
+            g_free(pkg_name);
+
+            entry.repo = repo;
+            entry.pf = cp_string_pool_intern(self->strings, pf, strlen(pf));
+            entry.metadata = 0;
+            entry.cached = -1;
+            entry.scanned = NULL;
+            (void)g_array_append_val(name->entries, entry);
+        } end_CP_STRV_ITER
+
+        g_strfreev(pfs);
+        g_free(path);
+        category_listed(self, repo, category, &mtime);
+    }
+
+    g_hash_table_insert(self->categories, g_strdup(category), name2entries);
+    return TRUE;
+}
+
+/**
+ * Reads whole md5-cache entry of \a entry in \a category into
+ * CPPorttreeS.metadata unless it was read already. Keys and values are
+ * interned, so repeated LICENSE, HOMEPAGE or eclass-generated DEPEND
+ * of different entries are stored once. Only entries of packages
+ * whose metadata was requested are kept this way.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+load_metadata(
+    CPPorttree self,
+    const char *category,
+    struct porttree_entry *entry,
+    /*@null@*/ GError **error
+) /*@modifies *self,*entry,*error,errno@*/ /*@globals fileSystem@*/ {
+    GBytes *bytes;
+    const char *line;
+    const char *end;
+    gsize length;
+    guint32 n_keys = 0;
+    guint start;
+    char *path;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (entry->metadata != 0) {
+        return TRUE;
+    }
+
+    path = g_build_filename("metadata", "md5-cache", category,
+        cp_string_pool_get(self->strings, entry->pf), NULL);
+    bytes = cp_repository_read(g_ptr_array_index(self->repos, entry->repo),
+        path, error);
+    g_free(path);
+    if (bytes == NULL) {
+        return FALSE;
+    }
+
+    /* Empty files have no contents */
+    line = g_bytes_get_data(bytes, &length);
+    if (line == NULL) {
+        line = "";
+    }
+    end = line + length;
+
+    start = self->metadata->len;
+    (void)g_array_append_val(self->metadata, n_keys);
+
+    while (line < end) {
+        const char *eol = memchr(line, '\n', (size_t)(end - line));
+        const char *eq;
+
+        if (eol == NULL) {
+            eol = end;
+        }
+
+        eq = memchr(line, '=', (size_t)(eol - line));
+        if (eq != NULL) {
+            CPStringRef refs[2];
+
+            refs[0] = cp_string_pool_intern(self->strings, line, (size_t)(eq - line));
+            refs[1] = cp_string_pool_intern(self->strings, eq + 1,
+                (size_t)(eol - eq - 1));
+            (void)g_array_append_vals(self->metadata, refs, G_N_ELEMENTS(refs));
+            ++n_keys;
+        }
+
+        line = eol + 1;
+    }
+
+    g_array_index(self->metadata, guint32, start) = n_keys;
+    ++self->n_entries_read;
+    self->metadata_read += length;
+    entry->metadata = start + 1;
+
+    g_bytes_unref(bytes);
+    return TRUE;
+}
+
+/**
+ * \return value of \a key in md5-cache entry of \a entry, which must have
+ *         been read by load_metadata(), or %NULL if entry doesn't have it
+ */
+static /*@observer@*/ /*@null@*/ const char *
+get_value(
+    const CPPorttree self,
+    const struct porttree_entry *entry,
+    const char *key
+) /*@*/ {
+    const guint32 *record;
+    CPStringRef key_ref;
+    guint32 i;
+
+    g_assert(entry->metadata != 0);
+
+    /* Key that was never interned isn't in any entry */
+    if (!cp_string_pool_lookup(self->strings, key, &key_ref)) {
+        return NULL;
+    }
+
+    record = &g_array_index(self->metadata, guint32, entry->metadata - 1);
+    for (i = 0; i < record[0]; ++i) {
+        if (record[1 + 2 * i] == key_ref) {
+            return cp_string_pool_get(self->strings, record[2 + 2 * i]);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Fills \a values of \a n_keys \a keys from md5-cache entry of \a entry.
+ * Entries kept by load_metadata() are served from memory, others are
+ * only scanned for \a keys and not kept.
+ *
+ * \param values return location for \a n_keys newly allocated values,
+ *               %NULL for missing keys. Only set on success.
+ * \param error  return location for a %GError, or %NULL
+ * \return       %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+read_values(
+    const CPPorttree self,
+    const char *category,
+    const struct porttree_entry *entry,
+    const char * const *keys,
+    guint n_keys,
+    /*@out@*/ char **values,
+    /*@null@*/ GError **error
+) /*@modifies *values,*error,errno@*/ /*@globals fileSystem@*/ {
+    char *path;
+    gboolean result;
+    guint i;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (entry->metadata != 0) {
+        for (i = 0; i < n_keys; ++i) {
+            values[i] = g_strdup(get_value(self, entry, keys[i]));
+        }
+        return TRUE;
+    }
+
+    path = g_build_filename("metadata", "md5-cache", category,
+        cp_string_pool_get(self->strings, entry->pf), NULL);
+    result = cp_md5_cache_read(g_ptr_array_index(self->repos, entry->repo),
+        path, keys, n_keys, values, error);
+
+    g_free(path);
+    return result;
+}
+
+/**
+ * Creates packages from md5-cache entries of \a name. Only EAPI and SLOT
+ * are read from listed entries with read_values(), so listing doesn't
+ * keep whole entries in memory. Entries found in binary cache or by
+ * scanning ebuilds aren't read at all. Entries with unsupported EAPI
+ * or without SLOT are skipped, they can't be installed anyway.
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+load_packages(
+    CPPorttree self,
+    const char *category,
+    const char *pkg_name,
+    struct porttree_name *name,
+    /*@null@*/ GError **error
+) /*@modifies *self,*name,*error,errno@*/ /*@globals fileSystem@*/ {
+    GPtrArray *pkgs;
+    guint i;
+
+    g_assert(error == NULL || *error == NULL);
+    g_assert(name->pkgs == NULL);
+
+    for (i = 0; i < name->entries->len; ++i) {
+        struct porttree_entry *entry =
+            &g_array_index(name->entries, struct porttree_entry, i);
+
+        if (entry->version == NULL) {
+            const struct repo_cache *cache =
+                g_ptr_array_index(self->caches, entry->repo);
+
+            entry->version = cp_version_new(
+                cp_porttree_cache_version(cache->cache, (guint)entry->cached), NULL
+            );
+            /* Cache only stores valid versions */
+            g_assert(entry->version != NULL);
+        }
+    }
+
+    g_array_sort_with_data(name->entries, entry_cmp, self->caches);
+    pkgs = g_ptr_array_new_with_free_func((GDestroyNotify)cp_package_unref);
+
+    for (i = 0; i < name->entries->len; ++i) {
+        struct porttree_entry *entry =
+            &g_array_index(name->entries, struct porttree_entry, i);
+        CPRepository repo = g_ptr_array_index(self->repos, entry->repo);
+        const char *pf = cp_string_pool_get(self->strings, entry->pf);
+        char *values[G_N_ELEMENTS(package_keys)];
+        const char *slot;
+        CPEapi eapi;
+
+        if (entry->scanned != NULL) {
+            /* Scanner only keeps ebuilds with valid SLOT and known EAPI */
+            g_ptr_array_add(pkgs, cp_package_new(category, pkg_name,
+                entry->version, entry->scanned->slot, cp_repository_name(repo),
+                entry->scanned->eapi));
+            continue;
+        }
+
+        if (entry->cached >= 0) {
+            const struct repo_cache *cache =
+                g_ptr_array_index(self->caches, entry->repo);
+
+            slot = cp_porttree_cache_slot(cache->cache, (guint)entry->cached);
+            eapi = cp_porttree_cache_eapi(cache->cache, (guint)entry->cached);
+            if (eapi == CP_EAPI_UNKNOWN || slot[0] == '\0'
+                    || !cp_atom_slot_validate(slot, eapi, NULL)) {
+                g_debug("Skipping cached entry '%s/%s': unsupported EAPI"
+                    " or invalid SLOT", category, pf);
+            } else {
+                g_ptr_array_add(pkgs, cp_package_new(category, pkg_name,
+                    entry->version, slot, cp_repository_name(repo), eapi));
+            }
+            continue;
+        }
+
+        if (!read_values(self, category, entry, package_keys,
+                G_N_ELEMENTS(package_keys), values, error)) {
+            g_ptr_array_unref(pkgs);
+            return FALSE;
+        }
+
+        /* Entries without EAPI key are EAPI 0 */
+        eapi = cp_eapi_parse(values[0] == NULL ? "0" : values[0], pf, NULL);
+        if (eapi == CP_EAPI_UNKNOWN || values[1] == NULL
+                || !cp_atom_slot_validate(values[1], eapi, NULL)) {
+            g_debug("Skipping md5-cache entry '%s/%s': unsupported EAPI"
+                " or invalid SLOT", category, pf);
+        } else {
+            g_ptr_array_add(pkgs, cp_package_new(category, pkg_name,
+                entry->version, values[1], cp_repository_name(repo), eapi));
+        }
+
+        g_free(values[0]);
+        g_free(values[1]);
+    }
+
+    name->pkgs = pkgs;
+    return TRUE;
+}
+
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+get_category(
+    CPPorttree self,
+    const char *category,
+    /*@out@*/ GHashTable **result,
+    /*@null@*/ GError **error
+) /*@modifies *self,*result,*error,errno@*/ /*@globals fileSystem@*/ {
+    g_assert(error == NULL || *error == NULL);
+
+    if (!g_hash_table_lookup_extended(self->categories, category, NULL, (void **)result)) {
+        if (self->categories_listed) {
+            /* Nonexistent category */
+            *result = NULL;
+            return TRUE;
+        }
+        if (!load_category(self, category, error)) {
+            *result = NULL;
+            return FALSE;
+        }
+        *result = g_hash_table_lookup(self->categories, category);
+    }
+
+    return TRUE;
+}
+
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+get_packages(
+    CPPorttree self,
+    const char *category,
+    const char *pkg_name,
+    /*@out@*/ GPtrArray **result,
+    /*@null@*/ GError **error
+) /*@modifies *self,*result,*error,errno@*/ /*@globals fileSystem@*/ {
+    GHashTable *name2entries;
+    struct porttree_name *name;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *result = NULL;
+
+    if (!get_category(self, category, &name2entries, error)) {
+        return FALSE;
+    }
+    if (name2entries == NULL) {
+        return TRUE;
+    }
+
+    name = g_hash_table_lookup(name2entries, pkg_name);
+    if (name == NULL) {
+        return TRUE;
+    }
+
+    if (name->pkgs == NULL
+            && !load_packages(self, category, pkg_name, name, error)) {
+        return FALSE;
+    }
+
+    /*@-dependenttrans@*/
+    *result = name->pkgs;
+    /*@=dependenttrans@*/
+    return TRUE;
+}
+
+/**
+ * Makes sure every category of every repository has an entry in cache.
+ *
+ * \param into  return location for sorted list of existing categories,
+ *              free it using g_list_free()
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+list_categories(
+    CPPorttree self,
+    /*@out@*/ GList **into,
+    /*@null@*/ GError **error
+) /*@modifies *self,*into,*error,errno@*/ /*@globals fileSystem@*/ {
+    GList *categories;
+    GList *iter;
+    guint repo;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *into = NULL;
+
+    for (repo = 0; repo < self->repos->len && !self->categories_listed; ++repo) {
+        CPPorttreeScan scan = g_ptr_array_index(self->scans, repo);
+        char **names;
+
+        if (scan != NULL) {
+            if (!cp_porttree_scan_all(scan, self->jobs, error)) {
+                return FALSE;
+            }
+            CP_STRV_ITER(cp_porttree_scan_categories(scan), category) {
+                if (!g_hash_table_lookup_extended(self->categories, category, NULL, NULL)
+                        && !load_category(self, category, error)) {
+                    return FALSE;
+                }
+            } end_CP_STRV_ITER
+            continue;
+        }
+
+        names = cp_repository_list(
+            g_ptr_array_index(self->repos, repo), "metadata/md5-cache", NULL
+        );
+        /* md5-cache directory can't be read, nothing is available there */
+        if (names == NULL) {
+            continue;
+        }
+
+        CP_STRV_ITER(names, category) {
+            if (!g_hash_table_lookup_extended(self->categories, category, NULL, NULL)
+                    && !load_category(self, category, error)) {
+                g_strfreev(names);
+                return FALSE;
+            }
+        } end_CP_STRV_ITER
+
+        g_strfreev(names);
+    }
+    self->categories_listed = TRUE;
+
+    categories = g_list_sort(
+        g_hash_table_get_keys(self->categories), (GCompareFunc)strcmp
+    );
+    for (iter = categories; iter != NULL; iter = iter->next) {
+        if (g_hash_table_lookup(self->categories, iter->data) != NULL) {
+            *into = g_list_prepend(*into, iter->data);
+        }
+    }
+    g_list_free(categories);
+
+    *into = g_list_reverse(*into);
+    return TRUE;
+}
+
+static gboolean
+cp_porttree_find_packages(
+    void *priv,
+    const CPAtom atom,
+    /*@out@*/ GSList/*<CPPackage>*/ **match,
+    /*@null@*/ GError **error
+) /*@modifies *priv,*match,*error,errno@*/ /*@globals fileSystem@*/ {
+    CPPorttree self = priv;
+    GPtrArray *pkgs;
+    guint from;
+    guint to;
+    guint i;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *match = NULL;
+
+    if (!get_packages(self, cp_atom_category(atom), cp_atom_package(atom),
+            &pkgs, error)) {
+        return FALSE;
+    }
+
+    if (pkgs == NULL) {
+        return TRUE;
+    }
+
+    cp_atom_match_range(atom, (CPPackage *)pkgs->pdata, pkgs->len, &from, &to);
+
+    /* Walking in ascending order gives descending list */
+    for (i = from; i < to; ++i) {
+        CPPackage pkg = g_ptr_array_index(pkgs, i);
+
+        if (cp_atom_matches(atom, pkg)) {
+            /*@-mustfreefresh@*/
+            *match = g_slist_prepend(*match, cp_package_ref(pkg));
+            /*@=mustfreefresh@*/
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * Calls \a func for packages of every name in \a category that matches
+ * \a pattern (or every name if \a pattern is %NULL), sorted by name
+ * and version.
+ *
+ * \param proceed return location for %FALSE if \a func stopped iteration
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+foreach_in_category(
+    CPPorttree self,
+    const char *category,
+    /*@null@*/ const CPPattern pattern,
+    CPTreeForeachFunc func,
+    void *user_data,
+    /*@out@*/ gboolean *proceed,
+    /*@null@*/ GError **error
+) /*@modifies *self,*user_data,*proceed,*error,errno@*/ /*@globals fileSystem@*/ {
+    GHashTable *name2entries = g_hash_table_lookup(self->categories, category);
+    GList *names;
+    GList *iter;
+    gboolean result = TRUE;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *proceed = TRUE;
+
+    names = g_list_sort(
+        g_hash_table_get_keys(name2entries), (GCompareFunc)strcmp
+    );
+
+    for (iter = names; iter != NULL && *proceed; iter = iter->next) {
+        GPtrArray *pkgs;
+        guint i;
+
+        if (pattern != NULL && !cp_pattern_package_matches(pattern, iter->data)) {
+            continue;
+        }
+
+        if (!get_packages(self, category, iter->data, &pkgs, error)) {
+            result = FALSE;
+            break;
+        }
+
+        for (i = 0; i < pkgs->len && *proceed; ++i) {
+            *proceed = func(g_ptr_array_index(pkgs, i), user_data);
+        }
+    }
+
+    g_list_free(names);
+    return result;
+}
+
+static gboolean
+cp_porttree_foreach_package(
+    void *priv,
+    CPTreeForeachFunc func,
+    void *user_data,
+    /*@null@*/ GError **error
+) /*@modifies *priv,*user_data,*error,errno@*/ /*@globals fileSystem@*/ {
+    CPPorttree self = priv;
+    GList *categories;
+    GList *iter;
+    gboolean proceed = TRUE;
+    gboolean result = TRUE;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!list_categories(self, &categories, error)) {
+        return FALSE;
+    }
+
+    for (iter = categories; iter != NULL && proceed; iter = iter->next) {
+        if (!foreach_in_category(self, iter->data, NULL, func, user_data,
+                &proceed, error)) {
+            result = FALSE;
+            break;
+        }
+    }
+
+    g_list_free(categories);
+    return result;
+}
+
+static gboolean
+prepend_package(const CPPackage package, void *user_data) /*@modifies *user_data@*/ {
+    GSList **match = user_data;
+
+    /*@-mustfreefresh@*/
+    *match = g_slist_prepend(*match, cp_package_ref(package));
+    /*@=mustfreefresh@*/
+    return TRUE;
+}
+
+static gboolean
+cp_porttree_find_pattern(
+    void *priv,
+    const CPPattern pattern,
+    /*@out@*/ GSList/*<CPPackage>*/ **match,
+    /*@null@*/ GError **error
+) /*@modifies *priv,*match,*error,errno@*/ /*@globals fileSystem@*/ {
+    CPPorttree self = priv;
+    GList *categories = NULL;
+    GList *iter;
+    gboolean proceed;
+    gboolean result = TRUE;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *match = NULL;
+
+    if (cp_pattern_category_kind(pattern) == CP_PATTERN_EXACT) {
+        /* Only one category can match, no need to list repositories */
+        GHashTable *name2entries;
+
+        if (!get_category(self, cp_pattern_category_prefix(pattern),
+                &name2entries, error)) {
+            return FALSE;
+        }
+        if (name2entries != NULL) {
+            void *category;
+
+            (void)g_hash_table_lookup_extended(self->categories,
+                cp_pattern_category_prefix(pattern), &category, NULL);
+            categories = g_list_prepend(NULL, category);
+        }
+    } else if (!list_categories(self, &categories, error)) {
+        return FALSE;
+    }
+
+    /* Walking in ascending order gives descending list */
+    for (iter = categories; iter != NULL; iter = iter->next) {
+        if (!cp_pattern_category_matches(pattern, iter->data)) {
+            continue;
+        }
+        if (!foreach_in_category(self, iter->data, pattern, prepend_package,
+                match, &proceed, error)) {
+            cp_package_list_free(*match);
+            *match = NULL;
+            result = FALSE;
+            break;
+        }
+    }
+
+    g_list_free(categories);
+    return result;
+}
+
+/**
+ * Adds md5-cache entry \a pf of listed \a category to \a writer.
+ * Entries whose file wasn't modified, or whose _md5_ didn't change,
+ * are copied from old cache without parsing.
+ */
+static void
+add_cache_entry(
+    const CPPorttree self,
+    guint repo,
+    CPPorttreeCacheWriter writer,
+    const char *category,
+    const char *pf
+) /*@modifies *writer,errno@*/ /*@globals fileSystem@*/ {
+    const struct repo_cache *cache = g_ptr_array_index(self->caches, repo);
+    char *values[G_N_ELEMENTS(cache_keys)];
+    CPPorttreeCacheData data;
+    CPTimestamp old_mtime;
+    gboolean is_dir;
+    GError *error = NULL;
+    gint old = -1;
+    char *path;
+    guint first;
+    guint n;
+    int dep;
+
+    path = g_build_filename("metadata", "md5-cache", category, pf, NULL);
+
+    if (!cp_repository_stat(g_ptr_array_index(self->repos, repo),
+            path, &data.mtime, &is_dir)) {
+        /* Removed since category was listed */
+        g_free(path);
+        return;
+    }
+
+    if (cache->cache != NULL
+            && cp_porttree_cache_get_category(cache->cache, category, NULL, &first, &n)) {
+        old = cp_porttree_cache_find(cache->cache, first, n, pf);
+    }
+
+    if (old >= 0) {
+        cp_porttree_cache_mtime(cache->cache, (guint)old, &old_mtime);
+        if (old_mtime.sec == data.mtime.sec && old_mtime.nsec == data.mtime.nsec) {
+            cp_porttree_cache_writer_copy_entry(writer, cache->cache, (guint)old, &data.mtime);
+            g_free(path);
+            return;
+        }
+    }
+
+    if (!cp_md5_cache_read(g_ptr_array_index(self->repos, repo),
+            path, cache_keys, G_N_ELEMENTS(cache_keys), values, &error)) {
+        g_debug("Can't cache md5-cache entry: %s", error->message);
+        g_error_free(error);
+        g_free(path);
+        return;
+    }
+
+    if (old >= 0 && values[3] != NULL
+            && strcmp(values[3], cp_porttree_cache_md5(cache->cache, (guint)old)) == 0) {
+        /* Touched, but not regenerated */
+        cp_porttree_cache_writer_copy_entry(writer, cache->cache, (guint)old, &data.mtime);
+    } else {
+        data.pf = pf;
+        data.eapi = values[0];
+        data.slot = values[1];
+        data.keywords = values[2];
+        data.md5 = values[3];
+        for (dep = 0; dep < CP_PORTTREE_N_DEPS; ++dep) {
+            data.deps[dep] = values[CACHE_KEY_DEPS + dep];
+        }
+        (void)cp_porttree_cache_writer_add_entry(writer, &data);
+    }
+
+    for (n = 0; n < G_N_ELEMENTS(cache_keys); ++n) {
+        g_free(values[n]);
+    }
+    g_free(path);
+}
+
+/**
+ * Writes binary cache of \a repo if some of its categories were listed.
+ * Categories that weren't looked at are copied from old cache, unless
+ * all categories were listed (then missing ones are gone).
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+save_cache(
+    CPPorttree self,
+    guint repo,
+    /*@null@*/ GError **error
+) /*@modifies *self,*error,errno,fileSystem@*/ /*@globals fileSystem@*/ {
+    struct repo_cache *cache = g_ptr_array_index(self->caches, repo);
+    CPPorttreeCacheWriter writer;
+    GHashTableIter iter;
+    void *key;
+    void *value;
+    gboolean result;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!cache->dirty) {
+        return TRUE;
+    }
+
+    writer = cp_porttree_cache_writer_new();
+
+    if (cache->cache != NULL && !self->categories_listed) {
+        guint i;
+
+        for (i = 0; i < cp_porttree_cache_n_categories(cache->cache); ++i) {
+            const char *category = cp_porttree_cache_category(cache->cache, i);
+            if (!g_hash_table_lookup_extended(cache->loaded, category, NULL, NULL)) {
+                (void)cp_porttree_cache_writer_copy_category(
+                    writer, cache->cache, category
+                );
+            }
+        }
+    }
+
+    g_hash_table_iter_init(&iter, cache->loaded);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const struct loaded_category *loaded = value;
+        GHashTableIter name_iter;
+        GHashTable *name2entries;
+        void *name;
+
+        if (!loaded->listed) {
+            (void)cp_porttree_cache_writer_copy_category(writer, cache->cache, key);
+            continue;
+        }
+
+        cp_porttree_cache_writer_add_category(writer, key, &loaded->mtime);
+
+        name2entries = g_hash_table_lookup(self->categories, key);
+        if (name2entries == NULL) {
+            continue;
+        }
+
+        g_hash_table_iter_init(&name_iter, name2entries);
+        while (g_hash_table_iter_next(&name_iter, NULL, &name)) {
+            const GArray *entries = ((struct porttree_name *)name)->entries;
+            guint i;
+
+            for (i = 0; i < entries->len; ++i) {
+                const struct porttree_entry *entry =
+                    &g_array_index(entries, struct porttree_entry, i);
+                if (entry->repo == repo) {
+                    add_cache_entry(self, repo, writer, key,
+                        cp_string_pool_get(self->strings, entry->pf));
+                }
+            }
+        }
+    }
+
+    result = cp_porttree_cache_writer_save(writer, cache->path, error);
+    if (result) {
+        cache->dirty = FALSE;
+    }
+
+    cp_porttree_cache_writer_destroy(writer);
+    return result;
+}
+
+/**
+ * Creates directory binary caches of \a self are written to.
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+make_cache_dir(
+    const CPPorttree self,
+    /*@null@*/ GError **error
+) /*@modifies *error,errno,fileSystem@*/ /*@globals fileSystem@*/ {
+    g_assert(error == NULL || *error == NULL);
+    g_assert(self->cache_dir != NULL);
+
+    if (g_mkdir_with_parents(self->cache_dir, 0755) != 0) {
+        int save_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(save_errno),
+            _("Can't create '%s': %s"), self->cache_dir, g_strerror(save_errno));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+cp_porttree_destroy(/*@only@*/ void *priv) /*@modifies priv@*/ {
+    CPPorttree self = priv;
+    guint repo;
+
+    if (self->cache_dir != NULL) {
+        GError *error = NULL;
+
+        if (!make_cache_dir(self, &error)) {
+            g_debug("Failed to write porttree cache: %s", error->message);
+            g_error_free(error);
+            g_free(self->cache_dir);
+            self->cache_dir = NULL;
+        }
+    }
+
+    for (repo = 0; self->cache_dir != NULL && repo < self->caches->len; ++repo) {
+        GError *error = NULL;
+
+        if (!save_cache(self, repo, &error)) {
+            g_debug("Failed to write porttree cache: %s", error->message);
+            g_error_free(error);
+        }
+    }
+
+    for (repo = 0; self->cache_dir != NULL && repo < self->scans->len; ++repo) {
+        CPPorttreeScan scan = g_ptr_array_index(self->scans, repo);
+        GError *error = NULL;
+
+        if (scan != NULL && !cp_porttree_scan_save(scan, &error)) {
+            g_debug("Failed to write ebuild scan cache: %s", error->message);
+            g_error_free(error);
+        }
+    }
+
+    g_ptr_array_unref(self->scans);
+    g_ptr_array_unref(self->repos);
+    cp_eclass_index_unref(self->eclasses);
+    cp_hash_table_destroy(self->categories);
+    if (self->caches != NULL) {
+        g_ptr_array_unref(self->caches);
+    }
+    g_free(self->cache_dir);
+
+    g_debug("Metadata of %u md5-cache entries (%" G_GSIZE_FORMAT " bytes)"
+        " kept in %" G_GSIZE_FORMAT " bytes", self->n_entries_read,
+        self->metadata_read, cp_string_pool_memory(self->strings)
+        + self->metadata->len * sizeof(guint32));
+    cp_string_pool_destroy(self->strings);
+    (void)g_array_free(self->metadata, TRUE);
+
+    /*@-refcounttrans@*/
+    g_free(priv);
+    /*@=refcounttrans@*/
+}
+
+/*@unchecked@*/ static const struct CPTreeOps porttree_ops = {
+    cp_porttree_destroy,
+    cp_porttree_find_packages,
+    cp_porttree_foreach_package,
+    cp_porttree_find_pattern
+};
+
+/**
+ * \return newly allocated path of \a repo cache file with \a suffix.
+ *         Caches never live inside repositories, so that they don't
+ *         show up as unlisted files when repository is verified.
+ */
+static /*@only@*/ char *
+cache_path(
+    const CPPorttree self,
+    const CPRepository repo,
+    const char *suffix
+) /*@*/ {
+    char *name = g_strconcat(cp_repository_name(repo), suffix, NULL);
+    char *path = g_build_filename(self->cache_dir, name, NULL);
+
+    g_free(name);
+    return path;
+}
+
+CPPorttree
+cp_porttree_new(const CPSettings settings, GError **error) {
+    CPPorttree self;
+    const char *cache_dir =
+        cp_settings_get_default(settings, "CPORTAGE_PORTTREE_CACHE_DIR", "");
+    gboolean caching;
+    long online;
+    guint jobs;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!cp_settings_get_uint(settings, "CPORTAGE_PORTTREE_JOBS", 0, &jobs, error)) {
+        return NULL;
+    }
+
+    self = g_new0(struct CPPorttreeS, 1);
+    g_assert(self->tree == NULL);
+    self->tree = cp_tree_new(&porttree_ops, self);
+
+    g_assert(self->repos == NULL);
+    self->repos = g_ptr_array_new_with_free_func(
+        (GDestroyNotify)cp_repository_unref
+    );
+    CP_GSLIST_ITER(cp_settings_repositories(settings), repo) {
+        g_ptr_array_add(self->repos, cp_repository_ref(repo));
+    } end_CP_GSLIST_ITER
+
+    g_assert(self->eclasses == NULL);
+    self->eclasses = cp_settings_eclass_index(settings);
+
+    g_assert(self->categories == NULL);
+    self->categories = g_hash_table_new_full(
+        g_str_hash, g_str_equal, g_free, name2entries_free
+    );
+
+    g_assert(self->strings == NULL);
+    self->strings = cp_string_pool_new();
+    g_assert(self->metadata == NULL);
+    self->metadata = g_array_new(FALSE, FALSE, sizeof(guint32));
+
+    online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs > 0) {
+        self->jobs = jobs;
+    } else {
+        self->jobs = online > 0 ? (guint)online : 1;
+    }
+
+    caching = cp_string_truth(
+        cp_settings_get_default(settings, "CPORTAGE_PORTTREE_CACHE", "true")
+    ) == CP_TRUE;
+    if (caching && cache_dir[0] != '\0') {
+        g_assert(self->cache_dir == NULL);
+        self->cache_dir = g_strdup(cache_dir);
+    } else if (caching) {
+        g_assert(self->cache_dir == NULL);
+        self->cache_dir = g_build_filename(cp_settings_config_root(settings),
+            "var", "cache", "cportage", NULL);
+    }
+
+    g_assert(self->scans == NULL);
+    self->scans = g_ptr_array_new_with_free_func(
+        (GDestroyNotify)cp_porttree_scan_destroy
+    );
+    CP_GSLIST_ITER(cp_settings_repositories(settings), repo) {
+        CPTimestamp mtime;
+
+        if (stat_dir(repo, "metadata/md5-cache", &mtime)) {
+            g_ptr_array_add(self->scans, NULL);
+        } else if (cp_repository_is_snapshot(repo)) {
+            /* Ebuild scanner only reads directories */
+            g_debug("Snapshot '%s' has no md5-cache, it provides no packages",
+                cp_repository_path(repo));
+            g_ptr_array_add(self->scans, NULL);
+        } else {
+            char *scan_cache =
+                caching ? cache_path(self, repo, ".scan-cache") : NULL;
+
+            g_ptr_array_add(self->scans,
+                cp_porttree_scan_new(cp_repository_path(repo), scan_cache));
+            g_free(scan_cache);
+        }
+    } end_CP_GSLIST_ITER
+
+    if (caching) {
+        g_assert(self->caches == NULL);
+        self->caches = g_ptr_array_new_with_free_func(repo_cache_free);
+
+        CP_GSLIST_ITER(cp_settings_repositories(settings), repo) {
+            struct repo_cache *cache = g_new0(struct repo_cache, 1);
+
+            cache->path = cache_path(self, repo, ".cache");
+            cache->cache = cp_porttree_cache_open(cache->path);
+            cache->loaded = g_hash_table_new_full(
+                g_str_hash, g_str_equal, g_free, g_free
+            );
+            g_ptr_array_add(self->caches, cache);
+        } end_CP_GSLIST_ITER
+    }
+
+    return self;
+}
+
+CPPorttree
+cp_porttree_ref(CPPorttree self) {
+    self->tree = cp_tree_ref(self->tree);
+    /*@-refcounttrans@*/
+    return self;
+    /*@=refcounttrans@*/
+}
+
+void
+cp_porttree_unref(CPPorttree self) {
+    if (self == NULL) {
+        return;
+    }
+
+    cp_tree_unref(self->tree);
+}
+
+CPTree
+cp_porttree_get_tree(CPPorttree self) {
+    return cp_tree_ref(self->tree);
+}
+
+/**
+ * Finds entry \a package was created from.
+ *
+ * \param entry return location for the entry
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+find_entry(
+    CPPorttree self,
+    const CPPackage package,
+    /*@out@*/ struct porttree_entry **entry,
+    /*@null@*/ GError **error
+) /*@modifies *self,*entry,*error,errno@*/ /*@globals fileSystem@*/ {
+    const char *pf = strchr(cp_package_str(package), '/') + 1;
+    GHashTable *name2entries;
+    struct porttree_name *name = NULL;
+    guint i;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *entry = NULL;
+
+    if (!get_category(self, cp_package_category(package), &name2entries, error)) {
+        return FALSE;
+    }
+    if (name2entries != NULL) {
+        name = g_hash_table_lookup(name2entries, cp_package_name(package));
+    }
+
+    for (i = 0; name != NULL && i < name->entries->len; ++i) {
+        struct porttree_entry *candidate =
+            &g_array_index(name->entries, struct porttree_entry, i);
+        CPRepository repo = g_ptr_array_index(self->repos, candidate->repo);
+
+        if (strcmp(cp_string_pool_get(self->strings, candidate->pf), pf) == 0
+                && strcmp(cp_repository_name(repo), cp_package_repo(package)) == 0) {
+            *entry = candidate;
+            return TRUE;
+        }
+    }
+
+    g_set_error(error, G_FILE_ERROR, (gint)G_FILE_ERROR_NOENT,
+        _("Package '%s::%s' isn't available"),
+        cp_package_str(package), cp_package_repo(package));
+    return FALSE;
+}
+
+/**
+ * Fills \a values of \a keys of \a entry scanned in repository
+ * without md5-cache. Only EAPI, SLOT and KEYWORDS are known.
+ */
+static void
+get_scanned_metadata(
+    const struct porttree_entry *entry,
+    const char * const *keys,
+    /*@out@*/ char **values
+) /*@modifies *values@*/ {
+    guint i;
+
+    for (i = 0; keys[i] != NULL; ++i) {
+        values[i] = NULL;
+        if (strcmp(keys[i], "EAPI") == 0) {
+            values[i] = g_strdup(cp_eapi_str(entry->scanned->eapi));
+        } else if (strcmp(keys[i], "SLOT") == 0) {
+            values[i] = g_strdup(entry->scanned->slot);
+        } else if (strcmp(keys[i], "KEYWORDS") == 0) {
+            values[i] = g_strdup(entry->scanned->keywords);
+        }
+    }
+}
+
+gboolean
+cp_porttree_get_metadata(
+    CPPorttree self,
+    const CPPackage package,
+    const char * const *keys,
+    char **values,
+    GError **error
+) {
+    struct porttree_entry *entry;
+    guint i;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!find_entry(self, package, &entry, error)) {
+        return FALSE;
+    }
+
+    if (entry->scanned != NULL) {
+        get_scanned_metadata(entry, keys, values);
+        return TRUE;
+    }
+
+    if (!load_metadata(self, cp_package_category(package), entry, error)) {
+        return FALSE;
+    }
+
+    for (i = 0; keys[i] != NULL; ++i) {
+        values[i] = g_strdup(get_value(self, entry, keys[i]));
+    }
+
+    return TRUE;
+}
+
+gboolean
+cp_porttree_update_cache(CPPorttree self, GError **error) {
+    GList *categories;
+    guint repo;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (self->caches == NULL) {
+        return TRUE;
+    }
+
+    if (!make_cache_dir(self, error) || !list_categories(self, &categories, error)) {
+        return FALSE;
+    }
+    g_list_free(categories);
+
+    for (repo = 0; repo < self->caches->len; ++repo) {
+        CPPorttreeScan scan = g_ptr_array_index(self->scans, repo);
+
+        if (!save_cache(self, repo, error)
+                || (scan != NULL && !cp_porttree_scan_save(scan, error))) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+gboolean
+cp_porttree_get_keywords(
+    CPPorttree self,
+    const CPPackage package,
+    char ***keywords,
+    GError **error
+) {
+    const char * const keys[] = { "KEYWORDS" };
+    struct porttree_entry *entry;
+    char *value;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *keywords = NULL;
+
+    if (!find_entry(self, package, &entry, error)) {
+        return FALSE;
+    }
+
+    if (entry->scanned != NULL) {
+        *keywords = cp_strings_pysplit(
+            entry->scanned->keywords == NULL ? "" : entry->scanned->keywords
+        );
+        return TRUE;
+    }
+
+    if (entry->cached >= 0) {
+        const struct repo_cache *cache = g_ptr_array_index(self->caches, entry->repo);
+
+        *keywords = cp_porttree_cache_get_keywords(cache->cache, (guint)entry->cached);
+        return TRUE;
+    }
+
+    if (!read_values(self, cp_package_category(package), entry,
+            keys, G_N_ELEMENTS(keys), &value, error)) {
+        return FALSE;
+    }
+
+    *keywords = cp_strings_pysplit(value == NULL ? "" : value);
+    g_free(value);
+    return TRUE;
+}
+
+gboolean
+cp_porttree_validate_cache(CPPorttree self, GSList **stale, GError **error) {
+    g_assert(error == NULL || *error == NULL);
+
+    *stale = NULL;
+
+    if (self->repos->len == 0) {
+        return TRUE;
+    }
+
+    /* Eclasses that changed since last validation are hashed again */
+    cp_eclass_index_refresh(self->eclasses);
+    return cp_md5_cache_validate(self->repos, self->eclasses, self->jobs, stale, error);
+}
@@ -0,0 +1,47 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Internal interface of available packages tree. */
+
+#ifndef CP_PORTTREE_H
+#define CP_PORTTREE_H
+
+#include <cportage.h>
+
+/*@-exportany@*/
+
+/**
+ * Reads KEYWORDS of available \a package. Entries found in binary cache
+ * are decoded from their keyword bitsets without touching md5-cache.
+ *
+ * \param keywords return location for %NULL-terminated array of keywords,
+ *                 free it using g_strfreev()
+ * \param error    return location for a %GError, or %NULL
+ * \return         %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_porttree_get_keywords(
+    CPPorttree self,
+    const CPPackage package,
+    /*@out@*/ char ***keywords,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*keywords,*error,errno@*/ /*@globals fileSystem@*/;
+
+#endif
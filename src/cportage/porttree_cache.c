@@ -0,0 +1,905 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Cache file layout (all integers are in host byte order):
+
+  struct cache_header;
+  struct cache_category[header.n_categories], sorted by name;
+  struct cache_entry[header.n_entries], grouped by category,
+      sorted by pf inside category;
+  guint32 keywords[header.n_keywords], keyword names;
+  guint32 bitsets[header.n_entries * header.keyword_words], KEYWORDS
+      of entries, bit N of a bitset stands for keywords[N];
+  guint32 tokens[header.n_tokens], dependency tokens;
+  char strings[header.strings_size], NUL-terminated strings.
+
+  All string fields are offsets into strings table, equal values share
+  a single copy. Records are naturally aligned, so the whole file can be
+  used right from mmap()ed memory. Everything is validated on open, so
+  accessors don't check anything.
+ */
+
+#include <string.h>
+
+#include "atom.h"
+#include "eapi.h"
+#include "porttree_cache.h"
+#include "version.h"
+
+#define CACHE_MAGIC "CPPTCACH"
+#define CACHE_VERSION 2
+#define CACHE_BYTE_ORDER 0x01020304
+
+const char * const cp_porttree_dep_keys[CP_PORTTREE_N_DEPS] = {
+    "DEPEND", "RDEPEND", "PDEPEND", "BDEPEND"
+};
+
+struct cache_header {
+    char magic[8];
+    guint32 version;
+    guint32 byte_order;
+    guint32 n_categories;
+    guint32 n_entries;
+    guint32 n_keywords;
+    guint32 keyword_words;
+    guint32 n_tokens;
+    guint32 strings_size;
+};
+
+struct cache_category {
+    guint32 name;
+    guint32 first_entry;
+    guint32 n_entries;
+    guint32 reserved;
+    guint64 mtime_sec;
+    guint64 mtime_nsec;
+};
+
+struct cache_entry {
+    guint32 pf;
+    guint32 name;
+    guint32 version;
+    guint32 slot;
+    guint32 md5;
+    /** EAPI string rather than #CPEapi, so that cache survives new EAPIs */
+    guint32 eapi;
+    guint32 rank;
+    guint32 reserved;
+    guint32 first_token[CP_PORTTREE_N_DEPS];
+    guint32 n_tokens[CP_PORTTREE_N_DEPS];
+    guint64 mtime_sec;
+    guint64 mtime_nsec;
+};
+
+struct CPPorttreeCacheS {
+    /*@only@*/ GMappedFile *file;
+
+    /*@dependent@*/ const struct cache_header *header;
+    /*@dependent@*/ const struct cache_category *categories;
+    /*@dependent@*/ const struct cache_entry *entries;
+    /*@dependent@*/ const guint32 *keywords;
+    /*@dependent@*/ const guint32 *bitsets;
+    /*@dependent@*/ const guint32 *tokens;
+    /*@dependent@*/ const char *strings;
+};
+
+/**
+ * Checks that all versions of \a self parse, so that porttree can
+ * create them lazily without error handling. Every distinct string
+ * is parsed once.
+ */
+static gboolean
+check_versions(const CPPorttreeCache self) /*@*/ {
+    GHashTable *checked = g_hash_table_new(g_direct_hash, g_direct_equal);
+    gboolean result = TRUE;
+    guint32 i;
+
+    for (i = 0; i < self->header->n_entries && result; ++i) {
+        guint32 offset = self->entries[i].version;
+        CPVersion version;
+
+        if (g_hash_table_lookup(checked, GUINT_TO_POINTER(offset + 1)) != NULL) {
+            continue;
+        }
+
+        version = cp_version_new(&self->strings[offset], NULL);
+        result = version != NULL;
+        cp_version_unref(version);
+        g_hash_table_insert(checked, GUINT_TO_POINTER(offset + 1), GUINT_TO_POINTER(1));
+    }
+
+    g_hash_table_destroy(checked);
+    return result;
+}
+
+static gboolean
+check_contents(const CPPorttreeCache self) /*@*/ {
+    const struct cache_header *header = self->header;
+    const char *prev = NULL;
+    guint32 i;
+    int dep;
+
+    for (i = 0; i < header->n_keywords; ++i) {
+        if (self->keywords[i] >= header->strings_size) {
+            return FALSE;
+        }
+    }
+
+    for (i = 0; i < header->n_tokens; ++i) {
+        if (self->tokens[i] >= header->strings_size) {
+            return FALSE;
+        }
+    }
+
+    for (i = 0; i < header->n_entries; ++i) {
+        const struct cache_entry *entry = &self->entries[i];
+
+        if (entry->pf >= header->strings_size
+                || entry->name >= header->strings_size
+                || entry->version >= header->strings_size
+                || entry->slot >= header->strings_size
+                || entry->md5 >= header->strings_size
+                || entry->eapi >= header->strings_size) {
+            return FALSE;
+        }
+        for (dep = 0; dep < CP_PORTTREE_N_DEPS; ++dep) {
+            if ((guint64)entry->first_token[dep] + entry->n_tokens[dep]
+                    > header->n_tokens) {
+                return FALSE;
+            }
+        }
+    }
+
+    for (i = 0; i < header->n_categories; ++i) {
+        const struct cache_category *cat = &self->categories[i];
+        const char *name;
+        guint32 j;
+
+        if (cat->name >= header->strings_size
+                || (guint64)cat->first_entry + cat->n_entries > header->n_entries) {
+            return FALSE;
+        }
+
+        /* Binary searches rely on this */
+        name = &self->strings[cat->name];
+        if (prev != NULL && strcmp(prev, name) >= 0) {
+            return FALSE;
+        }
+        prev = name;
+
+        for (j = 1; j < cat->n_entries; ++j) {
+            if (strcmp(cp_porttree_cache_pf(self, cat->first_entry + j - 1),
+                    cp_porttree_cache_pf(self, cat->first_entry + j)) >= 0) {
+                return FALSE;
+            }
+        }
+    }
+
+    return check_versions(self);
+}
+
+CPPorttreeCache
+cp_porttree_cache_open(const char *path) {
+    CPPorttreeCache self;
+    const struct cache_header *header;
+    GError *error = NULL;
+    GMappedFile *file;
+    const char *data;
+    gsize length;
+    guint64 expected;
+
+    file = g_mapped_file_new(path, FALSE, &error);
+    if (file == NULL) {
+        g_debug("Can't load porttree cache: %s", error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    data = g_mapped_file_get_contents(file);
+    length = g_mapped_file_get_length(file);
+
+    self = g_new0(struct CPPorttreeCacheS, 1);
+    self->file = file;
+
+    if (data == NULL || length < sizeof(*header)) {
+        goto ERR;
+    }
+
+    /*@-dependenttrans@*/
+    header = self->header = (const void *)data;
+    /*@=dependenttrans@*/
+    if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0
+            || header->version != CACHE_VERSION
+            || header->byte_order != CACHE_BYTE_ORDER
+            || header->keyword_words != (header->n_keywords + 31) / 32) {
+        goto ERR;
+    }
+
+    expected = sizeof(*header)
+        + (guint64)header->n_categories * sizeof(*self->categories)
+        + (guint64)header->n_entries * sizeof(*self->entries)
+        + (guint64)header->n_keywords * sizeof(*self->keywords)
+        + (guint64)header->n_entries * header->keyword_words * sizeof(*self->bitsets)
+        + (guint64)header->n_tokens * sizeof(*self->tokens)
+        + header->strings_size;
+    if (expected != length || header->strings_size == 0) {
+        goto ERR;
+    }
+
+    /*@-dependenttrans@*/
+    self->categories = (const void *)&data[sizeof(*header)];
+    self->entries = (const void *)&self->categories[header->n_categories];
+    self->keywords = (const void *)&self->entries[header->n_entries];
+    self->bitsets = &self->keywords[header->n_keywords];
+    self->tokens = &self->bitsets[header->n_entries * header->keyword_words];
+    self->strings = (const char *)&self->tokens[header->n_tokens];
+    /*@=dependenttrans@*/
+
+    if (self->strings[header->strings_size - 1] != '\0'
+            || !check_contents(self)) {
+        goto ERR;
+    }
+
+    return self;
+
+ERR:
+    g_debug("Porttree cache '%s' is corrupt, ignoring it", path);
+    cp_porttree_cache_destroy(self);
+    return NULL;
+}
+
+void
+cp_porttree_cache_destroy(CPPorttreeCache self) {
+    if (self == NULL) {
+        /*@-mustfreeonly@*/
+        return;
+        /*@=mustfreeonly@*/
+    }
+
+    g_mapped_file_unref(self->file);
+
+    /*@-refcounttrans@*/
+    g_free(self);
+    /*@=refcounttrans@*/
+}
+
+static /*@null@*/ /*@dependent@*/ const struct cache_category *
+find_category(const CPPorttreeCache self, const char *category) /*@*/ {
+    guint32 lo = 0;
+    guint32 hi = self->header->n_categories;
+
+    while (lo < hi) {
+        guint32 mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(&self->strings[self->categories[mid].name], category);
+
+        if (cmp == 0) {
+            return &self->categories[mid];
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return NULL;
+}
+
+guint
+cp_porttree_cache_n_categories(const CPPorttreeCache self) {
+    return self->header->n_categories;
+}
+
+const char *
+cp_porttree_cache_category(const CPPorttreeCache self, guint i) {
+    return &self->strings[self->categories[i].name];
+}
+
+gboolean
+cp_porttree_cache_get_category(
+    const CPPorttreeCache self,
+    const char *category,
+    const CPTimestamp *mtime,
+    guint *first,
+    guint *n
+) {
+    const struct cache_category *cat = find_category(self, category);
+
+    *first = 0;
+    *n = 0;
+
+    if (cat == NULL
+            || (mtime != NULL
+                && (cat->mtime_sec != mtime->sec || cat->mtime_nsec != mtime->nsec))) {
+        return FALSE;
+    }
+
+    *first = cat->first_entry;
+    *n = cat->n_entries;
+    return TRUE;
+}
+
+gint
+cp_porttree_cache_find(
+    const CPPorttreeCache self,
+    guint first,
+    guint n,
+    const char *pf
+) {
+    guint lo = first;
+    guint hi = first + n;
+
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(cp_porttree_cache_pf(self, mid), pf);
+
+        if (cmp == 0) {
+            return (gint)mid;
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return -1;
+}
+
+const char *
+cp_porttree_cache_pf(const CPPorttreeCache self, guint i) {
+    return &self->strings[self->entries[i].pf];
+}
+
+const char *
+cp_porttree_cache_name(const CPPorttreeCache self, guint i) {
+    return &self->strings[self->entries[i].name];
+}
+
+const char *
+cp_porttree_cache_version(const CPPorttreeCache self, guint i) {
+    return &self->strings[self->entries[i].version];
+}
+
+guint
+cp_porttree_cache_rank(const CPPorttreeCache self, guint i) {
+    return self->entries[i].rank;
+}
+
+const char *
+cp_porttree_cache_slot(const CPPorttreeCache self, guint i) {
+    return &self->strings[self->entries[i].slot];
+}
+
+CPEapi
+cp_porttree_cache_eapi(const CPPorttreeCache self, guint i) {
+    return cp_eapi_parse(&self->strings[self->entries[i].eapi], "EAPI", NULL);
+}
+
+const char *
+cp_porttree_cache_md5(const CPPorttreeCache self, guint i) {
+    return &self->strings[self->entries[i].md5];
+}
+
+void
+cp_porttree_cache_mtime(const CPPorttreeCache self, guint i, CPTimestamp *mtime) {
+    mtime->sec = self->entries[i].mtime_sec;
+    mtime->nsec = self->entries[i].mtime_nsec;
+}
+
+guint
+cp_porttree_cache_n_keywords(const CPPorttreeCache self) {
+    return self->header->n_keywords;
+}
+
+const char *
+cp_porttree_cache_keyword(const CPPorttreeCache self, guint bit) {
+    g_assert(bit < self->header->n_keywords);
+
+    return &self->strings[self->keywords[bit]];
+}
+
+const guint32 *
+cp_porttree_cache_keywords(const CPPorttreeCache self, guint i, guint *n_words) {
+    *n_words = self->header->keyword_words;
+    return &self->bitsets[i * self->header->keyword_words];
+}
+
+char **
+cp_porttree_cache_get_keywords(const CPPorttreeCache self, guint i) {
+    GPtrArray *words = g_ptr_array_new();
+    const guint32 *bitset;
+    guint n_words;
+    guint bit;
+
+    bitset = cp_porttree_cache_keywords(self, i, &n_words);
+    for (bit = 0; bit < cp_porttree_cache_n_keywords(self); ++bit) {
+        if ((bitset[bit / 32] & (1U << (bit % 32))) != 0) {
+            g_ptr_array_add(words, g_strdup(cp_porttree_cache_keyword(self, bit)));
+        }
+    }
+    g_ptr_array_add(words, NULL);
+
+    return (char **)g_ptr_array_free(words, FALSE);
+}
+
+guint
+cp_porttree_cache_n_tokens(const CPPorttreeCache self, guint i, CPPorttreeDep dep) {
+    return self->entries[i].n_tokens[dep];
+}
+
+const char *
+cp_porttree_cache_token(
+    const CPPorttreeCache self,
+    guint i,
+    CPPorttreeDep dep,
+    guint token
+) {
+    const struct cache_entry *entry = &self->entries[i];
+
+    g_assert(token < entry->n_tokens[dep]);
+
+    return &self->strings[self->tokens[entry->first_token[dep] + token]];
+}
+
+struct writer_entry {
+    struct cache_entry record;
+    /** Used to compute ranks when cache is saved */
+    /*@only@*/ CPVersion version;
+    /** Bits of entry keywords */
+    /*@only@*/ GArray/*<guint32>*/ *keywords;
+};
+
+struct writer_category {
+    CPTimestamp mtime;
+    /*@only@*/ GArray/*<struct writer_entry>*/ *entries;
+};
+
+struct CPPorttreeCacheWriterS {
+    /*@only@*/ GTree/*<char *, struct writer_category *>*/ *categories;
+    /** Category that new entries are added to */
+    /*@dependent@*/ /*@null@*/ struct writer_category *current;
+
+    /** Keyword name offsets, indexed by bit */
+    /*@only@*/ GArray/*<guint32>*/ *keywords;
+    /** Keyword->(bit + 1) map */
+    /*@only@*/ GHashTable *keyword_bits;
+
+    /*@only@*/ GArray/*<guint32>*/ *tokens;
+
+    /*@only@*/ GString *strings;
+    /** String->(offset + 1) map, used to deduplicate strings */
+    /*@only@*/ GHashTable *offsets;
+};
+
+static void
+writer_category_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct writer_category *cat = data;
+    guint i;
+
+    for (i = 0; i < cat->entries->len; ++i) {
+        struct writer_entry *entry = &g_array_index(cat->entries, struct writer_entry, i);
+        cp_version_unref(entry->version);
+        (void)g_array_free(entry->keywords, TRUE);
+    }
+    (void)g_array_free(cat->entries, TRUE);
+    g_free(cat);
+}
+
+CPPorttreeCacheWriter
+cp_porttree_cache_writer_new(void) {
+    CPPorttreeCacheWriter self = g_new0(struct CPPorttreeCacheWriterS, 1);
+
+    g_assert(self->categories == NULL);
+    self->categories = g_tree_new_full(
+        (GCompareDataFunc)strcmp, NULL, g_free, writer_category_free
+    );
+
+    g_assert(self->keywords == NULL);
+    self->keywords = g_array_new(FALSE, FALSE, sizeof(guint32));
+    g_assert(self->keyword_bits == NULL);
+    self->keyword_bits = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    g_assert(self->tokens == NULL);
+    self->tokens = g_array_new(FALSE, FALSE, sizeof(guint32));
+
+    g_assert(self->strings == NULL);
+    self->strings = g_string_new("");
+    g_assert(self->offsets == NULL);
+    self->offsets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    return self;
+}
+
+void
+cp_porttree_cache_writer_destroy(CPPorttreeCacheWriter self) {
+    if (self == NULL) {
+        /*@-mustfreeonly@*/
+        return;
+        /*@=mustfreeonly@*/
+    }
+
+    cp_tree_destroy(self->categories);
+    (void)g_array_free(self->keywords, TRUE);
+    cp_hash_table_destroy(self->keyword_bits);
+    (void)g_array_free(self->tokens, TRUE);
+    (void)g_string_free(self->strings, TRUE);
+    cp_hash_table_destroy(self->offsets);
+
+    /*@-refcounttrans@*/
+    g_free(self);
+    /*@=refcounttrans@*/
+}
+
+static guint32
+intern_string(CPPorttreeCacheWriter self, const char *str) /*@modifies *self@*/ {
+    gsize offset = GPOINTER_TO_UINT(g_hash_table_lookup(self->offsets, str));
+
+    if (offset == 0) {
+        offset = self->strings->len;
+        (void)g_string_append_len(self->strings, str, (gssize)strlen(str) + 1);
+        g_hash_table_insert(
+            self->offsets, g_strdup(str), GUINT_TO_POINTER(offset + 1)
+        );
+    } else {
+        --offset;
+    }
+
+    return (guint32)offset;
+}
+
+static void
+add_keyword(
+    CPPorttreeCacheWriter self,
+    GArray *bits,
+    const char *keyword
+) /*@modifies *self,*bits@*/ {
+    guint32 bit = GPOINTER_TO_UINT(g_hash_table_lookup(self->keyword_bits, keyword));
+
+    if (bit == 0) {
+        guint32 offset = intern_string(self, keyword);
+
+        (void)g_array_append_val(self->keywords, offset);
+        bit = self->keywords->len;
+        g_hash_table_insert(
+            self->keyword_bits, g_strdup(keyword), GUINT_TO_POINTER(bit)
+        );
+    }
+
+    --bit;
+    (void)g_array_append_val(bits, bit);
+}
+
+static void
+add_token(CPPorttreeCacheWriter self, const char *token) /*@modifies *self@*/ {
+    guint32 offset = intern_string(self, token);
+
+    (void)g_array_append_val(self->tokens, offset);
+}
+
+void
+cp_porttree_cache_writer_add_category(
+    CPPorttreeCacheWriter self,
+    const char *category,
+    const CPTimestamp *mtime
+) {
+    struct writer_category *cat = g_new0(struct writer_category, 1);
+
+    cat->mtime = *mtime;
+    cat->entries = g_array_new(FALSE, FALSE, sizeof(struct writer_entry));
+
+    g_tree_insert(self->categories, g_strdup(category), cat);
+    self->current = cat;
+}
+
+gboolean
+cp_porttree_cache_writer_add_entry(
+    CPPorttreeCacheWriter self,
+    const CPPorttreeCacheData *data
+) {
+    struct writer_entry entry;
+    char *name;
+    char **tokens;
+    int dep;
+
+    g_assert(self->current != NULL);
+
+    if (!cp_atom_pv_split(data->pf, &name, &entry.version, NULL)) {
+        return FALSE;
+    }
+
+    memset(&entry.record, 0, sizeof(entry.record));
+    entry.record.pf = intern_string(self, data->pf);
+    entry.record.name = intern_string(self, name);
+    entry.record.version = intern_string(self, cp_version_str(entry.version));
+    entry.record.slot = intern_string(self, data->slot == NULL ? "" : data->slot);
+    entry.record.md5 = intern_string(self, data->md5 == NULL ? "" : data->md5);
+    /* Entries without EAPI key are EAPI 0 */
+    entry.record.eapi = intern_string(self, data->eapi == NULL ? "0" : data->eapi);
+    entry.record.mtime_sec = data->mtime.sec;
+    entry.record.mtime_nsec = data->mtime.nsec;
+    g_free(name);
+
+    entry.keywords = g_array_new(FALSE, FALSE, sizeof(guint32));
+    if (data->keywords != NULL) {
+        tokens = cp_strings_pysplit(data->keywords);
+        CP_STRV_ITER(tokens, keyword) {
+            add_keyword(self, entry.keywords, keyword);
+        } end_CP_STRV_ITER
+        g_strfreev(tokens);
+    }
+
+    for (dep = 0; dep < CP_PORTTREE_N_DEPS; ++dep) {
+        entry.record.first_token[dep] = self->tokens->len;
+        if (data->deps[dep] != NULL) {
+            tokens = cp_strings_pysplit(data->deps[dep]);
+            CP_STRV_ITER(tokens, token) {
+                add_token(self, token);
+            } end_CP_STRV_ITER
+            g_strfreev(tokens);
+        }
+        entry.record.n_tokens[dep] = self->tokens->len - entry.record.first_token[dep];
+    }
+
+    (void)g_array_append_val(self->current->entries, entry);
+    return TRUE;
+}
+
+void
+cp_porttree_cache_writer_copy_entry(
+    CPPorttreeCacheWriter self,
+    const CPPorttreeCache cache,
+    guint i,
+    const CPTimestamp *mtime
+) {
+    const struct cache_entry *src = &cache->entries[i];
+    struct writer_entry entry;
+    const guint32 *bitset;
+    guint n_words;
+    guint bit;
+    int dep;
+
+    g_assert(self->current != NULL);
+
+    entry.record = *src;
+    entry.record.pf = intern_string(self, cp_porttree_cache_pf(cache, i));
+    entry.record.name = intern_string(self, cp_porttree_cache_name(cache, i));
+    entry.record.version = intern_string(self, cp_porttree_cache_version(cache, i));
+    entry.record.slot = intern_string(self, cp_porttree_cache_slot(cache, i));
+    entry.record.md5 = intern_string(self, cp_porttree_cache_md5(cache, i));
+    entry.record.mtime_sec = mtime->sec;
+    entry.record.mtime_nsec = mtime->nsec;
+    entry.version = cp_version_new(cp_porttree_cache_version(cache, i), NULL);
+    /* Version was valid when it was written */
+    g_assert(entry.version != NULL);
+
+    entry.keywords = g_array_new(FALSE, FALSE, sizeof(guint32));
+    bitset = cp_porttree_cache_keywords(cache, i, &n_words);
+    for (bit = 0; bit < cache->header->n_keywords; ++bit) {
+        if ((bitset[bit / 32] & (1U << (bit % 32))) != 0) {
+            add_keyword(self, entry.keywords, cp_porttree_cache_keyword(cache, bit));
+        }
+    }
+
+    for (dep = 0; dep < CP_PORTTREE_N_DEPS; ++dep) {
+        guint token;
+
+        entry.record.first_token[dep] = self->tokens->len;
+        for (token = 0; token < src->n_tokens[dep]; ++token) {
+            add_token(self,
+                cp_porttree_cache_token(cache, i, (CPPorttreeDep)dep, token));
+        }
+    }
+
+    (void)g_array_append_val(self->current->entries, entry);
+}
+
+gboolean
+cp_porttree_cache_writer_copy_category(
+    CPPorttreeCacheWriter self,
+    const CPPorttreeCache cache,
+    const char *category
+) {
+    const struct cache_category *src = find_category(cache, category);
+    CPTimestamp mtime;
+    guint32 i;
+
+    if (src == NULL) {
+        return FALSE;
+    }
+
+    mtime.sec = src->mtime_sec;
+    mtime.nsec = src->mtime_nsec;
+    cp_porttree_cache_writer_add_category(self, category, &mtime);
+
+    for (i = 0; i < src->n_entries; ++i) {
+        guint entry = src->first_entry + i;
+
+        cp_porttree_cache_mtime(cache, entry, &mtime);
+        cp_porttree_cache_writer_copy_entry(self, cache, entry, &mtime);
+    }
+
+    return TRUE;
+}
+
+struct save_data {
+    /*@dependent@*/ CPPorttreeCacheWriter self;
+    /*@dependent@*/ GString *categories;
+    /*@dependent@*/ GString *entries;
+    /*@dependent@*/ GString *bitsets;
+    guint32 keyword_words;
+    guint32 n_categories;
+    guint32 n_entries;
+};
+
+/** Orders entries of a category by pf */
+static gint
+entry_pf_cmp(const void *a, const void *b, void *user_data) /*@*/ {
+    const struct writer_entry *entry_a = a;
+    const struct writer_entry *entry_b = b;
+    const char *strings = user_data;
+
+    return strcmp(&strings[entry_a->record.pf], &strings[entry_b->record.pf]);
+}
+
+/**
+ * Orders pointers to entries of a category by package name and version.
+ * Names are interned, so equal names have equal offsets.
+ */
+static gint
+entry_version_cmp(const void *a, const void *b) /*@*/ {
+    const struct writer_entry *entry_a = *(struct writer_entry * const *)a;
+    const struct writer_entry *entry_b = *(struct writer_entry * const *)b;
+
+    if (entry_a->record.name != entry_b->record.name) {
+        return entry_a->record.name < entry_b->record.name ? -1 : 1;
+    }
+    return cp_version_cmp(entry_a->version, entry_b->version);
+}
+
+static void
+compute_ranks(GArray/*<struct writer_entry>*/ *entries) /*@modifies *entries@*/ {
+    GPtrArray *sorted = g_ptr_array_sized_new(entries->len);
+    guint32 rank = 0;
+    guint i;
+
+    for (i = 0; i < entries->len; ++i) {
+        g_ptr_array_add(sorted, &g_array_index(entries, struct writer_entry, i));
+    }
+    g_ptr_array_sort(sorted, entry_version_cmp);
+
+    for (i = 0; i < sorted->len; ++i) {
+        struct writer_entry *entry = g_ptr_array_index(sorted, i);
+
+        if (i > 0) {
+            const struct writer_entry *prev = g_ptr_array_index(sorted, i - 1);
+            rank = prev->record.name == entry->record.name ? rank + 1 : 0;
+        }
+        entry->record.rank = rank;
+    }
+
+    (void)g_ptr_array_free(sorted, TRUE);
+}
+
+static gboolean
+save_category(void *key, void *value, void *user_data) /*@modifies *user_data@*/ {
+    struct save_data *data = user_data;
+    struct writer_category *cat = value;
+    struct cache_category record;
+    guint32 *bitset = g_new(guint32, data->keyword_words);
+    guint i;
+
+    g_array_sort_with_data(cat->entries, entry_pf_cmp, data->self->strings->str);
+    compute_ranks(cat->entries);
+
+    memset(&record, 0, sizeof(record));
+    record.name = intern_string(data->self, key);
+    record.first_entry = data->n_entries;
+    record.n_entries = cat->entries->len;
+    record.mtime_sec = cat->mtime.sec;
+    record.mtime_nsec = cat->mtime.nsec;
+    (void)g_string_append_len(
+        data->categories, (const char *)&record, (gssize)sizeof(record)
+    );
+
+    for (i = 0; i < cat->entries->len; ++i) {
+        const struct writer_entry *entry =
+            &g_array_index(cat->entries, struct writer_entry, i);
+        guint j;
+
+        (void)g_string_append_len(
+            data->entries, (const char *)&entry->record, (gssize)sizeof(entry->record)
+        );
+
+        memset(bitset, 0, data->keyword_words * sizeof(*bitset));
+        for (j = 0; j < entry->keywords->len; ++j) {
+            guint32 bit = g_array_index(entry->keywords, guint32, j);
+            bitset[bit / 32] |= 1U << (bit % 32);
+        }
+        (void)g_string_append_len(
+            data->bitsets, (const char *)bitset,
+            (gssize)(data->keyword_words * sizeof(*bitset))
+        );
+    }
+
+    ++data->n_categories;
+    data->n_entries += cat->entries->len;
+
+    g_free(bitset);
+    return FALSE;
+}
+
+gboolean
+cp_porttree_cache_writer_save(
+    const CPPorttreeCacheWriter self,
+    const char *path,
+    GError **error
+) {
+    struct cache_header header;
+    struct save_data data;
+    GString *contents;
+    gboolean result;
+
+    g_assert(error == NULL || *error == NULL);
+
+    data.self = self;
+    data.categories = g_string_new("");
+    data.entries = g_string_new("");
+    data.bitsets = g_string_new("");
+    data.keyword_words = (self->keywords->len + 31) / 32;
+    data.n_categories = 0;
+    data.n_entries = 0;
+
+    /* Category names are interned here, before strings are written */
+    g_tree_foreach(self->categories, save_category, &data);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.byte_order = CACHE_BYTE_ORDER;
+    header.n_categories = data.n_categories;
+    header.n_entries = data.n_entries;
+    header.n_keywords = self->keywords->len;
+    header.keyword_words = data.keyword_words;
+    header.n_tokens = self->tokens->len;
+
+    /* Cache with empty strings table is invalid */
+    if (self->strings->len == 0) {
+        (void)g_string_append_c(self->strings, '\0');
+    }
+    header.strings_size = (guint32)self->strings->len;
+
+    contents = g_string_new_len((const char *)&header, (gssize)sizeof(header));
+    (void)g_string_append_len(contents, data.categories->str, (gssize)data.categories->len);
+    (void)g_string_append_len(contents, data.entries->str, (gssize)data.entries->len);
+    (void)g_string_append_len(contents, self->keywords->data,
+        (gssize)(self->keywords->len * sizeof(guint32)));
+    (void)g_string_append_len(contents, data.bitsets->str, (gssize)data.bitsets->len);
+    (void)g_string_append_len(contents, self->tokens->data,
+        (gssize)(self->tokens->len * sizeof(guint32)));
+    (void)g_string_append_len(contents, self->strings->str, (gssize)self->strings->len);
+
+    result = g_file_set_contents(path, contents->str, (gssize)contents->len, error);
+
+    (void)g_string_free(contents, TRUE);
+    (void)g_string_free(data.categories, TRUE);
+    (void)g_string_free(data.entries, TRUE);
+    (void)g_string_free(data.bitsets, TRUE);
+
+    return result;
+}
@@ -0,0 +1,300 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Binary cache of pre-parsed md5-cache entries of a single repository. */
+
+#ifndef CP_PORTTREE_CACHE_H
+#define CP_PORTTREE_CACHE_H
+
+#include <cportage.h>
+
+#include "io.h"
+
+/*@-exportany@*/
+
+/**
+ * Dependency keys stored in cache.
+ */
+typedef enum {
+    CP_PORTTREE_DEPEND,
+    CP_PORTTREE_RDEPEND,
+    CP_PORTTREE_PDEPEND,
+    CP_PORTTREE_BDEPEND,
+    CP_PORTTREE_N_DEPS
+} CPPorttreeDep;
+
+/**
+ * md5-cache keys of dependencies, indexed by #CPPorttreeDep.
+ */
+extern const char * const cp_porttree_dep_keys[CP_PORTTREE_N_DEPS];
+
+/**
+ * Values parsed from a single md5-cache entry.
+ */
+typedef struct CPPorttreeCacheData {
+    /*@observer@*/ const char *pf;
+    /** %NULL if entry doesn't have EAPI key */
+    /*@observer@*/ /*@null@*/ const char *eapi;
+    /*@observer@*/ /*@null@*/ const char *slot;
+    /*@observer@*/ /*@null@*/ const char *keywords;
+    /*@observer@*/ /*@null@*/ const char *md5;
+    /*@observer@*/ /*@null@*/ const char *deps[CP_PORTTREE_N_DEPS];
+    /** Modification time of entry file */
+    CPTimestamp mtime;
+} CPPorttreeCacheData;
+
+/**
+ * Read-only memory-mapped porttree cache.
+ */
+typedef struct CPPorttreeCacheS *CPPorttreeCache;
+
+/**
+ * Maps cache file at \a path into memory.
+ *
+ * \return a #CPPorttreeCache or %NULL if \a path doesn't exist or isn't
+ *         a valid cache file, free it using cp_porttree_cache_destroy()
+ */
+/*@null@*/ /*@only@*/ CPPorttreeCache
+cp_porttree_cache_open(
+    const char *path
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT
+/*@modifies errno@*/ /*@globals fileSystem@*/;
+
+void
+cp_porttree_cache_destroy(
+    /*@null@*/ /*@only@*/ CPPorttreeCache self
+) /*@modifies self@*/;
+
+/**
+ * \return number of categories in \a self
+ */
+guint
+cp_porttree_cache_n_categories(
+    const CPPorttreeCache self
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return readonly name of \a i-th category in \a self
+ */
+/*@observer@*/ const char *
+cp_porttree_cache_category(
+    const CPPorttreeCache self,
+    guint i
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * Finds entries of \a category.
+ *
+ * \param mtime current modification time of md5-cache directory
+ *              of \a category, or %NULL to skip validation
+ * \param first return location for index of first entry of \a category,
+ *              entries are sorted by pf
+ * \param n     return location for number of entries
+ * \return      %TRUE if \a self has up-to-date data for \a category,
+ *              %FALSE otherwise
+ */
+gboolean
+cp_porttree_cache_get_category(
+    const CPPorttreeCache self,
+    const char *category,
+    /*@null@*/ const CPTimestamp *mtime,
+    /*@out@*/ guint *first,
+    /*@out@*/ guint *n
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *first,*n@*/;
+
+/**
+ * \return index of entry \a pf among \a n entries starting at \a first,
+ *         or -1 if there is no such entry
+ */
+gint
+cp_porttree_cache_find(
+    const CPPorttreeCache self,
+    guint first,
+    guint n,
+    const char *pf
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/*@observer@*/ const char *
+cp_porttree_cache_pf(const CPPorttreeCache self, guint i) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/*@observer@*/ const char *
+cp_porttree_cache_name(const CPPorttreeCache self, guint i) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/*@observer@*/ const char *
+cp_porttree_cache_version(const CPPorttreeCache self, guint i) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return position of entry \a i among entries with the same package name
+ *         in its category, sorted by version. Comparing ranks is the same
+ *         as comparing versions, without parsing them.
+ */
+guint
+cp_porttree_cache_rank(const CPPorttreeCache self, guint i) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return SLOT of entry \a i, empty string if it didn't have one
+ */
+/*@observer@*/ const char *
+cp_porttree_cache_slot(const CPPorttreeCache self, guint i) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return EAPI of entry \a i, #CP_EAPI_UNKNOWN if it isn't supported
+ */
+CPEapi
+cp_porttree_cache_eapi(const CPPorttreeCache self, guint i) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/*@observer@*/ const char *
+cp_porttree_cache_md5(const CPPorttreeCache self, guint i) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+void
+cp_porttree_cache_mtime(
+    const CPPorttreeCache self,
+    guint i,
+    /*@out@*/ CPTimestamp *mtime
+) /*@modifies *mtime@*/;
+
+/**
+ * \return number of distinct keywords in \a self
+ */
+guint
+cp_porttree_cache_n_keywords(const CPPorttreeCache self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return keyword that corresponds to bit \a bit in keyword bitsets
+ */
+/*@observer@*/ const char *
+cp_porttree_cache_keyword(const CPPorttreeCache self, guint bit) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \param n_words return location for number of words in bitset
+ * \return        readonly bitset of KEYWORDS of entry \a i
+ */
+/*@observer@*/ const guint32 *
+cp_porttree_cache_keywords(
+    const CPPorttreeCache self,
+    guint i,
+    /*@out@*/ guint *n_words
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *n_words@*/;
+
+/**
+ * Decodes KEYWORDS bitset of entry \a i.
+ *
+ * \return a %NULL-terminated string array, free it using g_strfreev()
+ */
+/*@only@*/ char **
+cp_porttree_cache_get_keywords(
+    const CPPorttreeCache self,
+    guint i
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * Dependencies are stored split into whitespace-separated tokens,
+ * so that parsers don't need to rescan the strings.
+ *
+ * \return number of \a dep tokens of entry \a i
+ */
+guint
+cp_porttree_cache_n_tokens(
+    const CPPorttreeCache self,
+    guint i,
+    CPPorttreeDep dep
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/*@observer@*/ const char *
+cp_porttree_cache_token(
+    const CPPorttreeCache self,
+    guint i,
+    CPPorttreeDep dep,
+    guint token
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * Builder of a new cache file.
+ */
+typedef struct CPPorttreeCacheWriterS *CPPorttreeCacheWriter;
+
+/*@only@*/ CPPorttreeCacheWriter
+cp_porttree_cache_writer_new(void) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+void
+cp_porttree_cache_writer_destroy(
+    /*@null@*/ /*@only@*/ CPPorttreeCacheWriter self
+) /*@modifies self@*/;
+
+/**
+ * Starts \a category with md5-cache directory modified at \a mtime.
+ * Following entries are added to it.
+ */
+void
+cp_porttree_cache_writer_add_category(
+    CPPorttreeCacheWriter self,
+    const char *category,
+    const CPTimestamp *mtime
+) /*@modifies *self@*/;
+
+/**
+ * Adds entry parsed from md5-cache to current category.
+ *
+ * \return %FALSE if \a data->pf isn't a valid package name and version
+ */
+gboolean
+cp_porttree_cache_writer_add_entry(
+    CPPorttreeCacheWriter self,
+    const CPPorttreeCacheData *data
+) /*@modifies *self@*/;
+
+/**
+ * Adds \a i-th entry of \a cache to current category as is, except for
+ * its modification time that is set to \a mtime.
+ */
+void
+cp_porttree_cache_writer_copy_entry(
+    CPPorttreeCacheWriter self,
+    const CPPorttreeCache cache,
+    guint i,
+    const CPTimestamp *mtime
+) /*@modifies *self@*/;
+
+/**
+ * Copies \a category data from \a cache to \a self as is.
+ *
+ * \return %TRUE if \a cache contains \a category, %FALSE otherwise
+ */
+gboolean
+cp_porttree_cache_writer_copy_category(
+    CPPorttreeCacheWriter self,
+    const CPPorttreeCache cache,
+    const char *category
+) /*@modifies *self@*/;
+
+/**
+ * Atomically writes cache to \a path.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_porttree_cache_writer_save(
+    const CPPorttreeCacheWriter self,
+    const char *path,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *error,errno,fileSystem@*/ /*@globals fileSystem@*/;
+
+#endif
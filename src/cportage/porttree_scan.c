@@ -0,0 +1,660 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Scan results are cached in porttree cache format (see porttree_cache.c)
+  with one "category/package" record per package directory. Record
+  modification time is the one of package directory, so adding, removing
+  or replacing an ebuild invalidates the record. Ebuilds edited in place
+  don't change their directory and aren't noticed.
+ */
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <string.h>
+
+#include "atom.h"
+#include "eapi.h"
+#include "porttree_cache.h"
+#include "porttree_scan.h"
+#include "version.h"
+
+/** Ebuilds of a single package directory. */
+struct scan_package {
+    /** "category/package" */
+    /*@only@*/ char *key;
+    CPTimestamp mtime;
+    /** %TRUE if entries were taken from cache file */
+    gboolean cached;
+    /*@only@*/ GPtrArray/*<CPPorttreeScanEntry>*/ *entries;
+};
+
+/** Ebuilds of a single category. */
+struct scan_category {
+    /*@only@*/ GPtrArray/*<struct scan_package>*/ *packages;
+    /** Entries of all packages, owned by packages */
+    /*@only@*/ GPtrArray/*<CPPorttreeScanEntry>*/ *entries;
+};
+
+struct CPPorttreeScanS {
+    /*@only@*/ char *path;
+    /*@only@*/ /*@null@*/ char *cache_path;
+    /*@only@*/ /*@null@*/ CPPorttreeCache cache;
+    /** Contents of profiles/categories */
+    /*@only@*/ char **categories;
+    /** Set of valid category names from #categories */
+    /*@only@*/ GHashTable/*<char *, char *>*/ *listed;
+    /**
+     * Category->scan_category map of scanned categories,
+     * %NULL values for categories that don't exist
+     */
+    /*@only@*/ GHashTable *scanned;
+    /** %TRUE if some package directory was listed */
+    gboolean dirty;
+};
+
+static void
+entry_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    CPPorttreeScanEntry *entry = data;
+
+    g_free(entry->pf);
+    g_free(entry->name);
+    cp_version_unref(entry->version);
+    g_free(entry->slot);
+    g_free(entry->keywords);
+    g_free(entry);
+}
+
+static void
+package_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct scan_package *pkg = data;
+
+    g_free(pkg->key);
+    g_ptr_array_unref(pkg->entries);
+    g_free(pkg);
+}
+
+static void
+category_free(/*@null@*/ /*@only@*/ void *data) /*@modifies data@*/ {
+    struct scan_category *cat = data;
+
+    if (cat == NULL) {
+        return;
+    }
+
+    g_ptr_array_unref(cat->entries);
+    g_ptr_array_unref(cat->packages);
+    g_free(cat);
+}
+
+/**
+ * Finds assignment of \a key at the beginning of a line of ebuild
+ * \a contents, the way PMS requires EAPI to be detected.
+ *
+ * \param found return location for %TRUE if \a key is assigned at all
+ * \return      newly allocated value of first assignment or %NULL
+ *              if there is none or its value isn't literal
+ */
+static /*@null@*/ char *
+find_value(
+    const char *contents,
+    const char *key,
+    /*@out@*/ gboolean *found
+) /*@modifies *found@*/ {
+    size_t key_len = strlen(key);
+    const char *line = contents;
+
+    *found = FALSE;
+
+    while (line != NULL) {
+        const char *start = line + strspn(line, " \t");
+        const char *value;
+        const char *end;
+        const char *p;
+        char quote;
+
+        line = strchr(line, '\n');
+        if (line != NULL) {
+            ++line;
+        }
+
+        if (strncmp(start, key, key_len) != 0 || start[key_len] != '=') {
+            continue;
+        }
+
+        *found = TRUE;
+        value = start + key_len + 1;
+        quote = *value == '"' || *value == '\'' ? *value : '\0';
+        if (quote != '\0') {
+            ++value;
+            end = strchr(value, quote);
+        } else {
+            end = value + strcspn(value, " \t\n;#");
+        }
+
+        if (end == NULL) {
+            return NULL;
+        }
+        /* Everything is literal inside single quotes */
+        for (p = value; quote != '\'' && p < end; ++p) {
+            if (*p == '$' || *p == '`' || *p == '\\') {
+                return NULL;
+            }
+        }
+
+        return g_strndup(value, (gsize)(end - value));
+    }
+
+    return NULL;
+}
+
+/**
+ * Reads ebuild \a file of package \a pn in directory \a pkg_path.
+ *
+ * \return a #CPPorttreeScanEntry or %NULL if \a file isn't a valid ebuild
+ *         name, its EAPI isn't supported or it has no literal SLOT
+ */
+static /*@null@*/ CPPorttreeScanEntry *
+scan_ebuild(
+    const char *pkg_path,
+    const char *pn,
+    const char *file
+) /*@modifies errno@*/ /*@globals fileSystem@*/ {
+    CPPorttreeScanEntry *entry = NULL;
+    char *pf = g_strndup(file, strlen(file) - strlen(".ebuild"));
+    char *path = g_build_filename(pkg_path, file, NULL);
+    char *contents = NULL;
+    char *eapi_str = NULL;
+    char *slot = NULL;
+    char *name;
+    CPVersion version;
+    gboolean found;
+    CPEapi eapi;
+
+    if (!cp_atom_pv_split(pf, &name, &version, NULL)) {
+        g_free(path);
+        g_free(pf);
+        return NULL;
+    }
+
+    if (strcmp(name, pn) != 0 || !g_file_get_contents(path, &contents, NULL, NULL)) {
+        goto OUT;
+    }
+
+    eapi_str = find_value(contents, "EAPI", &found);
+    /* Ebuilds without EAPI assignment are EAPI 0 */
+    eapi = found && eapi_str == NULL
+        ? CP_EAPI_UNKNOWN
+        : cp_eapi_parse(eapi_str == NULL ? "0" : eapi_str, path, NULL);
+    slot = find_value(contents, "SLOT", &found);
+
+    if (eapi == CP_EAPI_UNKNOWN || slot == NULL
+            || !cp_atom_slot_validate(slot, eapi, NULL)) {
+        g_debug("Skipping ebuild '%s': unsupported EAPI or SLOT that isn't literal",
+            path);
+        goto OUT;
+    }
+
+    entry = g_new(CPPorttreeScanEntry, 1);
+    entry->pf = pf;
+    entry->name = name;
+    entry->version = version;
+    entry->eapi = eapi;
+    entry->slot = slot;
+    entry->keywords = find_value(contents, "KEYWORDS", &found);
+    pf = NULL;
+    name = NULL;
+    version = NULL;
+    slot = NULL;
+
+OUT:
+    g_free(slot);
+    g_free(eapi_str);
+    g_free(contents);
+    cp_version_unref(version);
+    g_free(name);
+    g_free(path);
+    g_free(pf);
+    return entry;
+}
+
+/**
+ * \return entry \a i of \a cache or %NULL if it can't be used
+ */
+static /*@null@*/ CPPorttreeScanEntry *
+cached_entry(const CPPorttreeCache cache, guint i) /*@*/ {
+    CPPorttreeScanEntry *entry;
+    const char *slot = cp_porttree_cache_slot(cache, i);
+    CPEapi eapi = cp_porttree_cache_eapi(cache, i);
+    char **keywords;
+
+    if (eapi == CP_EAPI_UNKNOWN || slot[0] == '\0') {
+        return NULL;
+    }
+
+    entry = g_new(CPPorttreeScanEntry, 1);
+    entry->pf = g_strdup(cp_porttree_cache_pf(cache, i));
+    entry->name = g_strdup(cp_porttree_cache_name(cache, i));
+    entry->version = cp_version_new(cp_porttree_cache_version(cache, i), NULL);
+    /* Cache only stores valid versions */
+    g_assert(entry->version != NULL);
+    entry->eapi = eapi;
+    entry->slot = g_strdup(slot);
+
+    keywords = cp_porttree_cache_get_keywords(cache, i);
+    entry->keywords = keywords[0] == NULL ? NULL : g_strjoinv(" ", keywords);
+    g_strfreev(keywords);
+
+    return entry;
+}
+
+/**
+ * Lists ebuilds in package directory \a pn of \a category, or takes
+ * them from cache if directory wasn't modified.
+ *
+ * \return a new scan_package or %NULL if \a pn isn't a directory
+ */
+static /*@null@*/ struct scan_package *
+scan_package(
+    const CPPorttreeScan self,
+    const char *category,
+    const char *cat_path,
+    const char *pn
+) /*@modifies errno@*/ /*@globals fileSystem@*/ {
+    char *path = g_build_filename(cat_path, pn, NULL);
+    struct scan_package *pkg;
+    struct stat st;
+    guint first;
+    guint n;
+    guint i;
+    GDir *dir;
+
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        g_free(path);
+        return NULL;
+    }
+
+    pkg = g_new(struct scan_package, 1);
+    pkg->key = g_strconcat(category, "/", pn, NULL);
+    pkg->mtime.sec = (guint64)st.st_mtim.tv_sec;
+    pkg->mtime.nsec = (guint64)st.st_mtim.tv_nsec;
+    pkg->entries = g_ptr_array_new_with_free_func(entry_free);
+    pkg->cached = self->cache != NULL && cp_porttree_cache_get_category(
+        self->cache, pkg->key, &pkg->mtime, &first, &n
+    );
+
+    if (pkg->cached) {
+        for (i = first; i < first + n; ++i) {
+            CPPorttreeScanEntry *entry = cached_entry(self->cache, i);
+
+            if (entry != NULL) {
+                g_ptr_array_add(pkg->entries, entry);
+            }
+        }
+        g_free(path);
+        return pkg;
+    }
+
+    /* Unreadable package directory has no ebuilds */
+    dir = g_dir_open(path, 0, NULL);
+    if (dir != NULL) {
+        CP_GDIR_ITER(dir, file) {
+            CPPorttreeScanEntry *entry;
+
+            if (!g_str_has_suffix(file, ".ebuild")) {
+                continue;
+            }
+
+            entry = scan_ebuild(path, pn, file);
+            if (entry != NULL) {
+                g_ptr_array_add(pkg->entries, entry);
+            }
+        } end_CP_GDIR_ITER
+
+        g_dir_close(dir);
+    }
+
+    g_free(path);
+    return pkg;
+}
+
+/**
+ * Scans package directories of \a category. Only immutable parts
+ * of \a self are read, so categories can be scanned concurrently.
+ *
+ * \param result return location for scanned category, %NULL if
+ *               its directory doesn't exist
+ * \param error  return location for a %GError, or %NULL
+ * \return       %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean
+scan_category(
+    const CPPorttreeScan self,
+    const char *category,
+    /*@out@*/ struct scan_category **result,
+    /*@null@*/ GError **error
+) /*@modifies *result,*error,errno@*/ /*@globals fileSystem@*/ {
+    char *path = g_build_filename(self->path, category, NULL);
+    GError *tmp_error = NULL;
+    struct scan_category *cat;
+    GDir *dir;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *result = NULL;
+
+    dir = g_dir_open(path, 0, &tmp_error);
+    if (dir == NULL) {
+        g_free(path);
+        if (g_error_matches(tmp_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)
+                || g_error_matches(tmp_error, G_FILE_ERROR, G_FILE_ERROR_NOTDIR)) {
+            g_error_free(tmp_error);
+            return TRUE;
+        }
+        g_propagate_error(error, tmp_error);
+        return FALSE;
+    }
+
+    cat = g_new(struct scan_category, 1);
+    cat->packages = g_ptr_array_new_with_free_func(package_free);
+    cat->entries = g_ptr_array_new();
+
+    CP_GDIR_ITER(dir, pn) {
+        struct scan_package *pkg = scan_package(self, category, path, pn);
+        guint i;
+
+        if (pkg == NULL) {
+            continue;
+        }
+
+        for (i = 0; i < pkg->entries->len; ++i) {
+            g_ptr_array_add(cat->entries, g_ptr_array_index(pkg->entries, i));
+        }
+        g_ptr_array_add(cat->packages, pkg);
+    } end_CP_GDIR_ITER
+
+    g_dir_close(dir);
+    g_free(path);
+
+    *result = cat;
+    return TRUE;
+}
+
+static void
+add_category(
+    CPPorttreeScan self,
+    const char *category,
+    /*@null@*/ /*@only@*/ struct scan_category *cat
+) /*@modifies *self,cat@*/ {
+    guint i;
+
+    for (i = 0; cat != NULL && i < cat->packages->len; ++i) {
+        const struct scan_package *pkg = g_ptr_array_index(cat->packages, i);
+
+        if (!pkg->cached) {
+            self->dirty = TRUE;
+        }
+    }
+
+    g_hash_table_insert(self->scanned, g_strdup(category), cat);
+}
+
+CPPorttreeScan
+cp_porttree_scan_new(const char *path, const char *cache_path) {
+    CPPorttreeScan self;
+    char *categories_path;
+
+    self = g_new0(struct CPPorttreeScanS, 1);
+    self->path = g_strdup(path);
+    self->cache_path = g_strdup(cache_path);
+    self->cache = cache_path == NULL ? NULL : cp_porttree_cache_open(cache_path);
+
+    categories_path = g_build_filename(path, "profiles", "categories", NULL);
+    self->categories = cp_io_getlines(categories_path, TRUE, NULL);
+    g_free(categories_path);
+    /* Repository without categories has no packages */
+    if (self->categories == NULL) {
+        self->categories = g_new0(char *, 1);
+    }
+
+    self->listed = g_hash_table_new(g_str_hash, g_str_equal);
+    CP_STRV_ITER(self->categories, category) {
+        if (cp_atom_category_validate(category, NULL)) {
+            g_hash_table_insert(self->listed, category, category);
+        }
+    } end_CP_STRV_ITER
+
+    self->scanned = g_hash_table_new_full(
+        g_str_hash, g_str_equal, g_free, category_free
+    );
+
+    return self;
+}
+
+void
+cp_porttree_scan_destroy(CPPorttreeScan self) {
+    if (self == NULL) {
+        return;
+    }
+
+    g_free(self->path);
+    g_free(self->cache_path);
+    cp_porttree_cache_destroy(self->cache);
+    g_hash_table_destroy(self->listed);
+    g_strfreev(self->categories);
+    g_hash_table_destroy(self->scanned);
+    g_free(self);
+}
+
+char **
+cp_porttree_scan_categories(const CPPorttreeScan self) {
+    return self->categories;
+}
+
+gboolean
+cp_porttree_scan_get_category(
+    CPPorttreeScan self,
+    const char *category,
+    const GPtrArray **entries,
+    GError **error
+) {
+    void *value;
+    struct scan_category *cat;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *entries = NULL;
+
+    if (g_hash_table_lookup_extended(self->scanned, category, NULL, &value)) {
+        cat = value;
+    } else {
+        if (!g_hash_table_contains(self->listed, category)) {
+            return TRUE;
+        }
+        if (!scan_category(self, category, &cat, error)) {
+            return FALSE;
+        }
+        add_category(self, category, cat);
+    }
+
+    if (cat != NULL) {
+        *entries = cat->entries;
+    }
+    return TRUE;
+}
+
+/** State shared between category scanning jobs. */
+struct scan_data {
+    /*@dependent@*/ CPPorttreeScan self;
+    /** Guards everything below and results in #self */
+    GMutex lock;
+    /** First error that occurred, remaining jobs are skipped after it */
+    /*@null@*/ GError *error;
+};
+
+static void
+scan_job(
+    /*@dependent@*/ void *data,
+    void *user_data
+) /*@modifies *user_data,errno@*/ /*@globals fileSystem@*/ {
+    const char *category = data;
+    struct scan_data *ctx = user_data;
+    struct scan_category *cat;
+    GError *error = NULL;
+    gboolean failed;
+
+    g_mutex_lock(&ctx->lock);
+    failed = ctx->error != NULL;
+    g_mutex_unlock(&ctx->lock);
+    if (failed) {
+        return;
+    }
+
+    failed = !scan_category(ctx->self, category, &cat, &error);
+
+    g_mutex_lock(&ctx->lock);
+    if (!failed) {
+        add_category(ctx->self, category, cat);
+    } else if (ctx->error == NULL) {
+        ctx->error = error;
+        error = NULL;
+    }
+    g_mutex_unlock(&ctx->lock);
+
+    if (error != NULL) {
+        g_error_free(error);
+    }
+}
+
+gboolean
+cp_porttree_scan_all(CPPorttreeScan self, guint jobs, GError **error) {
+    struct scan_data ctx;
+    GThreadPool *pool;
+    GHashTableIter iter;
+    GSList *todo = NULL;
+    void *category;
+
+    g_assert(error == NULL || *error == NULL);
+
+    /* Jobs add results to self->scanned, so it isn't looked at while they run */
+    g_hash_table_iter_init(&iter, self->listed);
+    while (g_hash_table_iter_next(&iter, &category, NULL)) {
+        if (!g_hash_table_contains(self->scanned, category)) {
+            todo = g_slist_prepend(todo, category);
+        }
+    }
+
+    if (todo == NULL) {
+        return TRUE;
+    }
+
+    ctx.self = self;
+    g_mutex_init(&ctx.lock);
+    ctx.error = NULL;
+
+    pool = g_thread_pool_new(scan_job, &ctx, (gint)jobs, TRUE, error);
+    if (pool != NULL) {
+        CP_GSLIST_ITER(todo, elem) {
+            /* Pool owns its threads, so pushing can't fail */
+            (void)g_thread_pool_push(pool, elem, NULL);
+        } end_CP_GSLIST_ITER
+        g_thread_pool_free(pool, FALSE, TRUE);
+    }
+
+    g_slist_free(todo);
+    g_mutex_clear(&ctx.lock);
+
+    if (ctx.error != NULL) {
+        g_propagate_error(error, ctx.error);
+        return FALSE;
+    }
+    return pool != NULL;
+}
+
+gboolean
+cp_porttree_scan_save(CPPorttreeScan self, GError **error) {
+    CPPorttreeCacheWriter writer;
+    GHashTableIter iter;
+    void *value;
+    gboolean result;
+    guint i;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!self->dirty || self->cache_path == NULL) {
+        return TRUE;
+    }
+
+    writer = cp_porttree_cache_writer_new();
+
+    for (i = 0; self->cache != NULL && i < cp_porttree_cache_n_categories(self->cache); ++i) {
+        const char *key = cp_porttree_cache_category(self->cache, i);
+        const char *slash = strchr(key, '/');
+        char *category;
+
+        if (slash == NULL) {
+            continue;
+        }
+
+        category = g_strndup(key, (gsize)(slash - key));
+        if (g_hash_table_contains(self->listed, category)
+                && !g_hash_table_contains(self->scanned, category)) {
+            (void)cp_porttree_cache_writer_copy_category(writer, self->cache, key);
+        }
+        g_free(category);
+    }
+
+    g_hash_table_iter_init(&iter, self->scanned);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        const struct scan_category *cat = value;
+
+        for (i = 0; cat != NULL && i < cat->packages->len; ++i) {
+            const struct scan_package *pkg = g_ptr_array_index(cat->packages, i);
+            guint j;
+
+            if (pkg->cached) {
+                (void)cp_porttree_cache_writer_copy_category(writer, self->cache, pkg->key);
+                continue;
+            }
+
+            cp_porttree_cache_writer_add_category(writer, pkg->key, &pkg->mtime);
+            for (j = 0; j < pkg->entries->len; ++j) {
+                const CPPorttreeScanEntry *entry = g_ptr_array_index(pkg->entries, j);
+                CPPorttreeCacheData data;
+
+                memset(&data, 0, sizeof(data));
+                data.pf = entry->pf;
+                data.eapi = cp_eapi_str(entry->eapi);
+                data.slot = entry->slot;
+                data.keywords = entry->keywords;
+                data.mtime = pkg->mtime;
+                (void)cp_porttree_cache_writer_add_entry(writer, &data);
+            }
+        }
+    }
+
+    result = cp_porttree_cache_writer_save(writer, self->cache_path, error);
+    if (result) {
+        self->dirty = FALSE;
+    }
+
+    cp_porttree_cache_writer_destroy(writer);
+    return result;
+}
@@ -0,0 +1,124 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Ebuild directory scanner for repositories without md5-cache. */
+
+#ifndef CP_PORTTREE_SCAN_H
+#define CP_PORTTREE_SCAN_H
+
+#include <cportage.h>
+
+/*@-exportany@*/
+
+/**
+ * Ebuild found in package directory, with metadata that can be read
+ * without running bash. Only ebuilds with supported EAPI and literal
+ * SLOT are kept.
+ */
+typedef struct CPPorttreeScanEntry {
+    /*@only@*/ char *pf;
+    /*@only@*/ char *name;
+    /*@only@*/ CPVersion version;
+    CPEapi eapi;
+    /*@only@*/ char *slot;
+    /** %NULL if KEYWORDS aren't assigned a literal value */
+    /*@only@*/ /*@null@*/ char *keywords;
+} CPPorttreeScanEntry;
+
+/**
+ * Scanner of a single repository.
+ */
+typedef struct CPPorttreeScanS *CPPorttreeScan;
+
+/**
+ * Creates scanner of repository at \a path. Only categories listed
+ * in its profiles/categories are scanned.
+ *
+ * \param cache_path file where results are kept between runs,
+ *                   or %NULL to scan everything every time
+ * \return           a #CPPorttreeScan, free it using cp_porttree_scan_destroy()
+ */
+/*@only@*/ CPPorttreeScan
+cp_porttree_scan_new(
+    const char *path,
+    /*@null@*/ const char *cache_path
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT
+/*@modifies errno@*/ /*@globals fileSystem@*/;
+
+void
+cp_porttree_scan_destroy(
+    /*@null@*/ /*@only@*/ CPPorttreeScan self
+) /*@modifies self@*/;
+
+/**
+ * \return readonly %NULL-terminated list of categories of \a self
+ */
+/*@observer@*/ char **
+cp_porttree_scan_categories(const CPPorttreeScan self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * Lists ebuilds of \a category unless it was already scanned. Package
+ * directories that weren't modified since results were cached aren't
+ * listed again.
+ *
+ * \param entries return location for readonly array of
+ *                #CPPorttreeScanEntry, %NULL if \a category isn't listed
+ *                or doesn't exist
+ * \param error   return location for a %GError, or %NULL
+ * \return        %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_porttree_scan_get_category(
+    CPPorttreeScan self,
+    const char *category,
+    /*@out@*/ const GPtrArray/*<CPPorttreeScanEntry>*/ **entries,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*entries,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Scans all categories that weren't scanned yet using a pool
+ * of \a jobs threads, one category per thread at a time.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_porttree_scan_all(
+    CPPorttreeScan self,
+    guint jobs,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Writes scan results to cache file if some package directories
+ * were listed. Categories that weren't scanned are kept as is.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_porttree_scan_save(
+    CPPorttreeScan self,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*error,errno,fileSystem@*/ /*@globals fileSystem@*/;
+
+#endif
@@ -17,46 +17,84 @@
     along with cportage.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
 
 #include "repository.h"
+#include "snapshot.h"
+#include "strings.h"
 
 struct CPRepositoryS {
     /*@only@*/ char *name;
     /*@only@*/ char *path;
+    /** Names from "masters" key of layout.conf, %NULL if it's missing */
+    /*@only@*/ /*@null@*/ char **masters;
+    /** %TRUE if path is a regular file */
+    gboolean is_snapshot;
+    /** Archive repository is read from, %NULL for directories */
+    /*@only@*/ /*@null@*/ CPSnapshot snapshot;
 
     /*@refs@*/ unsigned int refs;
 };
 
 static char * G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT
 read_repo_name(
-    const char *repo_path
-) /*@modifies *stderr,errno@*/ /*@globals fileSystem@*/ {
-    /*@only@*/ char *result = NULL;
-    char *path = g_build_filename(repo_path, "profiles", "repo_name", NULL);
-    /*@-modfilesys@*/
-    FILE *f = cp_io_fopen(path, "r", NULL);
-    /*@=modfilesys@*/
+    const CPRepository self
+) /*@modifies errno@*/ /*@globals fileSystem@*/ {
+    char **lines = cp_repository_getlines(self, "profiles/repo_name", NULL);
+    char *result;
 
     /* TODO: validate repo name */
-    if (f == NULL || cp_io_getline(f, path, &result, NULL) <= 0) {
-        char *basename = g_path_get_basename(repo_path);
+    if (lines == NULL || lines[0] == NULL) {
+        char *basename = g_path_get_basename(self->path);
         result = g_strconcat("x-", basename, NULL);
         g_free(basename);
         g_debug(_("Repository '%s' is missing 'profiles/repo_name' file,"
-          " using '%s' as repository name"), repo_path, result);
+          " using '%s' as repository name"), self->path, result);
     } else {
-        g_assert(result != NULL);
-        (void)g_strstrip(result);
+        result = g_strdup(lines[0]);
     }
 
-    if (f != NULL) {
-        /*@-modfilesys@*/
-        (void)fclose(f);
-        /*@=modfilesys@*/
+    g_strfreev(lines);
+    return result;
+}
+
+/**
+ * \return value of "masters" key of metadata/layout.conf split into
+ *         repository names, or %NULL if there is no such key
+ */
+static /*@null@*/ char ** G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT
+read_masters(
+    const CPRepository self
+) /*@modifies errno@*/ /*@globals fileSystem@*/ {
+    char **lines = cp_repository_getlines(self, "metadata/layout.conf", NULL);
+    char **result = NULL;
+
+    if (lines == NULL) {
+        return NULL;
     }
 
-    g_free(path);
+    /* layout.conf consists of "key = value" lines */
+    CP_STRV_ITER(lines, line) {
+        char *eq = strchr(line, '=');
+
+        if (eq == NULL) {
+            continue;
+        }
+        *eq = '\0';
+        if (strcmp(g_strstrip(line), "masters") == 0) {
+            g_strfreev(result);
+            result = cp_strings_pysplit(eq + 1);
+        }
+    } end_CP_STRV_ITER
+
+    g_strfreev(lines);
     return result;
 }
 
@@ -68,8 +106,24 @@ cp_repository_new(const char *path) {
     self->refs = (unsigned int)1;
     g_assert(self->path == NULL);
     self->path = g_strdup(path);
+
+    self->is_snapshot = g_file_test(path, G_FILE_TEST_IS_REGULAR);
+    if (self->is_snapshot) {
+        GError *error = NULL;
+
+        g_assert(self->snapshot == NULL);
+        self->snapshot = cp_snapshot_open(path, &error);
+        /* Unreadable snapshot is an empty repository */
+        if (self->snapshot == NULL) {
+            g_warning(_("Can't read repository snapshot: %s"), error->message);
+            g_error_free(error);
+        }
+    }
+
     g_assert(self->name == NULL);
-    self->name = read_repo_name(path);
+    self->name = read_repo_name(self);
+    g_assert(self->masters == NULL);
+    self->masters = read_masters(self);
 
     return self;
 }
@@ -97,12 +151,48 @@ cp_repository_unref(CPRepository self) {
 
     g_free(self->name);
     g_free(self->path);
+    g_strfreev(self->masters);
+    cp_snapshot_destroy(self->snapshot);
 
     /*@-refcounttrans@*/
     g_free(self);
     /*@=refcounttrans@*/
 }
 
+/**
+ * Replaces snapshot of \a self with "<snapshot>.new" file, if there is one.
+ * Rename is atomic, so readers see either old or new snapshot.
+ */
+static int
+sync_snapshot(
+    const CPRepository self,
+    /*@null@*/ GError **error
+) /*@modifies *error,errno,fileSystem@*/ /*@globals fileSystem@*/ {
+    char *new_path = g_strconcat(self->path, ".new", NULL);
+    int saved_errno;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!g_file_test(new_path, G_FILE_TEST_IS_REGULAR)) {
+        g_message(_("No new snapshot for %s, skipping"), self->path);
+        g_free(new_path);
+        return EXIT_SUCCESS;
+    }
+
+    if (g_rename(new_path, self->path) != 0) {
+        saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+            _("Can't replace snapshot %s with %s: %s"),
+            self->path, new_path, g_strerror(saved_errno));
+        g_free(new_path);
+        return EXIT_FAILURE;
+    }
+
+    g_message(_("Replaced snapshot %s"), self->path);
+    g_free(new_path);
+    return EXIT_SUCCESS;
+}
+
 int
 cp_repository_sync(const CPRepository self, GError **error) {
     gboolean result;
@@ -111,6 +201,10 @@ cp_repository_sync(const CPRepository self, GError **error) {
 
     g_assert(error == NULL || *error == NULL);
 
+    if (self->is_snapshot) {
+        return sync_snapshot(self, error);
+    }
+
     sync_cmd = g_strsplit("git pull", " ", 0);
     g_message(_("Starting git pull in %s..."), self->path);
     result = g_spawn_sync(self->path, sync_cmd, NULL, (gint)G_SPAWN_SEARCH_PATH,
@@ -146,3 +240,130 @@ const char *
 cp_repository_path(const CPRepository self) {
     return self->path;
 }
+
+char **
+cp_repository_masters(const CPRepository self) {
+    return self->masters;
+}
+
+gboolean
+cp_repository_is_snapshot(const CPRepository self) {
+    return self->is_snapshot;
+}
+
+gboolean
+cp_repository_stat(
+    const CPRepository self,
+    const char *path,
+    CPTimestamp *mtime,
+    gboolean *is_dir
+) {
+    struct stat st;
+    char *full_path;
+    int status;
+
+    mtime->sec = 0;
+    mtime->nsec = 0;
+    *is_dir = FALSE;
+
+    if (self->snapshot != NULL) {
+        return cp_snapshot_stat(self->snapshot, path, mtime, is_dir);
+    }
+
+    full_path = g_build_filename(self->path, path, NULL);
+    status = stat(full_path, &st);
+    g_free(full_path);
+    if (status != 0) {
+        return FALSE;
+    }
+
+    mtime->sec = (guint64)st.st_mtim.tv_sec;
+    mtime->nsec = (guint64)st.st_mtim.tv_nsec;
+    *is_dir = S_ISDIR(st.st_mode);
+    return TRUE;
+}
+
+char **
+cp_repository_list(const CPRepository self, const char *path, GError **error) {
+    GPtrArray *names;
+    char *full_path;
+    GDir *dir;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (self->snapshot != NULL) {
+        return cp_snapshot_list(self->snapshot, path, error);
+    }
+
+    full_path = g_build_filename(self->path, path, NULL);
+    dir = g_dir_open(full_path, 0, error);
+    g_free(full_path);
+    if (dir == NULL) {
+        return NULL;
+    }
+
+    names = g_ptr_array_new();
+    CP_GDIR_ITER(dir, name) {
+        g_ptr_array_add(names, g_strdup(name));
+    } end_CP_GDIR_ITER
+    g_ptr_array_add(names, NULL);
+    g_dir_close(dir);
+
+    return (char **)g_ptr_array_free(names, FALSE);
+}
+
+GBytes *
+cp_repository_read(const CPRepository self, const char *path, GError **error) {
+    GMappedFile *file;
+    GBytes *result;
+    char *full_path;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (self->snapshot != NULL) {
+        return cp_snapshot_read(self->snapshot, path, error);
+    }
+
+    full_path = g_build_filename(self->path, path, NULL);
+    file = g_mapped_file_new(full_path, FALSE, error);
+    g_free(full_path);
+    if (file == NULL) {
+        return NULL;
+    }
+
+    result = g_mapped_file_get_bytes(file);
+    g_mapped_file_unref(file);
+    return result;
+}
+
+char **
+cp_repository_getlines(const CPRepository self, const char *path, GError **error) {
+    GBytes *bytes;
+    char *data;
+    char **result;
+    gsize len;
+    const char *contents;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (self->snapshot == NULL) {
+        char *full_path = g_build_filename(self->path, path, NULL);
+
+        result = cp_io_getlines(full_path, TRUE, error);
+        g_free(full_path);
+        return result;
+    }
+
+    bytes = cp_snapshot_read(self->snapshot, path, error);
+    if (bytes == NULL) {
+        return NULL;
+    }
+
+    contents = g_bytes_get_data(bytes, &len);
+    data = g_strndup(contents, len);
+    result = cp_string_lines(data, TRUE);
+
+    g_free(data);
+    g_bytes_unref(bytes);
+    return result;
+}
@@ -22,10 +22,14 @@
 
 #include <cportage.h>
 
+#include "io.h"
+
 /*@-exportany@*/
 
 /**
  * Creates a #CPRepository with given path. Assumes path is absolute.
+ * If \a path is a regular file, it's read as an uncompressed tar snapshot
+ * of repository, see cp_repository_is_snapshot().
  *
  * \return a #CPRepository, free it using cp_repository_unref()
  */
@@ -35,4 +39,82 @@ cp_repository_new(
 ) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT
 /*@modifies *stderr,errno@*/ /*@globals fileSystem@*/;
 
+/**
+ * \return readonly names of repositories \a self inherits eclasses from,
+ *         as listed in "masters" key of its metadata/layout.conf, or %NULL
+ *         if it doesn't have that key
+ */
+/*@observer@*/ /*@null@*/ char **
+cp_repository_masters(const CPRepository self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * Snapshot repositories are read straight from a tar archive, without
+ * unpacking it. Their sync replaces the archive with "<archive>.new".
+ *
+ * \return %TRUE if \a self is a snapshot, %FALSE if it's a directory
+ */
+gboolean
+cp_repository_is_snapshot(
+    const CPRepository self
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/*
+  Functions below access repository files by paths relative to repository
+  root, the same way for directories and snapshots. Errors are reported
+  in G_FILE_ERROR domain, like for real files.
+ */
+
+/**
+ * \param mtime  return location for modification time of \a path
+ * \param is_dir return location for %TRUE if \a path is a directory
+ * \return       %TRUE if \a path exists, %FALSE otherwise
+ */
+gboolean
+cp_repository_stat(
+    const CPRepository self,
+    const char *path,
+    /*@out@*/ CPTimestamp *mtime,
+    /*@out@*/ gboolean *is_dir
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *mtime,*is_dir,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * \param error return location for a %GError, or %NULL
+ * \return      %NULL-terminated array of names in directory \a path
+ *              or %NULL if an error occurred, free it using g_strfreev()
+ */
+/*@null@*/ /*@only@*/ char **
+cp_repository_list(
+    const CPRepository self,
+    const char *path,
+    /*@null@*/ GError **error
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Maps file \a path into memory.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      contents of \a path or %NULL if an error occurred,
+ *              free them using g_bytes_unref()
+ */
+/*@null@*/ /*@only@*/ GBytes *
+cp_repository_read(
+    const CPRepository self,
+    const char *path,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * Same as cp_io_getlines() with comments ignored, for file \a path.
+ */
+/*@null@*/ /*@only@*/ char **
+cp_repository_getlines(
+    const CPRepository self,
+    const char *path,
+    /*@null@*/ GError **error
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *error,errno@*/ /*@globals fileSystem@*/;
+
 #endif
@@ -17,12 +17,16 @@
     along with cportage.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 
 #include "collections.h"
 #include "eapi.h"
+#include "eclass_index.h"
 #include "error.h"
 #include "incrementals.h"
+#include "io_batch.h"
 #include "path.h"
 #include "repository.h"
 #include "settings.h"
@@ -35,10 +39,14 @@ struct CPSettingsS {
 
     /*@owned@*/ GTree/*<char *, char *>*/ *config;
     /*@only@*/ CPIncrementals incrementals;
+    /** Profile directories, parents first */
+    /*@only@*/ GSList/*<char *>*/ *profiles;
 
     CPRepository main_repo;
     /*@only@*/ GSList/*<CPRepository>*/ *repos;
     /*@only@*/ GTree/*<char *,CPRepository>*/ *name2repo;
+    /** Eclasses of #repos, %NULL until they're asked for */
+    /*@only@*/ /*@null@*/ CPEclassIndex eclasses;
 
     /*@refs@*/ unsigned int refs;
 };
@@ -161,7 +169,8 @@ add_profile(
  * Calls cp_settings_add_profile() for each profile in parents file.
  *
  * \param self         a #CPSettings structure
- * \param parents_file file with parent list (must exist)
+ * \param parents_file file with parent list
+ * \param contents     contents of \a parents_file
  * \param error        return location for a %GError, or %NULL
  * \return             %TRUE on success, %FALSE if an error occurred
  */
@@ -169,6 +178,7 @@ static gboolean G_GNUC_WARN_UNUSED_RESULT
 add_parent_profiles(
     CPSettings self,
     const char *parents_file,
+    const char *contents,
     /*@null@*/ GError **error
 ) /*@modifies *self,*error,*stderr,errno@*/ /*@globals fileSystem@*/ {
     char *basedir;
@@ -177,10 +187,7 @@ add_parent_profiles(
 
     g_assert(error == NULL || *error == NULL);
 
-    parents = cp_io_getlines(parents_file, TRUE, error);
-    if (parents == NULL) {
-        return FALSE;
-    }
+    parents = cp_string_lines(contents, TRUE);
     basedir = g_path_get_dirname(parents_file);
 
     CP_STRV_ITER(parents, parent) {
@@ -201,48 +208,117 @@ add_parent_profiles(
     return result;
 }
 
+/** Files of profile directory, read together by add_profile() */
+enum {
+    PROFILE_EAPI,
+    PROFILE_DEPRECATED,
+    PROFILE_PARENT,
+    PROFILE_USE_MASK,
+    PROFILE_USE_FORCE,
+    PROFILE_N_FILES
+};
+
+/*@observer@*/ /*@unchecked@*/ static const char * const profile_files[PROFILE_N_FILES] = {
+    "eapi", "deprecated", "parent", "use.mask", "use.force"
+};
+
+/**
+ * Reports failure to read profile file \a req, missing file isn't an error.
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+check_profile_file(
+    const CPIOBatchRequest *req,
+    /*@null@*/ GError **error
+) /*@modifies *error@*/ {
+    g_assert(error == NULL || *error == NULL);
+
+    if (req->error != 0 && req->error != ENOENT) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(req->error),
+            _("Can't read '%s': %s"), req->path, g_strerror(req->error));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Checks EAPI of profile from its \a req file.
+ * Missing file means latest EAPI.
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+check_profile_eapi(
+    CPIOBatchRequest *req,
+    /*@null@*/ GError **error
+) /*@modifies *req,*error@*/ {
+    g_assert(error == NULL || *error == NULL);
+
+    if (req->contents == NULL) {
+        return TRUE;
+    }
+
+    return cp_eapi_parse(g_strstrip(req->contents), req->path, error)
+        != CP_EAPI_UNKNOWN;
+}
+
 /** See declaration above. */
 static gboolean
 add_profile(CPSettings self, const char *profile_dir, GError **error) {
-    char *path;
+    CPIOBatchRequest files[PROFILE_N_FILES];
+    char *paths[PROFILE_N_FILES];
     gboolean result = TRUE;
+    size_t i;
 
     g_assert(error == NULL || *error == NULL);
 
-    /* Check eapi */
-    path = g_build_filename(profile_dir, "eapi", NULL);
-    result = cp_eapi_parse_file(path, error) != CP_EAPI_UNKNOWN;
-    g_free(path);
-    if (!result) {
-        return FALSE;
+    /* Line-based profile files are read in one batch */
+    for (i = 0; i < PROFILE_N_FILES; ++i) {
+        paths[i] = g_build_filename(profile_dir, profile_files[i], NULL);
+        files[i].dir_fd = AT_FDCWD;
+        files[i].path = paths[i];
+    }
+    cp_io_batch_read(files, PROFILE_N_FILES, 1);
+
+    for (i = 0; i < PROFILE_N_FILES && result; ++i) {
+        result = check_profile_file(&files[i], error);
     }
 
+    /* Check eapi */
+    result = result && check_profile_eapi(&files[PROFILE_EAPI], error);
+
     /* Check whether profile is deprecated */
-    path = g_build_filename(profile_dir, "deprecated", NULL);
-    if (g_file_test(path, G_FILE_TEST_EXISTS)) {
+    if (result && files[PROFILE_DEPRECATED].error != ENOENT) {
         g_warning("Profile %s is deprecated", profile_dir);
         /* TODO: read and print deprecation reason from file */
     }
-    g_free(path);
 
     /* Load parents */
-    path = g_build_filename(profile_dir, "parent", NULL);
-    if (g_file_test(path, G_FILE_TEST_EXISTS)) {
-        result = add_parent_profiles(self, path, error);
+    if (result && files[PROFILE_PARENT].contents != NULL) {
+        result = add_parent_profiles(
+            self, paths[PROFILE_PARENT], files[PROFILE_PARENT].contents, error
+        );
     }
-    g_free(path);
-    if (!result) {
-        return FALSE;
+
+    if (result) {
+        self->profiles = g_slist_append(self->profiles, g_strdup(profile_dir));
+
+        /* Parse profile configs */
+        result = load_make_config(self, g_build_filename(profile_dir, "make.defaults", NULL), FALSE, TRUE, error);
     }
 
-    /* Parse profile configs */
-    if (!load_make_config(self, g_build_filename(profile_dir, "make.defaults", NULL), FALSE, TRUE, error)) {
-        return FALSE;
+    if (result) {
+        cp_incrementals_process_profile(
+            self->incrementals,
+            files[PROFILE_USE_MASK].contents,
+            files[PROFILE_USE_FORCE].contents
+        );
     }
 
-    return cp_incrementals_process_profile(
-        self->incrementals, profile_dir, error
-    );
+    cp_io_batch_clear(files, PROFILE_N_FILES);
+    for (i = 0; i < PROFILE_N_FILES; ++i) {
+        g_free(paths[i]);
+    }
+
+    return result;
 }
 
 /** TODO: documentation */
@@ -309,9 +385,11 @@ init_repos(CPSettings self) /*@modifies *self,*stderr,errno@*/ /*@globals fileSy
         CPRepository repo;
         const char *name;
 
-        if (!g_file_test(path, G_FILE_TEST_IS_DIR)) {
-            g_warning("PORTDIR_OVERLAY contains '%s' which is not a directory",
-                path);
+        /* Regular files are repository snapshots */
+        if (!g_file_test(path, G_FILE_TEST_IS_DIR)
+                && !g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+            g_warning("PORTDIR_OVERLAY contains '%s' which is neither"
+                " a directory nor a snapshot", path);
             continue;
         }
 
@@ -475,7 +553,9 @@ cp_settings_unref(CPSettings self) {
 
     cp_tree_destroy(self->config);
     cp_incrementals_destroy(self->incrementals);
+    g_slist_free_full(self->profiles, g_free);
 
+    cp_eclass_index_unref(self->eclasses);
     cp_tree_destroy(self->name2repo);
     cp_repository_unref(self->main_repo);
     /* Repositories refcount is decremented during name2repo destruction */
@@ -501,6 +581,16 @@ cp_settings_get_repository(const CPSettings self, const char *name) {
     return g_tree_lookup(self->name2repo, name);
 }
 
+CPEclassIndex
+cp_settings_eclass_index(CPSettings self) {
+    if (self->eclasses == NULL) {
+        self->eclasses = cp_eclass_index_new(self->repos);
+    }
+    cp_eclass_index_refresh(self->eclasses);
+
+    return cp_eclass_index_ref(self->eclasses);
+}
+
 const char *
 cp_settings_get_default(
     const CPSettings self,
@@ -534,6 +624,73 @@ cp_settings_get_required(
     return result;
 }
 
+gboolean
+cp_settings_get_uint(
+    const CPSettings self,
+    const char *key,
+    guint fallback,
+    guint *value,
+    GError **error
+) {
+    const char *str;
+    char *end;
+    guint64 result;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *value = fallback;
+    str = cp_settings_get(self, key);
+    if (str == NULL) {
+        return TRUE;
+    }
+
+    /* g_ascii_strtoull() skips whitespace and accepts negative numbers */
+    errno = 0;
+    result = g_ascii_isdigit(str[0]) ? g_ascii_strtoull(str, &end, 10) : 0;
+    if (!g_ascii_isdigit(str[0]) || *end != '\0' || errno != 0
+            || result > (guint64)G_MAXUINT) {
+        g_set_error(error, CP_ERROR, (gint)CP_ERROR_SETTINGS_INVALID_VALUE,
+            _("Invalid value of config variable '%s': '%s'"), key, str);
+        return FALSE;
+    }
+
+    *value = (guint)result;
+    return TRUE;
+}
+
+gboolean
+cp_settings_get_boolean(
+    const CPSettings self,
+    const char *key,
+    gboolean fallback,
+    gboolean *value,
+    GError **error
+) {
+    const char *str;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *value = fallback;
+    str = cp_settings_get(self, key);
+    if (str == NULL) {
+        return TRUE;
+    }
+
+    switch (cp_string_truth(str)) {
+        case CP_TRUE:
+            *value = TRUE;
+            return TRUE;
+        case CP_FALSE:
+            *value = FALSE;
+            return TRUE;
+        case CP_UNKNOWN:
+        default:
+            g_set_error(error, CP_ERROR, (gint)CP_ERROR_SETTINGS_INVALID_VALUE,
+                _("Invalid value of config variable '%s': '%s'"), key, str);
+            return FALSE;
+    }
+}
+
 const char *
 cp_settings_profile(const CPSettings self) {
     return self->profile;
@@ -544,7 +701,22 @@ cp_settings_config_root(const CPSettings self) {
     return self->config_root;
 }
 
+GSList *
+cp_settings_profiles(const CPSettings self) {
+    return self->profiles;
+}
+
 gboolean
 cp_settings_feature_enabled(const CPSettings self, const char *feature) {
     return cp_incrementals_contains(self->incrementals, "FEATURES", feature);
 }
+
+const char *
+cp_settings_configured_use(const CPSettings self) {
+    return cp_incrementals_configured_use(self->incrementals);
+}
+
+const char *
+cp_settings_disabled_use(const CPSettings self) {
+    return cp_incrementals_disabled_use(self->incrementals);
+}
@@ -22,6 +22,8 @@
 
 #include <cportage.h>
 
+#include "eclass_index.h"
+
 /*@-exportany@*/
 
 /**
@@ -30,6 +32,13 @@
 /*@observer@*/ const char *
 cp_settings_config_root(const CPSettings self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
 
+/**
+ * \return readonly list of canonical paths to profile directories,
+ *         parents first
+ */
+/*@observer@*/ GSList/*<char *>*/ *
+cp_settings_profiles(const CPSettings self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
 /**
  * \return %TRUE if \a feature is enabled in \c FEATURES variable,
  *         %FALSE otherwise
@@ -40,4 +49,31 @@ cp_settings_feature_enabled(
     const char *feature
 ) G_GNUC_WARN_UNUSED_RESULT /*@*/;
 
+/**
+ * \return readonly USE of \a self before use.force and use.mask were
+ *         applied, USE engine applies them per package instead
+ */
+/*@observer@*/ const char *
+cp_settings_configured_use(const CPSettings self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return readonly flags negated in USE of \a self since last "-*",
+ *         or "*" if there was one. IUSE defaults don't enable them.
+ */
+/*@observer@*/ const char *
+cp_settings_disabled_use(const CPSettings self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * Returns eclass index of repositories of \a self. It's created once
+ * per settings object and refreshed on every call, so that only
+ * repositories whose eclass directories changed are listed again.
+ * Must not be called while index lookups are running.
+ *
+ * \return a #CPEclassIndex, free it using cp_eclass_index_unref()
+ */
+/*@newref@*/ CPEclassIndex
+cp_settings_eclass_index(
+    CPSettings self
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *self,errno@*/ /*@globals fileSystem@*/;
+
 #endif
@@ -0,0 +1,690 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Tar archives consist of 512-byte blocks: a header block per member,
+  followed by member data padded to whole blocks, and zero blocks at the
+  end. Supported headers are ustar (with name prefix), GNU long names
+  ('L' and 'K' members) and pax extended headers ('x' members, only path,
+  linkpath, size and mtime keys are used). Hard links share data of their
+  target, symbolic links and special files are skipped.
+
+  The whole archive is indexed when it's opened, directories that don't
+  have members of their own get modification time of the archive.
+ */
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <string.h>
+
+#include "snapshot.h"
+
+#define BLOCK_SIZE 512
+
+/* Offsets of ustar header fields */
+#define HEADER_NAME 0
+#define HEADER_SIZE 124
+#define HEADER_MTIME 136
+#define HEADER_CHKSUM 148
+#define HEADER_TYPE 156
+#define HEADER_LINKNAME 157
+#define HEADER_MAGIC 257
+#define HEADER_PREFIX 345
+
+struct member {
+    /** Offset of member data in archive */
+    guint64 offset;
+    guint64 size;
+    CPTimestamp mtime;
+    /** Names of directory entries, %NULL for files */
+    /*@only@*/ /*@null@*/ GPtrArray/*<char *>*/ *children;
+};
+
+struct CPSnapshotS {
+    /** Path of archive, for error messages */
+    /*@only@*/ char *path;
+    /*@only@*/ GBytes *data;
+    /** Path->member map, paths are relative to archive root */
+    /*@only@*/ GHashTable *members;
+    /** Path of repository root inside archive, "" or "dir/" */
+    /*@only@*/ char *root;
+};
+
+/** Values taken from extended headers that apply to the next member. */
+struct pending {
+    /*@only@*/ /*@null@*/ char *path;
+    /*@only@*/ /*@null@*/ char *linkpath;
+    gboolean has_size;
+    guint64 size;
+    gboolean has_mtime;
+    CPTimestamp mtime;
+};
+
+static void
+member_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct member *member = data;
+
+    if (member->children != NULL) {
+        g_ptr_array_unref(member->children);
+    }
+    g_free(member);
+}
+
+static void
+pending_clear(struct pending *pending) /*@modifies *pending@*/ {
+    g_free(pending->path);
+    g_free(pending->linkpath);
+    memset(pending, 0, sizeof(*pending));
+}
+
+/**
+ * Parses numeric header field: octal digits, optionally surrounded by
+ * spaces and NULs, or GNU base-256 encoding for large values.
+ *
+ * \return %FALSE if \a field isn't a number
+ */
+static gboolean
+parse_number(
+    const guchar *field,
+    size_t len,
+    /*@out@*/ guint64 *value
+) /*@modifies *value@*/ {
+    size_t i = 0;
+
+    *value = 0;
+
+    if ((field[0] & 0x80) != 0) {
+        *value = field[0] & 0x7f;
+        for (i = 1; i < len; ++i) {
+            *value = (*value << 8) | field[i];
+        }
+        return TRUE;
+    }
+
+    while (i < len && (field[i] == ' ' || field[i] == '\0')) {
+        ++i;
+    }
+    for (; i < len && field[i] >= '0' && field[i] <= '7'; ++i) {
+        *value = (*value << 3) | (guint64)(field[i] - '0');
+    }
+    for (; i < len; ++i) {
+        if (field[i] != ' ' && field[i] != '\0') {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * \return %TRUE if checksum of \a header is correct
+ */
+static gboolean
+header_valid(const guchar *header) /*@*/ {
+    guint64 expected;
+    guint64 sum = 0;
+    size_t i;
+
+    if (!parse_number(&header[HEADER_CHKSUM], 8, &expected)) {
+        return FALSE;
+    }
+
+    for (i = 0; i < BLOCK_SIZE; ++i) {
+        sum += i >= HEADER_CHKSUM && i < HEADER_CHKSUM + 8 ? ' ' : header[i];
+    }
+
+    return sum == expected;
+}
+
+static gboolean
+block_is_zero(const guchar *block) /*@*/ {
+    size_t i;
+
+    for (i = 0; i < BLOCK_SIZE; ++i) {
+        if (block[i] != 0) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * \return newly allocated copy of NUL-padded field of at most \a len bytes
+ */
+static char *
+field_dup(const guchar *field, size_t len) /*@*/ {
+    return g_strndup((const char *)field, len);
+}
+
+/**
+ * Strips "./", leading and trailing slashes from archive member \a path.
+ *
+ * \return newly allocated normalized path, "" for archive root
+ */
+static char *
+normalize(const char *path) /*@*/ {
+    size_t len;
+
+    for (;;) {
+        if (path[0] == '/') {
+            ++path;
+        } else if (path[0] == '.' && path[1] == '/') {
+            path += 2;
+        } else {
+            break;
+        }
+    }
+
+    len = strlen(path);
+    while (len > 0 && path[len - 1] == '/') {
+        --len;
+    }
+    if (len == 1 && path[0] == '.') {
+        len = 0;
+    }
+
+    return g_strndup(path, len);
+}
+
+/**
+ * Applies pax extended header \a records of \a len bytes to \a pending.
+ *
+ * \return %FALSE if \a records are malformed
+ */
+static gboolean
+parse_pax(
+    const char *records,
+    guint64 len,
+    struct pending *pending
+) /*@modifies *pending@*/ {
+    const char *end = records + len;
+    const char *p = records;
+
+    /* Every record is "<length> <key>=<value>\n" */
+    while (p < end) {
+        const char *space;
+        const char *eq;
+        const char *value;
+        const char *record_end;
+        guint64 record_len = 0;
+
+        for (space = p; space < end && g_ascii_isdigit(*space); ++space) {
+            record_len = record_len * 10 + (guint64)(*space - '0');
+            if (record_len > (guint64)(end - p)) {
+                return FALSE;
+            }
+        }
+        if (record_len == 0) {
+            return FALSE;
+        }
+        record_end = p + record_len;
+
+        /* Everything is looked for inside the record only */
+        if (space >= record_end || *space != ' ' || record_end[-1] != '\n') {
+            return FALSE;
+        }
+        eq = memchr(space, '=', (size_t)(record_end - 1 - space));
+        if (eq == NULL) {
+            return FALSE;
+        }
+        value = eq + 1;
+
+        if (strncmp(space + 1, "path=", 5) == 0) {
+            g_free(pending->path);
+            pending->path = g_strndup(value, (gsize)(record_end - 1 - value));
+        } else if (strncmp(space + 1, "linkpath=", 9) == 0) {
+            g_free(pending->linkpath);
+            pending->linkpath = g_strndup(value, (gsize)(record_end - 1 - value));
+        } else if (strncmp(space + 1, "size=", 5) == 0) {
+            pending->has_size = TRUE;
+            pending->size = g_ascii_strtoull(value, NULL, 10);
+        } else if (strncmp(space + 1, "mtime=", 6) == 0) {
+            char *frac;
+            guint64 nsec = 0;
+            int digits = 0;
+
+            pending->has_mtime = TRUE;
+            pending->mtime.sec = g_ascii_strtoull(value, &frac, 10);
+            if (*frac == '.') {
+                for (++frac; digits < 9; ++digits) {
+                    nsec *= 10;
+                    if (g_ascii_isdigit(*frac)) {
+                        nsec += (guint64)(*frac++ - '0');
+                    }
+                }
+            }
+            pending->mtime.nsec = nsec;
+        }
+
+        p = record_end;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Returns directory member \a path, creating it and its parents if
+ * needed with \a mtime.
+ */
+static /*@dependent@*/ struct member *
+get_dir(
+    CPSnapshot self,
+    const char *path,
+    const CPTimestamp *mtime
+) /*@modifies *self@*/ {
+    struct member *member = g_hash_table_lookup(self->members, path);
+    const char *slash;
+    char *parent;
+    struct member *parent_member;
+
+    if (member != NULL) {
+        return member;
+    }
+
+    member = g_new0(struct member, 1);
+    member->mtime = *mtime;
+    member->children = g_ptr_array_new_with_free_func(g_free);
+    g_hash_table_insert(self->members, g_strdup(path), member);
+
+    if (path[0] == '\0') {
+        return member;
+    }
+
+    slash = strrchr(path, '/');
+    parent = slash == NULL ? g_strdup("") : g_strndup(path, (gsize)(slash - path));
+    parent_member = get_dir(self, parent, mtime);
+    g_ptr_array_add(parent_member->children,
+        g_strdup(slash == NULL ? path : slash + 1));
+    g_free(parent);
+
+    return member;
+}
+
+/**
+ * Adds file member \a path, later members replace earlier ones
+ * with the same path.
+ */
+static void
+add_file(
+    CPSnapshot self,
+    /*@only@*/ char *path,
+    guint64 offset,
+    guint64 size,
+    const CPTimestamp *mtime,
+    const CPTimestamp *archive_mtime
+) /*@modifies *self,path@*/ {
+    struct member *member = g_hash_table_lookup(self->members, path);
+    const char *slash;
+    char *parent;
+
+    if (member != NULL && member->children != NULL) {
+        g_debug("Snapshot member '%s' is both a file and a directory", path);
+        g_free(path);
+        return;
+    }
+
+    if (member == NULL) {
+        slash = strrchr(path, '/');
+        parent = slash == NULL ? g_strdup("") : g_strndup(path, (gsize)(slash - path));
+        g_ptr_array_add(get_dir(self, parent, archive_mtime)->children,
+            g_strdup(slash == NULL ? path : slash + 1));
+        g_free(parent);
+
+        member = g_new0(struct member, 1);
+        g_hash_table_insert(self->members, path, member);
+    } else {
+        g_free(path);
+    }
+
+    member->offset = offset;
+    member->size = size;
+    member->mtime = *mtime;
+}
+
+/**
+ * \return name of member described by \a header, taking extended
+ *         headers into account
+ */
+static char *
+member_name(
+    const guchar *header,
+    const struct pending *pending,
+    /*@null@*/ const char *long_name
+) /*@*/ {
+    char *name;
+    char *result;
+
+    if (pending->path != NULL) {
+        return normalize(pending->path);
+    }
+    if (long_name != NULL) {
+        return normalize(long_name);
+    }
+
+    name = field_dup(&header[HEADER_NAME], 100);
+    if (memcmp(&header[HEADER_MAGIC], "ustar\0", 6) == 0
+            && header[HEADER_PREFIX] != '\0') {
+        char *prefix = field_dup(&header[HEADER_PREFIX], 155);
+        char *full = g_strconcat(prefix, "/", name, NULL);
+
+        g_free(prefix);
+        g_free(name);
+        name = full;
+    }
+
+    result = normalize(name);
+    g_free(name);
+    return result;
+}
+
+/**
+ * Indexes all members of archive \a path.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean
+index_members(
+    CPSnapshot self,
+    const char *path,
+    const CPTimestamp *archive_mtime,
+    /*@null@*/ GError **error
+) /*@modifies *self,*error@*/ {
+    gsize len;
+    const guchar *data = g_bytes_get_data(self->data, &len);
+    struct pending pending;
+    char *long_name = NULL;
+    char *long_link = NULL;
+    gboolean result = TRUE;
+    guint64 pos = 0;
+
+    g_assert(error == NULL || *error == NULL);
+
+    memset(&pending, 0, sizeof(pending));
+    (void)get_dir(self, "", archive_mtime);
+
+    while (result && pos + BLOCK_SIZE <= len && !block_is_zero(&data[pos])) {
+        const guchar *header = &data[pos];
+        guint64 offset = pos + BLOCK_SIZE;
+        guint64 size;
+        guint64 value;
+        CPTimestamp mtime;
+        char *name;
+
+        if (!header_valid(header)
+                || !parse_number(&header[HEADER_SIZE], 12, &size)) {
+            g_set_error(error, G_FILE_ERROR, (gint)G_FILE_ERROR_INVAL,
+                _("'%s' isn't a tar archive or is corrupt at offset %" G_GUINT64_FORMAT),
+                path, pos);
+            result = FALSE;
+            break;
+        }
+        if (pending.has_size && header[HEADER_TYPE] != 'x') {
+            size = pending.size;
+        }
+        if (size > len - offset) {
+            g_set_error(error, G_FILE_ERROR, (gint)G_FILE_ERROR_INVAL,
+                _("Tar archive '%s' is truncated at offset %" G_GUINT64_FORMAT),
+                path, pos);
+            result = FALSE;
+            break;
+        }
+        pos = offset + (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+
+        switch (header[HEADER_TYPE]) {
+            case 'L':
+                g_free(long_name);
+                long_name = g_strndup((const char *)&data[offset], (gsize)size);
+                continue;
+            case 'K':
+                g_free(long_link);
+                long_link = g_strndup((const char *)&data[offset], (gsize)size);
+                continue;
+            case 'x':
+                if (!parse_pax((const char *)&data[offset], size, &pending)) {
+                    g_set_error(error, G_FILE_ERROR, (gint)G_FILE_ERROR_INVAL,
+                        _("Malformed pax header in '%s' at offset %" G_GUINT64_FORMAT),
+                        path, offset - BLOCK_SIZE);
+                    result = FALSE;
+                }
+                continue;
+            case 'g':
+                continue;
+            default:
+                break;
+        }
+
+        name = member_name(header, &pending, long_name);
+        if (pending.has_mtime) {
+            mtime = pending.mtime;
+        } else {
+            (void)parse_number(&header[HEADER_MTIME], 12, &value);
+            mtime.sec = value;
+            mtime.nsec = 0;
+        }
+
+        switch (header[HEADER_TYPE]) {
+            case '0':
+            case '\0':
+            case '7':
+                add_file(self, name, offset, size, &mtime, archive_mtime);
+                name = NULL;
+                break;
+            case '5':
+                get_dir(self, name, archive_mtime)->mtime = mtime;
+                break;
+            case '1': {
+                char *target_name = pending.linkpath != NULL
+                    ? g_strdup(pending.linkpath)
+                    : long_link != NULL
+                        ? g_strdup(long_link)
+                        : field_dup(&header[HEADER_LINKNAME], 100);
+                char *target_key = normalize(target_name);
+                const struct member *target =
+                    g_hash_table_lookup(self->members, target_key);
+
+                if (target != NULL && target->children == NULL) {
+                    add_file(self, name, target->offset, target->size,
+                        &mtime, archive_mtime);
+                    name = NULL;
+                } else {
+                    g_debug("Skipping hard link '%s' to unknown file '%s'",
+                        name, target_key);
+                }
+                g_free(target_key);
+                g_free(target_name);
+                break;
+            }
+            default:
+                g_debug("Skipping snapshot member '%s' of type '%c'",
+                    name, header[HEADER_TYPE]);
+                break;
+        }
+
+        g_free(name);
+        g_free(long_name);
+        long_name = NULL;
+        g_free(long_link);
+        long_link = NULL;
+        pending_clear(&pending);
+    }
+
+    g_free(long_name);
+    g_free(long_link);
+    pending_clear(&pending);
+    return result;
+}
+
+CPSnapshot
+cp_snapshot_open(const char *path, GError **error) {
+    CPSnapshot self;
+    GMappedFile *file;
+    CPTimestamp archive_mtime;
+    const struct member *root;
+    struct stat st;
+
+    g_assert(error == NULL || *error == NULL);
+
+    file = g_mapped_file_new(path, FALSE, error);
+    if (file == NULL) {
+        return NULL;
+    }
+
+    archive_mtime.sec = 0;
+    archive_mtime.nsec = 0;
+    if (stat(path, &st) == 0) {
+        archive_mtime.sec = (guint64)st.st_mtim.tv_sec;
+        archive_mtime.nsec = (guint64)st.st_mtim.tv_nsec;
+    }
+
+    self = g_new0(struct CPSnapshotS, 1);
+    self->path = g_strdup(path);
+    self->data = g_mapped_file_get_bytes(file);
+    g_mapped_file_unref(file);
+    self->members = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, member_free);
+
+    if (!index_members(self, path, &archive_mtime, error)) {
+        cp_snapshot_destroy(self);
+        return NULL;
+    }
+
+    /* Snapshots are usually packed with a top-level directory */
+    root = g_hash_table_lookup(self->members, "");
+    if (root->children->len == 1
+            && !g_hash_table_contains(self->members, "profiles")) {
+        const char *top = g_ptr_array_index(root->children, 0);
+        const struct member *member = g_hash_table_lookup(self->members, top);
+
+        if (member->children != NULL) {
+            self->root = g_strconcat(top, "/", NULL);
+        }
+    }
+    if (self->root == NULL) {
+        self->root = g_strdup("");
+    }
+
+    return self;
+}
+
+void
+cp_snapshot_destroy(CPSnapshot self) {
+    if (self == NULL) {
+        return;
+    }
+
+    g_free(self->path);
+    g_bytes_unref(self->data);
+    g_hash_table_destroy(self->members);
+    g_free(self->root);
+    g_free(self);
+}
+
+/**
+ * \return member \a path relative to repository root or %NULL
+ */
+static /*@null@*/ /*@dependent@*/ const struct member *
+lookup(const CPSnapshot self, const char *path) /*@*/ {
+    char *relative = normalize(path);
+    char *key;
+    const struct member *result;
+
+    if (relative[0] == '\0') {
+        /* Root itself, without trailing slash */
+        key = g_strndup(self->root, self->root[0] == '\0' ? 0 : strlen(self->root) - 1);
+    } else {
+        key = g_strconcat(self->root, relative, NULL);
+    }
+
+    result = g_hash_table_lookup(self->members, key);
+
+    g_free(key);
+    g_free(relative);
+    return result;
+}
+
+gboolean
+cp_snapshot_stat(
+    const CPSnapshot self,
+    const char *path,
+    CPTimestamp *mtime,
+    gboolean *is_dir
+) {
+    const struct member *member = lookup(self, path);
+
+    if (member == NULL) {
+        mtime->sec = 0;
+        mtime->nsec = 0;
+        *is_dir = FALSE;
+        return FALSE;
+    }
+
+    *mtime = member->mtime;
+    *is_dir = member->children != NULL;
+    return TRUE;
+}
+
+char **
+cp_snapshot_list(const CPSnapshot self, const char *path, GError **error) {
+    const struct member *member = lookup(self, path);
+    char **result;
+    guint i;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (member == NULL) {
+        g_set_error(error, G_FILE_ERROR, (gint)G_FILE_ERROR_NOENT,
+            _("'%s' doesn't exist in snapshot %s"), path, self->path);
+        return NULL;
+    }
+    if (member->children == NULL) {
+        g_set_error(error, G_FILE_ERROR, (gint)G_FILE_ERROR_NOTDIR,
+            _("'%s' isn't a directory in snapshot %s"), path, self->path);
+        return NULL;
+    }
+
+    result = g_new(char *, member->children->len + 1);
+    for (i = 0; i < member->children->len; ++i) {
+        result[i] = g_strdup(g_ptr_array_index(member->children, i));
+    }
+    result[i] = NULL;
+
+    return result;
+}
+
+GBytes *
+cp_snapshot_read(const CPSnapshot self, const char *path, GError **error) {
+    const struct member *member = lookup(self, path);
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (member == NULL) {
+        g_set_error(error, G_FILE_ERROR, (gint)G_FILE_ERROR_NOENT,
+            _("'%s' doesn't exist in snapshot %s"), path, self->path);
+        return NULL;
+    }
+    if (member->children != NULL) {
+        g_set_error(error, G_FILE_ERROR, (gint)G_FILE_ERROR_ISDIR,
+            _("'%s' is a directory in snapshot %s"), path, self->path);
+        return NULL;
+    }
+
+    return g_bytes_new_from_bytes(self->data, (gsize)member->offset, (gsize)member->size);
+}
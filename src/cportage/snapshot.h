@@ -0,0 +1,100 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Read-only access to repository snapshots packed into tar archives. */
+
+#ifndef CP_SNAPSHOT_H
+#define CP_SNAPSHOT_H
+
+#include <cportage.h>
+
+#include "io.h"
+
+/*@-exportany@*/
+
+/**
+ * Uncompressed tar archive mapped into memory, with an index of its
+ * members. Safe to read from several threads at once.
+ */
+typedef struct CPSnapshotS *CPSnapshot;
+
+/**
+ * Maps tar archive at \a path into memory and indexes its members by
+ * path. Archive of a single top-level directory (like portage/ of
+ * Gentoo snapshots) is entered, so that paths are relative to the
+ * repository root either way.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      a #CPSnapshot or %NULL if an error occurred,
+ *              free it using cp_snapshot_destroy()
+ */
+/*@null@*/ /*@only@*/ CPSnapshot
+cp_snapshot_open(
+    const char *path,
+    /*@null@*/ GError **error
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *error,errno@*/ /*@globals fileSystem@*/;
+
+void
+cp_snapshot_destroy(
+    /*@null@*/ /*@only@*/ CPSnapshot self
+) /*@modifies self@*/;
+
+/**
+ * \param mtime  return location for modification time of member \a path
+ * \param is_dir return location for %TRUE if \a path is a directory
+ * \return       %TRUE if \a self has member \a path, %FALSE otherwise
+ */
+gboolean
+cp_snapshot_stat(
+    const CPSnapshot self,
+    const char *path,
+    /*@out@*/ CPTimestamp *mtime,
+    /*@out@*/ gboolean *is_dir
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *mtime,*is_dir@*/;
+
+/**
+ * Lists directory \a path, like g_dir_open() does for real directories.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %NULL-terminated array of member names or %NULL if an error
+ *              occurred, free it using g_strfreev()
+ */
+/*@null@*/ /*@only@*/ char **
+cp_snapshot_list(
+    const CPSnapshot self,
+    const char *path,
+    /*@null@*/ GError **error
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT /*@modifies *error@*/;
+
+/**
+ * Returns contents of file \a path without copying them.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      contents or %NULL if an error occurred,
+ *              free them using g_bytes_unref()
+ */
+/*@null@*/ /*@only@*/ GBytes *
+cp_snapshot_read(
+    const CPSnapshot self,
+    const char *path,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *error@*/;
+
+#endif
@@ -0,0 +1,238 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Strings are packed NUL-terminated into 64 KiB chunks that never move,
+  a reference is chunk index in upper 16 bits and offset in lower ones.
+  Strings that don't fit into a chunk get a chunk of their own.
+  Index is an open addressing hash table of references.
+ */
+
+#include <string.h>
+
+#include "string_pool.h"
+
+#define CHUNK_BITS 16
+#define CHUNK_SIZE ((gsize)1 << CHUNK_BITS)
+#define MAX_CHUNKS ((guint)1 << (32 - CHUNK_BITS))
+
+/** Hash table slot, ref 0 marks empty slots since "" isn't indexed */
+struct pool_slot {
+    guint32 hash;
+    CPStringRef ref;
+};
+
+struct CPStringPoolS {
+    /*@only@*/ GPtrArray/*<char *>*/ *chunks;
+    /** Bytes used in the last chunk */
+    gsize used;
+    /** Bytes allocated for chunks */
+    gsize allocated;
+    /*@only@*/ struct pool_slot *slots;
+    /** Number of slots, a power of 2 */
+    guint32 capacity;
+    guint32 n_strings;
+};
+
+static guint32
+hash_bytes(const char *str, size_t len) /*@*/ {
+    /* FNV-1a */
+    guint32 hash = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        hash ^= (guint32)(guchar)str[i];
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+CPStringPool
+cp_string_pool_new(void) {
+    CPStringPool self;
+    char *first;
+
+    self = g_new0(struct CPStringPoolS, 1);
+    g_assert(self->chunks == NULL);
+    self->chunks = g_ptr_array_new_with_free_func(g_free);
+
+    /* Empty string takes first byte of first chunk, so that its ref is 0 */
+    first = g_malloc(CHUNK_SIZE);
+    first[0] = '\0';
+    g_ptr_array_add(self->chunks, first);
+    self->used = 1;
+    self->allocated = CHUNK_SIZE;
+
+    self->capacity = 1024;
+    g_assert(self->slots == NULL);
+    self->slots = g_new0(struct pool_slot, self->capacity);
+
+    return self;
+}
+
+void
+cp_string_pool_destroy(CPStringPool self) {
+    if (self == NULL) {
+        /*@-mustfreeonly@*/
+        return;
+        /*@=mustfreeonly@*/
+    }
+
+    g_ptr_array_unref(self->chunks);
+    g_free(self->slots);
+    g_free(self);
+}
+
+const char *
+cp_string_pool_get(const CPStringPool self, CPStringRef ref) {
+    const char *chunk = g_ptr_array_index(self->chunks, ref >> CHUNK_BITS);
+
+    return chunk + (ref & (CHUNK_SIZE - 1));
+}
+
+/**
+ * \return slot where string \a str of \a len bytes with \a hash
+ *         is stored, or empty slot where it should be stored
+ */
+static struct pool_slot *
+find_slot(
+    const CPStringPool self,
+    const char *str,
+    size_t len,
+    guint32 hash
+) /*@*/ {
+    guint32 mask = self->capacity - 1;
+    guint32 i = hash & mask;
+
+    for (;;) {
+        struct pool_slot *slot = &self->slots[i];
+
+        if (slot->ref == 0) {
+            return slot;
+        }
+        if (slot->hash == hash) {
+            const char *stored = cp_string_pool_get(self, slot->ref);
+
+            if (strncmp(stored, str, len) == 0 && stored[len] == '\0') {
+                return slot;
+            }
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+static void
+grow_slots(CPStringPool self) /*@modifies *self@*/ {
+    struct pool_slot *old = self->slots;
+    guint32 old_capacity = self->capacity;
+    guint32 i;
+
+    self->capacity *= 2;
+    self->slots = g_new0(struct pool_slot, self->capacity);
+
+    for (i = 0; i < old_capacity; ++i) {
+        if (old[i].ref != 0) {
+            guint32 mask = self->capacity - 1;
+            guint32 j = old[i].hash & mask;
+
+            while (self->slots[j].ref != 0) {
+                j = (j + 1) & mask;
+            }
+            self->slots[j] = old[i];
+        }
+    }
+
+    g_free(old);
+}
+
+/** Copies \a str of \a len bytes into chunks. */
+static CPStringRef
+store(CPStringPool self, const char *str, size_t len) /*@modifies *self@*/ {
+    char *chunk;
+    CPStringRef ref;
+
+    if (len + 1 > CHUNK_SIZE - self->used) {
+        gsize size = MAX(len + 1, CHUNK_SIZE);
+
+        if (self->chunks->len == MAX_CHUNKS) {
+            g_error("String pool exhausted all %u chunks", MAX_CHUNKS);
+        }
+        g_ptr_array_add(self->chunks, g_malloc(size));
+        self->allocated += size;
+        self->used = 0;
+    }
+
+    chunk = g_ptr_array_index(self->chunks, self->chunks->len - 1);
+    ref = (CPStringRef)(((self->chunks->len - 1) << CHUNK_BITS) | self->used);
+    memcpy(chunk + self->used, str, len);
+    chunk[self->used + len] = '\0';
+    /* Oversized chunk is full, next string starts a new one */
+    self->used = MIN(self->used + len + 1, CHUNK_SIZE);
+
+    return ref;
+}
+
+CPStringRef
+cp_string_pool_intern(CPStringPool self, const char *str, size_t len) {
+    struct pool_slot *slot;
+    guint32 hash;
+
+    if (len == 0) {
+        return 0;
+    }
+
+    hash = hash_bytes(str, len);
+    slot = find_slot(self, str, len, hash);
+    if (slot->ref != 0) {
+        return slot->ref;
+    }
+
+    /* Keeps load factor at most 1/2 */
+    if (self->n_strings + 1 > self->capacity / 2) {
+        grow_slots(self);
+        slot = find_slot(self, str, len, hash);
+    }
+
+    slot->hash = hash;
+    slot->ref = store(self, str, len);
+    ++self->n_strings;
+    return slot->ref;
+}
+
+gboolean
+cp_string_pool_lookup(const CPStringPool self, const char *str, CPStringRef *ref) {
+    size_t len = strlen(str);
+    const struct pool_slot *slot;
+
+    *ref = 0;
+    if (len == 0) {
+        return TRUE;
+    }
+
+    slot = find_slot(self, str, len, hash_bytes(str, len));
+    *ref = slot->ref;
+    return slot->ref != 0;
+}
+
+gsize
+cp_string_pool_memory(const CPStringPool self) {
+    return sizeof(*self) + self->allocated
+        + self->capacity * sizeof(struct pool_slot);
+}
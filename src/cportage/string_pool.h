@@ -0,0 +1,89 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Deduplicated store of immutable strings. */
+
+#ifndef CP_STRING_POOL_H
+#define CP_STRING_POOL_H
+
+#include <cportage.h>
+
+/*@-exportany@*/
+
+/**
+ * Append-only store where every distinct string is kept once
+ * and referred to by a 32-bit #CPStringRef.
+ */
+typedef struct CPStringPoolS *CPStringPool;
+
+/** Reference to a string in #CPStringPool, 0 is the empty string. */
+typedef guint32 CPStringRef;
+
+/*@only@*/ CPStringPool
+cp_string_pool_new(void) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+void
+cp_string_pool_destroy(
+    /*@null@*/ /*@only@*/ CPStringPool self
+) /*@modifies self@*/;
+
+/**
+ * Adds first \a len bytes of \a str to \a self unless an equal string
+ * is already there. \a str must not contain NUL bytes.
+ *
+ * \return reference to the stored copy
+ */
+CPStringRef
+cp_string_pool_intern(
+    CPStringPool self,
+    const char *str,
+    size_t len
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *self@*/;
+
+/**
+ * Looks \a str up in \a self without adding it.
+ *
+ * \return %TRUE and sets \a ref if \a str is stored, %FALSE otherwise
+ */
+gboolean
+cp_string_pool_lookup(
+    const CPStringPool self,
+    const char *str,
+    /*@out@*/ CPStringRef *ref
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *ref@*/;
+
+/**
+ * \return NUL-terminated string \a ref refers to, valid as long
+ *         as \a self exists
+ */
+/*@observer@*/ const char *
+cp_string_pool_get(
+    const CPStringPool self,
+    CPStringRef ref
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return number of bytes allocated by \a self for strings and index
+ */
+gsize
+cp_string_pool_memory(
+    const CPStringPool self
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+#endif
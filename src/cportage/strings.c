@@ -89,3 +89,40 @@ cp_string_truth(const char *str) {
 
     return CP_UNKNOWN;
 }
+
+char **
+cp_string_lines(const char *data, gboolean ignore_comments) {
+    char **lines = g_strsplit(data, "\n", -1);
+    char **result;
+    char *line;
+    size_t i = 0;
+    size_t j = 0;
+
+    if (!ignore_comments) {
+        return lines;
+    }
+
+    result = g_new(char *, g_strv_length(lines) + 1);
+    while ((line = lines[i++]) != NULL) {
+        char *comment = g_utf8_strchr(line, (gssize)-1, (gunichar)'#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        (void)g_strstrip(line);
+        if (line[0] != '\0') {
+            result[j++] = g_strdup(line);
+        }
+    }
+    result[j] = NULL;
+    g_strfreev(lines);
+
+    return result;
+}
+
+void
+cp_string_fingerprint_add(guint64 *hash, const char *str) {
+    do {
+        *hash ^= (guint64)(guchar)*str;
+        *hash *= G_GUINT64_CONSTANT(0x100000001b3);
+    } while (*str++ != '\0');
+}
@@ -45,4 +45,26 @@ cp_string_truth(
 ) G_GNUC_WARN_UNUSED_RESULT
 /*@*/;
 
+/**
+ * Splits \a data into lines, see cp_io_getlines() for \a ignore_comments.
+ *
+ * \return a %NULL-terminated string array, free it using g_strfreev()
+ */
+/*@only@*/ char **
+cp_string_lines(
+    const char *data,
+    gboolean ignore_comments
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/** Initial value of fingerprints built with cp_string_fingerprint_add() */
+#define CP_FINGERPRINT_INIT G_GUINT64_CONSTANT(0xcbf29ce484222325)
+
+/**
+ * Mixes \a str into 64-bit FNV-1a \a hash, which should start at
+ * #CP_FINGERPRINT_INIT. Terminating NUL is hashed too, so that
+ * consecutive strings are kept apart.
+ */
+void
+cp_string_fingerprint_add(guint64 *hash, const char *str) /*@modifies *hash@*/;
+
 #endif
@@ -30,6 +30,7 @@ CPTree
 cp_tree_new(const CPTreeOps ops, void *priv) {
     CPTree self = g_new0(struct CPTreeS, 1);
 
+    self->refs = (unsigned int)1;
     self->ops = ops;
     g_assert(self->priv == NULL);
     self->priv = priv;
@@ -86,3 +87,35 @@ cp_tree_find_packages(
 
     return result;
 }
+
+gboolean
+cp_tree_find_pattern(
+    CPTree self,
+    const CPPattern pattern,
+    gboolean ascending,
+    GSList **match,
+    GError **error
+) {
+    gboolean result;
+    g_assert(error == NULL || *error == NULL);
+
+    result = self->ops->find_pattern(self->priv, pattern, match, error);
+
+    if (result && ascending) {
+        *match = g_slist_reverse(*match);
+    }
+
+    return result;
+}
+
+gboolean
+cp_tree_foreach(
+    CPTree self,
+    CPTreeForeachFunc func,
+    void *user_data,
+    GError **error
+) {
+    g_assert(error == NULL || *error == NULL);
+
+    return self->ops->foreach_package(self->priv, func, user_data, error);
+}
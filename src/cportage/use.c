@@ -0,0 +1,804 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "atom.h"
+#include "collections.h"
+#include "dep.h"
+#include "porttree.h"
+#include "settings.h"
+#include "strings.h"
+#include "use.h"
+
+/** Layers of USE configuration, in order of evaluation. */
+enum use_layer_id {
+    /** package.use, applied on top of global USE and IUSE defaults */
+    USE_LAYER_USE,
+    /** Flags added to result of USE_LAYER_USE */
+    USE_LAYER_FORCE,
+    /** Flags removed from everything else */
+    USE_LAYER_MASK,
+    USE_N_LAYERS
+};
+
+/** Profile file and layer its lines go to. */
+struct profile_file {
+    /*@observer@*/ const char *name;
+    enum use_layer_id layer;
+    /** Lines start with an atom, otherwise whole file applies to everything */
+    gboolean per_package;
+    /** Only applies to packages stable on ARCH */
+    gboolean stable_only;
+};
+
+/*@observer@*/ /*@unchecked@*/ static const struct profile_file
+profile_files[] = {
+    { "package.use", USE_LAYER_USE, TRUE, FALSE },
+    { "package.use.stable", USE_LAYER_USE, TRUE, TRUE },
+    { "use.force", USE_LAYER_FORCE, FALSE, FALSE },
+    { "use.stable.force", USE_LAYER_FORCE, FALSE, TRUE },
+    { "package.use.force", USE_LAYER_FORCE, TRUE, FALSE },
+    { "package.use.stable.force", USE_LAYER_FORCE, TRUE, TRUE },
+    { "use.mask", USE_LAYER_MASK, FALSE, FALSE },
+    { "use.stable.mask", USE_LAYER_MASK, FALSE, TRUE },
+    { "package.use.mask", USE_LAYER_MASK, TRUE, FALSE },
+    { "package.use.stable.mask", USE_LAYER_MASK, TRUE, TRUE }
+};
+
+/*@observer@*/ /*@unchecked@*/ static const struct profile_file
+user_package_use = { "package.use", USE_LAYER_USE, TRUE, FALSE };
+
+/** Lines of a config file, in order. */
+struct use_source {
+    /*@dependent@*/ const struct profile_file *file;
+    /*@only@*/ GPtrArray/*<char *>*/ *lines;
+};
+
+/**
+ * Change of layer state: "-*" clears it, then flags of set are added
+ * and flags of clear are removed.
+ */
+struct use_delta {
+    /** Position in layer, deltas are applied in ascending order */
+    guint seq;
+    /** Packages the delta applies to, %NULL for every package */
+    /*@only@*/ /*@null@*/ CPAtom atom;
+    gboolean stable_only;
+    gboolean reset;
+    /*@only@*/ GArray/*<guint32>*/ *set;
+    /*@only@*/ GArray/*<guint32>*/ *clear;
+};
+
+struct use_layer {
+    /** Deltas applying to every package, in order */
+    /*@only@*/ GPtrArray/*<struct use_delta>*/ *global;
+    /** "category/package"->GPtrArray<struct use_delta>, in order */
+    /*@only@*/ GHashTable *index;
+    guint n_deltas;
+};
+
+/** USE configuration and results evaluated for it. */
+struct use_config {
+    guint64 fingerprint;
+    /*@only@*/ char *arch;
+    /** Bitset of global USE before use.force and use.mask were applied */
+    /*@only@*/ GArray/*<guint32>*/ *use;
+    /** Bitset of flags negated in USE, IUSE defaults don't enable them */
+    /*@only@*/ GArray/*<guint32>*/ *disabled;
+    /** USE had "-*", IUSE defaults don't enable anything */
+    gboolean no_defaults;
+    struct use_layer layers[USE_N_LAYERS];
+    /** CPPackage->GArray<guint32> memo */
+    /*@only@*/ GHashTable *memo;
+};
+
+struct CPUseS {
+    /*@only@*/ CPPorttree porttree;
+    /*@only@*/ CPAtomFactory factory;
+
+    /**
+     * Interns flags of all configurations, so that bitsets can be passed
+     * to cp_dep_eval_flatten() for dependencies parsed into it
+     */
+    /*@only@*/ CPDepTable deps;
+    /** CPPackage->GArray<guint32> bitset of flags enabled in its IUSE */
+    /*@only@*/ GHashTable *package_defaults;
+
+    /** Fingerprint->use_config map of loaded configurations */
+    /*@only@*/ GHashTable *configs;
+    /*@dependent@*/ struct use_config *config;
+
+    /** Changed atomically, references can be dropped from any thread */
+    /*@refs@*/ gint refs;
+};
+
+static void
+use_source_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct use_source *source = data;
+
+    g_ptr_array_unref(source->lines);
+    g_free(source);
+}
+
+static void
+use_delta_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct use_delta *delta = data;
+
+    cp_atom_unref(delta->atom);
+    (void)g_array_free(delta->set, TRUE);
+    (void)g_array_free(delta->clear, TRUE);
+    g_free(delta);
+}
+
+static void
+use_config_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct use_config *config = data;
+    guint i;
+
+    g_free(config->arch);
+    (void)g_array_free(config->use, TRUE);
+    (void)g_array_free(config->disabled, TRUE);
+    for (i = 0; i < (guint)USE_N_LAYERS; ++i) {
+        g_ptr_array_unref(config->layers[i].global);
+        cp_hash_table_destroy(config->layers[i].index);
+    }
+    cp_hash_table_destroy(config->memo);
+    g_free(config);
+}
+
+static void
+append_lines(char **lines, void *user_data) /*@modifies *user_data@*/ {
+    CP_STRV_ITER(lines, line) {
+        g_ptr_array_add(user_data, g_strdup(line));
+    } end_CP_STRV_ITER
+}
+
+/** Reads \a path into a new source of \a file, empty files are skipped. */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+add_source(
+    GPtrArray/*<struct use_source>*/ *sources,
+    const struct profile_file *file,
+    /*@only@*/ char *path,
+    /*@null@*/ GError **error
+) /*@modifies *sources,*error,errno@*/ /*@globals fileSystem@*/ {
+    GPtrArray *lines = g_ptr_array_new_with_free_func(g_free);
+    struct use_source *source;
+    gboolean result;
+
+    g_assert(error == NULL || *error == NULL);
+
+    result = cp_collect_lines(path, append_lines, lines, error);
+    g_free(path);
+    if (!result) {
+        g_ptr_array_unref(lines);
+        return FALSE;
+    }
+    if (lines->len == 0) {
+        g_ptr_array_unref(lines);
+        return TRUE;
+    }
+
+    source = g_new0(struct use_source, 1);
+    source->file = file;
+    source->lines = lines;
+    g_ptr_array_add(sources, source);
+    return TRUE;
+}
+
+static /*@only@*/ struct use_delta *
+new_delta(
+    struct use_layer *layer,
+    /*@only@*/ /*@null@*/ CPAtom atom,
+    gboolean stable_only
+) /*@modifies *layer@*/ {
+    struct use_delta *delta = g_new0(struct use_delta, 1);
+
+    delta->seq = layer->n_deltas++;
+    delta->atom = atom;
+    delta->stable_only = stable_only;
+    delta->reset = FALSE;
+    delta->set = g_array_new(FALSE, TRUE, sizeof(guint32));
+    delta->clear = g_array_new(FALSE, TRUE, sizeof(guint32));
+    return delta;
+}
+
+/**
+ * Compiles flag \a items into \a delta, in order. "NAME:" item makes
+ * following flags USE_EXPAND values of NAME.
+ */
+static void
+compile_items(
+    CPUse self,
+    char **items,
+    struct use_delta *delta,
+    /*@observer@*/ const char *file
+) /*@modifies *self,*delta@*/ {
+    char *prefix = NULL;
+
+    CP_STRV_ITER(items, item) {
+        size_t len = strlen(item);
+        gboolean negated = item[0] == '-';
+        char *flag;
+        guint id;
+
+        if (len > 1 && item[len - 1] == ':') {
+            g_free(prefix);
+            prefix = g_ascii_strdown(item, (ssize_t)(len - 1));
+            continue;
+        }
+        if (strcmp(item, "-*") == 0) {
+            if (prefix != NULL) {
+                g_warning("Unsupported \"-*\" for %s in %s", prefix, file);
+                continue;
+            }
+            delta->reset = TRUE;
+            (void)g_array_set_size(delta->set, 0);
+            (void)g_array_set_size(delta->clear, 0);
+            continue;
+        }
+
+        flag = negated ? &item[1] : item;
+        if (prefix != NULL) {
+            flag = g_strconcat(prefix, "_", flag, NULL);
+            id = cp_dep_table_intern_flag(self->deps, flag);
+            g_free(flag);
+        } else {
+            id = cp_dep_table_intern_flag(self->deps, flag);
+        }
+
+        if (negated) {
+            cp_bitset_clear(delta->set, id);
+            cp_bitset_set(delta->clear, id);
+        } else {
+            cp_bitset_set(delta->set, id);
+            cp_bitset_clear(delta->clear, id);
+        }
+    } end_CP_STRV_ITER
+
+    g_free(prefix);
+}
+
+/** Adds \a delta to \a index under package name of its atom. */
+static void
+index_delta(GHashTable *index, /*@only@*/ struct use_delta *delta)
+/*@modifies *index@*/ {
+    char *key;
+    GPtrArray *deltas;
+
+    g_assert(delta->atom != NULL);
+    key = g_strconcat(cp_atom_category(delta->atom), "/",
+        cp_atom_package(delta->atom), NULL);
+    deltas = g_hash_table_lookup(index, key);
+
+    if (deltas == NULL) {
+        deltas = g_ptr_array_new_with_free_func(use_delta_free);
+        g_hash_table_insert(index, key, deltas);
+    } else {
+        g_free(key);
+    }
+    g_ptr_array_add(deltas, delta);
+}
+
+/**
+ * Compiles \a source into deltas of its layer. Each line of per-package
+ * file is a delta, whole file is a single delta otherwise.
+ */
+static void
+compile_source(
+    CPUse self,
+    struct use_config *config,
+    const struct use_source *source
+) /*@modifies *self,*config@*/ {
+    const struct profile_file *file = source->file;
+    struct use_layer *layer = &config->layers[file->layer];
+    struct use_delta *delta;
+    guint i;
+
+    if (!file->per_package) {
+        delta = new_delta(layer, NULL, file->stable_only);
+        for (i = 0; i < source->lines->len; ++i) {
+            char **items = cp_strings_pysplit(g_ptr_array_index(source->lines, i));
+
+            if (items != NULL) {
+                compile_items(self, items, delta, file->name);
+                g_strfreev(items);
+            }
+        }
+        g_ptr_array_add(layer->global, delta);
+        return;
+    }
+
+    for (i = 0; i < source->lines->len; ++i) {
+        char **items = cp_strings_pysplit(g_ptr_array_index(source->lines, i));
+        GError *error = NULL;
+        CPAtom atom;
+
+        if (items == NULL) {
+            continue;
+        }
+
+        atom = cp_atom_new(self->factory, CP_EAPI_LATEST, items[0], &error);
+        if (atom == NULL) {
+            g_warning("Invalid atom in %s: %s", file->name, error->message);
+            g_error_free(error);
+        } else {
+            delta = new_delta(layer, atom, file->stable_only);
+            compile_items(self, &items[1], delta, file->name);
+            index_delta(layer->index, delta);
+        }
+        g_strfreev(items);
+    }
+}
+
+/**
+ * Reads USE configuration of \a settings and makes it current.
+ * Configuration with the same fingerprint is reused with its memo.
+ * USE is taken from cp_settings_configured_use(): use.force and use.mask
+ * are compiled into layers, so they must not be applied to it already.
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+load_config(
+    CPUse self,
+    const CPSettings settings,
+    /*@null@*/ GError **error
+) /*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/ {
+    const char *config_root = cp_settings_config_root(settings);
+    const char *use = cp_settings_configured_use(settings);
+    const char *disabled = cp_settings_disabled_use(settings);
+    const char *arch = cp_settings_get_default(settings, "ARCH", "");
+    struct use_config *config;
+    GPtrArray *sources;
+    guint64 fingerprint = CP_FINGERPRINT_INIT;
+    char **flags;
+    gboolean result = TRUE;
+    guint i;
+    guint j;
+
+    g_assert(error == NULL || *error == NULL);
+
+    sources = g_ptr_array_new_with_free_func(use_source_free);
+
+    /* Profiles come first, then user configuration */
+    CP_GSLIST_ITER(cp_settings_profiles(settings), profile) {
+        for (i = 0; i < G_N_ELEMENTS(profile_files) && result; ++i) {
+            result = add_source(sources, &profile_files[i],
+                g_build_filename(profile, profile_files[i].name, NULL), error);
+        }
+    } end_CP_GSLIST_ITER
+    result = result && add_source(sources, &user_package_use,
+        g_build_filename(config_root, "etc", "portage", "package.use", NULL), error);
+    if (!result) {
+        goto OUT;
+    }
+
+    cp_string_fingerprint_add(&fingerprint, use);
+    cp_string_fingerprint_add(&fingerprint, disabled);
+    cp_string_fingerprint_add(&fingerprint, arch);
+    for (i = 0; i < sources->len; ++i) {
+        const struct use_source *source = g_ptr_array_index(sources, i);
+
+        cp_string_fingerprint_add(&fingerprint, source->file->name);
+        for (j = 0; j < source->lines->len; ++j) {
+            cp_string_fingerprint_add(&fingerprint, g_ptr_array_index(source->lines, j));
+        }
+        cp_string_fingerprint_add(&fingerprint, "");
+    }
+
+    config = g_hash_table_lookup(self->configs, &fingerprint);
+    if (config != NULL) {
+        self->config = config;
+        goto OUT;
+    }
+
+    config = g_new0(struct use_config, 1);
+    config->fingerprint = fingerprint;
+    config->arch = g_strdup(arch);
+    config->use = g_array_new(FALSE, TRUE, sizeof(guint32));
+    flags = cp_strings_pysplit(use);
+    if (flags != NULL) {
+        CP_STRV_ITER(flags, flag) {
+            cp_bitset_set(config->use, cp_dep_table_intern_flag(self->deps, flag));
+        } end_CP_STRV_ITER
+        g_strfreev(flags);
+    }
+    config->disabled = g_array_new(FALSE, TRUE, sizeof(guint32));
+    config->no_defaults = FALSE;
+    flags = cp_strings_pysplit(disabled);
+    if (flags != NULL) {
+        CP_STRV_ITER(flags, flag) {
+            if (strcmp(flag, "*") == 0) {
+                config->no_defaults = TRUE;
+            } else {
+                cp_bitset_set(config->disabled, cp_dep_table_intern_flag(self->deps, flag));
+            }
+        } end_CP_STRV_ITER
+        g_strfreev(flags);
+    }
+    for (i = 0; i < (guint)USE_N_LAYERS; ++i) {
+        config->layers[i].global = g_ptr_array_new_with_free_func(use_delta_free);
+        config->layers[i].index = g_hash_table_new_full(g_str_hash, g_str_equal,
+            g_free, (GDestroyNotify)g_ptr_array_unref);
+        config->layers[i].n_deltas = 0;
+    }
+    config->memo = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+        (GDestroyNotify)cp_package_unref, cp_bitset_free);
+
+    for (i = 0; i < sources->len; ++i) {
+        compile_source(self, config, g_ptr_array_index(sources, i));
+    }
+
+    g_hash_table_insert(self->configs, &config->fingerprint, config);
+    self->config = config;
+
+OUT:
+    g_ptr_array_unref(sources);
+    return result;
+}
+
+/** Reads bitset of flags enabled by default in IUSE of \a package. */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+get_package_defaults(
+    CPUse self,
+    const CPPackage package,
+    /*@out@*/ const GArray/*<guint32>*/ **result,
+    /*@null@*/ GError **error
+) /*@modifies *self,*result,*error,errno@*/ /*@globals fileSystem@*/ {
+    static const char * const keys[] = { "IUSE", NULL };
+    GArray *bitset = g_hash_table_lookup(self->package_defaults, package);
+    char *iuse;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (bitset == NULL) {
+        if (!cp_porttree_get_metadata(self->porttree, package, keys, &iuse, error)) {
+            *result = NULL;
+            return FALSE;
+        }
+
+        bitset = g_array_new(FALSE, TRUE, sizeof(guint32));
+        if (iuse != NULL) {
+            char **items = cp_strings_pysplit(iuse);
+
+            if (items != NULL) {
+                CP_STRV_ITER(items, item) {
+                    if (item[0] == '+') {
+                        cp_bitset_set(bitset, cp_dep_table_intern_flag(self->deps, &item[1]));
+                    }
+                } end_CP_STRV_ITER
+                g_strfreev(items);
+            }
+            g_free(iuse);
+        }
+
+        g_hash_table_insert(self->package_defaults, cp_package_ref(package), bitset);
+    }
+
+    /*@-dependenttrans@*/
+    *result = bitset;
+    /*@=dependenttrans@*/
+    return TRUE;
+}
+
+/** Sets \a stable to 1 if KEYWORDS of \a package contain ARCH, 0 otherwise. */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+check_stable(
+    CPUse self,
+    const CPPackage package,
+    /*@out@*/ int *stable,
+    /*@null@*/ GError **error
+) /*@modifies *self,*stable,*error,errno@*/ /*@globals fileSystem@*/ {
+    char **keywords;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!cp_porttree_get_keywords(self->porttree, package, &keywords, error)) {
+        return FALSE;
+    }
+
+    *stable = 0;
+    CP_STRV_ITER(keywords, keyword) {
+        if (strcmp(keyword, self->config->arch) == 0) {
+            *stable = 1;
+            break;
+        }
+    } end_CP_STRV_ITER
+    g_strfreev(keywords);
+
+    return TRUE;
+}
+
+/**
+ * Applies deltas of \a layer that match \a package to \a state, merging
+ * global and per-package deltas by their position.
+ *
+ * \param stable -1 if stability of \a package isn't known yet, it is
+ *               checked once a stable-only delta matches
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+apply_layer(
+    CPUse self,
+    const struct use_layer *layer,
+    const CPPackage package,
+    const char *key,
+    GArray/*<guint32>*/ *state,
+    int *stable,
+    /*@null@*/ GError **error
+) /*@modifies *self,*state,*stable,*error,errno@*/ /*@globals fileSystem@*/ {
+    const GPtrArray *global = layer->global;
+    const GPtrArray *local = g_hash_table_lookup(layer->index, key);
+    guint i = 0;
+    guint j = 0;
+
+    g_assert(error == NULL || *error == NULL);
+
+    for (;;) {
+        const struct use_delta *next_global = NULL;
+        const struct use_delta *next_local = NULL;
+        const struct use_delta *delta;
+
+        if (i < global->len) {
+            next_global = g_ptr_array_index(global, i);
+        }
+        if (local != NULL && j < local->len) {
+            next_local = g_ptr_array_index(local, j);
+        }
+
+        if (next_local == NULL
+                || (next_global != NULL && next_global->seq < next_local->seq)) {
+            if (next_global == NULL) {
+                break;
+            }
+            delta = next_global;
+            ++i;
+        } else {
+            delta = next_local;
+            ++j;
+        }
+
+        if (delta->atom != NULL && !cp_atom_matches(delta->atom, package)) {
+            continue;
+        }
+        if (delta->stable_only) {
+            if (*stable < 0 && !check_stable(self, package, stable, error)) {
+                return FALSE;
+            }
+            if (*stable == 0) {
+                continue;
+            }
+        }
+
+        if (delta->reset) {
+            (void)g_array_set_size(state, 0);
+        }
+        cp_bitset_or(state, delta->set);
+        cp_bitset_and_not(state, delta->clear);
+    }
+
+    return TRUE;
+}
+
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+evaluate(
+    CPUse self,
+    const CPPackage package,
+    /*@out@*/ const GArray/*<guint32>*/ **result,
+    /*@null@*/ GError **error
+) /*@modifies *self,*result,*error,errno@*/ /*@globals fileSystem@*/ {
+    struct use_config *config = self->config;
+    const GArray *defaults;
+    GArray *use;
+    GArray *forced;
+    GArray *masked;
+    char *key;
+    int stable = -1;
+    gboolean success;
+    guint i;
+
+    g_assert(error == NULL || *error == NULL);
+
+    use = g_hash_table_lookup(config->memo, package);
+    if (use != NULL) {
+        /*@-dependenttrans@*/
+        *result = use;
+        /*@=dependenttrans@*/
+        return TRUE;
+    }
+
+    *result = NULL;
+
+    if (!get_package_defaults(self, package, &defaults, error)) {
+        return FALSE;
+    }
+
+    use = g_array_new(FALSE, TRUE, sizeof(guint32));
+    cp_bitset_or(use, config->use);
+    if (!config->no_defaults) {
+        if (use->len < defaults->len) {
+            (void)g_array_set_size(use, defaults->len);
+        }
+        for (i = 0; i < defaults->len; ++i) {
+            guint32 disabled = i < config->disabled->len
+                ? g_array_index(config->disabled, guint32, i) : 0;
+
+            g_array_index(use, guint32, i) |= g_array_index(defaults, guint32, i) & ~disabled;
+        }
+    }
+
+    forced = g_array_new(FALSE, TRUE, sizeof(guint32));
+    masked = g_array_new(FALSE, TRUE, sizeof(guint32));
+    key = g_strconcat(cp_package_category(package), "/", cp_package_name(package), NULL);
+
+    success = apply_layer(self, &config->layers[USE_LAYER_USE],
+            package, key, use, &stable, error)
+        && apply_layer(self, &config->layers[USE_LAYER_FORCE],
+            package, key, forced, &stable, error)
+        && apply_layer(self, &config->layers[USE_LAYER_MASK],
+            package, key, masked, &stable, error);
+
+    g_free(key);
+
+    /* Masked flags win over forced ones, as they do in global USE */
+    cp_bitset_or(use, forced);
+    cp_bitset_and_not(use, masked);
+    (void)g_array_free(forced, TRUE);
+    (void)g_array_free(masked, TRUE);
+
+    if (!success) {
+        (void)g_array_free(use, TRUE);
+        return FALSE;
+    }
+
+    g_hash_table_insert(config->memo, cp_package_ref(package), use);
+    /*@-dependenttrans@*/
+    *result = use;
+    /*@=dependenttrans@*/
+    return TRUE;
+}
+
+CPUse
+cp_use_new(const CPSettings settings, CPPorttree porttree, GError **error) {
+    CPUse self;
+
+    g_assert(error == NULL || *error == NULL);
+
+    self = g_new0(struct CPUseS, 1);
+    self->refs = 1;
+
+    g_assert(self->porttree == NULL);
+    self->porttree = cp_porttree_ref(porttree);
+    g_assert(self->factory == NULL);
+    self->factory = cp_atom_factory_new();
+
+    g_assert(self->deps == NULL);
+    self->deps = cp_dep_table_new(self->factory);
+    g_assert(self->package_defaults == NULL);
+    self->package_defaults = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+        (GDestroyNotify)cp_package_unref, cp_bitset_free);
+
+    g_assert(self->configs == NULL);
+    self->configs = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+        NULL, use_config_free);
+
+    if (!load_config(self, settings, error)) {
+        cp_use_unref(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+CPUse
+cp_use_ref(CPUse self) {
+    g_atomic_int_inc(&self->refs);
+    /*@-refcounttrans@*/
+    return self;
+    /*@=refcounttrans@*/
+}
+
+void
+cp_use_unref(CPUse self) {
+    /*@-mustfreeonly@*/
+    if (self == NULL) {
+        return;
+    }
+
+    g_assert(g_atomic_int_get(&self->refs) > 0);
+    if (!g_atomic_int_dec_and_test(&self->refs)) {
+        return;
+    }
+    /*@=mustfreeonly@*/
+
+    cp_hash_table_destroy(self->configs);
+    cp_hash_table_destroy(self->package_defaults);
+    cp_dep_table_destroy(self->deps);
+    cp_atom_factory_unref(self->factory);
+    cp_porttree_unref(self->porttree);
+
+    /*@-refcounttrans@*/
+    g_free(self);
+    /*@=refcounttrans@*/
+}
+
+gboolean
+cp_use_reload(CPUse self, const CPSettings settings, GError **error) {
+    g_assert(error == NULL || *error == NULL);
+
+    return load_config(self, settings, error);
+}
+
+guint64
+cp_use_fingerprint(const CPUse self) {
+    return self->config->fingerprint;
+}
+
+gboolean
+cp_use_get_bitset(
+    CPUse self,
+    const CPPackage package,
+    const GArray **bitset,
+    GError **error
+) {
+    g_assert(error == NULL || *error == NULL);
+
+    return evaluate(self, package, bitset, error);
+}
+
+gboolean
+cp_use_get_flags(CPUse self, const CPPackage package, char ***flags, GError **error) {
+    const GArray *bitset;
+    GPtrArray *result;
+    guint bit;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!evaluate(self, package, &bitset, error)) {
+        *flags = NULL;
+        return FALSE;
+    }
+
+    result = g_ptr_array_new();
+    for (bit = 0; bit < bitset->len * 32; ++bit) {
+        if (cp_bitset_get(bitset, bit)) {
+            g_ptr_array_add(result, g_strdup(cp_dep_table_flag_name(self->deps, bit)));
+        }
+    }
+    g_ptr_array_add(result, NULL);
+
+    *flags = (char **)g_ptr_array_free(result, FALSE);
+    cp_strings_sort(*flags);
+    return TRUE;
+}
+
+guint
+cp_use_n_flags(const CPUse self) {
+    return cp_dep_table_n_flags(self->deps);
+}
+
+const char *
+cp_use_flag_name(const CPUse self, guint id) {
+    g_assert(id < cp_dep_table_n_flags(self->deps));
+
+    return cp_dep_table_flag_name(self->deps, id);
+}
+
+CPDepTable
+cp_use_get_dep_table(const CPUse self) {
+    return self->deps;
+}
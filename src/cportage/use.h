@@ -0,0 +1,68 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Per-package effective USE. */
+
+#ifndef CP_USE_H
+#define CP_USE_H
+
+#include <cportage.h>
+
+#include "dep.h"
+
+/*@-exportany@*/
+
+/**
+ * Same as cp_use_get_flags(), but returns bitset over flag IDs of \a self.
+ *
+ * \param bitset return location for readonly bitset, valid until \a self
+ *               is reloaded with different configuration
+ * \param error  return location for a %GError, or %NULL
+ * \return       %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_use_get_bitset(
+    CPUse self,
+    const CPPackage package,
+    /*@out@*/ const GArray/*<guint32>*/ **bitset,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *self,*bitset,*error,errno@*/ /*@globals fileSystem@*/;
+
+/**
+ * \return number of flags interned by \a self so far, IDs are below it
+ */
+guint
+cp_use_n_flags(const CPUse self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return readonly name of flag with \a id
+ */
+/*@observer@*/ const char *
+cp_use_flag_name(const CPUse self, guint id) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return table whose flag IDs bitsets of \a self are over, dependencies
+ *         parsed into it can be flattened with cp_use_get_bitset() output
+ *         by cp_dep_eval_flatten(). Valid as long as \a self exists
+ */
+/*@dependent@*/ CPDepTable
+cp_use_get_dep_table(const CPUse self) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+#endif
@@ -17,298 +17,2597 @@
     along with cportage.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+/* DT_* constants of struct dirent are a BSD extension */
+#define _DEFAULT_SOURCE 1
+
+#include "config.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#if HAVE_INOTIFY_INIT1
+#   include <sys/inotify.h>
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
 #include "atom.h"
 #include "collections.h"
 #include "eapi.h"
+#include "io_batch.h"
 #include "package.h"
+#include "pattern.h"
 #include "settings.h"
 #include "strings.h"
+#include "vartree_column.h"
+#include "vartree_index.h"
+
+/** Cached contents of a single vdb category. */
+struct category_cache {
+    /**
+     * Packagename->packages table, %NULL if category directory is invalid.
+     * Packages are stored in arrays sorted by version, so that version
+     * ranges can be found with binary search.
+     */
+    /*@null@*/ /*@only@*/ GHashTable *name2pkg;
+    /** Modification time of category directory when it was read */
+    CPTimestamp mtime;
+};
+
+/** Cached column of a single metadata key. */
+struct column_cache {
+    /*@only@*/ CPVartreeColumn column;
+    /** Value of CPVartreeS.generation when column was built */
+    guint64 generation;
+    /** Whether column file is outdated, it is written by cp_vartree_save_index() */
+    gboolean dirty;
+};
+
+/**
+ * Secondary indexes of package names, used by pattern searches.
+ * All arrays are sorted and point into \a strings.
+ */
+struct name_index {
+    /** Value of CPVartreeS.generation when index was built */
+    guint64 generation;
+    /*@only@*/ GStringChunk *strings;
+    /** Category names */
+    /*@only@*/ GPtrArray/*<char *>*/ *categories;
+    /** Unique package names */
+    /*@only@*/ GPtrArray/*<char *>*/ *names;
+    /** Package name->categories containing it */
+    /*@only@*/ GHashTable/*<char *, GPtrArray<char *>>*/ *name2categories;
+    /** Category->package names in it */
+    /*@only@*/ GHashTable/*<char *, GPtrArray<char *>>*/ *category2names;
+};
+
+/**
+ * Published view of vartree cache. Never changes after publication,
+ * so readers don't need any locking.
+ */
+struct CPVartreeSnapshotS {
+    /** Category->name2pkg tables, shared with vartree cache */
+    /*@only@*/ GHashTable *categories;
+    /** Secondary indexes of \a categories, list keys in sorted order too */
+    /*@only@*/ struct name_index *index;
+    /** Value of CPVartreeS.generation when snapshot was built */
+    guint64 generation;
+
+    /** Changed atomically, snapshots are released from several threads */
+    /*@refs@*/ gint refs;
+};
 
 struct CPVartreeS {
     CPTree tree;
 
     /*@only@*/ char *path;
 
-    /** Category->packagename->packages cache */
+    /** Category->category_cache cache, %NULL values for unloaded categories */
     /*@only@*/ GHashTable *cache;
+    /**
+     * %FALSE in on-demand mode until vdb root is listed. Until then,
+     * categories missing from cache are looked up directly.
+     */
+    gboolean categories_listed;
+
+    /** Path to index file, %NULL if index is disabled */
+    /*@only@*/ /*@null@*/ char *index_path;
+    /*@only@*/ /*@null@*/ CPVartreeIndex index;
+    /** Modification time of vdb root when list of categories was read */
+    CPTimestamp root_mtime;
+    /** %TRUE if index file doesn't match cache contents */
+    gboolean index_dirty;
+
+    /** inotify descriptor in watch mode, -1 otherwise */
+    int watch_fd;
+    /** Watch descriptor->category name map */
+    /*@only@*/ /*@null@*/ GHashTable *wd2category;
+    /** Increased every time cache contents change */
+    guint64 generation;
+
+    /** Built on first pattern search */
+    /*@only@*/ /*@null@*/ struct name_index *names;
+
+    /** Metadata key->column_cache table, filled on demand */
+    /*@only@*/ GHashTable *columns;
+    /** Number of threads used to read vdb */
+    unsigned int jobs;
+
+    /** Latest published snapshot, only accessed atomically */
+    /*@only@*/ CPVartreeSnapshot snapshot;
+    /** Readers that are acquiring snapshot, counted separately per epoch */
+    gint readers[2];
+    /** Selects counter in \a readers used by new readers */
+    gint epoch;
+};
+
+static void
+category_cache_free(/*@null@*/ /*@only@*/ void *data) /*@modifies data@*/ {
+    struct category_cache *cat = data;
+
+    if (cat == NULL) {
+        return;
+    }
+
+    /* Table can still be used by foreach or snapshots */
+    if (cat->name2pkg != NULL) {
+        g_hash_table_unref(cat->name2pkg);
+    }
+    g_free(cat);
+}
+
+static void
+name_index_free(/*@null@*/ /*@only@*/ struct name_index *index) /*@modifies index@*/ {
+    if (index == NULL) {
+        return;
+    }
+
+    (void)g_ptr_array_free(index->categories, TRUE);
+    (void)g_ptr_array_free(index->names, TRUE);
+    cp_hash_table_destroy(index->name2categories);
+    cp_hash_table_destroy(index->category2names);
+    g_string_chunk_free(index->strings);
+    g_free(index);
+}
+
+static void
+column_cache_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct column_cache *col = data;
+
+    cp_vartree_column_destroy(col->column);
+    g_free(col);
+}
+
+static void
+timestamp_from_stat(
+    const struct stat *st,
+    /*@out@*/ CPTimestamp *mtime
+) /*@modifies *mtime@*/ {
+    mtime->sec = (guint64)st->st_mtim.tv_sec;
+    mtime->nsec = (guint64)st->st_mtim.tv_nsec;
+}
+
+/**
+ * \param mtime return location for modification time of \a path
+ * \return      %TRUE if \a path is a directory, %FALSE otherwise
+ */
+static gboolean
+stat_dir(
+    const char *path,
+    /*@out@*/ CPTimestamp *mtime
+) /*@modifies *mtime,errno@*/ /*@globals fileSystem@*/ {
+    struct stat st;
+
+    mtime->sec = 0;
+    mtime->nsec = 0;
+
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return FALSE;
+    }
+
+    timestamp_from_stat(&st, mtime);
+    return TRUE;
+}
+
+/** Maximum size of single-value vdb files like SLOT or repository */
+#define VDB_VALUE_MAX 1024
+
+/** Package directory being read. */
+struct vdb_entry {
+    /*@observer@*/ const char *vdb_path;
+    /*@observer@*/ const char *category;
+    /*@observer@*/ const char *pv;
+    /** Package directory descriptor, -1 when files are read in a batch */
+    int fd;
+};
+
+static void
+set_read_error(
+    const struct vdb_entry *entry,
+    const char *name,
+    int save_errno,
+    /*@null@*/ GError **error
+) /*@modifies *error@*/ {
+    char *path = g_build_filename(
+        entry->vdb_path, entry->category, entry->pv, name, NULL
+    );
+
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(save_errno),
+        _("Can't read '%s': %s"), path, g_strerror(save_errno));
+    g_free(path);
+}
+
+/** Files read for every package, indices into its CPIOBatchRequest block. */
+enum {
+    VDB_FILE_EAPI,
+    VDB_FILE_SLOT,
+    VDB_FILE_REPO,
+    VDB_N_FILES
 };
 
+/*@observer@*/ /*@unchecked@*/ static const char * const vdb_files[VDB_N_FILES] = {
+    "EAPI", "SLOT", "repository"
+};
+
+/**
+ * Reads file \a name of package \a entry into \a buf and strips
+ * surrounding whitespace. Doesn't allocate memory.
+ *
+ * \param buf   buffer of at least #VDB_VALUE_MAX + 1 bytes
+ * \param found return location for flag telling whether \a name exists,
+ *              or %NULL if missing file is an error
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
 static gboolean G_GNUC_WARN_UNUSED_RESULT
-try_load_package(
-    const CPVartree self,
+read_value(
+    const struct vdb_entry *entry,
+    const char *name,
+    /*@out@*/ char *buf,
+    /*@null@*/ /*@out@*/ gboolean *found,
+    /*@null@*/ GError **error
+) /*@modifies *buf,*found,*error,errno@*/ /*@globals fileSystem@*/ {
+    size_t len = 0;
+    int fd;
+
+    g_assert(error == NULL || *error == NULL);
+
+    buf[0] = '\0';
+
+    fd = openat(entry->fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        int save_errno = errno;
+        if (found != NULL && save_errno == ENOENT) {
+            *found = FALSE;
+            return TRUE;
+        }
+        set_read_error(entry, name, save_errno, error);
+        return FALSE;
+    }
+
+    /* Read one byte more than allowed to detect oversized files */
+    while (len <= VDB_VALUE_MAX) {
+        ssize_t n = read(fd, buf + len, VDB_VALUE_MAX + 1 - len);
+        if (n < 0) {
+            int save_errno = errno;
+            if (save_errno == EINTR) {
+                continue;
+            }
+            (void)close(fd);
+            set_read_error(entry, name, save_errno, error);
+            return FALSE;
+        }
+        if (n == 0) {
+            break;
+        }
+        len += (size_t)n;
+    }
+
+    (void)close(fd);
+
+    if (len > VDB_VALUE_MAX) {
+        set_read_error(entry, name, EFBIG, error);
+        return FALSE;
+    }
+
+    buf[len] = '\0';
+    (void)g_strstrip(buf);
+    if (found != NULL) {
+        *found = TRUE;
+    }
+    return TRUE;
+}
+
+/**
+ * Checks that file \a name of package \a entry was read into \a req
+ * and strips surrounding whitespace from its contents.
+ *
+ * \param value return location for readonly value, owned by \a req
+ * \param found return location for flag telling whether \a name exists,
+ *              or %NULL if missing file is an error
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+get_value(
+    const struct vdb_entry *entry,
+    const char *name,
+    CPIOBatchRequest *req,
+    /*@out@*/ const char **value,
+    /*@null@*/ /*@out@*/ gboolean *found,
+    /*@null@*/ GError **error
+) /*@modifies *req,*value,*found,*error@*/ {
+    g_assert(error == NULL || *error == NULL);
+
+    *value = NULL;
+
+    if (req->error != 0) {
+        if (found != NULL && req->error == ENOENT) {
+            *found = FALSE;
+            return TRUE;
+        }
+        set_read_error(entry, name, req->error, error);
+        return FALSE;
+    }
+
+    g_assert(req->contents != NULL);
+    if (req->length > VDB_VALUE_MAX) {
+        set_read_error(entry, name, EFBIG, error);
+        return FALSE;
+    }
+
+    *value = g_strstrip(req->contents);
+    if (found != NULL) {
+        *found = TRUE;
+    }
+    return TRUE;
+}
+
+/** Valid package directory name found in category directory. */
+struct vdb_pending {
+    /*@only@*/ char *pv;
+    /*@only@*/ char *name;
+    /*@only@*/ CPVersion version;
+};
+
+/**
+ * Validates values read for package \a pending and creates it.
+ *
+ * \param eapi_str contents of EAPI file, or %NULL if there is none
+ * \param into     return location for a package
+ * \param error    return location for a %GError, or %NULL
+ * \return         %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+new_package(
+    const struct vdb_entry *entry,
+    const struct vdb_pending *pending,
+    /*@null@*/ const char *eapi_str,
+    const char *slot,
+    const char *repo,
+    /*@out@*/ CPPackage *into,
+    /*@null@*/ GError **error
+) /*@modifies *into,*error@*/ {
+    CPEapi eapi = CP_EAPI_LATEST;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *into = NULL;
+
+    if (eapi_str != NULL) {
+        eapi = cp_eapi_parse(eapi_str, "EAPI", NULL);
+        if (eapi == CP_EAPI_UNKNOWN) {
+            char *path = g_build_filename(
+                entry->vdb_path, entry->category, entry->pv, "EAPI", NULL
+            );
+            (void)cp_eapi_parse(eapi_str, path, error);
+            g_free(path);
+            return FALSE;
+        }
+    }
+
+    if (!cp_atom_slot_validate(slot, CP_EAPI_LATEST, error)
+            || !cp_atom_repo_validate(repo, error)) {
+        return FALSE;
+    }
+
+    *into = cp_package_new(
+        entry->category, pending->name, pending->version, slot, repo, eapi
+    );
+    return TRUE;
+}
+
+/**
+ * Reads package \a pending right from its directory into stack buffers,
+ * allocating nothing but the package itself.
+ *
+ * \param cat_fd descriptor of category directory
+ * \param into   return location for a package, set to %NULL if \a pending
+ *               isn't a package directory
+ * \param error  return location for a %GError, or %NULL
+ * \return       %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+read_package(
+    const char *vdb_path,
     const char *category,
-    const char *pv,
+    int cat_fd,
+    const struct vdb_pending *pending,
     /*@out@*/ CPPackage *into,
     /*@null@*/ GError **error
 ) /*@modifies *into,*error,errno@*/ /*@globals fileSystem@*/ {
+    struct vdb_entry entry;
+    char eapi[VDB_VALUE_MAX + 1];
+    char slot[VDB_VALUE_MAX + 1];
+    char repo[VDB_VALUE_MAX + 1];
+    gboolean found = FALSE;
+    gboolean result;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *into = NULL;
+
+    entry.vdb_path = vdb_path;
+    entry.category = category;
+    entry.pv = pending->pv;
+    entry.fd = openat(cat_fd, pending->pv, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (entry.fd < 0) {
+        int save_errno = errno;
+        /* Stray files in category directory aren't packages */
+        if (save_errno == ENOTDIR || save_errno == ENOENT) {
+            return TRUE;
+        }
+        set_read_error(&entry, "", save_errno, error);
+        return FALSE;
+    }
+
+    result = read_value(&entry, vdb_files[VDB_FILE_EAPI], eapi, &found, error)
+        && read_value(&entry, vdb_files[VDB_FILE_SLOT], slot, NULL, error)
+        && read_value(&entry, vdb_files[VDB_FILE_REPO], repo, NULL, error)
+        && new_package(&entry, pending, found ? eapi : NULL, slot, repo, into, error);
+
+    (void)close(entry.fd);
+    return result;
+}
+
+/**
+ * Creates package \a pending from its files read into \a files.
+ *
+ * \param cat_fd descriptor of category directory
+ * \param into   return location for a package, set to %NULL if \a pending
+ *               isn't a package directory
+ * \param error  return location for a %GError, or %NULL
+ * \return       %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+make_package(
+    const char *vdb_path,
+    const char *category,
+    int cat_fd,
+    const struct vdb_pending *pending,
+    CPIOBatchRequest *files,
+    /*@out@*/ CPPackage *into,
+    /*@null@*/ GError **error
+) /*@modifies *files,*into,*error,errno@*/ /*@globals fileSystem@*/ {
+    struct vdb_entry entry;
+    CPIOBatchRequest *slot_req = &files[VDB_FILE_SLOT];
+    const char *eapi_str;
+    const char *slot;
+    const char *repo;
+    gboolean found;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *into = NULL;
+
+    entry.vdb_path = vdb_path;
+    entry.category = category;
+    entry.pv = pending->pv;
+    entry.fd = -1;
+
+    if (slot_req->error == ENOTDIR) {
+        /* Stray files in category directory aren't packages */
+        return TRUE;
+    }
+    if (slot_req->error == ENOENT) {
+        struct stat st;
+        /* Package could have been unmerged after directory was listed */
+        if (fstatat(cat_fd, pending->pv, &st, 0) != 0 && errno == ENOENT) {
+            return TRUE;
+        }
+    }
+
+    if (!get_value(&entry, vdb_files[VDB_FILE_EAPI], &files[VDB_FILE_EAPI],
+            &eapi_str, &found, error)
+            || !get_value(&entry, vdb_files[VDB_FILE_SLOT], slot_req, &slot, NULL, error)
+            || !get_value(&entry, vdb_files[VDB_FILE_REPO], &files[VDB_FILE_REPO],
+                &repo, NULL, error)) {
+        return FALSE;
+    }
+
+    return new_package(
+        &entry, pending, found ? eapi_str : NULL, slot, repo, into, error
+    );
+}
+
+/**
+ * Appends \a package to \a name2pkg. Arrays have to be sorted using
+ * sort_packages() after all packages are inserted.
+ */
+static void
+insert_package(
+    GHashTable *name2pkg,
+    /*@only@*/ CPPackage package
+) /*@modifies *name2pkg@*/ {
+    const char *name = cp_package_name(package);
+    GPtrArray *pkgs = g_hash_table_lookup(name2pkg, name);
+
+    if (pkgs == NULL) {
+        pkgs = g_ptr_array_new_with_free_func((GDestroyNotify)cp_package_unref);
+        g_hash_table_insert(name2pkg, g_strdup(name), pkgs);
+    }
+
+    /*@-refcounttrans@*/
+    g_ptr_array_add(pkgs, package);
+    /*@=refcounttrans@*/
+}
+
+static gint
+package_ptr_cmp(const void *a, const void *b) /*@*/ {
+    const CPPackage *pa = a;
+    const CPPackage *pb = b;
+
+    return cp_package_cmp(*pa, *pb);
+}
+
+static void
+sort_packages(GHashTable *name2pkg) /*@modifies *name2pkg@*/ {
+    GHashTableIter iter;
+    void *pkgs;
+
+    g_hash_table_iter_init(&iter, name2pkg);
+    while (g_hash_table_iter_next(&iter, NULL, &pkgs)) {
+        g_ptr_array_sort(pkgs, package_ptr_cmp);
+    }
+}
+
+/**
+ * Reads files of all \a pending packages and adds packages to \a name2pkg.
+ * With io_uring, files of the whole category are read in one batch.
+ * Otherwise batching buys nothing over reading package by package
+ * into stack buffers, so that is done instead.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+load_packages(
+    const char *vdb_path,
+    const char *category,
+    int cat_fd,
+    GArray/*<struct vdb_pending>*/ *pending,
+    GHashTable *name2pkg,
+    /*@null@*/ GError **error
+) /*@modifies *name2pkg,*error,errno@*/ /*@globals fileSystem@*/ {
+    guint n_files = pending->len * VDB_N_FILES;
+    CPIOBatchRequest *files;
+    char **paths;
+    gboolean result = TRUE;
+    guint i;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!cp_io_batch_is_async()) {
+        for (i = 0; i < pending->len && result; ++i) {
+            CPPackage package;
+
+            result = read_package(
+                vdb_path, category, cat_fd,
+                &g_array_index(pending, struct vdb_pending, i), &package, error
+            );
+            if (result && package != NULL) {
+                insert_package(name2pkg, package);
+            }
+        }
+        return result;
+    }
+
+    files = g_new0(CPIOBatchRequest, n_files);
+    paths = g_new0(char *, n_files + 1);
+    for (i = 0; i < n_files; ++i) {
+        const struct vdb_pending *pkg
+            = &g_array_index(pending, struct vdb_pending, i / VDB_N_FILES);
+
+        paths[i] = g_build_filename(pkg->pv, vdb_files[i % VDB_N_FILES], NULL);
+        files[i].dir_fd = cat_fd;
+        files[i].path = paths[i];
+    }
+
+    /* Callers may already run one loader per thread */
+    cp_io_batch_read(files, n_files, 1);
+
+    for (i = 0; i < pending->len && result; ++i) {
+        CPPackage package;
+
+        result = make_package(
+            vdb_path, category, cat_fd,
+            &g_array_index(pending, struct vdb_pending, i),
+            &files[i * VDB_N_FILES], &package, error
+        );
+        if (result && package != NULL) {
+            insert_package(name2pkg, package);
+        }
+    }
+
+    cp_io_batch_clear(files, n_files);
+    g_free(files);
+    g_strfreev(paths);
+
+    return result;
+}
+
+/**
+ * Reads all packages of \a category, using \a index when it has up-to-date
+ * data. Doesn't touch any shared state, so it is safe to call from several
+ * threads at once.
+ *
+ * \param into      return location for category cache
+ * \param from_disk return location for flag telling whether \a category
+ *                  was read from vdb rather than from \a index
+ * \param error     return location for a %GError, or %NULL
+ * \return          %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+load_category(
+    const char *vdb_path,
+    /*@null@*/ const CPVartreeIndex index,
+    const char *category,
+    /*@out@*/ struct category_cache **into,
+    /*@out@*/ gboolean *from_disk,
+    /*@null@*/ GError **error
+) /*@modifies *into,*from_disk,*error,errno@*/ /*@globals fileSystem@*/ {
+    struct category_cache *cat = g_new0(struct category_cache, 1);
+    char *cat_path = NULL;
+    int cat_fd = -1;
+    DIR *cat_dir = NULL;
+    struct dirent *dir_entry;
+    struct stat st;
+    GSList *indexed = NULL;
+    GArray *pending = NULL;
     gboolean result = TRUE;
-    char *config_file = NULL;
 
-    char *name = NULL;
-    CPVersion version = NULL;
-    char *slot = NULL;
-    char *repo = NULL;
+    g_assert(error == NULL || *error == NULL);
+
+    *into = NULL;
+    *from_disk = FALSE;
+
+    if (!cp_atom_category_validate(category, NULL)) {
+        goto OUT;
+    }
+
+    cat_path = g_build_filename(vdb_path, category, NULL);
+    cat_fd = open(cat_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cat_fd < 0) {
+        int save_errno = errno;
+        if (save_errno != ENOTDIR && save_errno != ENOENT) {
+            g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(save_errno),
+                _("Can't open '%s': %s"), cat_path, g_strerror(save_errno));
+            result = FALSE;
+        }
+        goto OUT;
+    }
+
+    if (fstat(cat_fd, &st) != 0) {
+        int save_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(save_errno),
+            _("Can't stat '%s': %s"), cat_path, g_strerror(save_errno));
+        result = FALSE;
+        goto OUT;
+    }
+    timestamp_from_stat(&st, &cat->mtime);
+
+    g_assert(cat->name2pkg == NULL);
+    cat->name2pkg = g_hash_table_new_full(
+        g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_ptr_array_unref
+    );
+
+    if (index != NULL
+            && cp_vartree_index_get_category(index, category, &cat->mtime, &indexed)) {
+        CP_GSLIST_ITER(indexed, package) {
+            insert_package(cat->name2pkg, package);
+        } end_CP_GSLIST_ITER
+        g_slist_free(indexed);
+        goto OUT;
+    }
+
+    *from_disk = TRUE;
+
+    cat_dir = fdopendir(cat_fd);
+    if (cat_dir == NULL) {
+        int save_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(save_errno),
+            _("Can't open '%s': %s"), cat_path, g_strerror(save_errno));
+        result = FALSE;
+        goto OUT;
+    }
+    /* Directory stream owns descriptor now */
+    cat_fd = dirfd(cat_dir);
+
+    pending = g_array_new(FALSE, FALSE, sizeof(struct vdb_pending));
+
+    /* Package files are read in one batch after listing whole directory */
+    for (;;) {
+        struct vdb_pending pkg;
+
+        errno = 0;
+        dir_entry = readdir(cat_dir);
+        if (dir_entry == NULL) {
+            if (errno != 0) {
+                int save_errno = errno;
+                g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(save_errno),
+                    _("Error reading from '%s': %s"), cat_path, g_strerror(save_errno));
+                result = FALSE;
+            }
+            break;
+        }
+
+        if (strcmp(dir_entry->d_name, ".") == 0
+                || strcmp(dir_entry->d_name, "..") == 0) {
+            continue;
+        }
+#ifdef DT_DIR
+        /* Packages are directories, skip anything else without a syscall */
+        if (dir_entry->d_type != DT_DIR && dir_entry->d_type != DT_UNKNOWN) {
+            continue;
+        }
+#endif
+
+        if (!cp_atom_pv_split(dir_entry->d_name, &pkg.name, &pkg.version, NULL)) {
+            continue;
+        }
+        pkg.pv = g_strdup(dir_entry->d_name);
+        (void)g_array_append_val(pending, pkg);
+    }
+
+    if (result) {
+        result = load_packages(
+            vdb_path, category, cat_fd, pending, cat->name2pkg, error
+        );
+    }
+
+OUT:
+    if (pending != NULL) {
+        guint i;
+
+        for (i = 0; i < pending->len; ++i) {
+            struct vdb_pending *pkg = &g_array_index(pending, struct vdb_pending, i);
+            g_free(pkg->pv);
+            g_free(pkg->name);
+            cp_version_unref(pkg->version);
+        }
+        (void)g_array_free(pending, TRUE);
+    }
+    if (cat_dir != NULL) {
+        (void)closedir(cat_dir);
+    } else if (cat_fd >= 0) {
+        (void)close(cat_fd);
+    }
+    if (result) {
+        if (cat->name2pkg != NULL) {
+            sort_packages(cat->name2pkg);
+        }
+        *into = cat;
+    } else {
+        category_cache_free(cat);
+    }
+    g_free(cat_path);
+    return result;
+}
+
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+populate_cache(
+    const CPVartree self,
+    const char *category,
+    /*@null@*/ GError **error
+) /*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/ {
+    struct category_cache *cat;
+    gboolean from_disk;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!load_category(self->path, self->index, category, &cat, &from_disk, error)) {
+        return FALSE;
+    }
+
+    if (from_disk) {
+        self->index_dirty = TRUE;
+    }
+    g_hash_table_insert(self->cache, g_strdup(category), cat);
+    return TRUE;
+}
+
+/** State shared between parallel category loaders. */
+struct load_categories_data {
+    /*@observer@*/ const char *vdb_path;
+    /*@observer@*/ /*@null@*/ CPVartreeIndex index;
+
+    /** Guards everything below */
+    GMutex lock;
+    /*@dependent@*/ GHashTable *cache;
+    /** %TRUE if any category was read from vdb rather than from index */
+    gboolean from_disk;
+    /** First error that occurred, remaining categories are skipped after it */
+    /*@null@*/ GError *error;
+};
+
+static void
+load_category_job(
+    /*@only@*/ void *data,
+    void *user_data
+) /*@modifies *user_data,errno@*/ /*@globals fileSystem@*/ {
+    char *category = data;
+    struct load_categories_data *ctx = user_data;
+    struct category_cache *cat = NULL;
+    gboolean from_disk = FALSE;
+    GError *error = NULL;
+    gboolean failed;
+
+    g_mutex_lock(&ctx->lock);
+    failed = ctx->error != NULL;
+    g_mutex_unlock(&ctx->lock);
+
+    if (!failed && !load_category(
+            ctx->vdb_path, ctx->index, category, &cat, &from_disk, &error)) {
+        failed = TRUE;
+    }
+
+    g_mutex_lock(&ctx->lock);
+    if (error != NULL && ctx->error == NULL) {
+        ctx->error = error;
+        error = NULL;
+    }
+    if (!failed) {
+        g_hash_table_insert(ctx->cache, category, cat);
+        ctx->from_disk = ctx->from_disk || from_disk;
+        category = NULL;
+    }
+    g_mutex_unlock(&ctx->lock);
+
+    if (error != NULL) {
+        g_error_free(error);
+    }
+    g_free(category);
+}
+
+/**
+ * Loads \a categories into \a self cache using a pool of \a jobs threads,
+ * one task per category.
+ *
+ * \param categories list of category names, consumed by this function
+ * \param error      return location for a %GError, or %NULL
+ * \return           %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+populate_cache_parallel(
+    CPVartree self,
+    /*@only@*/ GSList *categories,
+    unsigned int jobs,
+    /*@null@*/ GError **error
+) /*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/ {
+    struct load_categories_data ctx;
+    GThreadPool *pool;
+    gboolean result = TRUE;
+
+    g_assert(error == NULL || *error == NULL);
+
+    ctx.vdb_path = self->path;
+    ctx.index = self->index;
+    g_mutex_init(&ctx.lock);
+    ctx.cache = self->cache;
+    ctx.from_disk = FALSE;
+    ctx.error = NULL;
+
+    pool = g_thread_pool_new(load_category_job, &ctx, (gint)jobs, TRUE, error);
+    if (pool == NULL) {
+        g_slist_free_full(categories, g_free);
+        result = FALSE;
+        goto OUT;
+    }
+
+    CP_GSLIST_ITER(categories, category) {
+        /* Pool owns its threads, so pushing can't fail */
+        (void)g_thread_pool_push(pool, category, NULL);
+    } end_CP_GSLIST_ITER
+    g_slist_free(categories);
+
+    /* Waits for all queued categories to be processed */
+    g_thread_pool_free(pool, FALSE, TRUE);
+
+    if (ctx.from_disk) {
+        self->index_dirty = TRUE;
+    }
+
+    if (ctx.error != NULL) {
+        g_propagate_error(error, ctx.error);
+        result = FALSE;
+    }
+
+OUT:
+    g_mutex_clear(&ctx.lock);
+    return result;
+}
+
+#if HAVE_INOTIFY_INIT1
+#   define WATCH_ROOT_MASK \
+        (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+#   define WATCH_CATEGORY_MASK (WATCH_ROOT_MASK | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
+
+static void
+watch_category(CPVartree self, const char *category) /*@modifies *self@*/ {
+#if HAVE_INOTIFY_INIT1
+    char *cat_path;
+    int wd;
+
+    if (self->watch_fd < 0) {
+        return;
+    }
+
+    cat_path = g_build_filename(self->path, category, NULL);
+    wd = inotify_add_watch(self->watch_fd, cat_path, WATCH_CATEGORY_MASK);
+    g_free(cat_path);
+
+    /* Fails for non-directories, they don't need watching */
+    if (wd >= 0) {
+        g_assert(self->wd2category != NULL);
+        g_hash_table_insert(self->wd2category, GINT_TO_POINTER(wd), g_strdup(category));
+    }
+#else
+    (void)self;
+    (void)category;
+#endif
+}
+
+/**
+ * Starts watching vdb root of \a self for added and removed categories.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+init_watch(
+    CPVartree self,
+    /*@null@*/ GError **error
+) /*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/ {
+#if HAVE_INOTIFY_INIT1
+    int save_errno;
+
+    g_assert(error == NULL || *error == NULL);
+
+    self->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (self->watch_fd < 0) {
+        goto ERR;
+    }
+
+    if (inotify_add_watch(self->watch_fd, self->path, WATCH_ROOT_MASK) < 0) {
+        goto ERR;
+    }
+
+    g_assert(self->wd2category == NULL);
+    self->wd2category = g_hash_table_new_full(
+        g_direct_hash, g_direct_equal, NULL, g_free
+    );
+
+    return TRUE;
+
+ERR:
+    save_errno = errno;
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(save_errno),
+        _("Can't watch '%s': %s"), self->path, g_strerror(save_errno));
+    return FALSE;
+#else
+    g_assert(error == NULL || *error == NULL);
+    (void)self;
+    g_debug("vdb watching isn't supported on this platform");
+    return TRUE;
+#endif
+}
+
+/**
+ * Drops cached packages of \a category, they'll be reread on next access.
+ */
+static void
+invalidate_category(CPVartree self, const char *category) /*@modifies *self@*/ {
+    void *cat = NULL;
+
+    if (g_hash_table_lookup_extended(self->cache, category, NULL, &cat)
+            && cat != NULL) {
+        g_hash_table_insert(self->cache, g_strdup(category), NULL);
+        ++self->generation;
+    }
+}
+
+/**
+ * Collects names of vdb categories, either from index (when it is up to date)
+ * or by reading vdb root directory.
+ *
+ * \param into  return location for list of category names
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+list_categories(
+    CPVartree self,
+    /*@out@*/ GSList **into,
+    /*@null@*/ GError **error
+) /*@modifies *self,*into,*error,errno@*/ /*@globals fileSystem@*/ {
+    GDir *vdb_dir;
+    guint i;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *into = NULL;
+
+    if (self->index != NULL
+            && stat_dir(self->path, &self->root_mtime)
+            && cp_vartree_index_root_valid(self->index, &self->root_mtime)) {
+        for (i = cp_vartree_index_n_categories(self->index); i > 0; --i) {
+            *into = g_slist_prepend(
+                *into, g_strdup(cp_vartree_index_category(self->index, i - 1))
+            );
+        }
+        return TRUE;
+    }
+
+    /* Stat before reading, so that concurrent changes invalidate index */
+    (void)stat_dir(self->path, &self->root_mtime);
+
+    vdb_dir = g_dir_open(self->path, 0, error);
+    if (vdb_dir == NULL) {
+        return FALSE;
+    }
+
+    CP_GDIR_ITER(vdb_dir, category) {
+        *into = g_slist_prepend(*into, g_strdup(category));
+    } end_CP_GDIR_ITER
+
+    g_dir_close(vdb_dir);
+
+    self->index_dirty = TRUE;
+    return TRUE;
+}
+
+/**
+ * Makes sure every vdb category has an entry in cache. Only does any work
+ * in on-demand mode, before first operation that needs whole vdb.
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+list_all_categories(
+    CPVartree self,
+    /*@null@*/ GError **error
+) /*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/ {
+    GSList *categories = NULL;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (self->categories_listed) {
+        return TRUE;
+    }
+
+    if (!list_categories(self, &categories, error)) {
+        return FALSE;
+    }
+
+    CP_GSLIST_ITER(categories, category) {
+        /* Categories that were already looked up keep their cache */
+        if (!g_hash_table_lookup_extended(self->cache, category, NULL, NULL)) {
+            g_hash_table_insert(self->cache, g_strdup(category), NULL);
+        }
+    } end_CP_GSLIST_ITER
+    g_slist_free_full(categories, g_free);
+
+    self->categories_listed = TRUE;
+    return TRUE;
+}
+
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+init_cache(
+    CPVartree self,
+    gboolean lazy_cache,
+    unsigned int jobs,
+    /*@null@*/ GError **error
+) /*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/ {
+    GSList *categories = NULL;
+    gboolean result = FALSE;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!list_categories(self, &categories, error)) {
+        goto ERR;
+    }
+    self->categories_listed = TRUE;
+
+    /* Watch before reading, so that no change is missed */
+    CP_GSLIST_ITER(categories, category) {
+        watch_category(self, category);
+    } end_CP_GSLIST_ITER
+
+    if (!lazy_cache && jobs > 1) {
+        result = populate_cache_parallel(self, categories, jobs, error);
+        categories = NULL;
+        goto ERR;
+    }
+
+    CP_GSLIST_ITER(categories, category) {
+        if (lazy_cache) {
+            g_hash_table_insert(self->cache, g_strdup(category), NULL);
+            continue;
+        }
+
+        if (!populate_cache(self, category, error)) {
+            goto ERR;
+        }
+    } end_CP_GSLIST_ITER
+
+    result = TRUE;
+
+ERR:
+    g_slist_free_full(categories, g_free);
+    return result;
+}
+
+/**
+ * Writes contents of \a self cache to index file. Categories that weren't
+ * loaded yet are copied from previous index or marked as outdated.
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+save_packages(
+    CPVartree self,
+    /*@null@*/ GError **error
+) /*@modifies *self,*error,errno,fileSystem@*/ /*@globals fileSystem@*/ {
+    CPVartreeIndexWriter writer;
+    GHashTableIter iter;
+    void *key;
+    void *value;
+    gboolean result;
+
+    g_assert(error == NULL || *error == NULL);
+    g_assert(self->index_path != NULL);
+
+    /* Without full list of categories, index can't vouch for vdb root */
+    if (self->categories_listed) {
+        writer = cp_vartree_index_writer_new(&self->root_mtime);
+    } else {
+        CPTimestamp unknown = {0, 0};
+        writer = cp_vartree_index_writer_new(&unknown);
+    }
+
+    if (!self->categories_listed && self->index != NULL) {
+        guint i;
+
+        for (i = 0; i < cp_vartree_index_n_categories(self->index); ++i) {
+            const char *category = cp_vartree_index_category(self->index, i);
+            if (!g_hash_table_lookup_extended(self->cache, category, NULL, NULL)) {
+                (void)cp_vartree_index_writer_copy_category(
+                    writer, self->index, category
+                );
+            }
+        }
+    }
+
+    g_hash_table_iter_init(&iter, self->cache);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        struct category_cache *cat = value;
+        GHashTableIter pkg_iter;
+        void *pkgs;
+        GSList *packages = NULL;
+
+        if (cat == NULL) {
+            if (self->index == NULL
+                    || !cp_vartree_index_writer_copy_category(writer, self->index, key)) {
+                cp_vartree_index_writer_add_category(writer, key, NULL, NULL);
+            }
+            continue;
+        }
+
+        if (cat->name2pkg == NULL) {
+            /* Not a category, no need to remember it */
+            continue;
+        }
+
+        g_hash_table_iter_init(&pkg_iter, cat->name2pkg);
+        while (g_hash_table_iter_next(&pkg_iter, NULL, &pkgs)) {
+            GPtrArray *arr = pkgs;
+            guint i;
+
+            for (i = 0; i < arr->len; ++i) {
+                packages = g_slist_prepend(packages, g_ptr_array_index(arr, i));
+            }
+        }
+        cp_vartree_index_writer_add_category(writer, key, &cat->mtime, packages);
+        g_slist_free(packages);
+    }
+
+    result = cp_vartree_index_writer_save(writer, self->index_path, error);
+    if (result) {
+        self->index_dirty = FALSE;
+    }
+
+    cp_vartree_index_writer_destroy(writer);
+    return result;
+}
+
+#if HAVE_INOTIFY_INIT1
+/**
+ * Event queue overflowed, so any change could have been missed.
+ * Rereads list of categories and drops all cached packages.
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+handle_overflow(
+    CPVartree self,
+    /*@null@*/ GError **error
+) /*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/ {
+    GDir *vdb_dir;
+
+    g_assert(error == NULL || *error == NULL);
+
+    g_debug("vdb watch queue overflowed, dropping vartree cache");
+
+    vdb_dir = g_dir_open(self->path, 0, error);
+    if (vdb_dir == NULL) {
+        return FALSE;
+    }
+
+    g_hash_table_remove_all(self->cache);
+    CP_GDIR_ITER(vdb_dir, category) {
+        g_hash_table_insert(self->cache, g_strdup(category), NULL);
+        watch_category(self, category);
+    } end_CP_GDIR_ITER
+    g_dir_close(vdb_dir);
+
+    ++self->generation;
+    (void)stat_dir(self->path, &self->root_mtime);
+    self->index_dirty = TRUE;
+    return TRUE;
+}
+
+static void
+handle_event(
+    CPVartree self,
+    const struct inotify_event *event
+) /*@modifies *self@*/ {
+    const char *category;
+
+    if ((event->mask & IN_IGNORED) != 0) {
+        (void)g_hash_table_remove(self->wd2category, GINT_TO_POINTER(event->wd));
+        return;
+    }
+
+    category = g_hash_table_lookup(self->wd2category, GINT_TO_POINTER(event->wd));
+    if (category != NULL) {
+        /* Package was merged or unmerged */
+        invalidate_category(self, category);
+        return;
+    }
+
+    /* Event on vdb root, category was added or removed */
+    if (event->len == 0) {
+        return;
+    }
+
+    if ((event->mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+        if (g_hash_table_lookup_extended(self->cache, event->name, NULL, NULL)) {
+            return;
+        }
+        g_hash_table_insert(self->cache, g_strdup(event->name), NULL);
+        watch_category(self, event->name);
+    } else if (!g_hash_table_remove(self->cache, event->name)) {
+        return;
+    }
+
+    ++self->generation;
+    /* List of categories in index is outdated now */
+    (void)stat_dir(self->path, &self->root_mtime);
+    self->index_dirty = TRUE;
+}
+#endif
+
+gboolean
+cp_vartree_sync(CPVartree self, GError **error) {
+#if HAVE_INOTIFY_INIT1
+    union {
+        struct inotify_event event;
+        char data[4096];
+    } buf;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (self->watch_fd < 0) {
+        return TRUE;
+    }
+
+    for (;;) {
+        ssize_t len = read(self->watch_fd, buf.data, sizeof(buf.data));
+        size_t offset = 0;
+
+        if (len < 0) {
+            int save_errno = errno;
+            if (save_errno == EINTR) {
+                continue;
+            }
+            if (save_errno == EAGAIN) {
+                /* No more pending events */
+                return TRUE;
+            }
+            g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(save_errno),
+                _("Can't watch '%s': %s"), self->path, g_strerror(save_errno));
+            return FALSE;
+        }
+
+        while (offset < (size_t)len) {
+            const struct inotify_event *event = (const void *)&buf.data[offset];
+
+            if ((event->mask & IN_Q_OVERFLOW) != 0) {
+                if (!handle_overflow(self, error)) {
+                    return FALSE;
+                }
+            } else {
+                handle_event(self, event);
+            }
+            offset += sizeof(*event) + event->len;
+        }
+    }
+#else
+    g_assert(error == NULL || *error == NULL);
+    (void)self;
+    return TRUE;
+#endif
+}
+
+guint64
+cp_vartree_generation(const CPVartree self) {
+    return self->generation;
+}
+
+static gboolean
+get_category_cache(
+    CPVartree self,
+    const char *cat,
+    /*@out@*/ GHashTable **result,
+    /*@null@*/ GError **error
+) /*@modifies *self,*result,*error,errno@*/ /*@globals fileSystem@*/ {
+    struct category_cache *cache = NULL;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *result = NULL;
+
+    if (!g_hash_table_lookup_extended(self->cache, cat, NULL, (void **)&cache)) {
+        if (self->categories_listed) {
+            /* Nonexistent category */
+            return TRUE;
+        }
+        /*
+         * On-demand mode: open category directory directly. Nonexistent
+         * categories are cached with %NULL name2pkg, so they are only
+         * checked once.
+         */
+        if (!populate_cache(self, cat, error)) {
+            return FALSE;
+        }
+        cache = g_hash_table_lookup(self->cache, cat);
+    } else if (cache == NULL) {
+        /* Uninited lazy cache */
+        if (!populate_cache(self, cat, error)) {
+            return FALSE;
+        }
+        cache = g_hash_table_lookup(self->cache, cat);
+    }
+
+    if (cache != NULL) {
+        /*@-dependenttrans@*/
+        *result = cache->name2pkg;
+        /*@=dependenttrans@*/
+    }
+
+    return TRUE;
+}
+
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+get_package_cache(
+    CPVartree self,
+    const char *category,
+    const char *package,
+    /*@out@*/ GPtrArray **result,
+    /*@null@*/ GError **error
+) /*@modifies *self,*result,*error,errno@*/ /*@globals fileSystem@*/ {
+    GHashTable *name2pkg;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *result = NULL;
+
+    if (!get_category_cache(self, category, &name2pkg, error)) {
+        return FALSE;
+    }
+
+    if (name2pkg != NULL) {
+        /*@-dependenttrans@*/
+        *result = g_hash_table_lookup(name2pkg, package);
+        /*@=dependenttrans@*/
+    }
+
+    return TRUE;
+}
+
+/**
+ * Prepends packages from \a pkgs (sorted by version) that match \a atom
+ * to \a match.
+ */
+static void
+match_packages(
+    /*@null@*/ GPtrArray/*<CPPackage>*/ *pkgs,
+    const CPAtom atom,
+    GSList/*<CPPackage>*/ **match
+) /*@modifies *match@*/ {
+    guint from;
+    guint to;
+    guint i;
+
+    if (pkgs == NULL) {
+        return;
+    }
+
+    cp_atom_match_range(atom, (CPPackage *)pkgs->pdata, pkgs->len, &from, &to);
+
+    /* Walking in ascending order gives descending list */
+    for (i = from; i < to; ++i) {
+        CPPackage pkg = g_ptr_array_index(pkgs, i);
+
+        if (cp_atom_matches(atom, pkg)) {
+            /*@-mustfreefresh@*/
+            *match = g_slist_prepend(*match, cp_package_ref(pkg));
+            /*@=mustfreefresh@*/
+        }
+    }
+}
+
+static gboolean
+cp_vartree_find_packages(
+    void *priv,
+    const CPAtom atom,
+    /*@out@*/ GSList/*<CPPackage>*/ **match,
+    /*@null@*/ GError **error
+) /*@modifies *priv,*match,*error,errno@*/ /*@globals fileSystem@*/ {
+    CPVartree self = priv;
+
+    const char *category = cp_atom_category(atom);
+    const char *package = cp_atom_package(atom);
+    GPtrArray *pkgs;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *match = NULL;
+
+    if (!cp_vartree_sync(self, error)) {
+        return FALSE;
+    }
+
+    if (!get_package_cache(self, category, package, &pkgs, error)) {
+        return FALSE;
+    }
+
+    match_packages(pkgs, atom, match);
+    return TRUE;
+}
+
+/**
+ * Passes packages of \a name2pkg to \a func sorted by name and version.
+ *
+ * \return %FALSE if \a func stopped iteration, %TRUE otherwise
+ */
+static gboolean
+foreach_category(
+    GHashTable *name2pkg,
+    CPTreeForeachFunc func,
+    void *user_data
+) /*@modifies *user_data@*/ {
+    GList *names;
+    GList *iter;
+    gboolean result = TRUE;
+
+    /* func may sync vartree and drop this category from cache */
+    name2pkg = g_hash_table_ref(name2pkg);
+    names = g_list_sort(g_hash_table_get_keys(name2pkg), (GCompareFunc)strcmp);
+
+    for (iter = names; iter != NULL && result; iter = iter->next) {
+        GPtrArray *pkgs = g_hash_table_lookup(name2pkg, iter->data);
+        guint i;
+
+        for (i = 0; i < pkgs->len && result; ++i) {
+            result = func(g_ptr_array_index(pkgs, i), user_data);
+        }
+    }
+
+    g_list_free(names);
+    g_hash_table_unref(name2pkg);
+    return result;
+}
+
+/** Category read ahead of iteration by a loader thread. */
+struct foreach_slot {
+    /*@only@*/ char *category;
+    /** %TRUE if category is loaded by a thread */
+    gboolean pending;
+
+    /* Set by loader thread, guarded by foreach_data.lock */
+    gboolean done;
+    /*@null@*/ /*@only@*/ struct category_cache *cat;
+    gboolean from_disk;
+    /*@null@*/ GError *error;
+};
+
+/** State shared between iterating thread and category loaders. */
+struct foreach_data {
+    /*@observer@*/ const char *vdb_path;
+    /*@observer@*/ /*@null@*/ CPVartreeIndex index;
+
+    GMutex lock;
+    /** Signalled every time a slot is done */
+    GCond cond;
+};
+
+static void
+foreach_load_job(
+    void *data,
+    void *user_data
+) /*@modifies *data,*user_data,errno@*/ /*@globals fileSystem@*/ {
+    struct foreach_slot *slot = data;
+    struct foreach_data *ctx = user_data;
+    struct category_cache *cat = NULL;
+    gboolean from_disk = FALSE;
+    GError *error = NULL;
+
+    (void)load_category(
+        ctx->vdb_path, ctx->index, slot->category, &cat, &from_disk, &error
+    );
+
+    g_mutex_lock(&ctx->lock);
+    slot->cat = cat;
+    slot->from_disk = from_disk;
+    slot->error = error;
+    slot->done = TRUE;
+    g_cond_broadcast(&ctx->cond);
+    g_mutex_unlock(&ctx->lock);
+}
+
+/**
+ * Moves category loaded by a thread into \a self cache.
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+take_slot(
+    CPVartree self,
+    struct foreach_slot *slot,
+    guint64 generation,
+    /*@null@*/ GError **error
+) /*@modifies *self,*slot,*error@*/ {
+    g_assert(error == NULL || *error == NULL);
+
+    slot->pending = FALSE;
+
+    if (slot->error != NULL) {
+        g_propagate_error(error, slot->error);
+        slot->error = NULL;
+        return FALSE;
+    }
+
+    /*
+     * func could have synced vartree while category was being read,
+     * then it is reread on access.
+     */
+    if (self->generation == generation
+            && g_hash_table_lookup_extended(self->cache, slot->category, NULL, NULL)) {
+        if (slot->from_disk) {
+            self->index_dirty = TRUE;
+        }
+        g_hash_table_insert(self->cache, g_strdup(slot->category), slot->cat);
+    } else {
+        category_cache_free(slot->cat);
+    }
+    slot->cat = NULL;
+
+    return TRUE;
+}
+
+static gboolean
+cp_vartree_foreach_package(
+    void *priv,
+    CPTreeForeachFunc func,
+    void *user_data,
+    /*@null@*/ GError **error
+) /*@modifies *priv,*user_data,*error,errno@*/ /*@globals fileSystem@*/ {
+    CPVartree self = priv;
+    struct foreach_data ctx;
+    struct foreach_slot *slots;
+    GThreadPool *pool = NULL;
+    GList *categories;
+    GList *iter;
+    guint64 generation;
+    guint n_slots;
+    guint n_pending = 0;
+    guint i;
+    gboolean result = FALSE;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!cp_vartree_sync(self, error) || !list_all_categories(self, error)) {
+        return FALSE;
+    }
+
+    generation = self->generation;
+    categories = g_list_sort(
+        g_hash_table_get_keys(self->cache), (GCompareFunc)strcmp
+    );
+    n_slots = g_list_length(categories);
+    slots = g_new0(struct foreach_slot, n_slots);
+
+    for (iter = categories, i = 0; iter != NULL; iter = iter->next, ++i) {
+        /* Cache can change while func runs, so names are copied */
+        slots[i].category = g_strdup(iter->data);
+        if (self->jobs > 1 && g_hash_table_lookup(self->cache, iter->data) == NULL) {
+            slots[i].pending = TRUE;
+            ++n_pending;
+        }
+    }
+    g_list_free(categories);
+
+    ctx.vdb_path = self->path;
+    ctx.index = self->index;
+    g_mutex_init(&ctx.lock);
+    g_cond_init(&ctx.cond);
+
+    if (n_pending > 0) {
+        /* Unloaded categories are read ahead in iteration order */
+        pool = g_thread_pool_new(foreach_load_job, &ctx, (gint)self->jobs, TRUE, error);
+        if (pool == NULL) {
+            goto OUT;
+        }
+        for (i = 0; i < n_slots; ++i) {
+            if (slots[i].pending) {
+                /* Pool owns its threads, so pushing can't fail */
+                (void)g_thread_pool_push(pool, &slots[i], NULL);
+            }
+        }
+    }
+
+    for (i = 0; i < n_slots; ++i) {
+        GHashTable *name2pkg;
+
+        if (slots[i].pending) {
+            g_mutex_lock(&ctx.lock);
+            while (!slots[i].done) {
+                g_cond_wait(&ctx.cond, &ctx.lock);
+            }
+            g_mutex_unlock(&ctx.lock);
+
+            if (!take_slot(self, &slots[i], generation, error)) {
+                goto OUT;
+            }
+        }
+
+        if (!get_category_cache(self, slots[i].category, &name2pkg, error)) {
+            goto OUT;
+        }
+
+        if (name2pkg != NULL && !foreach_category(name2pkg, func, user_data)) {
+            break;
+        }
+    }
+
+    result = TRUE;
+
+OUT:
+    if (pool != NULL) {
+        /* Drops categories that weren't started yet */
+        g_thread_pool_free(pool, TRUE, TRUE);
+    }
+
+    for (i = 0; i < n_slots; ++i) {
+        if (slots[i].pending && slots[i].done && slots[i].error == NULL) {
+            /* Already read, so keep it */
+            (void)take_slot(self, &slots[i], generation, NULL);
+        }
+        if (slots[i].error != NULL) {
+            g_error_free(slots[i].error);
+        }
+        category_cache_free(slots[i].cat);
+        g_free(slots[i].category);
+    }
+    g_free(slots);
+
+    g_cond_clear(&ctx.cond);
+    g_mutex_clear(&ctx.lock);
+
+    return result;
+}
+
+static gint
+str_ptr_cmp(const void *a, const void *b) /*@*/ {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/**
+ * \return index of first string in \a sorted that isn't less than \a prefix
+ */
+static guint
+lower_bound(const GPtrArray *sorted, const char *prefix) /*@*/ {
+    guint lo = 0;
+    guint hi = sorted->len;
+
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+
+        if (strcmp(g_ptr_array_index(sorted, mid), prefix) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static void
+ptr_array_unref(/*@only@*/ void *array) /*@modifies array@*/ {
+    g_ptr_array_unref(array);
+}
+
+static /*@only@*/ struct name_index *
+name_index_new(guint64 generation) /*@*/ {
+    struct name_index *result = g_new0(struct name_index, 1);
+
+    result->generation = generation;
+    g_assert(result->strings == NULL);
+    result->strings = g_string_chunk_new(4096);
+    g_assert(result->categories == NULL);
+    result->categories = g_ptr_array_new();
+    g_assert(result->names == NULL);
+    result->names = g_ptr_array_new();
+    g_assert(result->name2categories == NULL);
+    result->name2categories = g_hash_table_new_full(
+        g_str_hash, g_str_equal, NULL, ptr_array_unref
+    );
+    g_assert(result->category2names == NULL);
+    result->category2names = g_hash_table_new_full(
+        g_str_hash, g_str_equal, NULL, ptr_array_unref
+    );
+
+    return result;
+}
+
+/**
+ * Adds package names of \a category to \a index. Adding categories in
+ * order keeps name->categories arrays sorted.
+ */
+static void
+name_index_add_category(
+    struct name_index *index,
+    const char *category_name,
+    GHashTable *name2pkg
+) /*@modifies *index@*/ {
+    GList *names;
+    GList *name_iter;
+    GPtrArray *cat_names;
+    char *category;
+
+    category = g_string_chunk_insert_const(index->strings, category_name);
+    g_ptr_array_add(index->categories, category);
+    cat_names = g_ptr_array_new();
+    g_hash_table_insert(index->category2names, category, cat_names);
+
+    names = g_list_sort(g_hash_table_get_keys(name2pkg), (GCompareFunc)strcmp);
+    for (name_iter = names; name_iter != NULL; name_iter = name_iter->next) {
+        char *name = g_string_chunk_insert_const(index->strings, name_iter->data);
+        GPtrArray *name_cats = g_hash_table_lookup(index->name2categories, name);
+
+        if (name_cats == NULL) {
+            name_cats = g_ptr_array_new();
+            g_hash_table_insert(index->name2categories, name, name_cats);
+            g_ptr_array_add(index->names, name);
+        }
+        g_ptr_array_add(name_cats, category);
+        g_ptr_array_add(cat_names, name);
+    }
+    g_list_free(names);
+}
+
+/**
+ * Builds secondary indexes of package names over all categories.
+ * With vartree index enabled, this doesn't need to read package directories.
+ */
+static /*@null@*/ /*@only@*/ struct name_index *
+build_name_index(
+    CPVartree self,
+    /*@null@*/ GError **error
+) /*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/ {
+    struct name_index *result = name_index_new(self->generation);
+    GList *categories;
+    GList *cat_iter;
+
+    g_assert(error == NULL || *error == NULL);
+
+    categories = g_list_sort(
+        g_hash_table_get_keys(self->cache), (GCompareFunc)strcmp
+    );
+
+    for (cat_iter = categories; cat_iter != NULL; cat_iter = cat_iter->next) {
+        GHashTable *name2pkg;
+
+        if (!get_category_cache(self, cat_iter->data, &name2pkg, error)) {
+            g_list_free(categories);
+            name_index_free(result);
+            return NULL;
+        }
+        if (name2pkg != NULL) {
+            name_index_add_category(result, cat_iter->data, name2pkg);
+        }
+    }
+    g_list_free(categories);
+
+    g_ptr_array_sort(result->names, str_ptr_cmp);
+
+    return result;
+}
+
+/** Category and package name matched by a pattern. */
+struct name_match {
+    /*@dependent@*/ const char *category;
+    /*@dependent@*/ const char *name;
+};
+
+static gint
+name_match_cmp(const void *a, const void *b) /*@*/ {
+    const struct name_match *match_a = a;
+    const struct name_match *match_b = b;
+    int result = strcmp(match_a->category, match_b->category);
+
+    return result != 0 ? result : strcmp(match_a->name, match_b->name);
+}
+
+static void
+add_name_match(
+    GArray *matches,
+    const char *category,
+    const char *name
+) /*@modifies *matches@*/ {
+    struct name_match match;
+
+    match.category = category;
+    match.name = name;
+    (void)g_array_append_val(matches, match);
+}
+
+/**
+ * Adds names from \a sorted that match package part of \a pattern,
+ * using binary search to skip names without required prefix.
+ */
+static void
+match_names(
+    const CPPattern pattern,
+    const GPtrArray *sorted,
+    /*@null@*/ const char *category,
+    const struct name_index *index,
+    GArray *matches
+) /*@modifies *matches@*/ {
+    const char *prefix = cp_pattern_package_prefix(pattern);
+    guint i;
+
+    for (i = lower_bound(sorted, prefix); i < sorted->len; ++i) {
+        const char *name = g_ptr_array_index(sorted, i);
+        GPtrArray *categories;
+        guint j;
+
+        if (!g_str_has_prefix(name, prefix)) {
+            break;
+        }
+        if (!cp_pattern_package_matches(pattern, name)) {
+            continue;
+        }
+
+        if (category != NULL) {
+            add_name_match(matches, category, name);
+            continue;
+        }
+
+        categories = g_hash_table_lookup(index->name2categories, name);
+        for (j = 0; j < categories->len; ++j) {
+            const char *cat = g_ptr_array_index(categories, j);
+            if (cp_pattern_category_matches(pattern, cat)) {
+                add_name_match(matches, cat, name);
+            }
+        }
+    }
+}
+
+/**
+ * Finds (category, package name) pairs matching \a pattern using
+ * secondary indexes, so no category is scanned as a whole unless
+ * the pattern asks for it.
+ */
+static void
+match_pattern(
+    const CPPattern pattern,
+    const struct name_index *index,
+    GArray *matches
+) /*@modifies *matches@*/ {
+    const char *cat_prefix = cp_pattern_category_prefix(pattern);
+    GPtrArray *arr;
+    guint i;
+
+    if (cp_pattern_category_kind(pattern) == CP_PATTERN_EXACT) {
+        arr = g_hash_table_lookup(index->category2names, cat_prefix);
+        if (arr == NULL) {
+            return;
+        }
+        if (cp_pattern_package_kind(pattern) == CP_PATTERN_EXACT) {
+            add_name_match(matches, cat_prefix, cp_pattern_package_prefix(pattern));
+        } else {
+            match_names(pattern, arr, cat_prefix, index, matches);
+        }
+        return;
+    }
+
+    if (cp_pattern_package_kind(pattern) == CP_PATTERN_EXACT) {
+        const char *name = cp_pattern_package_prefix(pattern);
+
+        arr = g_hash_table_lookup(index->name2categories, name);
+        if (arr == NULL) {
+            return;
+        }
+        for (i = 0; i < arr->len; ++i) {
+            const char *cat = g_ptr_array_index(arr, i);
+            if (cp_pattern_category_matches(pattern, cat)) {
+                add_name_match(matches, cat, name);
+            }
+        }
+        return;
+    }
+
+    if (cat_prefix[0] == '\0'
+            && cp_pattern_package_prefix(pattern)[0] != '\0') {
+        /* Only package name narrows the search */
+        match_names(pattern, index->names, NULL, index, matches);
+        return;
+    }
+
+    for (i = lower_bound(index->categories, cat_prefix); i < index->categories->len; ++i) {
+        const char *cat = g_ptr_array_index(index->categories, i);
+
+        if (!g_str_has_prefix(cat, cat_prefix)) {
+            break;
+        }
+        if (cp_pattern_category_matches(pattern, cat)) {
+            match_names(
+                pattern, g_hash_table_lookup(index->category2names, cat),
+                cat, index, matches
+            );
+        }
+    }
+}
+
+static gboolean
+cp_vartree_find_pattern(
+    void *priv,
+    const CPPattern pattern,
+    /*@out@*/ GSList/*<CPPackage>*/ **match,
+    /*@null@*/ GError **error
+) /*@modifies *priv,*match,*error,errno@*/ /*@globals fileSystem@*/ {
+    CPVartree self = priv;
+    GArray *matches;
+    gboolean result = FALSE;
+    guint i;
 
     g_assert(error == NULL || *error == NULL);
 
-    if (!cp_atom_pv_split(pv, &name, &version, NULL)) {
-        goto OUT;
-    }
+    *match = NULL;
 
-    config_file = g_build_filename(self->path, category, pv, "EAPI", NULL);
-    result = cp_eapi_parse_file(config_file, error) != CP_EAPI_UNKNOWN;
-    g_free(config_file);
-    if (!result) {
-        goto OUT;
+    if (!cp_vartree_sync(self, error)) {
+        return FALSE;
     }
 
-    config_file = g_build_filename(self->path, category, pv, "SLOT", NULL);
-    result = g_file_get_contents(config_file, &slot, NULL, error);
-    g_free(config_file);
-    if (!result) {
-        goto OUT;
+    if (self->names != NULL && self->names->generation != self->generation) {
+        name_index_free(self->names);
+        self->names = NULL;
     }
-    slot = g_strstrip(slot);
-
-    result = cp_atom_slot_validate(slot, CP_EAPI_LATEST, error);
-    if (!result) {
-        goto OUT;
+    if (self->names == NULL) {
+        if (!list_all_categories(self, error)) {
+            return FALSE;
+        }
+        self->names = build_name_index(self, error);
+        if (self->names == NULL) {
+            return FALSE;
+        }
     }
 
-    config_file = g_build_filename(self->path, category, pv, "repository", NULL);
-    result = g_file_get_contents(config_file, &repo, NULL, error);
-    g_free(config_file);
-    if (!result) {
-        goto OUT;
-    }
-    repo = g_strstrip(repo);
+    matches = g_array_new(FALSE, FALSE, sizeof(struct name_match));
+    match_pattern(pattern, self->names, matches);
+    g_array_sort(matches, name_match_cmp);
 
-    result = cp_atom_repo_validate(repo, error);
-    if (!result) {
-        goto OUT;
+    for (i = 0; i < matches->len; ++i) {
+        const struct name_match *name = &g_array_index(matches, struct name_match, i);
+        GPtrArray *pkgs;
+        guint j;
+
+        if (!get_package_cache(self, name->category, name->name, &pkgs, error)) {
+            cp_package_list_free(*match);
+            *match = NULL;
+            goto OUT;
+        }
+        if (pkgs == NULL) {
+            continue;
+        }
+
+        /* Walking in ascending order gives descending list */
+        for (j = 0; j < pkgs->len; ++j) {
+            /*@-mustfreefresh@*/
+            *match = g_slist_prepend(*match, cp_package_ref(g_ptr_array_index(pkgs, j)));
+            /*@=mustfreefresh@*/
+        }
     }
 
-    *into = cp_package_new(category, name, version, slot, repo);
+    result = TRUE;
 
 OUT:
-    g_free(name);
-    cp_version_unref(version);
-    g_free(slot);
-    g_free(repo);
-
+    (void)g_array_free(matches, TRUE);
     return result;
 }
 
-static void
-insert_package(
-    GHashTable *name2pkg,
-    CPPackage package
-) /*@modifies *name2pkg@*/ {
-    const char *name = cp_package_name(package);
-    /*@only@*/ void *key = NULL;
-    GSList *list = NULL;
-
-    if (g_hash_table_lookup_extended(name2pkg, name, &key, (void **)&list)) {
-        gboolean stolen = g_hash_table_steal(name2pkg, name);
-        g_assert(stolen);
-    } else {
-        g_assert(key == NULL);
-        key = g_strdup(name);
-    }
-
-    /*@-refcounttrans@*/
-    list = g_slist_insert_sorted(list, package, (GCompareFunc)cp_package_cmp);
-    /*@=refcounttrans@*/
-    g_hash_table_insert(name2pkg, key, list);
-}
+/** Metadata value of a single package being read from vdb. */
+struct column_value {
+    /*@dependent@*/ const char *package;
+    /*@null@*/ /*@only@*/ char *value;
+};
 
+/**
+ * Reads \a key of all packages in \a values in one batch, using
+ * CPVartreeS.jobs threads when io_uring isn't available.
+ * Missing file means package doesn't have the key and leaves value %NULL.
+ */
 static gboolean G_GNUC_WARN_UNUSED_RESULT
-populate_cache(
+read_column_values(
     const CPVartree self,
-    const char *category,
+    const char *key,
+    GArray/*<struct column_value>*/ *values,
     /*@null@*/ GError **error
-) /*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/ {
-    GHashTable *name2pkg = NULL;
-    char *cat_path = NULL;
-    GDir *cat_dir = NULL;
+) /*@modifies *values,*error,errno@*/ /*@globals fileSystem@*/ {
+    CPIOBatchRequest *files = g_new0(CPIOBatchRequest, values->len);
+    char **paths = g_new0(char *, values->len + 1);
     gboolean result = TRUE;
+    guint i;
 
     g_assert(error == NULL || *error == NULL);
 
-    if (!cp_atom_category_validate(category, NULL)) {
-        goto OUT;
-    }
-
-    cat_path = g_build_filename(self->path, category, NULL);
-    if (!g_file_test(cat_path, G_FILE_TEST_IS_DIR)) {
-        goto OUT;
-    }
+    for (i = 0; i < values->len; ++i) {
+        const struct column_value *entry
+            = &g_array_index(values, struct column_value, i);
 
-    cat_dir = g_dir_open(cat_path, 0, error);
-    if (cat_dir == NULL) {
-        result = FALSE;
-        goto OUT;
+        paths[i] = g_build_filename(self->path, entry->package, key, NULL);
+        files[i].dir_fd = AT_FDCWD;
+        files[i].path = paths[i];
     }
 
-    name2pkg = g_hash_table_new_full(
-        g_str_hash, g_str_equal, g_free, (GDestroyNotify)cp_package_list_free
-    );
+    cp_io_batch_read(files, values->len, self->jobs);
 
-    CP_GDIR_ITER(cat_dir, pv) {
-        CPPackage package = NULL;
+    for (i = 0; i < values->len; ++i) {
+        struct column_value *entry = &g_array_index(values, struct column_value, i);
 
-        result = try_load_package(self, category, pv, &package, error);
-        if (!result) {
-            break;
+        if (files[i].error == 0) {
+            entry->value = files[i].contents;
+            files[i].contents = NULL;
+            (void)g_strstrip(entry->value);
+        } else if (files[i].error != ENOENT && result) {
+            g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(files[i].error),
+                _("Can't read '%s': %s"), paths[i], g_strerror(files[i].error));
+            result = FALSE;
         }
-        if (package != NULL) {
-            insert_package(name2pkg, package);
-        }
-    } end_CP_GDIR_ITER
+    }
 
-    g_dir_close(cat_dir);
+    cp_io_batch_clear(files, values->len);
+    g_free(files);
+    g_strfreev(paths);
 
-OUT:
-    if (result) {
-        g_hash_table_insert(self->cache, g_strdup(category), name2pkg);
-    } else {
-        cp_hash_table_destroy(name2pkg);
-    }
-    g_free(cat_path);
     return result;
 }
 
-static gboolean G_GNUC_WARN_UNUSED_RESULT
-init_cache(
+/**
+ * Builds column of \a key for all installed packages. Values of categories
+ * that didn't change since \a old was built are taken from it, the rest
+ * are read from vdb.
+ *
+ * \param changed return location for flag telling whether anything was read
+ * \param error   return location for a %GError, or %NULL
+ * \return        a #CPVartreeColumn or %NULL if an error occurred
+ */
+static /*@null@*/ /*@only@*/ CPVartreeColumn
+build_column(
     CPVartree self,
-    gboolean lazy_cache,
+    const char *key,
+    /*@null@*/ const CPVartreeColumn old,
+    /*@out@*/ gboolean *changed,
     /*@null@*/ GError **error
-) /*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/ {
-    GDir *vdb_dir = NULL;
-    gboolean result = FALSE;
+) /*@modifies *self,*changed,*error,errno@*/ /*@globals fileSystem@*/ {
+    CPVartreeColumnWriter writer;
+    GArray *values;
+    GList *categories;
+    GList *cat_iter;
+    guint i;
+    CPVartreeColumn result = NULL;
 
     g_assert(error == NULL || *error == NULL);
 
-    vdb_dir = g_dir_open(self->path, 0, error);
-    if (vdb_dir == NULL) {
-        goto ERR;
-    }
+    writer = cp_vartree_column_writer_new();
+    values = g_array_new(FALSE, FALSE, sizeof(struct column_value));
+    /* Loading lazy categories only replaces values, so keys stay valid */
+    categories = g_hash_table_get_keys(self->cache);
 
-    CP_GDIR_ITER(vdb_dir, category) {
-        if (lazy_cache) {
-            g_hash_table_insert(self->cache, g_strdup(category), NULL);
+    for (cat_iter = categories; cat_iter != NULL; cat_iter = cat_iter->next) {
+        const char *category = cat_iter->data;
+        const struct category_cache *cat;
+        GHashTable *name2pkg;
+        GHashTableIter pkg_iter;
+        void *pkgs;
+        gboolean reuse;
+
+        if (!get_category_cache(self, category, &name2pkg, error)) {
+            goto ERR;
+        }
+        if (name2pkg == NULL) {
             continue;
         }
 
-        if (!populate_cache(self, category, error)) {
-            goto ERR;
+        cat = g_hash_table_lookup(self->cache, category);
+        g_assert(cat != NULL);
+        reuse = old != NULL
+            && cp_vartree_column_category_valid(old, category, &cat->mtime);
+        cp_vartree_column_writer_add_category(writer, category, &cat->mtime);
+
+        g_hash_table_iter_init(&pkg_iter, name2pkg);
+        while (g_hash_table_iter_next(&pkg_iter, NULL, &pkgs)) {
+            GPtrArray *arr = pkgs;
+
+            for (i = 0; i < arr->len; ++i) {
+                const char *package = cp_package_str(g_ptr_array_index(arr, i));
+                const char *value;
+                struct column_value entry;
+
+                if (reuse && cp_vartree_column_lookup(old, package, &value)) {
+                    cp_vartree_column_writer_add_value(writer, package, value);
+                    continue;
+                }
+
+                entry.package = package;
+                entry.value = NULL;
+                (void)g_array_append_val(values, entry);
+            }
         }
-    } end_CP_GDIR_ITER
+    }
 
-    result = TRUE;
+    if (!read_column_values(self, key, values, error)) {
+        goto ERR;
+    }
+
+    for (i = 0; i < values->len; ++i) {
+        struct column_value *entry = &g_array_index(values, struct column_value, i);
+        cp_vartree_column_writer_add_value(writer, entry->package, entry->value);
+    }
+
+    *changed = values->len > 0;
+    result = cp_vartree_column_writer_finish(writer);
 
 ERR:
-    g_dir_close(vdb_dir);
+    cp_vartree_column_writer_destroy(writer);
+    for (i = 0; i < values->len; ++i) {
+        g_free(g_array_index(values, struct column_value, i).value);
+    }
+    (void)g_array_free(values, TRUE);
+    g_list_free(categories);
+
     return result;
 }
 
-static gboolean
-get_category_cache(
+/**
+ * \return up-to-date column of \a key, loading it if needed
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+get_column(
     CPVartree self,
-    const char *cat,
-    /*@out@*/ GHashTable **result,
+    const char *key,
+    /*@out@*/ CPVartreeColumn *result,
     /*@null@*/ GError **error
 ) /*@modifies *self,*result,*error,errno@*/ /*@globals fileSystem@*/ {
+    struct column_cache *cached;
+    CPVartreeColumn old = NULL;
+    CPVartreeColumn column;
+    char *column_path = NULL;
+    gboolean changed = FALSE;
+
     g_assert(error == NULL || *error == NULL);
 
     *result = NULL;
 
-    if (!g_hash_table_lookup_extended(self->cache, cat, NULL, (void **)result)) {
-        /* Nonexistent category */
-        return TRUE;
+    if (!list_all_categories(self, error)) {
+        return FALSE;
     }
 
-    if (*result != NULL) {
-        return TRUE;
+    cached = g_hash_table_lookup(self->columns, key);
+    if (cached != NULL) {
+        if (cached->generation == self->generation) {
+            /*@-dependenttrans@*/
+            *result = cached->column;
+            /*@=dependenttrans@*/
+            return TRUE;
+        }
+    } else if (self->index_path != NULL) {
+        column_path = g_strconcat(self->index_path, ".", key, NULL);
+        old = cp_vartree_column_open(column_path);
     }
 
-    /* Uninited lazy cache */
-    if (!populate_cache(self, cat, error)) {
+    column = build_column(
+        self, key, cached != NULL ? cached->column : old, &changed, error
+    );
+    if (column == NULL) {
+        cp_vartree_column_destroy(old);
+        g_free(column_path);
         return FALSE;
     }
 
-    /*@-dependenttrans@*/
-    *result = g_hash_table_lookup(self->cache, cat);
-    /*@=dependenttrans@*/
+    /* Column file only needs rewriting if something had to be read */
+    if (cached != NULL) {
+        changed = changed || cached->dirty;
+    } else {
+        changed = column_path != NULL && (changed || old == NULL);
+    }
+    cp_vartree_column_destroy(old);
+    g_free(column_path);
 
+    cached = g_new0(struct column_cache, 1);
+    cached->column = column;
+    cached->generation = self->generation;
+    cached->dirty = changed;
+    g_hash_table_insert(self->columns, g_strdup(key), cached);
+
+    *result = column;
     return TRUE;
 }
 
-static gboolean G_GNUC_WARN_UNUSED_RESULT
-get_package_cache(
+gboolean
+cp_vartree_get_metadata(
     CPVartree self,
-    const char *category,
-    const char *package,
-    /*@out@*/ GSList **result,
-    /*@null@*/ GError **error
-) /*@modifies *self,*result,*error,errno@*/ /*@globals fileSystem@*/ {
-    GHashTable *name2pkg;
+    const CPPackage package,
+    const char *key,
+    const char **value,
+    GError **error
+) {
+    CPVartreeColumn column;
 
     g_assert(error == NULL || *error == NULL);
+    /* Key is used as file name */
+    g_assert(key[0] != '\0' && key[0] != '.' && strchr(key, '/') == NULL);
 
-    *result = NULL;
+    *value = NULL;
 
-    if (!get_category_cache(self, category, &name2pkg, error)) {
+    if (!cp_vartree_sync(self, error)
+            || !get_column(self, key, &column, error)) {
         return FALSE;
     }
 
-    if (name2pkg != NULL) {
-        /*@-dependenttrans@*/
-        *result = g_hash_table_lookup(name2pkg, package);
-        /*@=dependenttrans@*/
+    if (!cp_vartree_column_lookup(column, cp_package_str(package), value)) {
+        *value = NULL;
+    }
+    return TRUE;
+}
+
+gboolean
+cp_vartree_save_index(CPVartree self, GError **error) {
+    GHashTableIter iter;
+    void *key;
+    void *value;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (self->index_path == NULL) {
+        return TRUE;
     }
 
+    if (self->index_dirty && !save_packages(self, error)) {
+        return FALSE;
+    }
+
+    g_hash_table_iter_init(&iter, self->columns);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        struct column_cache *cached = value;
+        char *column_path;
+        gboolean saved;
+
+        if (!cached->dirty) {
+            continue;
+        }
+
+        column_path = g_strconcat(self->index_path, ".", key, NULL);
+        saved = cp_vartree_column_save(cached->column, column_path, error);
+        g_free(column_path);
+        if (!saved) {
+            return FALSE;
+        }
+        cached->dirty = FALSE;
+    }
+
+    return TRUE;
+}
+
+static /*@only@*/ CPVartreeSnapshot
+snapshot_new(guint64 generation) /*@*/ {
+    CPVartreeSnapshot self = g_new0(struct CPVartreeSnapshotS, 1);
+
+    self->refs = 1;
+    g_assert(self->categories == NULL);
+    self->categories = g_hash_table_new_full(
+        g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_hash_table_unref
+    );
+    g_assert(self->index == NULL);
+    self->index = name_index_new(generation);
+    self->generation = generation;
+
+    return self;
+}
+
+CPVartreeSnapshot
+cp_vartree_snapshot_ref(CPVartreeSnapshot self) {
+    g_atomic_int_inc(&self->refs);
+    /*@-refcounttrans@*/
+    return self;
+    /*@=refcounttrans@*/
+}
+
+void
+cp_vartree_snapshot_unref(CPVartreeSnapshot self) {
+    /*@-mustfreeonly@*/
+    if (self == NULL) {
+        return;
+    }
+
+    g_assert(g_atomic_int_get(&self->refs) > 0);
+    if (!g_atomic_int_dec_and_test(&self->refs)) {
+        return;
+    }
+    /*@=mustfreeonly@*/
+
+    name_index_free(self->index);
+    g_hash_table_destroy(self->categories);
+
+    /*@-refcounttrans@*/
+    g_free(self);
+    /*@=refcounttrans@*/
+}
+
+guint64
+cp_vartree_snapshot_generation(const CPVartreeSnapshot self) {
+    return self->generation;
+}
+
+/**
+ * Waits until every reader that could have fetched snapshot pointer
+ * before it was replaced has taken its reference. Readers that come
+ * later see new snapshot, so old one can be released after that.
+ */
+static void
+wait_for_readers(CPVartree self) /*@modifies *self@*/ {
+    int phase;
+
+    /*
+     * Reader that fetched epoch before first flip can increase either
+     * counter, so both of them have to drain. New readers go to the other
+     * counter, so waiting for each of them is bounded.
+     */
+    for (phase = 0; phase < 2; ++phase) {
+        gint old = g_atomic_int_get(&self->epoch);
+
+        g_atomic_int_set(&self->epoch, old ^ 1);
+        while (g_atomic_int_get(&self->readers[old]) != 0) {
+            g_thread_yield();
+        }
+    }
+}
+
+gboolean
+cp_vartree_publish(CPVartree self, GError **error) {
+    CPVartreeSnapshot snapshot;
+    CPVartreeSnapshot old;
+    GList *categories;
+    GList *iter;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!cp_vartree_sync(self, error) || !list_all_categories(self, error)) {
+        return FALSE;
+    }
+
+    snapshot = snapshot_new(self->generation);
+    /* Loading lazy categories only replaces values, so keys stay valid */
+    categories = g_list_sort(
+        g_hash_table_get_keys(self->cache), (GCompareFunc)strcmp
+    );
+
+    for (iter = categories; iter != NULL; iter = iter->next) {
+        GHashTable *name2pkg;
+
+        if (!get_category_cache(self, iter->data, &name2pkg, error)) {
+            g_list_free(categories);
+            cp_vartree_snapshot_unref(snapshot);
+            return FALSE;
+        }
+        if (name2pkg == NULL) {
+            continue;
+        }
+
+        /* Tables are never modified once loaded, so they can be shared */
+        g_hash_table_insert(
+            snapshot->categories, g_strdup(iter->data), g_hash_table_ref(name2pkg)
+        );
+        name_index_add_category(snapshot->index, iter->data, name2pkg);
+    }
+    g_list_free(categories);
+    g_ptr_array_sort(snapshot->index->names, str_ptr_cmp);
+
+    old = self->snapshot;
+    g_atomic_pointer_set(&self->snapshot, snapshot);
+    wait_for_readers(self);
+    cp_vartree_snapshot_unref(old);
+
     return TRUE;
 }
 
+CPVartreeSnapshot
+cp_vartree_snapshot_acquire(CPVartree self) {
+    gint epoch = g_atomic_int_get(&self->epoch);
+    CPVartreeSnapshot result;
+
+    /* Publisher waits for this counter before releasing old snapshot */
+    g_atomic_int_inc(&self->readers[epoch]);
+    result = g_atomic_pointer_get(&self->snapshot);
+    result = cp_vartree_snapshot_ref(result);
+    (void)g_atomic_int_dec_and_test(&self->readers[epoch]);
+
+    return result;
+}
+
+static void
+snapshot_tree_destroy(/*@only@*/ void *priv) /*@modifies priv@*/ {
+    cp_vartree_snapshot_unref(priv);
+}
+
 static gboolean
-cp_vartree_find_packages(
+snapshot_find_packages(
     void *priv,
     const CPAtom atom,
     /*@out@*/ GSList/*<CPPackage>*/ **match,
     /*@null@*/ GError **error
-) /*@modifies *priv,*match,*error,errno@*/ /*@globals fileSystem@*/ {
-    CPVartree self = priv;
-
-    const char *category = cp_atom_category(atom);
-    const char *package = cp_atom_package(atom);
-    GSList *pkgs;
+) /*@modifies *match@*/ {
+    CPVartreeSnapshot self = priv;
+    GHashTable *name2pkg;
 
     g_assert(error == NULL || *error == NULL);
 
     *match = NULL;
 
-    if (!get_package_cache(self, category, package, &pkgs, error)) {
-        return FALSE;
+    name2pkg = g_hash_table_lookup(self->categories, cp_atom_category(atom));
+    if (name2pkg != NULL) {
+        match_packages(
+            g_hash_table_lookup(name2pkg, cp_atom_package(atom)), atom, match
+        );
     }
 
-    CP_GSLIST_ITER(pkgs, pkg) {
-        if (cp_atom_matches(atom, pkg)) {
+    return TRUE;
+}
+
+static gboolean
+snapshot_foreach_package(
+    void *priv,
+    CPTreeForeachFunc func,
+    void *user_data,
+    /*@null@*/ GError **error
+) /*@modifies *user_data@*/ {
+    CPVartreeSnapshot self = priv;
+    gboolean proceed = TRUE;
+    guint i;
+
+    g_assert(error == NULL || *error == NULL);
+
+    for (i = 0; i < self->index->categories->len && proceed; ++i) {
+        proceed = foreach_category(
+            g_hash_table_lookup(
+                self->categories, g_ptr_array_index(self->index->categories, i)
+            ),
+            func,
+            user_data
+        );
+    }
+
+    return TRUE;
+}
+
+static gboolean
+snapshot_find_pattern(
+    void *priv,
+    const CPPattern pattern,
+    /*@out@*/ GSList/*<CPPackage>*/ **match,
+    /*@null@*/ GError **error
+) /*@modifies *match@*/ {
+    CPVartreeSnapshot self = priv;
+    GArray *matches;
+    guint i;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *match = NULL;
+
+    matches = g_array_new(FALSE, FALSE, sizeof(struct name_match));
+    match_pattern(pattern, self->index, matches);
+    g_array_sort(matches, name_match_cmp);
+
+    for (i = 0; i < matches->len; ++i) {
+        const struct name_match *name = &g_array_index(matches, struct name_match, i);
+        GHashTable *name2pkg = g_hash_table_lookup(self->categories, name->category);
+        GPtrArray *pkgs;
+        guint j;
+
+        pkgs = name2pkg != NULL ? g_hash_table_lookup(name2pkg, name->name) : NULL;
+        if (pkgs == NULL) {
+            continue;
+        }
+
+        /* Walking in ascending order gives descending list */
+        for (j = 0; j < pkgs->len; ++j) {
             /*@-mustfreefresh@*/
-            *match = g_slist_prepend(*match, cp_package_ref(pkg));
+            *match = g_slist_prepend(*match, cp_package_ref(g_ptr_array_index(pkgs, j)));
             /*@=mustfreefresh@*/
         }
-    } end_CP_GSLIST_ITER
+    }
 
+    (void)g_array_free(matches, TRUE);
     return TRUE;
 }
 
+/*@unchecked@*/ static const struct CPTreeOps snapshot_ops = {
+    snapshot_tree_destroy,
+    snapshot_find_packages,
+    snapshot_foreach_package,
+    snapshot_find_pattern
+};
+
+CPTree
+cp_vartree_snapshot_get_tree(CPVartreeSnapshot self) {
+    return cp_tree_new(&snapshot_ops, cp_vartree_snapshot_ref(self));
+}
+
 static void
 cp_vartree_destroy(/*@only@*/ void *priv) /*@modifies priv@*/ {
     CPVartree self = priv;
 
     g_free(self->path);
     cp_hash_table_destroy(self->cache);
+    g_free(self->index_path);
+    cp_vartree_index_destroy(self->index);
+    if (self->watch_fd >= 0) {
+        (void)close(self->watch_fd);
+    }
+    cp_hash_table_destroy(self->wd2category);
+    cp_hash_table_destroy(self->columns);
+    name_index_free(self->names);
+    cp_vartree_snapshot_unref(self->snapshot);
 
     /*@-refcounttrans@*/
     g_free(priv);
@@ -317,17 +2616,28 @@ cp_vartree_destroy(/*@only@*/ void *priv) /*@modifies priv@*/ {
 
 /*@unchecked@*/ static const struct CPTreeOps vartree_ops = {
     cp_vartree_destroy,
-    cp_vartree_find_packages
+    cp_vartree_find_packages,
+    cp_vartree_foreach_package,
+    cp_vartree_find_pattern
 };
 
 CPVartree
 cp_vartree_new(const CPSettings settings, GError **error) {
     CPVartree self;
     gboolean lazy_cache;
+    gboolean on_demand;
+    guint jobs;
 
     g_assert(error == NULL || *error == NULL);
 
+    if (!cp_settings_get_uint(settings, "CPORTAGE_VARTREE_JOBS", 1, &jobs, error)) {
+        return NULL;
+    }
+
     self = g_new0(struct CPVartreeS, 1);
+    self->watch_fd = -1;
+    g_assert(self->snapshot == NULL);
+    self->snapshot = snapshot_new(0);
     g_assert(self->tree == NULL);
     self->tree = cp_tree_new(&vartree_ops, self);
 
@@ -338,12 +2648,40 @@ cp_vartree_new(const CPSettings settings, GError **error) {
     lazy_cache = cp_string_truth(
         cp_settings_get_default(settings, "CPORTAGE_VARTREE_LAZY", "true")
     ) == CP_TRUE;
+    on_demand = cp_string_truth(
+        cp_settings_get_default(settings, "CPORTAGE_VARTREE_ONDEMAND", "false")
+    ) == CP_TRUE;
+
+    self->jobs = jobs > 1 ? jobs : 1;
 
     g_assert(self->cache == NULL);
     self->cache = g_hash_table_new_full(
-        g_str_hash, g_str_equal, g_free, (GDestroyNotify)cp_hash_table_destroy
+        g_str_hash, g_str_equal, g_free, category_cache_free
     );
-    if (!init_cache(self, lazy_cache, error)) {
+
+    if (cp_string_truth(
+            cp_settings_get_default(settings, "CPORTAGE_VARTREE_INDEX", "false")
+        ) == CP_TRUE) {
+        g_assert(self->index_path == NULL);
+        self->index_path = g_strconcat(self->path, ".cportage-index", NULL);
+        g_assert(self->index == NULL);
+        self->index = cp_vartree_index_open(self->index_path);
+    }
+
+    if (cp_string_truth(
+            cp_settings_get_default(settings, "CPORTAGE_VARTREE_WATCH", "false")
+        ) == CP_TRUE && !init_watch(self, error)) {
+        goto ERR;
+    }
+
+    g_assert(self->columns == NULL);
+    self->columns = g_hash_table_new_full(
+        g_str_hash, g_str_equal, g_free, column_cache_free
+    );
+
+    /* Watch mode needs every category to be known upfront */
+    if ((!on_demand || self->watch_fd >= 0)
+            && !init_cache(self, lazy_cache || on_demand, self->jobs, error)) {
        goto ERR;
     }
 
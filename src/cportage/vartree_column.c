@@ -0,0 +1,447 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Column file layout (all integers are in host byte order):
+
+  struct column_header;
+  struct column_category[header.n_categories], sorted by name;
+  struct column_package[header.n_packages], sorted by package string;
+  char strings[header.strings_size], NUL-terminated strings.
+
+  All string fields are offsets into strings table, equal values share
+  a single copy. Built columns use the same layout in memory, so lookups
+  don't care where the column came from.
+ */
+
+#include <string.h>
+
+#include "vartree_column.h"
+
+#define COLUMN_MAGIC "CPVDBCOL"
+#define COLUMN_VERSION 1
+#define COLUMN_BYTE_ORDER 0x01020304
+
+/** Package doesn't have the key */
+#define NO_VALUE G_MAXUINT32
+
+struct column_header {
+    char magic[8];
+    guint32 version;
+    guint32 byte_order;
+    guint32 n_categories;
+    guint32 n_packages;
+    guint32 strings_size;
+    guint32 reserved;
+};
+
+struct column_category {
+    guint32 name;
+    guint32 reserved;
+    guint64 mtime_sec;
+    guint64 mtime_nsec;
+};
+
+struct column_package {
+    guint32 package;
+    guint32 value;
+};
+
+struct CPVartreeColumnS {
+    /*@only@*/ /*@null@*/ GMappedFile *file;
+    /*@only@*/ /*@null@*/ char *buffer;
+    gsize length;
+
+    /*@dependent@*/ const struct column_header *header;
+    /*@dependent@*/ const struct column_category *categories;
+    /*@dependent@*/ const struct column_package *packages;
+    /*@dependent@*/ const char *strings;
+};
+
+static /*@null@*/ /*@observer@*/ const char *
+get_string(const CPVartreeColumn self, guint32 offset) /*@*/ {
+    if (offset >= self->header->strings_size) {
+        return NULL;
+    }
+    return &self->strings[offset];
+}
+
+static gboolean
+check_sorted(const CPVartreeColumn self) /*@*/ {
+    const char *prev = NULL;
+    guint32 i;
+
+    for (i = 0; i < self->header->n_categories; ++i) {
+        const char *name = get_string(self, self->categories[i].name);
+
+        if (name == NULL || (prev != NULL && strcmp(prev, name) >= 0)) {
+            return FALSE;
+        }
+        prev = name;
+    }
+
+    prev = NULL;
+    for (i = 0; i < self->header->n_packages; ++i) {
+        const struct column_package *pkg = &self->packages[i];
+        const char *name = get_string(self, pkg->package);
+
+        if (name == NULL || (prev != NULL && strcmp(prev, name) >= 0)) {
+            return FALSE;
+        }
+        if (pkg->value != NO_VALUE && get_string(self, pkg->value) == NULL) {
+            return FALSE;
+        }
+        prev = name;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Sets up section pointers of \a self over \a data.
+ */
+static gboolean
+column_init(
+    CPVartreeColumn self,
+    const char *data,
+    gsize length
+) /*@modifies *self@*/ {
+    guint64 expected;
+
+    if (data == NULL || length < sizeof(*self->header)) {
+        return FALSE;
+    }
+
+    self->length = length;
+
+    /*@-dependenttrans@*/
+    self->header = (const void *)data;
+    /*@=dependenttrans@*/
+    if (memcmp(self->header->magic, COLUMN_MAGIC, sizeof(self->header->magic)) != 0
+            || self->header->version != COLUMN_VERSION
+            || self->header->byte_order != COLUMN_BYTE_ORDER) {
+        return FALSE;
+    }
+
+    expected = sizeof(*self->header)
+        + (guint64)self->header->n_categories * sizeof(*self->categories)
+        + (guint64)self->header->n_packages * sizeof(*self->packages)
+        + self->header->strings_size;
+    if (expected != length || self->header->strings_size == 0) {
+        return FALSE;
+    }
+
+    /*@-dependenttrans@*/
+    self->categories = (const void *)&data[sizeof(*self->header)];
+    self->packages = (const void *)&self->categories[self->header->n_categories];
+    self->strings = (const char *)&self->packages[self->header->n_packages];
+    /*@=dependenttrans@*/
+
+    return self->strings[self->header->strings_size - 1] == '\0';
+}
+
+CPVartreeColumn
+cp_vartree_column_open(const char *path) {
+    CPVartreeColumn self;
+    GError *error = NULL;
+    GMappedFile *file;
+
+    file = g_mapped_file_new(path, FALSE, &error);
+    if (file == NULL) {
+        g_debug("Can't load vartree column: %s", error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    self = g_new0(struct CPVartreeColumnS, 1);
+    self->file = file;
+
+    if (!column_init(self, g_mapped_file_get_contents(file),
+            g_mapped_file_get_length(file))
+            || !check_sorted(self)) {
+        g_debug("Vartree column '%s' is corrupt, ignoring it", path);
+        cp_vartree_column_destroy(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+void
+cp_vartree_column_destroy(CPVartreeColumn self) {
+    if (self == NULL) {
+        /*@-mustfreeonly@*/
+        return;
+        /*@=mustfreeonly@*/
+    }
+
+    if (self->file != NULL) {
+        g_mapped_file_unref(self->file);
+    }
+    g_free(self->buffer);
+
+    /*@-refcounttrans@*/
+    g_free(self);
+    /*@=refcounttrans@*/
+}
+
+gboolean
+cp_vartree_column_category_valid(
+    const CPVartreeColumn self,
+    const char *category,
+    const CPTimestamp *mtime
+) {
+    guint32 lo = 0;
+    guint32 hi = self->header->n_categories;
+
+    while (lo < hi) {
+        guint32 mid = lo + (hi - lo) / 2;
+        const struct column_category *cat = &self->categories[mid];
+        /* Checked in cp_vartree_column_open */
+        int cmp = strcmp(&self->strings[cat->name], category);
+
+        if (cmp == 0) {
+            return cat->mtime_sec == mtime->sec
+                && cat->mtime_nsec == mtime->nsec;
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return FALSE;
+}
+
+gboolean
+cp_vartree_column_lookup(
+    const CPVartreeColumn self,
+    const char *package,
+    const char **value
+) {
+    guint32 lo = 0;
+    guint32 hi = self->header->n_packages;
+
+    while (lo < hi) {
+        guint32 mid = lo + (hi - lo) / 2;
+        const struct column_package *pkg = &self->packages[mid];
+        int cmp = strcmp(&self->strings[pkg->package], package);
+
+        if (cmp == 0) {
+            *value = pkg->value == NO_VALUE ? NULL : &self->strings[pkg->value];
+            return TRUE;
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return FALSE;
+}
+
+gboolean
+cp_vartree_column_save(
+    const CPVartreeColumn self,
+    const char *path,
+    GError **error
+) {
+    g_assert(error == NULL || *error == NULL);
+
+    /*@-type@*/
+    return g_file_set_contents(
+        path, (const char *)self->header, (gssize)self->length, error
+    );
+    /*@=type@*/
+}
+
+struct writer_package {
+    /*@only@*/ char *package;
+    guint32 value;
+};
+
+struct CPVartreeColumnWriterS {
+    /*@only@*/ GArray/*<struct column_category>*/ *categories;
+    /*@only@*/ GArray/*<struct writer_package>*/ *packages;
+
+    /*@only@*/ GString *strings;
+    /** String->(offset + 1) map, used to deduplicate strings */
+    /*@only@*/ GHashTable *offsets;
+};
+
+CPVartreeColumnWriter
+cp_vartree_column_writer_new(void) {
+    CPVartreeColumnWriter self = g_new0(struct CPVartreeColumnWriterS, 1);
+
+    g_assert(self->categories == NULL);
+    self->categories = g_array_new(FALSE, FALSE, sizeof(struct column_category));
+
+    g_assert(self->packages == NULL);
+    self->packages = g_array_new(FALSE, FALSE, sizeof(struct writer_package));
+
+    g_assert(self->strings == NULL);
+    self->strings = g_string_new("");
+
+    g_assert(self->offsets == NULL);
+    self->offsets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    return self;
+}
+
+void
+cp_vartree_column_writer_destroy(CPVartreeColumnWriter self) {
+    guint i;
+
+    if (self == NULL) {
+        /*@-mustfreeonly@*/
+        return;
+        /*@=mustfreeonly@*/
+    }
+
+    for (i = 0; i < self->packages->len; ++i) {
+        g_free(g_array_index(self->packages, struct writer_package, i).package);
+    }
+    (void)g_array_free(self->categories, TRUE);
+    (void)g_array_free(self->packages, TRUE);
+    (void)g_string_free(self->strings, TRUE);
+    cp_hash_table_destroy(self->offsets);
+
+    /*@-refcounttrans@*/
+    g_free(self);
+    /*@=refcounttrans@*/
+}
+
+static guint32
+intern_string(CPVartreeColumnWriter self, const char *str) /*@modifies *self@*/ {
+    gsize offset = GPOINTER_TO_UINT(g_hash_table_lookup(self->offsets, str));
+
+    if (offset == 0) {
+        offset = self->strings->len;
+        (void)g_string_append_len(self->strings, str, (gssize)strlen(str) + 1);
+        g_hash_table_insert(
+            self->offsets, g_strdup(str), GUINT_TO_POINTER(offset + 1)
+        );
+    } else {
+        --offset;
+    }
+
+    return (guint32)offset;
+}
+
+void
+cp_vartree_column_writer_add_category(
+    CPVartreeColumnWriter self,
+    const char *category,
+    const CPTimestamp *mtime
+) {
+    struct column_category record;
+
+    record.name = intern_string(self, category);
+    record.reserved = 0;
+    record.mtime_sec = mtime->sec;
+    record.mtime_nsec = mtime->nsec;
+
+    (void)g_array_append_val(self->categories, record);
+}
+
+void
+cp_vartree_column_writer_add_value(
+    CPVartreeColumnWriter self,
+    const char *package,
+    const char *value
+) {
+    struct writer_package record;
+
+    record.package = g_strdup(package);
+    record.value = value == NULL ? NO_VALUE : intern_string(self, value);
+
+    (void)g_array_append_val(self->packages, record);
+}
+
+static int
+category_cmp(const void *a, const void *b, void *user_data) /*@*/ {
+    const struct column_category *cat_a = a;
+    const struct column_category *cat_b = b;
+    const GString *strings = user_data;
+
+    return strcmp(&strings->str[cat_a->name], &strings->str[cat_b->name]);
+}
+
+static int
+package_cmp(const void *a, const void *b) /*@*/ {
+    const struct writer_package *pkg_a = a;
+    const struct writer_package *pkg_b = b;
+
+    return strcmp(pkg_a->package, pkg_b->package);
+}
+
+CPVartreeColumn
+cp_vartree_column_writer_finish(CPVartreeColumnWriter self) {
+    CPVartreeColumn result;
+    struct column_header header;
+    GString *contents;
+    guint i;
+
+    g_array_sort_with_data(self->categories, category_cmp, self->strings);
+    g_array_sort(self->packages, package_cmp);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COLUMN_MAGIC, sizeof(header.magic));
+    header.version = COLUMN_VERSION;
+    header.byte_order = COLUMN_BYTE_ORDER;
+    header.n_categories = self->categories->len;
+    header.n_packages = self->packages->len;
+
+    contents = g_string_new_len((const char *)&header, (gssize)sizeof(header));
+    (void)g_string_append_len(
+        contents,
+        self->categories->data,
+        (gssize)(self->categories->len * sizeof(struct column_category))
+    );
+    for (i = 0; i < self->packages->len; ++i) {
+        struct writer_package *pkg
+            = &g_array_index(self->packages, struct writer_package, i);
+        struct column_package record;
+
+        record.package = intern_string(self, pkg->package);
+        record.value = pkg->value;
+        (void)g_string_append_len(
+            contents, (const char *)&record, (gssize)sizeof(record)
+        );
+    }
+
+    /* Column with empty strings table is invalid */
+    if (self->strings->len == 0) {
+        (void)g_string_append_c(self->strings, '\0');
+    }
+    (void)g_string_append_len(
+        contents, self->strings->str, (gssize)self->strings->len
+    );
+    ((struct column_header *)contents->str)->strings_size
+        = (guint32)self->strings->len;
+
+    result = g_new0(struct CPVartreeColumnS, 1);
+    result->length = contents->len;
+    result->buffer = g_string_free(contents, FALSE);
+    if (!column_init(result, result->buffer, result->length)) {
+        g_assert_not_reached();
+    }
+
+    return result;
+}
@@ -0,0 +1,137 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** Packed values of a single vdb metadata key for all installed packages. */
+
+#ifndef CP_VARTREE_COLUMN_H
+#define CP_VARTREE_COLUMN_H
+
+#include <cportage.h>
+
+#include "io.h"
+
+/*@-exportany@*/
+
+/**
+ * Read-only column of metadata values, either memory-mapped from disk
+ * or built in memory.
+ */
+typedef struct CPVartreeColumnS *CPVartreeColumn;
+
+/**
+ * Maps column file at \a path into memory.
+ *
+ * \return a #CPVartreeColumn or %NULL if \a path doesn't exist or isn't
+ *         a valid column file, free it using cp_vartree_column_destroy()
+ */
+/*@null@*/ /*@only@*/ CPVartreeColumn
+cp_vartree_column_open(
+    const char *path
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT
+/*@modifies errno@*/ /*@globals fileSystem@*/;
+
+void
+cp_vartree_column_destroy(
+    /*@null@*/ /*@only@*/ CPVartreeColumn self
+) /*@modifies self@*/;
+
+/**
+ * \return %TRUE if \a self has up-to-date values for packages of
+ *         \a category directory modified at \a mtime
+ */
+gboolean
+cp_vartree_column_category_valid(
+    const CPVartreeColumn self,
+    const char *category,
+    const CPTimestamp *mtime
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \param package "category/name-version" string
+ * \param value   return location for readonly value, set to %NULL
+ *                if package doesn't have the key
+ * \return        %TRUE if \a self contains \a package, %FALSE otherwise
+ */
+gboolean
+cp_vartree_column_lookup(
+    const CPVartreeColumn self,
+    const char *package,
+    /*@out@*/ /*@null@*/ const char **value
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *value@*/;
+
+/**
+ * Writes \a self to \a path atomically.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_vartree_column_save(
+    const CPVartreeColumn self,
+    const char *path,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *error,errno,fileSystem@*/ /*@globals fileSystem@*/;
+
+/**
+ * Builder of a new column.
+ */
+typedef struct CPVartreeColumnWriterS *CPVartreeColumnWriter;
+
+/*@only@*/ CPVartreeColumnWriter
+cp_vartree_column_writer_new(void) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+void
+cp_vartree_column_writer_destroy(
+    /*@null@*/ /*@only@*/ CPVartreeColumnWriter self
+) /*@modifies self@*/;
+
+/**
+ * Remembers that values of \a category packages were read when its directory
+ * was modified at \a mtime.
+ */
+void
+cp_vartree_column_writer_add_category(
+    CPVartreeColumnWriter self,
+    const char *category,
+    const CPTimestamp *mtime
+) /*@modifies *self@*/;
+
+/**
+ * Adds \a value of \a package, %NULL \a value means package doesn't have
+ * the key. Packages can be added in any order.
+ */
+void
+cp_vartree_column_writer_add_value(
+    CPVartreeColumnWriter self,
+    const char *package,
+    /*@null@*/ const char *value
+) /*@modifies *self@*/;
+
+/**
+ * Builds column from data added to \a self.
+ *
+ * \return a #CPVartreeColumn, free it using cp_vartree_column_destroy()
+ */
+/*@only@*/ CPVartreeColumn
+cp_vartree_column_writer_finish(
+    CPVartreeColumnWriter self
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *self@*/;
+
+#endif
@@ -0,0 +1,572 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Index file layout (all integers are in host byte order):
+
+  struct index_header;
+  struct index_category[header.n_categories], sorted by name;
+  struct index_package[header.n_packages], grouped by category;
+  char strings[header.strings_size], NUL-terminated strings.
+
+  All string fields are offsets into strings table. Records are naturally
+  aligned, so the whole file can be used right from mmap()ed memory.
+ */
+
+#include <string.h>
+
+#include "atom.h"
+#include "package.h"
+#include "vartree_index.h"
+
+#define INDEX_MAGIC "CPVDBIDX"
+#define INDEX_VERSION 1
+#define INDEX_BYTE_ORDER 0x01020304
+
+/** Category wasn't read when index was written */
+#define CATEGORY_FLAG_STALE 1
+
+struct index_header {
+    char magic[8];
+    guint32 version;
+    guint32 byte_order;
+    guint32 n_categories;
+    guint32 n_packages;
+    guint32 strings_size;
+    guint32 reserved;
+    guint64 root_mtime_sec;
+    guint64 root_mtime_nsec;
+};
+
+struct index_category {
+    guint32 name;
+    guint32 first_package;
+    guint32 n_packages;
+    guint32 flags;
+    guint64 mtime_sec;
+    guint64 mtime_nsec;
+};
+
+struct index_package {
+    guint32 pv;
+    guint32 slot;
+    guint32 subslot;
+    guint32 repo;
+    guint32 eapi;
+};
+
+struct CPVartreeIndexS {
+    /*@only@*/ GMappedFile *file;
+
+    /*@dependent@*/ const struct index_header *header;
+    /*@dependent@*/ const struct index_category *categories;
+    /*@dependent@*/ const struct index_package *packages;
+    /*@dependent@*/ const char *strings;
+};
+
+static /*@null@*/ /*@observer@*/ const char *
+get_string(const CPVartreeIndex self, guint32 offset) /*@*/ {
+    if (offset >= self->header->strings_size) {
+        return NULL;
+    }
+    return &self->strings[offset];
+}
+
+static gboolean
+check_categories(const CPVartreeIndex self) /*@*/ {
+    const char *prev = NULL;
+    guint32 i;
+
+    for (i = 0; i < self->header->n_categories; ++i) {
+        const struct index_category *cat = &self->categories[i];
+        const char *name = get_string(self, cat->name);
+
+        if (name == NULL) {
+            return FALSE;
+        }
+        if ((guint64)cat->first_package + cat->n_packages
+                > self->header->n_packages) {
+            return FALSE;
+        }
+        /* Binary search relies on this */
+        if (prev != NULL && strcmp(prev, name) >= 0) {
+            return FALSE;
+        }
+        prev = name;
+    }
+
+    return TRUE;
+}
+
+CPVartreeIndex
+cp_vartree_index_open(const char *path) {
+    CPVartreeIndex self;
+    GError *error = NULL;
+    GMappedFile *file;
+    const char *data;
+    gsize length;
+    guint64 expected;
+
+    file = g_mapped_file_new(path, FALSE, &error);
+    if (file == NULL) {
+        g_debug("Can't load vartree index: %s", error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    data = g_mapped_file_get_contents(file);
+    length = g_mapped_file_get_length(file);
+
+    self = g_new0(struct CPVartreeIndexS, 1);
+    self->file = file;
+
+    if (data == NULL || length < sizeof(*self->header)) {
+        goto ERR;
+    }
+
+    /*@-dependenttrans@*/
+    self->header = (const void *)data;
+    /*@=dependenttrans@*/
+    if (memcmp(self->header->magic, INDEX_MAGIC, sizeof(self->header->magic)) != 0
+            || self->header->version != INDEX_VERSION
+            || self->header->byte_order != INDEX_BYTE_ORDER) {
+        goto ERR;
+    }
+
+    expected = sizeof(*self->header)
+        + (guint64)self->header->n_categories * sizeof(*self->categories)
+        + (guint64)self->header->n_packages * sizeof(*self->packages)
+        + self->header->strings_size;
+    if (expected != length || self->header->strings_size == 0) {
+        goto ERR;
+    }
+
+    /*@-dependenttrans@*/
+    self->categories = (const void *)&data[sizeof(*self->header)];
+    self->packages = (const void *)&self->categories[self->header->n_categories];
+    self->strings = (const char *)&self->packages[self->header->n_packages];
+    /*@=dependenttrans@*/
+
+    if (self->strings[self->header->strings_size - 1] != '\0'
+            || !check_categories(self)) {
+        goto ERR;
+    }
+
+    return self;
+
+ERR:
+    g_debug("Vartree index '%s' is corrupt, ignoring it", path);
+    cp_vartree_index_destroy(self);
+    return NULL;
+}
+
+void
+cp_vartree_index_destroy(CPVartreeIndex self) {
+    if (self == NULL) {
+        /*@-mustfreeonly@*/
+        return;
+        /*@=mustfreeonly@*/
+    }
+
+    g_mapped_file_unref(self->file);
+
+    /*@-refcounttrans@*/
+    g_free(self);
+    /*@=refcounttrans@*/
+}
+
+static gboolean
+timestamp_equal(guint64 sec, guint64 nsec, const CPTimestamp *mtime) /*@*/ {
+    return sec == mtime->sec && nsec == mtime->nsec;
+}
+
+gboolean
+cp_vartree_index_root_valid(const CPVartreeIndex self, const CPTimestamp *mtime) {
+    return timestamp_equal(
+        self->header->root_mtime_sec, self->header->root_mtime_nsec, mtime
+    );
+}
+
+guint
+cp_vartree_index_n_categories(const CPVartreeIndex self) {
+    return self->header->n_categories;
+}
+
+const char *
+cp_vartree_index_category(const CPVartreeIndex self, guint i) {
+    const char *result;
+
+    g_assert(i < self->header->n_categories);
+
+    result = get_string(self, self->categories[i].name);
+    /* Checked in cp_vartree_index_open */
+    g_assert(result != NULL);
+
+    return result;
+}
+
+static /*@null@*/ /*@dependent@*/ const struct index_category *
+find_category(const CPVartreeIndex self, const char *category) /*@*/ {
+    guint32 lo = 0;
+    guint32 hi = self->header->n_categories;
+
+    while (lo < hi) {
+        guint32 mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(cp_vartree_index_category(self, mid), category);
+
+        if (cmp == 0) {
+            return &self->categories[mid];
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return NULL;
+}
+
+static /*@null@*/ CPPackage
+load_package(
+    const CPVartreeIndex self,
+    const char *category,
+    const struct index_package *record
+) /*@*/ {
+    const char *pv = get_string(self, record->pv);
+    const char *slot = get_string(self, record->slot);
+    const char *subslot = get_string(self, record->subslot);
+    const char *repo = get_string(self, record->repo);
+    char *name;
+    CPVersion version;
+    char *full_slot;
+    CPPackage result;
+
+    if (pv == NULL || slot == NULL || subslot == NULL || repo == NULL
+            || record->eapi > (guint32)CP_EAPI_LATEST) {
+        return NULL;
+    }
+
+    if (!cp_atom_pv_split(pv, &name, &version, NULL)) {
+        return NULL;
+    }
+
+    full_slot = strcmp(slot, subslot) == 0
+        ? g_strdup(slot)
+        : g_strconcat(slot, "/", subslot, NULL);
+
+    result = cp_package_new(
+        category, name, version, full_slot, repo, (CPEapi)record->eapi
+    );
+
+    g_free(full_slot);
+    g_free(name);
+    cp_version_unref(version);
+
+    return result;
+}
+
+gboolean
+cp_vartree_index_get_category(
+    const CPVartreeIndex self,
+    const char *category,
+    const CPTimestamp *mtime,
+    GSList **into
+) {
+    const struct index_category *cat = find_category(self, category);
+    GSList *result = NULL;
+    guint32 i;
+
+    if (cat == NULL
+            || (cat->flags & CATEGORY_FLAG_STALE) != 0
+            || !timestamp_equal(cat->mtime_sec, cat->mtime_nsec, mtime)) {
+        return FALSE;
+    }
+
+    for (i = 0; i < cat->n_packages; ++i) {
+        CPPackage package = load_package(
+            self, category, &self->packages[cat->first_package + i]
+        );
+        if (package == NULL) {
+            g_debug("Vartree index has corrupt data for '%s'", category);
+            cp_package_list_free(result);
+            return FALSE;
+        }
+        result = g_slist_prepend(result, package);
+    }
+
+    *into = result;
+    return TRUE;
+}
+
+struct writer_category {
+    CPTimestamp mtime;
+    guint32 flags;
+    /*@only@*/ GArray/*<struct index_package>*/ *packages;
+};
+
+struct CPVartreeIndexWriterS {
+    CPTimestamp root_mtime;
+
+    /*@only@*/ GTree/*<char *, struct writer_category *>*/ *categories;
+
+    /*@only@*/ GString *strings;
+    /** String->(offset + 1) map, used to deduplicate strings */
+    /*@only@*/ GHashTable *offsets;
+};
+
+static void
+writer_category_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct writer_category *cat = data;
+
+    (void)g_array_free(cat->packages, TRUE);
+    g_free(cat);
+}
+
+CPVartreeIndexWriter
+cp_vartree_index_writer_new(const CPTimestamp *root_mtime) {
+    CPVartreeIndexWriter self = g_new0(struct CPVartreeIndexWriterS, 1);
+
+    self->root_mtime = *root_mtime;
+
+    g_assert(self->categories == NULL);
+    self->categories = g_tree_new_full(
+        (GCompareDataFunc)strcmp, NULL, g_free, writer_category_free
+    );
+
+    g_assert(self->strings == NULL);
+    self->strings = g_string_new("");
+
+    g_assert(self->offsets == NULL);
+    self->offsets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    return self;
+}
+
+void
+cp_vartree_index_writer_destroy(CPVartreeIndexWriter self) {
+    if (self == NULL) {
+        /*@-mustfreeonly@*/
+        return;
+        /*@=mustfreeonly@*/
+    }
+
+    cp_tree_destroy(self->categories);
+    (void)g_string_free(self->strings, TRUE);
+    cp_hash_table_destroy(self->offsets);
+
+    /*@-refcounttrans@*/
+    g_free(self);
+    /*@=refcounttrans@*/
+}
+
+static guint32
+intern_string(CPVartreeIndexWriter self, const char *str) /*@modifies *self@*/ {
+    gsize offset = GPOINTER_TO_UINT(g_hash_table_lookup(self->offsets, str));
+
+    if (offset == 0) {
+        offset = self->strings->len;
+        (void)g_string_append_len(self->strings, str, (gssize)strlen(str) + 1);
+        g_hash_table_insert(
+            self->offsets, g_strdup(str), GUINT_TO_POINTER(offset + 1)
+        );
+    } else {
+        --offset;
+    }
+
+    return (guint32)offset;
+}
+
+static /*@dependent@*/ struct writer_category *
+writer_category_new(
+    CPVartreeIndexWriter self,
+    const char *category,
+    /*@null@*/ const CPTimestamp *mtime
+) /*@modifies *self@*/ {
+    struct writer_category *result = g_new0(struct writer_category, 1);
+
+    if (mtime == NULL) {
+        result->flags = CATEGORY_FLAG_STALE;
+    } else {
+        result->mtime = *mtime;
+    }
+    result->packages = g_array_new(FALSE, FALSE, sizeof(struct index_package));
+
+    g_tree_insert(self->categories, g_strdup(category), result);
+    /*@-dependenttrans@*/
+    return result;
+    /*@=dependenttrans@*/
+}
+
+void
+cp_vartree_index_writer_add_category(
+    CPVartreeIndexWriter self,
+    const char *category,
+    const CPTimestamp *mtime,
+    GSList *packages
+) {
+    struct writer_category *cat = writer_category_new(self, category, mtime);
+    size_t cat_len = strlen(category);
+
+    CP_GSLIST_ITER(packages, pkg) {
+        struct index_package record;
+        CPEapi eapi = cp_package_eapi(pkg);
+
+        /* Package string is "category/pv" */
+        record.pv = intern_string(self, &cp_package_str(pkg)[cat_len + 1]);
+        record.slot = intern_string(self, cp_package_slot(pkg));
+        record.subslot = intern_string(self, cp_package_subslot(pkg));
+        record.repo = intern_string(self, cp_package_repo(pkg));
+        record.eapi = (guint32)eapi;
+
+        (void)g_array_append_val(cat->packages, record);
+    } end_CP_GSLIST_ITER
+}
+
+gboolean
+cp_vartree_index_writer_copy_category(
+    CPVartreeIndexWriter self,
+    const CPVartreeIndex index,
+    const char *category
+) {
+    const struct index_category *src = find_category(index, category);
+    struct writer_category *dest;
+    guint32 i;
+
+    if (src == NULL) {
+        return FALSE;
+    }
+
+    dest = writer_category_new(self, category, NULL);
+    dest->flags = src->flags;
+    dest->mtime.sec = src->mtime_sec;
+    dest->mtime.nsec = src->mtime_nsec;
+
+    for (i = 0; i < src->n_packages; ++i) {
+        const struct index_package *src_pkg
+            = &index->packages[src->first_package + i];
+        const char *pv = get_string(index, src_pkg->pv);
+        const char *slot = get_string(index, src_pkg->slot);
+        const char *subslot = get_string(index, src_pkg->subslot);
+        const char *repo = get_string(index, src_pkg->repo);
+        struct index_package record;
+
+        if (pv == NULL || slot == NULL || subslot == NULL || repo == NULL) {
+            /* Corrupt source data, force reload of this category */
+            dest->flags |= CATEGORY_FLAG_STALE;
+            break;
+        }
+
+        record.pv = intern_string(self, pv);
+        record.slot = intern_string(self, slot);
+        record.subslot = intern_string(self, subslot);
+        record.repo = intern_string(self, repo);
+        record.eapi = src_pkg->eapi;
+
+        (void)g_array_append_val(dest->packages, record);
+    }
+
+    return TRUE;
+}
+
+struct save_data {
+    /*@dependent@*/ CPVartreeIndexWriter self;
+    /*@dependent@*/ GString *categories;
+    /*@dependent@*/ GString *packages;
+    guint32 n_categories;
+    guint32 n_packages;
+};
+
+static gboolean
+save_category(void *key, void *value, void *user_data) /*@modifies *user_data@*/ {
+    struct save_data *data = user_data;
+    struct writer_category *cat = value;
+    struct index_category record;
+
+    record.name = intern_string(data->self, key);
+    record.first_package = data->n_packages;
+    record.n_packages = cat->packages->len;
+    record.flags = cat->flags;
+    record.mtime_sec = cat->mtime.sec;
+    record.mtime_nsec = cat->mtime.nsec;
+
+    (void)g_string_append_len(
+        data->categories, (const char *)&record, (gssize)sizeof(record)
+    );
+    (void)g_string_append_len(
+        data->packages,
+        cat->packages->data,
+        (gssize)(cat->packages->len * sizeof(struct index_package))
+    );
+
+    ++data->n_categories;
+    data->n_packages += cat->packages->len;
+
+    return FALSE;
+}
+
+gboolean
+cp_vartree_index_writer_save(
+    const CPVartreeIndexWriter self,
+    const char *path,
+    GError **error
+) {
+    struct index_header header;
+    struct save_data data;
+    GString *contents;
+    gboolean result;
+
+    g_assert(error == NULL || *error == NULL);
+
+    data.self = self;
+    data.categories = g_string_new("");
+    data.packages = g_string_new("");
+    data.n_categories = 0;
+    data.n_packages = 0;
+
+    g_tree_foreach(self->categories, save_category, &data);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.byte_order = INDEX_BYTE_ORDER;
+    header.n_categories = data.n_categories;
+    header.n_packages = data.n_packages;
+    header.strings_size = (guint32)self->strings->len;
+    header.root_mtime_sec = self->root_mtime.sec;
+    header.root_mtime_nsec = self->root_mtime.nsec;
+
+    /* Index with empty strings table is invalid */
+    if (header.strings_size == 0) {
+        (void)g_string_append_c(self->strings, '\0');
+        header.strings_size = 1;
+    }
+
+    contents = g_string_new_len((const char *)&header, (gssize)sizeof(header));
+    (void)g_string_append_len(contents, data.categories->str, (gssize)data.categories->len);
+    (void)g_string_append_len(contents, data.packages->str, (gssize)data.packages->len);
+    (void)g_string_append_len(contents, self->strings->str, (gssize)self->strings->len);
+
+    result = g_file_set_contents(path, contents->str, (gssize)contents->len, error);
+
+    (void)g_string_free(contents, TRUE);
+    (void)g_string_free(data.categories, TRUE);
+    (void)g_string_free(data.packages, TRUE);
+
+    return result;
+}
@@ -0,0 +1,151 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** On-disk index of installed packages. */
+
+#ifndef CP_VARTREE_INDEX_H
+#define CP_VARTREE_INDEX_H
+
+#include <cportage.h>
+
+#include "io.h"
+
+/*@-exportany@*/
+
+/**
+ * Read-only memory-mapped index of installed packages.
+ */
+typedef struct CPVartreeIndexS *CPVartreeIndex;
+
+/**
+ * Maps index file at \a path into memory.
+ *
+ * \return a #CPVartreeIndex or %NULL if \a path doesn't exist or isn't
+ *         a valid index file, free it using cp_vartree_index_destroy()
+ */
+/*@null@*/ /*@only@*/ CPVartreeIndex
+cp_vartree_index_open(
+    const char *path
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT
+/*@modifies errno@*/ /*@globals fileSystem@*/;
+
+void
+cp_vartree_index_destroy(
+    /*@null@*/ /*@only@*/ CPVartreeIndex self
+) /*@modifies self@*/;
+
+/**
+ * \return %TRUE if list of categories in \a self is up to date
+ *         for vdb root directory modified at \a mtime
+ */
+gboolean
+cp_vartree_index_root_valid(
+    const CPVartreeIndex self,
+    const CPTimestamp *mtime
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return number of categories in \a self
+ */
+guint
+cp_vartree_index_n_categories(
+    const CPVartreeIndex self
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * \return readonly name of \a i-th category in \a self
+ */
+/*@observer@*/ const char *
+cp_vartree_index_category(
+    const CPVartreeIndex self,
+    guint i
+) G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+/**
+ * Creates packages of \a category from data stored in \a self.
+ *
+ * \param mtime current modification time of \a category directory
+ * \param into  return location for list of packages, only set on success.
+ *              Free it using cp_package_list_free().
+ * \return      %TRUE if \a self has up-to-date data for \a category,
+ *              %FALSE otherwise
+ */
+gboolean
+cp_vartree_index_get_category(
+    const CPVartreeIndex self,
+    const char *category,
+    const CPTimestamp *mtime,
+    /*@out@*/ GSList/*<CPPackage>*/ **into
+) G_GNUC_WARN_UNUSED_RESULT /*@modifies *into@*/;
+
+/**
+ * Builder of a new index file.
+ */
+typedef struct CPVartreeIndexWriterS *CPVartreeIndexWriter;
+
+/*@only@*/ CPVartreeIndexWriter
+cp_vartree_index_writer_new(
+    const CPTimestamp *root_mtime
+) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT /*@*/;
+
+void
+cp_vartree_index_writer_destroy(
+    /*@null@*/ /*@only@*/ CPVartreeIndexWriter self
+) /*@modifies self@*/;
+
+/**
+ * Adds \a category with given \a packages to \a self.
+ * Pass %NULL \a mtime for categories that weren't read, they will
+ * be considered outdated when index is loaded.
+ */
+void
+cp_vartree_index_writer_add_category(
+    CPVartreeIndexWriter self,
+    const char *category,
+    /*@null@*/ const CPTimestamp *mtime,
+    /*@null@*/ GSList/*<CPPackage>*/ *packages
+) /*@modifies *self@*/;
+
+/**
+ * Copies \a category data from \a index to \a self as is.
+ *
+ * \return %TRUE if \a index contains \a category, %FALSE otherwise
+ */
+gboolean
+cp_vartree_index_writer_copy_category(
+    CPVartreeIndexWriter self,
+    const CPVartreeIndex index,
+    const char *category
+) /*@modifies *self@*/;
+
+/**
+ * Atomically writes index to \a path.
+ *
+ * \param error return location for a %GError, or %NULL
+ * \return      %TRUE on success, %FALSE if an error occurred
+ */
+gboolean
+cp_vartree_index_writer_save(
+    const CPVartreeIndexWriter self,
+    const char *path,
+    /*@null@*/ GError **error
+) G_GNUC_WARN_UNUSED_RESULT
+/*@modifies *error,errno,fileSystem@*/ /*@globals fileSystem@*/;
+
+#endif
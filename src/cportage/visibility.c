@@ -0,0 +1,846 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "atom.h"
+#include "collections.h"
+#include "license.h"
+#include "porttree.h"
+#include "repository.h"
+#include "settings.h"
+#include "strings.h"
+
+/** Single line of package.accept_keywords. */
+struct accept_entry {
+    /*@only@*/ CPAtom atom;
+    /** Keywords accepted for packages matching atom */
+    /*@only@*/ char **keywords;
+};
+
+/** Visibility configuration and results evaluated for it. */
+struct visibility_config {
+    guint64 fingerprint;
+    /** ACCEPT_KEYWORDS items */
+    /*@only@*/ char **accept;
+    /** Bitset of keywords accepted by ACCEPT_KEYWORDS */
+    /*@only@*/ GArray/*<guint32>*/ *accepted;
+    /** Number of interned keywords already checked against accept */
+    guint n_checked;
+    /** "category/package"->GPtrArray<CPAtom> maps */
+    /*@only@*/ GHashTable *masks;
+    /*@only@*/ GHashTable *unmasks;
+    /** "category/package"->GPtrArray<struct accept_entry> */
+    /*@only@*/ GHashTable *accepts;
+    /*@only@*/ CPLicenseAccept accept_license;
+    /** Bitset of USE flags LICENSE conditionals are evaluated against */
+    /*@only@*/ GArray/*<guint32>*/ *use;
+    /**
+     * CPPackage->CPMaskReason memo. Reason can be 0, so it is looked up
+     * with g_hash_table_lookup_extended().
+     */
+    /*@only@*/ GHashTable *memo;
+};
+
+struct CPVisibilityS {
+    /*@only@*/ CPPorttree porttree;
+    /*@only@*/ CPAtomFactory factory;
+
+    /** Keyword->(bit + 1) map, shared by all configurations */
+    /*@only@*/ GHashTable *keyword_bits;
+    /** Keywords indexed by bit */
+    /*@only@*/ GPtrArray/*<char *>*/ *keywords;
+    /** CPPackage->GArray<guint32> bitset of its KEYWORDS */
+    /*@only@*/ GHashTable *package_keywords;
+
+    /** Interns USE flags of LICENSE conditionals */
+    /*@only@*/ CPDepTable deps;
+    /** License IDs and license groups of repositories */
+    /*@only@*/ CPLicenses licenses;
+    /** CPPackage->CPLicenseExpr of its LICENSE, %NULL if it's malformed */
+    /*@only@*/ GHashTable *package_licenses;
+
+    /** Fingerprint->visibility_config map of loaded configurations */
+    /*@only@*/ GHashTable *configs;
+    /*@dependent@*/ struct visibility_config *config;
+
+    /** Changed atomically, references can be dropped from any thread */
+    /*@refs@*/ gint refs;
+};
+
+static void
+accept_entry_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct accept_entry *entry = data;
+
+    cp_atom_unref(entry->atom);
+    g_strfreev(entry->keywords);
+    g_free(entry);
+}
+
+static void
+visibility_config_free(/*@only@*/ void *data) /*@modifies data@*/ {
+    struct visibility_config *config = data;
+
+    g_strfreev(config->accept);
+    (void)g_array_free(config->accepted, TRUE);
+    cp_hash_table_destroy(config->masks);
+    cp_hash_table_destroy(config->unmasks);
+    cp_hash_table_destroy(config->accepts);
+    cp_license_accept_destroy(config->accept_license);
+    (void)g_array_free(config->use, TRUE);
+    cp_hash_table_destroy(config->memo);
+    g_free(config);
+}
+
+/**
+ * Checks \a keyword of an ebuild against \a accept items.
+ * "*" accepts any stable keyword, "~*" any testing one and "**" anything.
+ * Ebuild keywords "*" and "~*" stand for all stable or testing arches.
+ */
+static gboolean
+keyword_accepted(const char *keyword, char **accept) /*@*/ {
+    CP_STRV_ITER(accept, item) {
+        if (strcmp(item, keyword) == 0 || strcmp(item, "**") == 0) {
+            return TRUE;
+        }
+        if (strcmp(item, "*") == 0 && keyword[0] != '~' && keyword[0] != '-') {
+            return TRUE;
+        }
+        if (strcmp(item, "~*") == 0 && keyword[0] == '~') {
+            return TRUE;
+        }
+        if (strcmp(keyword, "*") == 0 && item[0] != '~' && item[0] != '-') {
+            return TRUE;
+        }
+        if (strcmp(keyword, "~*") == 0 && item[0] == '~') {
+            return TRUE;
+        }
+    } end_CP_STRV_ITER
+
+    return FALSE;
+}
+
+/** \return %TRUE if \a accept contains "**", which accepts even empty KEYWORDS */
+static gboolean
+accepts_anything(char **accept) /*@*/ {
+    CP_STRV_ITER(accept, item) {
+        if (strcmp(item, "**") == 0) {
+            return TRUE;
+        }
+    } end_CP_STRV_ITER
+
+    return FALSE;
+}
+
+static guint
+intern_keyword(CPVisibility self, const char *keyword) /*@modifies *self@*/ {
+    guint bit = GPOINTER_TO_UINT(g_hash_table_lookup(self->keyword_bits, keyword));
+
+    if (bit == 0) {
+        char *copy = g_strdup(keyword);
+
+        g_ptr_array_add(self->keywords, copy);
+        bit = self->keywords->len;
+        g_hash_table_insert(self->keyword_bits, copy, GUINT_TO_POINTER(bit));
+    }
+
+    return bit - 1;
+}
+
+/**
+ * Brings bitset of accepted keywords of current configuration up to date
+ * with keywords interned since last call.
+ */
+static void
+update_accepted(CPVisibility self) /*@modifies *self@*/ {
+    struct visibility_config *config = self->config;
+
+    for (; config->n_checked < self->keywords->len; ++config->n_checked) {
+        const char *keyword = g_ptr_array_index(self->keywords, config->n_checked);
+
+        if (keyword_accepted(keyword, config->accept)) {
+            cp_bitset_set(config->accepted, config->n_checked);
+        }
+    }
+}
+
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+get_package_keywords(
+    CPVisibility self,
+    const CPPackage package,
+    /*@out@*/ const GArray/*<guint32>*/ **result,
+    /*@null@*/ GError **error
+) /*@modifies *self,*result,*error,errno@*/ /*@globals fileSystem@*/ {
+    GArray *bitset = g_hash_table_lookup(self->package_keywords, package);
+    char **keywords;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (bitset == NULL) {
+        if (!cp_porttree_get_keywords(self->porttree, package, &keywords, error)) {
+            *result = NULL;
+            return FALSE;
+        }
+
+        bitset = g_array_new(FALSE, TRUE, sizeof(guint32));
+        CP_STRV_ITER(keywords, keyword) {
+            cp_bitset_set(bitset, intern_keyword(self, keyword));
+        } end_CP_STRV_ITER
+        g_strfreev(keywords);
+
+        g_hash_table_insert(self->package_keywords, cp_package_ref(package), bitset);
+    }
+
+    /*@-dependenttrans@*/
+    *result = bitset;
+    /*@=dependenttrans@*/
+    return TRUE;
+}
+
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+get_package_license(
+    CPVisibility self,
+    const CPPackage package,
+    /*@out@*/ /*@null@*/ CPLicenseExpr *result,
+    /*@null@*/ GError **error
+) /*@modifies *self,*result,*error,errno@*/ /*@globals fileSystem@*/ {
+    static const char * const keys[] = { "LICENSE", NULL };
+    CPLicenseExpr expr;
+    GError *tmp_error = NULL;
+    void *cached;
+    char *license;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (g_hash_table_lookup_extended(self->package_licenses, package, NULL, &cached)) {
+        *result = cached;
+        return TRUE;
+    }
+
+    if (!cp_porttree_get_metadata(self->porttree, package, keys, &license, error)) {
+        *result = NULL;
+        return FALSE;
+    }
+
+    expr = cp_license_expr_new(self->licenses, license == NULL ? "" : license, &tmp_error);
+    if (expr == NULL) {
+        g_debug("Masking %s: %s", cp_package_str(package), tmp_error->message);
+        g_error_free(tmp_error);
+    }
+    g_free(license);
+
+    g_hash_table_insert(self->package_licenses, cp_package_ref(package), expr);
+    /*@-dependenttrans@*/
+    *result = expr;
+    /*@=dependenttrans@*/
+    return TRUE;
+}
+
+static gboolean
+any_matches(
+    /*@null@*/ const GPtrArray/*<CPAtom>*/ *atoms,
+    const CPPackage package
+) /*@modifies package@*/ {
+    guint i;
+
+    for (i = 0; atoms != NULL && i < atoms->len; ++i) {
+        if (cp_atom_matches(g_ptr_array_index(atoms, i), package)) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ * \return %TRUE if \a bitset has a keyword accepted by package.accept_keywords
+ *         entries matching \a package
+ */
+static gboolean
+package_accepted(
+    const CPVisibility self,
+    const CPPackage package,
+    const GArray/*<guint32>*/ *bitset,
+    /*@null@*/ const GPtrArray/*<struct accept_entry>*/ *entries
+) /*@modifies package@*/ {
+    guint i;
+    guint bit;
+
+    for (i = 0; entries != NULL && i < entries->len; ++i) {
+        const struct accept_entry *entry = g_ptr_array_index(entries, i);
+
+        if (!cp_atom_matches(entry->atom, package)) {
+            continue;
+        }
+        if (accepts_anything(entry->keywords)) {
+            return TRUE;
+        }
+        for (bit = 0; bit < bitset->len * 32; ++bit) {
+            if (cp_bitset_get(bitset, bit) && keyword_accepted(
+                    g_ptr_array_index(self->keywords, bit), entry->keywords)) {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+evaluate(
+    CPVisibility self,
+    const CPPackage package,
+    /*@out@*/ CPMaskReason *reason,
+    /*@null@*/ GError **error
+) /*@modifies *self,*reason,*error,errno@*/ /*@globals fileSystem@*/ {
+    struct visibility_config *config = self->config;
+    const GArray *bitset;
+    CPLicenseExpr license;
+    void *memo;
+    char *key;
+    gboolean accepted = FALSE;
+    guint i;
+    int result = (int)CP_MASK_NONE;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (g_hash_table_lookup_extended(config->memo, package, NULL, &memo)) {
+        *reason = (CPMaskReason)GPOINTER_TO_INT(memo);
+        return TRUE;
+    }
+
+    *reason = CP_MASK_NONE;
+
+    if (!get_package_keywords(self, package, &bitset, error)) {
+        return FALSE;
+    }
+    update_accepted(self);
+
+    for (i = 0; i < bitset->len && i < config->accepted->len && !accepted; ++i) {
+        accepted = (g_array_index(bitset, guint32, i)
+            & g_array_index(config->accepted, guint32, i)) != 0;
+    }
+    if (!accepted) {
+        accepted = accepts_anything(config->accept);
+    }
+
+    key = g_strconcat(cp_package_category(package), "/", cp_package_name(package), NULL);
+
+    if (!accepted && !package_accepted(self, package, bitset,
+            g_hash_table_lookup(config->accepts, key))) {
+        result |= (int)CP_MASK_KEYWORDS;
+    }
+
+    if (any_matches(g_hash_table_lookup(config->masks, key), package)
+            && !any_matches(g_hash_table_lookup(config->unmasks, key), package)) {
+        result |= (int)CP_MASK_PACKAGE_MASK;
+    }
+
+    g_free(key);
+
+    if (!get_package_license(self, package, &license, error)) {
+        return FALSE;
+    }
+    if (license == NULL
+            || !cp_license_expr_accepted(license, config->accept_license, config->use)) {
+        result |= (int)CP_MASK_LICENSE;
+    }
+
+    *reason = (CPMaskReason)result;
+    g_hash_table_insert(config->memo, cp_package_ref(package), GINT_TO_POINTER(result));
+    return TRUE;
+}
+
+static void
+stack_lines(char **lines, void *user_data) /*@modifies *user_data@*/ {
+    cp_stack_dict(user_data, lines);
+}
+
+/** Stacks lines of config file at \a path into \a into, see cp_collect_lines(). */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+collect_lines(
+    /*@only@*/ char *path,
+    GTree/*<char *, NULL>*/ *into,
+    /*@null@*/ GError **error
+) /*@modifies *into,*error,errno@*/ /*@globals fileSystem@*/ {
+    gboolean result = cp_collect_lines(path, stack_lines, into, error);
+
+    g_free(path);
+    return result;
+}
+
+/**
+ * Same as collect_lines(), but for \a path relative to snapshot \a repo.
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+collect_snapshot_lines(
+    const CPRepository repo,
+    /*@only@*/ char *path,
+    GTree/*<char *, NULL>*/ *into,
+    /*@null@*/ GError **error
+) /*@modifies *into,*error,errno@*/ /*@globals fileSystem@*/ {
+    CPTimestamp mtime;
+    gboolean is_dir;
+    gboolean result = TRUE;
+
+    g_assert(error == NULL || *error == NULL);
+
+    if (!cp_repository_stat(repo, path, &mtime, &is_dir)) {
+        /* Missing path is ignored */
+    } else if (is_dir) {
+        char **names = cp_repository_list(repo, path, error);
+
+        if (names == NULL) {
+            result = FALSE;
+        } else {
+            cp_strings_sort(names);
+            CP_STRV_ITER(names, name) {
+                if (!result) {
+                    break;
+                }
+                if (name[0] != '.' && !g_str_has_suffix(name, "~")) {
+                    result = collect_snapshot_lines(repo,
+                        g_build_filename(path, name, NULL), into, error);
+                }
+            } end_CP_STRV_ITER
+            g_strfreev(names);
+        }
+    } else {
+        char **lines = cp_repository_getlines(repo, path, error);
+
+        if (lines == NULL) {
+            result = FALSE;
+        } else {
+            cp_stack_dict(into, lines);
+            g_strfreev(lines);
+        }
+    }
+
+    g_free(path);
+    return result;
+}
+
+static gboolean
+fingerprint_line(
+    void *key,
+    /*@unused@*/ void *value G_GNUC_UNUSED,
+    void *user_data
+) /*@modifies *user_data@*/ {
+    cp_string_fingerprint_add(user_data, key);
+    return FALSE;
+}
+
+/** Adds \a value to \a index under package name of \a atom. */
+static void
+add_atom(
+    GHashTable *index,
+    const CPAtom atom,
+    /*@only@*/ void *value,
+    GDestroyNotify value_free_func
+) /*@modifies *index@*/ {
+    char *key = g_strconcat(cp_atom_category(atom), "/", cp_atom_package(atom), NULL);
+    GPtrArray *values = g_hash_table_lookup(index, key);
+
+    if (values == NULL) {
+        values = g_ptr_array_new_with_free_func(value_free_func);
+        g_hash_table_insert(index, key, values);
+    } else {
+        g_free(key);
+    }
+    g_ptr_array_add(values, value);
+}
+
+struct parse_data {
+    /*@dependent@*/ CPVisibility self;
+    /*@dependent@*/ GHashTable *index;
+    /*@observer@*/ const char *file;
+    /*@observer@*/ const char *arch;
+};
+
+/** Indexes package.mask or package.unmask line by package name. */
+static gboolean
+parse_mask(
+    void *key,
+    /*@unused@*/ void *value G_GNUC_UNUSED,
+    void *user_data
+) /*@modifies *user_data@*/ {
+    struct parse_data *data = user_data;
+    GError *error = NULL;
+    CPAtom atom;
+
+    atom = cp_atom_new(data->self->factory, CP_EAPI_LATEST, key, &error);
+    if (atom == NULL) {
+        g_warning("Invalid atom in %s: %s", data->file, error->message);
+        g_error_free(error);
+    } else {
+        add_atom(data->index, atom, atom, (GDestroyNotify)cp_atom_unref);
+    }
+
+    return FALSE;
+}
+
+/**
+ * Indexes package.accept_keywords line by package name. Line without
+ * keywords accepts testing keyword of current ARCH.
+ */
+static gboolean
+parse_accept(
+    void *key,
+    /*@unused@*/ void *value G_GNUC_UNUSED,
+    void *user_data
+) /*@modifies *user_data@*/ {
+    struct parse_data *data = user_data;
+    char **items = cp_strings_pysplit(key);
+    struct accept_entry *entry;
+    GError *error = NULL;
+    CPAtom atom;
+
+    atom = cp_atom_new(data->self->factory, CP_EAPI_LATEST, items[0], &error);
+    if (atom == NULL) {
+        g_warning("Invalid atom in %s: %s", data->file, error->message);
+        g_error_free(error);
+        g_strfreev(items);
+        return FALSE;
+    }
+
+    entry = g_new0(struct accept_entry, 1);
+    entry->atom = atom;
+    if (items[1] == NULL) {
+        entry->keywords = g_new0(char *, 2);
+        entry->keywords[0] = g_strconcat("~", data->arch, NULL);
+    } else {
+        entry->keywords = g_strdupv(&items[1]);
+    }
+    add_atom(data->index, entry->atom, entry, accept_entry_free);
+
+    g_strfreev(items);
+    return FALSE;
+}
+
+static /*@null@*/ GHashTable *
+new_index(void) /*@*/ {
+    return g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify)g_ptr_array_unref);
+}
+
+/**
+ * Reads visibility configuration of \a settings and makes it current.
+ * Configuration with the same fingerprint is reused with its memo.
+ */
+static gboolean G_GNUC_WARN_UNUSED_RESULT
+load_config(
+    CPVisibility self,
+    const CPSettings settings,
+    /*@null@*/ GError **error
+) /*@modifies *self,*error,errno@*/ /*@globals fileSystem@*/ {
+    const char *config_root = cp_settings_config_root(settings);
+    const char *accept = cp_settings_get_default(settings, "ACCEPT_KEYWORDS", "");
+    const char *arch = cp_settings_get_default(settings, "ARCH", "");
+    const char *accept_license =
+        cp_settings_get_default(settings, "ACCEPT_LICENSE", "");
+    const char *use = cp_settings_get_default(settings, "USE", "");
+    struct visibility_config *config;
+    struct parse_data data;
+    GTree *masks;
+    GTree *unmasks;
+    GTree *accepts;
+    guint64 fingerprint = CP_FINGERPRINT_INIT;
+    char **flags;
+    gboolean result = TRUE;
+
+    g_assert(error == NULL || *error == NULL);
+
+    masks = g_tree_new_full((GCompareDataFunc)strcmp, NULL, g_free, NULL);
+    unmasks = g_tree_new_full((GCompareDataFunc)strcmp, NULL, g_free, NULL);
+    accepts = g_tree_new_full((GCompareDataFunc)strcmp, NULL, g_free, NULL);
+
+    /* Repository masks come first, then profiles, then user ones */
+    CP_GSLIST_ITER(cp_settings_repositories(settings), repo) {
+        if (cp_repository_is_snapshot(repo)) {
+            result = result && collect_snapshot_lines(repo,
+                g_build_filename("profiles", "package.mask", NULL), masks, error);
+        } else {
+            result = result && collect_lines(g_build_filename(cp_repository_path(repo),
+                "profiles", "package.mask", NULL), masks, error);
+        }
+    } end_CP_GSLIST_ITER
+    CP_GSLIST_ITER(cp_settings_profiles(settings), profile) {
+        result = result && collect_lines(g_build_filename(profile,
+            "package.mask", NULL), masks, error);
+    } end_CP_GSLIST_ITER
+    result = result
+        && collect_lines(g_build_filename(config_root,
+            "etc", "portage", "package.mask", NULL), masks, error)
+        && collect_lines(g_build_filename(config_root,
+            "etc", "portage", "package.unmask", NULL), unmasks, error)
+        && collect_lines(g_build_filename(config_root,
+            "etc", "portage", "package.keywords", NULL), accepts, error)
+        && collect_lines(g_build_filename(config_root,
+            "etc", "portage", "package.accept_keywords", NULL), accepts, error);
+    if (!result) {
+        goto OUT;
+    }
+
+    /* Without make.globals nothing sets it, everything is accepted then */
+    if (accept_license[0] == '\0') {
+        accept_license = "*";
+    }
+
+    cp_string_fingerprint_add(&fingerprint, accept);
+    cp_string_fingerprint_add(&fingerprint, arch);
+    cp_string_fingerprint_add(&fingerprint, accept_license);
+    cp_string_fingerprint_add(&fingerprint, use);
+    g_tree_foreach(masks, fingerprint_line, &fingerprint);
+    cp_string_fingerprint_add(&fingerprint, "");
+    g_tree_foreach(unmasks, fingerprint_line, &fingerprint);
+    cp_string_fingerprint_add(&fingerprint, "");
+    g_tree_foreach(accepts, fingerprint_line, &fingerprint);
+
+    config = g_hash_table_lookup(self->configs, &fingerprint);
+    if (config != NULL) {
+        self->config = config;
+        goto OUT;
+    }
+
+    config = g_new0(struct visibility_config, 1);
+    config->fingerprint = fingerprint;
+    config->accept = cp_strings_pysplit(accept);
+    config->accepted = g_array_new(FALSE, TRUE, sizeof(guint32));
+    config->n_checked = 0;
+    config->masks = new_index();
+    config->unmasks = new_index();
+    config->accepts = new_index();
+    config->accept_license = cp_license_accept_new(self->licenses, accept_license);
+    config->use = g_array_new(FALSE, TRUE, sizeof(guint32));
+    flags = cp_strings_pysplit(use);
+    if (flags != NULL) {
+        CP_STRV_ITER(flags, flag) {
+            cp_bitset_set(config->use, cp_dep_table_intern_flag(self->deps, flag));
+        } end_CP_STRV_ITER
+        g_strfreev(flags);
+    }
+    config->memo = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+        (GDestroyNotify)cp_package_unref, NULL);
+
+    data.self = self;
+    data.arch = arch;
+    data.index = config->masks;
+    data.file = "package.mask";
+    g_tree_foreach(masks, parse_mask, &data);
+    data.index = config->unmasks;
+    data.file = "package.unmask";
+    g_tree_foreach(unmasks, parse_mask, &data);
+    data.index = config->accepts;
+    data.file = "package.accept_keywords";
+    g_tree_foreach(accepts, parse_accept, &data);
+
+    g_hash_table_insert(self->configs, &config->fingerprint, config);
+    self->config = config;
+
+OUT:
+    g_tree_destroy(masks);
+    g_tree_destroy(unmasks);
+    g_tree_destroy(accepts);
+    return result;
+}
+
+CPVisibility
+cp_visibility_new(const CPSettings settings, CPPorttree porttree, GError **error) {
+    CPVisibility self;
+
+    g_assert(error == NULL || *error == NULL);
+
+    self = g_new0(struct CPVisibilityS, 1);
+    self->refs = 1;
+
+    g_assert(self->porttree == NULL);
+    self->porttree = cp_porttree_ref(porttree);
+    g_assert(self->factory == NULL);
+    self->factory = cp_atom_factory_new();
+
+    g_assert(self->keyword_bits == NULL);
+    self->keyword_bits = g_hash_table_new(g_str_hash, g_str_equal);
+    g_assert(self->keywords == NULL);
+    self->keywords = g_ptr_array_new_with_free_func(g_free);
+    g_assert(self->package_keywords == NULL);
+    self->package_keywords = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+        (GDestroyNotify)cp_package_unref, cp_bitset_free);
+
+    g_assert(self->deps == NULL);
+    self->deps = cp_dep_table_new(self->factory);
+    g_assert(self->licenses == NULL);
+    self->licenses = cp_licenses_new(self->deps);
+    g_assert(self->package_licenses == NULL);
+    self->package_licenses = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+        (GDestroyNotify)cp_package_unref, (GDestroyNotify)cp_license_expr_destroy);
+
+    g_assert(self->configs == NULL);
+    self->configs = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+        NULL, visibility_config_free);
+
+    CP_GSLIST_ITER(cp_settings_repositories(settings), repo) {
+        if (!cp_licenses_add_groups(self->licenses, repo, error)) {
+            cp_visibility_unref(self);
+            return NULL;
+        }
+    } end_CP_GSLIST_ITER
+
+    if (!load_config(self, settings, error)) {
+        cp_visibility_unref(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+CPVisibility
+cp_visibility_ref(CPVisibility self) {
+    g_atomic_int_inc(&self->refs);
+    /*@-refcounttrans@*/
+    return self;
+    /*@=refcounttrans@*/
+}
+
+void
+cp_visibility_unref(CPVisibility self) {
+    /*@-mustfreeonly@*/
+    if (self == NULL) {
+        return;
+    }
+
+    g_assert(g_atomic_int_get(&self->refs) > 0);
+    if (!g_atomic_int_dec_and_test(&self->refs)) {
+        return;
+    }
+    /*@=mustfreeonly@*/
+
+    cp_hash_table_destroy(self->configs);
+    cp_hash_table_destroy(self->package_licenses);
+    cp_licenses_destroy(self->licenses);
+    cp_dep_table_destroy(self->deps);
+    cp_hash_table_destroy(self->package_keywords);
+    cp_hash_table_destroy(self->keyword_bits);
+    g_ptr_array_unref(self->keywords);
+    cp_atom_factory_unref(self->factory);
+    cp_porttree_unref(self->porttree);
+
+    /*@-refcounttrans@*/
+    g_free(self);
+    /*@=refcounttrans@*/
+}
+
+gboolean
+cp_visibility_reload(CPVisibility self, const CPSettings settings, GError **error) {
+    g_assert(error == NULL || *error == NULL);
+
+    return load_config(self, settings, error);
+}
+
+guint64
+cp_visibility_fingerprint(const CPVisibility self) {
+    return self->config->fingerprint;
+}
+
+struct compute_data {
+    /*@dependent@*/ CPVisibility self;
+    /*@null@*/ GError *error;
+};
+
+static gboolean
+compute_package(const CPPackage package, void *user_data) /*@modifies *user_data@*/ {
+    struct compute_data *data = user_data;
+    CPMaskReason reason;
+
+    return evaluate(data->self, package, &reason, &data->error);
+}
+
+gboolean
+cp_visibility_compute(CPVisibility self, GError **error) {
+    struct compute_data data;
+    CPTree tree;
+    gboolean result;
+
+    g_assert(error == NULL || *error == NULL);
+
+    data.self = self;
+    data.error = NULL;
+
+    tree = cp_porttree_get_tree(self->porttree);
+    result = cp_tree_foreach(tree, compute_package, &data, error);
+    cp_tree_unref(tree);
+
+    if (data.error != NULL) {
+        g_propagate_error(error, data.error);
+        result = FALSE;
+    }
+
+    return result;
+}
+
+gboolean
+cp_visibility_check(
+    CPVisibility self,
+    const CPPackage package,
+    CPMaskReason *reason,
+    GError **error
+) {
+    g_assert(error == NULL || *error == NULL);
+
+    return evaluate(self, package, reason, error);
+}
+
+gboolean
+cp_visibility_best_visible(
+    CPVisibility self,
+    const CPAtom atom,
+    CPPackage *best,
+    GError **error
+) {
+    CPTree tree;
+    GSList *match;
+    GSList *iter;
+    gboolean result;
+
+    g_assert(error == NULL || *error == NULL);
+
+    *best = NULL;
+
+    tree = cp_porttree_get_tree(self->porttree);
+    result = cp_tree_find_packages(tree, atom, FALSE, &match, error);
+    cp_tree_unref(tree);
+    if (!result) {
+        return FALSE;
+    }
+
+    for (iter = match; iter != NULL; iter = iter->next) {
+        CPMaskReason reason;
+
+        if (!evaluate(self, iter->data, &reason, error)) {
+            result = FALSE;
+            break;
+        }
+        if (reason == CP_MASK_NONE) {
+            *best = cp_package_ref(iter->data);
+            break;
+        }
+    }
+
+    cp_package_list_free(match);
+    return result;
+}
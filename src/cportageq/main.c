@@ -292,6 +292,113 @@ ERR:
     return retval;
 }
 
+static int
+owners(
+    int argc,
+    char **argv,
+    GError **error
+) /*@modifies *error,*stdout,*stderr,errno,fileSystem@*/ /*@globals fileSystem@*/ {
+    CPSettings settings = NULL;
+    CPVartree vartree = NULL;
+    CPOwners index = NULL;
+    gboolean found = FALSE;
+    int i;
+    int retval = 2;
+
+    if (argc < 2) {
+        g_critical(_("ERROR: insufficient parameters!"));
+        goto ERR;
+    }
+
+    settings = cp_settings_new(argv[0], NULL, error);
+    if (settings == NULL) {
+        goto ERR;
+    }
+
+    vartree = cp_vartree_new(settings, error);
+    if (vartree == NULL) {
+        goto ERR;
+    }
+
+    index = cp_owners_new(settings, vartree, error);
+    if (index == NULL) {
+        goto ERR;
+    }
+
+    for (i = 1; i < argc; ++i) {
+        /* Trailing slash asks for everything below directory */
+        GSList *pkgs = g_str_has_suffix(argv[i], "/")
+            ? cp_owners_find_dir(index, argv[i])
+            : cp_owners_find(index, argv[i]);
+
+        CP_GSLIST_ITER(pkgs, pkg) {
+            g_print("%s\n\t%s\n", (const char *)pkg, argv[i]);
+            found = TRUE;
+        } end_CP_GSLIST_ITER
+
+        g_slist_free(pkgs);
+    }
+
+    retval = found ? EXIT_SUCCESS : EXIT_FAILURE;
+
+ERR:
+    cp_owners_unref(index);
+    cp_vartree_unref(vartree);
+    cp_settings_unref(settings);
+
+    return retval;
+}
+
+static gboolean
+print_package(
+    const CPPackage package,
+    /*@unused@*/ void *user_data G_GNUC_UNUSED
+) /*@modifies *stdout,errno@*/ {
+    g_print("%s\n", cp_package_str(package));
+    return TRUE;
+}
+
+static int
+list_installed(
+    int argc,
+    char **argv,
+    GError **error
+) /*@modifies *error,*stdout,*stderr,errno@*/ /*@globals fileSystem@*/ {
+    CPSettings settings = NULL;
+    CPVartree vartree = NULL;
+    CPTree vardb = NULL;
+    int retval = 2;
+
+    if (argc != 1) {
+        g_critical(_("ERROR: expected 1 parameter, got %d!"), argc);
+        goto ERR;
+    }
+
+    settings = cp_settings_new(argv[0], NULL, error);
+    if (settings == NULL) {
+        goto ERR;
+    }
+
+    vartree = cp_vartree_new(settings, error);
+    if (vartree == NULL) {
+        goto ERR;
+    }
+    vardb = cp_vartree_get_tree(vartree);
+
+    if (!cp_tree_foreach(vardb, print_package, NULL, error)) {
+        goto ERR;
+    }
+
+    retval = EXIT_SUCCESS;
+
+ERR:
+    cp_tree_unref(vardb);
+    cp_vartree_unref(vartree);
+    cp_settings_unref(settings);
+
+    return retval;
+}
+
 static void
 usage(const char *progname) /*@modifies *stdout,errno@*/ {
     /* TODO: usage docs */
@@ -339,8 +446,12 @@ main(int argc, char **argv)
         retval = vdb_path(&error);
     } else if (strcmp("is_protected", argv[1]) == 0) {
         retval = is_protected(argc - 2, &argv[2], &error);
+    } else if (strcmp("owners", argv[1]) == 0) {
+        retval = owners(argc - 2, &argv[2], &error);
+    } else if (strcmp("list_installed", argv[1]) == 0) {
+        retval = list_installed(argc - 2, &argv[2], &error);
     /*
-      TODO: mass_best_version, metadata, contents, owners,
+      TODO: mass_best_version, metadata, contents,
       filter_protected, best_visible, mass_best_visible, all_best_visible,
       list_preserved_libs
      */
@@ -21,6 +21,7 @@
 
 #include <cportage.h>
 #include "cportage/atom.h"
+#include "cportage/package.h"
 
 struct item {
     const char *str;
@@ -160,11 +161,104 @@ pv_split(void) {
     cp_version_unref(version);
 }
 
+static CPPackage
+new_package(const char *pv) {
+    char *name = NULL;
+    CPVersion version = NULL;
+    CPPackage result;
+
+    g_assert(cp_atom_pv_split(pv, &name, &version, NULL));
+    result = cp_package_new("cat", name, version, "0", "gentoo", CP_EAPI_LATEST);
+
+    g_free(name);
+    cp_version_unref(version);
+    return result;
+}
+
+struct match_item {
+    const char *atom;
+    const char *expected;
+};
+
+static void
+match_range(void) {
+    CPAtomFactory atom_factory = cp_atom_factory_new();
+    /* Sorted by version */
+    const char *pvs[] = {
+        "foo-1.0", "foo-1.2", "foo-1.2-r1", "foo-1.2-r2",
+        "foo-1.2.3", "foo-1.3", "foo-1.20", "foo-2"
+    };
+    const struct match_item data[] = {
+        { "cat/foo", "1.0 1.2 1.2-r1 1.2-r2 1.2.3 1.3 1.20 2" },
+        { "<cat/foo-1.2-r1", "1.0 1.2" },
+        { "<=cat/foo-1.2-r1", "1.0 1.2 1.2-r1" },
+        { "=cat/foo-1.2-r1", "1.2-r1" },
+        { "=cat/foo-1.4", "" },
+        { ">=cat/foo-1.3", "1.3 1.20 2" },
+        { ">cat/foo-1.3", "1.20 2" },
+        { ">cat/foo-2", "" },
+        { "<cat/foo-1.0", "" },
+        { "~cat/foo-1.2", "1.2 1.2-r1 1.2-r2" },
+        { "~cat/foo-1.2-r1", "1.2-r1 1.2-r2" },
+        { "=cat/foo-1.2*", "1.2 1.2-r1 1.2-r2 1.2.3 1.20" },
+    };
+    CPPackage packages[G_N_ELEMENTS(pvs)];
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(pvs); ++i) {
+        packages[i] = new_package(pvs[i]);
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(data); ++i) {
+        GError *error = NULL;
+        CPAtom atom = cp_atom_new(atom_factory, CP_EAPI_LATEST, data[i].atom, &error);
+        GString *actual = g_string_new("");
+        guint from;
+        guint to;
+        guint j;
+
+        g_assert_no_error(error);
+        cp_atom_match_range(atom, packages, G_N_ELEMENTS(packages), &from, &to);
+
+        for (j = 0; j < G_N_ELEMENTS(packages); ++j) {
+            gboolean matches = cp_atom_matches(atom, packages[j]);
+            CPVersion version;
+
+            /* Range must never exclude a match */
+            if (matches && (j < from || j >= to)) {
+                g_error("'%s' excludes matching '%s'",
+                    data[i].atom, cp_package_str(packages[j]));
+            }
+            if (!matches) {
+                continue;
+            }
+
+            version = cp_package_version(packages[j]);
+            if (actual->len > 0) {
+                g_string_append_c(actual, ' ');
+            }
+            g_string_append(actual, cp_version_str(version));
+            cp_version_unref(version);
+        }
+
+        g_assert_cmpstr(actual->str, ==, data[i].expected);
+
+        g_string_free(actual, TRUE);
+        cp_atom_unref(atom);
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(packages); ++i) {
+        cp_package_unref(packages[i]);
+    }
+    cp_atom_factory_unref(atom_factory);
+}
+
 int main(int argc, char *argv[]) {
     g_test_init(&argc, &argv, NULL);
 
     g_test_add_func("/atom/new", atom_new);
     g_test_add_func("/atom/pv_split", pv_split);
+    g_test_add_func("/atom/match_range", match_range);
 
     return g_test_run();
 }
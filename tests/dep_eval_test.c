@@ -0,0 +1,183 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+
+#include <cportage/collections.h>
+#include <cportage/dep_eval.h>
+
+static CPAtomFactory atom_factory;
+static CPDepTable table;
+
+static CPDepId
+parse(const char *deps) {
+    GError *error = NULL;
+    CPDepId id = CP_DEP_EMPTY;
+
+    g_assert(cp_dep_table_parse(table, CP_EAPI_LATEST, deps, &id, &error));
+    g_assert_no_error(error);
+    return id;
+}
+
+/**
+ * \return bitset of %NULL-terminated list of flags
+ */
+static GArray *
+new_use(const char *flag, ...) {
+    GArray *use = g_array_new(FALSE, TRUE, sizeof(guint32));
+    va_list list;
+
+    va_start(list, flag);
+    while (flag != NULL) {
+        cp_bitset_set(use, cp_dep_table_intern_flag(table, flag));
+        flag = va_arg(list, const char *);
+    }
+    va_end(list);
+
+    return use;
+}
+
+/**
+ * Checks that \a deps flattened under \a use are nodes of %NULL-terminated
+ * list of single-node dependencies.
+ */
+static void
+assert_flat(CPDepEval eval, const char *deps, const GArray *use, ...) {
+    CPDepId id = parse(deps);
+    const CPDepId *nodes;
+    const char *expected;
+    va_list list;
+    guint n;
+    guint i = 0;
+
+    nodes = cp_dep_eval_flatten(eval, id, use, &n);
+
+    va_start(list, use);
+    while ((expected = va_arg(list, const char *)) != NULL) {
+        g_assert_cmpuint(i, <, n);
+        g_assert_cmpuint(nodes[i], ==, parse(expected));
+        ++i;
+    }
+    va_end(list);
+
+    g_assert_cmpuint(i, ==, n);
+}
+
+static const char *deps =
+    "dev-libs/a x? ( dev-libs/b ) !x? ( dev-libs/c ) "
+    "|| ( dev-libs/d y? ( dev-libs/e ) ) || ( dev-libs/f dev-libs/g ) "
+    "|| ( z? ( dev-libs/h ) )";
+
+static void
+flatten(void) {
+    CPDepEval eval = cp_dep_eval_new(table, 1024 * 1024);
+    GArray *none = new_use(NULL);
+    GArray *all = new_use("x", "y", "z", NULL);
+    CPDepEvalStats stats;
+
+    assert_flat(eval, deps, none, "dev-libs/a", "dev-libs/c", "dev-libs/d",
+        "|| ( dev-libs/f dev-libs/g )", NULL);
+    assert_flat(eval, deps, all, "dev-libs/a", "dev-libs/b",
+        "|| ( dev-libs/d dev-libs/e )", "|| ( dev-libs/f dev-libs/g )",
+        "dev-libs/h", NULL);
+    assert_flat(eval, "|| ( ( dev-libs/a dev-libs/b ) x? ( dev-libs/c ) )", none,
+        "dev-libs/a", "dev-libs/b", NULL);
+    assert_flat(eval, "", all, NULL);
+
+    cp_dep_eval_get_stats(eval, &stats);
+    g_assert_cmpuint(stats.misses, ==, 4);
+    g_assert_cmpuint(stats.hits, ==, 0);
+    g_assert_cmpuint(stats.size, ==, 4);
+
+    g_array_unref(all);
+    g_array_unref(none);
+    cp_dep_eval_destroy(eval);
+}
+
+static void
+hits(void) {
+    CPDepEval eval = cp_dep_eval_new(table, 1024 * 1024);
+    GArray *x = new_use("x", NULL);
+    GArray *x_other = new_use("x", "other", NULL);
+    CPDepEvalStats stats;
+
+    assert_flat(eval, deps, x, "dev-libs/a", "dev-libs/b", "dev-libs/d",
+        "|| ( dev-libs/f dev-libs/g )", NULL);
+    /* Flags that dependencies don't test are ignored */
+    assert_flat(eval, deps, x_other, "dev-libs/a", "dev-libs/b", "dev-libs/d",
+        "|| ( dev-libs/f dev-libs/g )", NULL);
+    assert_flat(eval, "dev-libs/a x? ( dev-libs/b )", x,
+        "dev-libs/a", "dev-libs/b", NULL);
+    assert_flat(eval, "( dev-libs/a ) x? ( ( dev-libs/b ) )", x_other,
+        "dev-libs/a", "dev-libs/b", NULL);
+
+    cp_dep_eval_get_stats(eval, &stats);
+    g_assert_cmpuint(stats.misses, ==, 2);
+    g_assert_cmpuint(stats.hits, ==, 2);
+    g_assert_cmpuint(stats.evictions, ==, 0);
+
+    g_array_unref(x_other);
+    g_array_unref(x);
+    cp_dep_eval_destroy(eval);
+}
+
+static void
+bounded(void) {
+    /* Room for a single small result */
+    CPDepEval eval = cp_dep_eval_new(table, 1);
+    GArray *none = new_use(NULL);
+    GArray *x = new_use("x", NULL);
+    CPDepEvalStats stats;
+
+    assert_flat(eval, "x? ( dev-libs/b )", none, NULL);
+    assert_flat(eval, "x? ( dev-libs/b )", x, "dev-libs/b", NULL);
+    assert_flat(eval, "x? ( dev-libs/b )", none, NULL);
+
+    cp_dep_eval_get_stats(eval, &stats);
+    g_assert_cmpuint(stats.misses, ==, 3);
+    g_assert_cmpuint(stats.hits, ==, 0);
+    g_assert_cmpuint(stats.evictions, ==, 2);
+    g_assert_cmpuint(stats.size, ==, 1);
+    g_assert_cmpuint(stats.memory, >, 0);
+
+    g_array_unref(x);
+    g_array_unref(none);
+    cp_dep_eval_destroy(eval);
+}
+
+int
+main(int argc, char *argv[]) {
+    int result;
+
+    g_test_init(&argc, &argv, NULL);
+
+    atom_factory = cp_atom_factory_new();
+    table = cp_dep_table_new(atom_factory);
+
+    g_test_add_func("/dep_eval/flatten", flatten);
+    g_test_add_func("/dep_eval/hits", hits);
+    g_test_add_func("/dep_eval/bounded", bounded);
+
+    result = g_test_run();
+
+    cp_dep_table_destroy(table);
+    cp_atom_factory_unref(atom_factory);
+
+    return result;
+}
@@ -0,0 +1,163 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+
+#include <cportage/dep.h>
+#include <cportage/error.h>
+
+static CPAtomFactory atom_factory;
+static CPDepTable table;
+
+static CPDepId
+parse(const char *deps) {
+    GError *error = NULL;
+    CPDepId id = CP_DEP_EMPTY;
+
+    g_assert(cp_dep_table_parse(table, CP_EAPI_LATEST, deps, &id, &error));
+    g_assert_no_error(error);
+    return id;
+}
+
+static void
+assert_invalid(const char *deps, gint code) {
+    GError *error = NULL;
+    CPDepId id;
+
+    g_assert(!cp_dep_table_parse(table, CP_EAPI_LATEST, deps, &id, &error));
+    g_assert_error(error, CP_ERROR, code);
+    g_error_free(error);
+}
+
+static void
+sharing(void) {
+    CPDepId root = parse("dev-libs/a x? ( dev-libs/b ) || ( dev-libs/c dev-libs/d )");
+    CPDepId other;
+    const CPDepId *children;
+    const CPDepId *other_children;
+    guint n;
+
+    g_assert(parse("") == CP_DEP_EMPTY);
+    g_assert(parse("( ) ( ( ) )") == CP_DEP_EMPTY);
+
+    g_assert(parse("dev-libs/a x? ( dev-libs/b ) || ( dev-libs/c dev-libs/d )") == root);
+    /* Redundant groups don't matter */
+    g_assert(parse("( dev-libs/a ) x? ( ( dev-libs/b ) ) "
+        "|| ( dev-libs/c ( dev-libs/d ) )") == root);
+
+    g_assert(cp_dep_kind(table, root) == CP_DEP_ALL_OF);
+    children = cp_dep_children(table, root, &n);
+    g_assert_cmpuint(n, ==, 3);
+    g_assert(cp_dep_kind(table, children[0]) == CP_DEP_ATOM);
+    g_assert(cp_dep_children(table, children[1], &n) != NULL);
+    g_assert_cmpuint(n, ==, 1);
+    g_assert(cp_dep_kind(table, children[1]) == CP_DEP_USE);
+    g_assert_cmpstr(cp_dep_table_flag_name(table, cp_dep_flag(table, children[1])), ==, "x");
+    g_assert(cp_dep_kind(table, children[2]) == CP_DEP_ANY_OF);
+
+    /* Equal subtrees of different roots are the same nodes */
+    other = parse("|| ( dev-libs/c dev-libs/d ) !y? ( dev-libs/a )");
+    g_assert(other != root);
+    other_children = cp_dep_children(table, other, &n);
+    g_assert_cmpuint(n, ==, 2);
+    children = cp_dep_children(table, root, &n);
+    g_assert(other_children[0] == children[2]);
+    g_assert(cp_dep_kind(table, other_children[1]) == CP_DEP_NOT_USE);
+    g_assert(cp_dep_children(table, other_children[1], &n)[0] == children[0]);
+
+    /* Single atom isn't wrapped into a group */
+    g_assert(parse("dev-libs/a") == children[0]);
+    g_assert(cp_dep_atom(table, children[0]) != NULL);
+}
+
+static int
+flag_cmp(const void *a, const void *b) {
+    guint32 flag_a = *(const guint32 *)a;
+    guint32 flag_b = *(const guint32 *)b;
+
+    return flag_a < flag_b ? -1 : flag_a > flag_b;
+}
+
+static void
+flags(void) {
+    CPDepId root = parse("z? ( dev-libs/a ) || ( x? ( dev-libs/b ) dev-libs/c ) "
+        "!x? ( y? ( dev-libs/d ) )");
+    guint32 expected[3];
+    const guint32 *ids;
+    guint n;
+
+    expected[0] = cp_dep_table_intern_flag(table, "x");
+    expected[1] = cp_dep_table_intern_flag(table, "y");
+    expected[2] = cp_dep_table_intern_flag(table, "z");
+    qsort(expected, G_N_ELEMENTS(expected), sizeof(guint32), flag_cmp);
+
+    ids = cp_dep_flags(table, root, &n);
+    g_assert_cmpuint(n, ==, 3);
+    g_assert_cmpuint(ids[0], ==, expected[0]);
+    g_assert_cmpuint(ids[1], ==, expected[1]);
+    g_assert_cmpuint(ids[2], ==, expected[2]);
+
+    ids = cp_dep_flags(table, parse("dev-libs/a || ( dev-libs/b dev-libs/c )"), &n);
+    g_assert_cmpuint(n, ==, 0);
+}
+
+static void
+blockers(void) {
+    const CPDepId *children;
+    guint n;
+
+    children = cp_dep_children(table, parse("!dev-libs/a !!dev-libs/a dev-libs/a"), &n);
+    g_assert_cmpuint(n, ==, 3);
+    g_assert(cp_dep_kind(table, children[0]) == CP_DEP_WEAK_BLOCKER);
+    g_assert(cp_dep_kind(table, children[1]) == CP_DEP_STRONG_BLOCKER);
+    g_assert(cp_dep_kind(table, children[2]) == CP_DEP_ATOM);
+    g_assert(cp_dep_atom(table, children[0]) == cp_dep_atom(table, children[2]));
+}
+
+static void
+invalid(void) {
+    assert_invalid("x? dev-libs/a", CP_ERROR_DEP_SYNTAX);
+    assert_invalid("|| dev-libs/a", CP_ERROR_DEP_SYNTAX);
+    assert_invalid("( dev-libs/a", CP_ERROR_DEP_SYNTAX);
+    assert_invalid("dev-libs/a )", CP_ERROR_DEP_SYNTAX);
+    assert_invalid("!? ( dev-libs/a )", CP_ERROR_DEP_SYNTAX);
+    assert_invalid("dev-libs", CP_ERROR_ATOM_SYNTAX);
+}
+
+int
+main(int argc, char *argv[]) {
+    int result;
+
+    g_test_init(&argc, &argv, NULL);
+
+    atom_factory = cp_atom_factory_new();
+    table = cp_dep_table_new(atom_factory);
+
+    g_test_add_func("/dep/sharing", sharing);
+    g_test_add_func("/dep/flags", flags);
+    g_test_add_func("/dep/blockers", blockers);
+    g_test_add_func("/dep/invalid", invalid);
+
+    result = g_test_run();
+
+    cp_dep_table_destroy(table);
+    cp_atom_factory_unref(atom_factory);
+
+    return result;
+}
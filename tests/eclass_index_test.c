@@ -0,0 +1,139 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include <cportage.h>
+#include <cportage/eclass_index.h>
+#include <cportage/settings.h>
+
+static char *dir;
+
+static char *
+repo_file(const char *repo, const char *file) {
+    char *result;
+    char *name = g_strconcat(file, ".eclass", NULL);
+
+    result = g_build_filename(repo, "eclass", name, NULL);
+    g_free(name);
+    return result;
+}
+
+static void
+assert_path(CPEclassIndex index, guint repo, const char *eclass, const char *expected) {
+    g_assert_cmpstr(cp_eclass_index_path(index, repo, eclass), ==, expected);
+}
+
+static void
+lookup(void) {
+    GTree *defaults;
+    CPSettings settings;
+    CPEclassIndex index;
+    CPRepository main_repo;
+    char *root;
+    char *overlay;
+    char *tmp_repo;
+    char *foo;
+    char *bar;
+    char *tmp_bar;
+    char *path;
+    char *contents;
+    char *digest;
+    GError *error = NULL;
+
+    root = g_build_filename(dir, "roots/porttree", NULL);
+    overlay = g_build_filename(root, "usr/local/overlay", NULL);
+
+    /* Overlay without layout.conf, its eclass directory is filled later */
+    tmp_repo = g_dir_make_tmp("eclass_index_test.XXXXXX", &error);
+    g_assert_no_error(error);
+    path = g_build_filename(tmp_repo, "eclass", NULL);
+    g_assert(g_mkdir(path, 0755) == 0);
+    g_free(path);
+
+    defaults = g_tree_new_full((GCompareDataFunc)strcmp, NULL, g_free, g_free);
+    g_tree_insert(defaults, g_strdup("PORTDIR_OVERLAY"),
+        g_strconcat(overlay, " ", tmp_repo, NULL));
+    settings = cp_settings_new(root, defaults, &error);
+    g_assert_no_error(error);
+
+    /* PORTDIR is canonicalized by settings */
+    main_repo = cp_settings_main_repository(settings);
+    foo = repo_file(cp_repository_path(main_repo), "foo");
+    bar = repo_file(overlay, "bar");
+    tmp_bar = repo_file(tmp_repo, "bar");
+
+    index = cp_settings_eclass_index(settings);
+    assert_path(index, 0, "foo", foo);
+    assert_path(index, 0, "bar", NULL);
+    /* Overlay lists main repository as its master */
+    assert_path(index, 1, "foo", foo);
+    assert_path(index, 1, "bar", bar);
+    /* Overlay without layout.conf inherits from main repository */
+    assert_path(index, 2, "foo", foo);
+    assert_path(index, 2, "bar", NULL);
+
+    g_assert(g_file_get_contents(foo, &contents, NULL, &error));
+    g_assert_no_error(error);
+    digest = g_compute_checksum_for_string(G_CHECKSUM_MD5, contents, -1);
+    g_assert_cmpstr(cp_eclass_index_digest(index, 1, "foo"), ==, digest);
+    g_assert(cp_eclass_index_digest(index, 1, "nonexistent") == NULL);
+    cp_eclass_index_unref(index);
+
+    /* New eclass changes directory mtime, so it's listed again */
+    g_assert(g_file_set_contents(tmp_bar, "# Bar eclass copy\n", -1, &error));
+    g_assert_no_error(error);
+    index = cp_settings_eclass_index(settings);
+    assert_path(index, 2, "bar", tmp_bar);
+    assert_path(index, 1, "bar", bar);
+    g_assert_cmpstr(cp_eclass_index_digest(index, 2, "foo"), ==, digest);
+    cp_eclass_index_unref(index);
+
+    g_assert(g_unlink(tmp_bar) == 0);
+    path = g_build_filename(tmp_repo, "eclass", NULL);
+    g_assert(g_rmdir(path) == 0);
+    g_assert(g_rmdir(tmp_repo) == 0);
+
+    g_free(path);
+    g_free(digest);
+    g_free(contents);
+    g_free(tmp_bar);
+    g_free(bar);
+    g_free(foo);
+    cp_repository_unref(main_repo);
+    cp_settings_unref(settings);
+    g_tree_unref(defaults);
+    g_free(tmp_repo);
+    g_free(overlay);
+    g_free(root);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_assert(argc == 2);
+    dir = argv[1];
+
+    g_test_add_func("/eclass_index/lookup", lookup);
+
+    return g_test_run();
+}
@@ -0,0 +1,155 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sys/resource.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include <cportage/io_batch.h>
+
+static char *dir;
+
+static void
+check_batch(unsigned int jobs) {
+    CPIOBatchRequest files[3];
+    char *small = g_build_filename(dir, "shellconfig_test_empty.conf", NULL);
+    char *missing = g_build_filename(dir, "nonexistent", NULL);
+    char *big = NULL;
+    GString *big_contents = g_string_new("");
+    GError *error = NULL;
+    int fd;
+
+    /* Bigger than a single read */
+    while (big_contents->len < 10000) {
+        g_string_append(big_contents, "0123456789abcdef\n");
+    }
+    fd = g_file_open_tmp("io_batch_test.XXXXXX", &big, &error);
+    g_assert_no_error(error);
+    (void)close(fd);
+    g_assert(g_file_set_contents(big, big_contents->str, (gssize)big_contents->len, &error));
+    g_assert_no_error(error);
+
+    files[0].dir_fd = AT_FDCWD;
+    files[0].path = small;
+    files[1].dir_fd = AT_FDCWD;
+    files[1].path = missing;
+    files[2].dir_fd = AT_FDCWD;
+    files[2].path = big;
+
+    cp_io_batch_read(files, G_N_ELEMENTS(files), jobs);
+
+    g_assert_cmpint(files[0].error, ==, 0);
+    g_assert(files[0].contents != NULL);
+    g_assert_cmpuint(files[0].length, ==, strlen(files[0].contents));
+
+    g_assert_cmpint(files[1].error, ==, ENOENT);
+    g_assert(files[1].contents == NULL);
+
+    g_assert_cmpint(files[2].error, ==, 0);
+    g_assert_cmpuint(files[2].length, ==, big_contents->len);
+    g_assert_cmpstr(files[2].contents, ==, big_contents->str);
+
+    cp_io_batch_clear(files, G_N_ELEMENTS(files));
+
+    (void)g_unlink(big);
+    g_string_free(big_contents, TRUE);
+    g_free(big);
+    g_free(missing);
+    g_free(small);
+}
+
+static void
+read_serial(void) {
+    check_batch(1);
+}
+
+static void
+read_parallel(void) {
+    check_batch(4);
+}
+
+/** Descriptor limit for read_over_fd_limit(), above any batch window */
+#define FD_LIMIT 128
+
+static void
+check_over_fd_limit(unsigned int jobs) {
+    CPIOBatchRequest files[4 * FD_LIMIT];
+    struct rlimit saved;
+    struct rlimit limited;
+    char *path = NULL;
+    const char *contents = "value\n";
+    GError *error = NULL;
+    guint i;
+    int fd;
+
+    fd = g_file_open_tmp("io_batch_test.XXXXXX", &path, &error);
+    g_assert_no_error(error);
+    (void)close(fd);
+    g_assert(g_file_set_contents(path, contents, -1, &error));
+    g_assert_no_error(error);
+
+    for (i = 0; i < G_N_ELEMENTS(files); ++i) {
+        files[i].dir_fd = AT_FDCWD;
+        files[i].path = path;
+    }
+
+    g_assert(getrlimit(RLIMIT_NOFILE, &saved) == 0);
+    limited = saved;
+    limited.rlim_cur = MIN(saved.rlim_cur, FD_LIMIT);
+    g_assert(setrlimit(RLIMIT_NOFILE, &limited) == 0);
+
+    cp_io_batch_read(files, G_N_ELEMENTS(files), jobs);
+
+    g_assert(setrlimit(RLIMIT_NOFILE, &saved) == 0);
+
+    for (i = 0; i < G_N_ELEMENTS(files); ++i) {
+        g_assert_cmpint(files[i].error, ==, 0);
+        g_assert_cmpstr(files[i].contents, ==, contents);
+    }
+
+    cp_io_batch_clear(files, G_N_ELEMENTS(files));
+
+    (void)g_unlink(path);
+    g_free(path);
+}
+
+static void
+read_over_fd_limit(void) {
+    check_over_fd_limit(1);
+    check_over_fd_limit(4);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_assert(argc == 2);
+    dir = argv[1];
+
+    g_test_add_func("/io_batch/read_serial", read_serial);
+    g_test_add_func("/io_batch/read_parallel", read_parallel);
+    g_test_add_func("/io_batch/read_over_fd_limit", read_over_fd_limit);
+
+    return g_test_run();
+}
@@ -0,0 +1,391 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include <cportage.h>
+#include <cportage/repository.h>
+
+static char *dir;
+
+static void
+assert_paths(GSList *paths, const char *expected) {
+    GString *actual = g_string_new("");
+
+    CP_GSLIST_ITER(paths, path) {
+        if (actual->len > 0) {
+            g_string_append_c(actual, ' ');
+        }
+        g_string_append(actual, path);
+    } end_CP_GSLIST_ITER
+
+    g_assert_cmpstr(actual->str, ==, expected);
+    g_string_free(actual, TRUE);
+}
+
+static CPManifest
+open_manifest(void) {
+    CPManifest manifest;
+    char *path;
+    GError *error = NULL;
+
+    path = g_build_filename(dir, "roots/porttree/usr/portage/app-misc/foo/Manifest", NULL);
+    manifest = cp_manifest_new(path, &error);
+    g_assert_no_error(error);
+    g_assert(manifest != NULL);
+    g_free(path);
+
+    return manifest;
+}
+
+static void
+verify_distfiles(void) {
+    static const char * const files[] = {
+        "foo-1.0.patch", "unlisted.patch", NULL
+    };
+    CPManifest manifest = open_manifest();
+    char *distdir = g_build_filename(dir, "roots/porttree/distfiles", NULL);
+    GSList *failed;
+    GError *error = NULL;
+
+    g_assert(cp_manifest_verify_distfiles(manifest, distdir, NULL, 2, &failed, &error));
+    g_assert_no_error(error);
+    assert_paths(failed, "foo-1.0-extra.patch");
+    g_slist_free_full(failed, g_free);
+
+    g_assert(cp_manifest_verify_distfiles(manifest, distdir, files, 2, &failed, &error));
+    g_assert_no_error(error);
+    assert_paths(failed, "unlisted.patch");
+    g_slist_free_full(failed, g_free);
+
+    g_free(distdir);
+    cp_manifest_destroy(manifest);
+}
+
+static void
+verify_repository(void) {
+    CPSettings settings;
+    GSList *failed;
+    char *root;
+    GError *error = NULL;
+
+    root = g_build_filename(dir, "roots/porttree", NULL);
+    settings = cp_settings_new(root, NULL, &error);
+    g_assert_no_error(error);
+
+    g_assert(cp_repository_verify(
+        cp_settings_main_repository(settings), 2, &failed, &error
+    ));
+    g_assert_no_error(error);
+    assert_paths(failed, "sys-libs/bar/metadata.xml");
+    g_slist_free_full(failed, g_free);
+
+    cp_settings_unref(settings);
+    g_free(root);
+}
+
+static void
+syntax_error(void) {
+    char *tmp;
+    char *path;
+    GError *error = NULL;
+
+    tmp = g_dir_make_tmp("manifest_test_XXXXXX", &error);
+    g_assert_no_error(error);
+    path = g_build_filename(tmp, "Manifest", NULL);
+
+    g_assert(g_file_set_contents(path, "EBUILD foo-1.ebuild big SHA512 00\n", -1, &error));
+    g_assert_no_error(error);
+    g_assert(cp_manifest_new(path, &error) == NULL);
+    g_assert(error != NULL);
+    g_error_free(error);
+
+    g_assert(g_unlink(path) == 0);
+    g_assert(g_rmdir(tmp) == 0);
+    g_free(path);
+    g_free(tmp);
+}
+
+/**
+ * Writes \a len bytes of \a contents to \a rel_path under \a root,
+ * creating missing directories.
+ */
+static void
+write_repo_file(const char *root, const char *rel_path, const char *contents, gsize len) {
+    char *path = g_build_filename(root, rel_path, NULL);
+    char *parent = g_path_get_dirname(path);
+    GError *error = NULL;
+
+    g_assert(g_mkdir_with_parents(parent, 0755) == 0);
+    g_assert(g_file_set_contents(path, contents, (gssize)len, &error));
+    g_assert_no_error(error);
+
+    g_free(parent);
+    g_free(path);
+}
+
+/**
+ * Appends Manifest entry of \a type for \a rel_path with \a contents
+ * to \a manifest.
+ */
+static void
+add_entry(
+    GString *manifest,
+    const char *type,
+    const char *rel_path,
+    const char *contents,
+    gsize len
+) {
+    char *digest = g_compute_checksum_for_data(
+        G_CHECKSUM_SHA256, (const guchar *)contents, len
+    );
+
+    g_string_append_printf(manifest, "%s %s %" G_GSIZE_FORMAT " SHA256 %s\n",
+        type, rel_path, len, digest);
+    g_free(digest);
+}
+
+/**
+ * \return gzip-compressed \a contents, its size is stored in \a len
+ */
+static char *
+gzip(const char *contents, gsize *len) {
+    GZlibCompressor *compressor = g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+    gsize capacity = strlen(contents) + 1024;
+    char *result = g_malloc(capacity);
+    gsize bytes_read;
+    GError *error = NULL;
+
+    g_assert_cmpint(g_converter_convert(G_CONVERTER(compressor),
+        contents, strlen(contents), result, capacity, G_CONVERTER_INPUT_AT_END,
+        &bytes_read, len, &error), ==, G_CONVERTER_FINISHED);
+    g_assert_no_error(error);
+    g_assert_cmpuint(bytes_read, ==, strlen(contents));
+
+    g_object_unref(compressor);
+    return result;
+}
+
+static void
+remove_tree(const char *path) {
+    GDir *gdir = g_dir_open(path, 0, NULL);
+
+    if (gdir != NULL) {
+        CP_GDIR_ITER(gdir, name) {
+            char *child = g_build_filename(path, name, NULL);
+            remove_tree(child);
+            g_free(child);
+        } end_CP_GDIR_ITER
+        g_dir_close(gdir);
+        g_assert(g_rmdir(path) == 0);
+    } else {
+        g_assert(g_unlink(path) == 0);
+    }
+}
+
+static void
+assert_verify_glep74(const char *root, const char *expected) {
+    CPRepository repo = cp_repository_new(root);
+    GSList *failed;
+    GError *error = NULL;
+
+    g_assert(cp_repository_verify(repo, 2, &failed, &error));
+    g_assert_no_error(error);
+    assert_paths(failed, expected);
+
+    g_slist_free_full(failed, g_free);
+    cp_repository_unref(repo);
+}
+
+static void
+verify_glep74(void) {
+    static const char repo_name[] = "glep74\n";
+    static const char file[] = "abc";
+    GString *manifest = g_string_new("");
+    GString *nested = g_string_new("");
+    char *nested_gz;
+    gsize nested_len;
+    char *root;
+    GError *error = NULL;
+
+    root = g_dir_make_tmp("manifest_test_XXXXXX", &error);
+    g_assert_no_error(error);
+
+    write_repo_file(root, "profiles/repo_name", repo_name, strlen(repo_name));
+    write_repo_file(root, "cat/pkg/file", file, strlen(file));
+    write_repo_file(root, "cat/pkg/.hidden", "", 0);
+    write_repo_file(root, "distfiles/foo.tar.gz", "", 0);
+
+    add_entry(nested, "DATA", "pkg/file", file, strlen(file));
+    nested_gz = gzip(nested->str, &nested_len);
+    write_repo_file(root, "cat/Manifest.gz", nested_gz, nested_len);
+
+    g_string_append(manifest, "IGNORE distfiles\n");
+    add_entry(manifest, "DATA", "profiles/repo_name", repo_name, strlen(repo_name));
+    add_entry(manifest, "MANIFEST", "cat/Manifest.gz", nested_gz, nested_len);
+    write_repo_file(root, "Manifest", manifest->str, manifest->len);
+
+    assert_verify_glep74(root, "");
+
+    /* Entries of compressed Manifest are verified */
+    write_repo_file(root, "cat/pkg/file", "abd", 3);
+    assert_verify_glep74(root, "cat/pkg/file");
+    write_repo_file(root, "cat/pkg/file", file, strlen(file));
+
+    /* Porttree caches aren't expected to be listed */
+    write_repo_file(root, "metadata/glep74.cache", "", 0);
+    write_repo_file(root, "metadata/glep74.scan-cache", "", 0);
+    assert_verify_glep74(root, "");
+
+    /* Files that aren't listed anywhere are reported */
+    write_repo_file(root, "cat/pkg/stray", "", 0);
+    write_repo_file(root, "extra/notes", "", 0);
+    assert_verify_glep74(root, "cat/pkg/stray extra/notes");
+
+    remove_tree(root);
+    g_free(root);
+    g_free(nested_gz);
+    g_string_free(nested, TRUE);
+    g_string_free(manifest, TRUE);
+}
+
+/**
+ * Lists packages of repository in usr/portage under \a root with default
+ * settings, so that porttree writes its caches when it is freed.
+ */
+static void
+list_porttree(const char *root) {
+    CPSettings settings;
+    CPPorttree porttree;
+    CPTree tree;
+    CPPattern pattern;
+    GSList *match = NULL;
+    GError *error = NULL;
+
+    settings = cp_settings_new(root, NULL, &error);
+    g_assert_no_error(error);
+    porttree = cp_porttree_new(settings, &error);
+    g_assert_no_error(error);
+    tree = cp_porttree_get_tree(porttree);
+    pattern = cp_pattern_new("*/*", &error);
+    g_assert_no_error(error);
+    g_assert(cp_tree_find_pattern(tree, pattern, FALSE, &match, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(g_slist_length(match), ==, 1);
+
+    cp_package_list_free(match);
+    cp_pattern_destroy(pattern);
+    cp_tree_unref(tree);
+    cp_porttree_unref(porttree);
+    cp_settings_unref(settings);
+}
+
+static void
+verify_after_porttree(void) {
+    static const char repo_name[] = "cached\n";
+    static const char entry[] =
+        "EAPI=5\nSLOT=0\n_md5_=d41d8cd98f00b204e9800998ecf8427e\n";
+    GString *manifest = g_string_new("");
+    char *root;
+    char *portdir;
+    char *cache_path;
+    GError *error = NULL;
+
+    root = g_dir_make_tmp("manifest_test_XXXXXX", &error);
+    g_assert_no_error(error);
+    /* PORTDIR defaults to usr/portage inside root */
+    portdir = g_build_filename(root, "usr", "portage", NULL);
+    cache_path = g_build_filename(root, "var", "cache", "cportage", "cached.cache", NULL);
+
+    write_repo_file(portdir, "profiles/repo_name", repo_name, strlen(repo_name));
+    write_repo_file(portdir, "metadata/md5-cache/cat/pkg-1", entry, strlen(entry));
+    add_entry(manifest, "DATA", "profiles/repo_name", repo_name, strlen(repo_name));
+    add_entry(manifest, "DATA", "metadata/md5-cache/cat/pkg-1", entry, strlen(entry));
+    write_repo_file(portdir, "Manifest", manifest->str, manifest->len);
+
+    list_porttree(root);
+    g_assert(g_file_test(cache_path, G_FILE_TEST_IS_REGULAR));
+
+    /* Cache is kept outside of repository, so it passes verification */
+    assert_verify_glep74(portdir, "");
+
+    remove_tree(root);
+    g_free(cache_path);
+    g_free(portdir);
+    g_free(root);
+    g_string_free(manifest, TRUE);
+}
+
+static void
+verify_after_scan(void) {
+    static const char repo_name[] = "scanned\n";
+    static const char categories[] = "cat\n";
+    static const char ebuild[] = "EAPI=5\nSLOT=0\n";
+    GString *manifest = g_string_new("");
+    char *root;
+    char *portdir;
+    char *cache_path;
+    GError *error = NULL;
+
+    root = g_dir_make_tmp("manifest_test_XXXXXX", &error);
+    g_assert_no_error(error);
+    portdir = g_build_filename(root, "usr", "portage", NULL);
+    cache_path = g_build_filename(root, "var", "cache", "cportage", "scanned.scan-cache", NULL);
+
+    /* Repository without md5-cache, its ebuilds are scanned */
+    write_repo_file(portdir, "profiles/repo_name", repo_name, strlen(repo_name));
+    write_repo_file(portdir, "profiles/categories", categories, strlen(categories));
+    write_repo_file(portdir, "cat/pkg/pkg-1.ebuild", ebuild, strlen(ebuild));
+    add_entry(manifest, "DATA", "profiles/repo_name", repo_name, strlen(repo_name));
+    add_entry(manifest, "DATA", "profiles/categories", categories, strlen(categories));
+    add_entry(manifest, "DATA", "cat/pkg/pkg-1.ebuild", ebuild, strlen(ebuild));
+    write_repo_file(portdir, "Manifest", manifest->str, manifest->len);
+
+    list_porttree(root);
+    g_assert(g_file_test(cache_path, G_FILE_TEST_IS_REGULAR));
+
+    /* Scan cache is kept outside of repository too */
+    assert_verify_glep74(portdir, "");
+
+    remove_tree(root);
+    g_free(cache_path);
+    g_free(portdir);
+    g_free(root);
+    g_string_free(manifest, TRUE);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_assert(argc == 2);
+    dir = argv[1];
+
+    g_test_add_func("/manifest/verify_distfiles", verify_distfiles);
+    g_test_add_func("/manifest/verify_repository", verify_repository);
+    g_test_add_func("/manifest/verify_glep74", verify_glep74);
+    g_test_add_func("/manifest/verify_after_porttree", verify_after_porttree);
+    g_test_add_func("/manifest/verify_after_scan", verify_after_scan);
+    g_test_add_func("/manifest/syntax_error", syntax_error);
+
+    return g_test_run();
+}
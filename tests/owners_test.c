@@ -0,0 +1,112 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include <cportage.h>
+
+static char *dir;
+
+static CPOwners owners_index;
+
+static void
+assert_owners(GSList *pkgs, const char *expected) {
+    GString *actual = g_string_new("");
+
+    CP_GSLIST_ITER(pkgs, pkg) {
+        if (actual->len > 0) {
+            g_string_append_c(actual, ' ');
+        }
+        g_string_append(actual, pkg);
+    } end_CP_GSLIST_ITER
+
+    g_assert_cmpstr(actual->str, ==, expected);
+
+    g_string_free(actual, TRUE);
+    g_slist_free(pkgs);
+}
+
+static void
+find_file(void) {
+    assert_owners(cp_owners_find(owners_index, "/usr/bin/foo"), "app-misc/foo-1.0");
+    assert_owners(cp_owners_find(owners_index, "/usr/lib/libbar.so"), "sys-libs/bar-2");
+    assert_owners(cp_owners_find(owners_index, "/usr/bin/bar"), "");
+}
+
+static void
+find_spaces(void) {
+    assert_owners(cp_owners_find(owners_index, "/usr/bin/foo alias"), "app-misc/foo-1.0");
+    assert_owners(cp_owners_find(owners_index, "/usr/share/foo/data file"), "app-misc/foo-1.0");
+}
+
+static void
+find_shared_dir(void) {
+    assert_owners(cp_owners_find(owners_index, "/usr"), "app-misc/foo-1.0 sys-libs/bar-2");
+    assert_owners(cp_owners_find(owners_index, "/usr/"), "app-misc/foo-1.0 sys-libs/bar-2");
+}
+
+static void
+find_dir(void) {
+    assert_owners(cp_owners_find_dir(owners_index, "/usr/lib"), "sys-libs/bar-2");
+    assert_owners(cp_owners_find_dir(owners_index, "/usr/share/"), "app-misc/foo-1.0");
+    assert_owners(cp_owners_find_dir(owners_index, "/"), "app-misc/foo-1.0 sys-libs/bar-2");
+    /* Shouldn't match /usr/lib */
+    assert_owners(cp_owners_find_dir(owners_index, "/usr/li"), "");
+}
+
+int
+main(int argc, char *argv[]) {
+    char *root;
+    GTree *defaults;
+    CPSettings settings;
+    CPVartree vartree;
+    GError *error = NULL;
+    int result;
+
+    g_test_init(&argc, &argv, NULL);
+
+    g_assert(argc == 2);
+    dir = argv[1];
+
+    root = g_build_filename(dir, "roots/owners", NULL);
+    defaults = g_tree_new_full((GCompareDataFunc)strcmp, NULL, g_free, g_free);
+    g_tree_insert(defaults, g_strdup("PORTDIR"), g_strdup("/tmp"));
+
+    settings = cp_settings_new(root, defaults, &error);
+    g_assert_no_error(error);
+    vartree = cp_vartree_new(settings, &error);
+    g_assert_no_error(error);
+    owners_index = cp_owners_new(settings, vartree, &error);
+    g_assert_no_error(error);
+
+    g_test_add_func("/owners/find_file", find_file);
+    g_test_add_func("/owners/find_spaces", find_spaces);
+    g_test_add_func("/owners/find_shared_dir", find_shared_dir);
+    g_test_add_func("/owners/find_dir", find_dir);
+
+    result = g_test_run();
+
+    cp_owners_unref(owners_index);
+    cp_vartree_unref(vartree);
+    cp_settings_unref(settings);
+    g_tree_unref(defaults);
+    g_free(root);
+
+    return result;
+}
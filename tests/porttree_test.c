@@ -0,0 +1,467 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include <cportage.h>
+
+static char *dir;
+
+static CPPorttree porttree;
+
+static CPAtomFactory atom_factory;
+
+static void
+assert_packages(GSList *pkgs, const char *expected) {
+    GString *actual = g_string_new("");
+
+    CP_GSLIST_ITER(pkgs, pkg) {
+        if (actual->len > 0) {
+            g_string_append_c(actual, ' ');
+        }
+        g_string_append(actual, cp_package_str(pkg));
+    } end_CP_GSLIST_ITER
+
+    g_assert_cmpstr(actual->str, ==, expected);
+    g_string_free(actual, TRUE);
+}
+
+static void
+assert_match(const char *atom_str, const char *expected) {
+    CPAtom atom;
+    CPTree tree;
+    GSList *match = NULL;
+    GError *error = NULL;
+
+    atom = cp_atom_new(atom_factory, CP_EAPI_LATEST, atom_str, &error);
+    g_assert_no_error(error);
+    tree = cp_porttree_get_tree(porttree);
+    g_assert(cp_tree_find_packages(tree, atom, TRUE, &match, &error));
+    g_assert_no_error(error);
+
+    assert_packages(match, expected);
+
+    cp_package_list_free(match);
+    cp_tree_unref(tree);
+    cp_atom_unref(atom);
+}
+
+static void
+find_packages(void) {
+    assert_match("app-misc/foo", "app-misc/foo-1.0 app-misc/foo-2");
+    assert_match(">=app-misc/foo-2", "app-misc/foo-2");
+    assert_match("app-misc/foo:0", "app-misc/foo-1.0");
+    assert_match("app-misc/foo::test", "app-misc/foo-1.0 app-misc/foo-2");
+    /* No EAPI key means EAPI 0 */
+    assert_match("sys-libs/bar", "sys-libs/bar-1");
+    assert_match("app-misc/bar", "");
+    assert_match("nonexistent/foo", "");
+}
+
+static void
+assert_metadata(const char *atom_str, const char *keywords, const char *slot) {
+    const char * const keys[] = { "KEYWORDS", "SLOT", "RDEPEND", NULL };
+    char *values[3];
+    CPAtom atom;
+    CPTree tree;
+    GSList *match = NULL;
+    GError *error = NULL;
+
+    atom = cp_atom_new(atom_factory, CP_EAPI_LATEST, atom_str, &error);
+    g_assert_no_error(error);
+    tree = cp_porttree_get_tree(porttree);
+    g_assert(cp_tree_find_packages(tree, atom, FALSE, &match, &error));
+    g_assert_no_error(error);
+    g_assert(match != NULL);
+
+    g_assert(cp_porttree_get_metadata(porttree, match->data, keys, values, &error));
+    g_assert_no_error(error);
+    g_assert_cmpstr(values[0], ==, keywords);
+    g_assert_cmpstr(values[1], ==, slot);
+    g_assert(values[2] == NULL);
+
+    g_free(values[0]);
+    g_free(values[1]);
+    cp_package_list_free(match);
+    cp_tree_unref(tree);
+    cp_atom_unref(atom);
+}
+
+static void
+metadata(void) {
+    assert_metadata("=app-misc/foo-1.0", "amd64 x86", "0");
+    assert_metadata("=app-misc/foo-2", "~amd64", "2/2.1");
+    assert_metadata("sys-libs/bar", NULL, "0");
+    /* Entries that were read are kept in memory */
+    assert_metadata("=app-misc/foo-1.0", "amd64 x86", "0");
+}
+
+static gboolean
+collect_package(const CPPackage package, void *user_data) {
+    GString *actual = user_data;
+
+    if (actual->len > 0) {
+        g_string_append_c(actual, ' ');
+    }
+    g_string_append(actual, cp_package_str(package));
+    return TRUE;
+}
+
+static void
+foreach(void) {
+    CPTree tree = cp_porttree_get_tree(porttree);
+    GString *actual = g_string_new("");
+    GError *error = NULL;
+
+    g_assert(cp_tree_foreach(tree, collect_package, actual, &error));
+    g_assert_no_error(error);
+    g_assert_cmpstr(actual->str, ==, "app-misc/foo-1.0 app-misc/foo-2 sys-libs/bar-1");
+
+    g_string_free(actual, TRUE);
+    cp_tree_unref(tree);
+}
+
+static void
+assert_pattern(const char *pattern_str, const char *expected) {
+    CPPattern pattern;
+    CPTree tree;
+    GSList *match = NULL;
+    GError *error = NULL;
+
+    pattern = cp_pattern_new(pattern_str, &error);
+    g_assert_no_error(error);
+    tree = cp_porttree_get_tree(porttree);
+    g_assert(cp_tree_find_pattern(tree, pattern, TRUE, &match, &error));
+    g_assert_no_error(error);
+
+    assert_packages(match, expected);
+
+    cp_package_list_free(match);
+    cp_tree_unref(tree);
+    cp_pattern_destroy(pattern);
+}
+
+static void
+find_pattern(void) {
+    assert_pattern("app-misc/*", "app-misc/foo-1.0 app-misc/foo-2");
+    assert_pattern("*/bar", "sys-libs/bar-1");
+    assert_pattern("*/*", "app-misc/foo-1.0 app-misc/foo-2 sys-libs/bar-1");
+    assert_pattern("nonexistent/*", "");
+}
+
+static void
+assert_stale(const char *expected) {
+    GSList *stale = NULL;
+    GString *actual = g_string_new("");
+    GError *error = NULL;
+
+    g_assert(cp_porttree_validate_cache(porttree, &stale, &error));
+    g_assert_no_error(error);
+
+    CP_GSLIST_ITER(stale, entry) {
+        if (actual->len > 0) {
+            g_string_append_c(actual, ' ');
+        }
+        g_string_append(actual, entry);
+    } end_CP_GSLIST_ITER
+
+    g_assert_cmpstr(actual->str, ==, expected);
+
+    g_slist_free_full(stale, g_free);
+    g_string_free(actual, TRUE);
+}
+
+static void
+validate_cache(void) {
+    /* foo-2 ebuild changed, foo-3 has no ebuild */
+    assert_stale("app-misc/foo-2::test app-misc/foo-3::test");
+}
+
+static CPPorttree
+new_cached_porttree(const char *cache_dir) {
+    GTree *defaults;
+    CPSettings settings;
+    CPPorttree result;
+    char *root;
+    GError *error = NULL;
+
+    root = g_build_filename(dir, "roots/porttree", NULL);
+    defaults = g_tree_new_full((GCompareDataFunc)strcmp, NULL, g_free, g_free);
+    g_tree_insert(defaults, g_strdup("CPORTAGE_PORTTREE_CACHE_DIR"), g_strdup(cache_dir));
+
+    settings = cp_settings_new(root, defaults, &error);
+    g_assert_no_error(error);
+    result = cp_porttree_new(settings, &error);
+    g_assert_no_error(error);
+
+    cp_settings_unref(settings);
+    g_tree_unref(defaults);
+    g_free(root);
+
+    return result;
+}
+
+static void
+check_cached_porttree(void) {
+    find_packages();
+    metadata();
+    foreach();
+    find_pattern();
+}
+
+/**
+ * Replaces first NUL-delimited \a from string of file \a path with \a to
+ * of the same length.
+ */
+static void
+patch_cache_string(const char *path, const char *from, const char *to) {
+    char *contents;
+    gsize length;
+    gsize from_len = strlen(from) + 2;
+    gsize i;
+    GError *error = NULL;
+
+    g_assert_cmpuint(strlen(from), ==, strlen(to));
+    g_assert(g_file_get_contents(path, &contents, &length, &error));
+    g_assert_no_error(error);
+
+    for (i = 0; i + from_len <= length; ++i) {
+        if (contents[i] == '\0' && contents[i + from_len - 1] == '\0'
+                && memcmp(&contents[i + 1], from, from_len - 2) == 0) {
+            break;
+        }
+    }
+    g_assert(i + from_len <= length);
+    memcpy(&contents[i + 1], to, from_len - 2);
+
+    g_assert(g_file_set_contents(path, contents, (gssize)length, &error));
+    g_assert_no_error(error);
+    g_free(contents);
+}
+
+static void
+cache(void) {
+    CPPorttree uncached = porttree;
+    char *cache_dir;
+    char *cache_path;
+    GError *error = NULL;
+
+    cache_dir = g_dir_make_tmp("porttree_test.XXXXXX", &error);
+    g_assert_no_error(error);
+    cache_path = g_build_filename(cache_dir, "test.cache", NULL);
+
+    /* Cold: cache is written by update */
+    porttree = new_cached_porttree(cache_dir);
+    check_cached_porttree();
+    g_assert(cp_porttree_update_cache(porttree, &error));
+    g_assert_no_error(error);
+    g_assert(g_file_test(cache_path, G_FILE_TEST_IS_REGULAR));
+    cp_porttree_unref(porttree);
+
+    /* Warm: everything comes from cache */
+    porttree = new_cached_porttree(cache_dir);
+    check_cached_porttree();
+    cp_porttree_unref(porttree);
+
+    /* Cache with a version that doesn't parse is ignored and rewritten */
+    patch_cache_string(cache_path, "1.0", "1.x");
+    porttree = new_cached_porttree(cache_dir);
+    check_cached_porttree();
+    g_assert(cp_porttree_update_cache(porttree, &error));
+    g_assert_no_error(error);
+    cp_porttree_unref(porttree);
+
+    /* Corrupt cache is ignored and rewritten */
+    g_assert(g_file_set_contents(cache_path, "CPPTCACH garbage", -1, &error));
+    g_assert_no_error(error);
+    porttree = new_cached_porttree(cache_dir);
+    check_cached_porttree();
+    cp_porttree_unref(porttree);
+
+    porttree = new_cached_porttree(cache_dir);
+    check_cached_porttree();
+    cp_porttree_unref(porttree);
+
+    porttree = uncached;
+    g_assert(g_unlink(cache_path) == 0);
+    g_assert(g_rmdir(cache_dir) == 0);
+    g_free(cache_path);
+    g_free(cache_dir);
+}
+
+static CPPorttree
+new_overlay_porttree(const char *cache_dir) {
+    GTree *defaults;
+    CPSettings settings;
+    CPPorttree result;
+    char *root;
+    GError *error = NULL;
+
+    root = g_build_filename(dir, "roots/porttree", NULL);
+    defaults = g_tree_new_full((GCompareDataFunc)strcmp, NULL, g_free, g_free);
+    g_tree_insert(defaults, g_strdup("PORTDIR_OVERLAY"),
+        g_build_filename(root, "usr/local/overlay", NULL));
+    g_tree_insert(defaults, g_strdup("CPORTAGE_PORTTREE_CACHE_DIR"), g_strdup(cache_dir));
+
+    settings = cp_settings_new(root, defaults, &error);
+    g_assert_no_error(error);
+    result = cp_porttree_new(settings, &error);
+    g_assert_no_error(error);
+
+    cp_settings_unref(settings);
+    g_tree_unref(defaults);
+    g_free(root);
+
+    return result;
+}
+
+static void
+check_overlay_porttree(void) {
+    CPTree tree = cp_porttree_get_tree(porttree);
+    GString *actual = g_string_new("");
+    GError *error = NULL;
+
+    assert_match("app-misc/foo::overlay", "app-misc/foo-2");
+    assert_match("app-misc/foo:3", "app-misc/foo-2");
+    /* SLOT="${PV}" needs bash, so baz-1.1 is skipped */
+    assert_match("dev-util/baz", "dev-util/baz-1.0");
+    /* Category isn't in profiles/categories */
+    assert_match("unlisted/qux", "");
+    assert_metadata("dev-util/baz", "~amd64 x86", "0");
+
+    g_assert(cp_tree_foreach(tree, collect_package, actual, &error));
+    g_assert_no_error(error);
+    g_assert_cmpstr(actual->str, ==, "app-misc/foo-1.0 app-misc/foo-2 app-misc/foo-2"
+        " dev-util/baz-1.0 sys-libs/bar-1");
+
+    g_string_free(actual, TRUE);
+    cp_tree_unref(tree);
+}
+
+static void
+overlay(void) {
+    CPPorttree uncached = porttree;
+    char *cache_dir;
+    char *cache_path;
+    char *scan_cache_path;
+    GError *error = NULL;
+
+    cache_dir = g_dir_make_tmp("porttree_test.XXXXXX", &error);
+    g_assert_no_error(error);
+    cache_path = g_build_filename(cache_dir, "test.cache", NULL);
+    scan_cache_path = g_build_filename(cache_dir, "overlay.scan-cache", NULL);
+
+    /* Cold: overlay has no md5-cache, so its ebuilds are scanned */
+    porttree = new_overlay_porttree(cache_dir);
+    check_overlay_porttree();
+    g_assert(cp_porttree_update_cache(porttree, &error));
+    g_assert_no_error(error);
+    g_assert(g_file_test(scan_cache_path, G_FILE_TEST_IS_REGULAR));
+    cp_porttree_unref(porttree);
+
+    /* Warm: package directories weren't modified */
+    porttree = new_overlay_porttree(cache_dir);
+    check_overlay_porttree();
+    cp_porttree_unref(porttree);
+
+    porttree = uncached;
+    g_assert(g_unlink(scan_cache_path) == 0);
+    g_assert(g_unlink(cache_path) == 0);
+    g_assert(g_rmdir(cache_dir) == 0);
+    g_free(scan_cache_path);
+    g_free(cache_path);
+    g_free(cache_dir);
+}
+
+static void
+snapshot(void) {
+    CPPorttree unpacked = porttree;
+    GTree *defaults;
+    CPSettings settings;
+    char *root;
+    GError *error = NULL;
+
+    root = g_build_filename(dir, "roots/porttree", NULL);
+    defaults = g_tree_new_full((GCompareDataFunc)strcmp, NULL, g_free, g_free);
+    g_tree_insert(defaults, g_strdup("PORTDIR_OVERLAY"),
+        g_build_filename(dir, "roots/snapshot.tar", NULL));
+    g_tree_insert(defaults, g_strdup("CPORTAGE_PORTTREE_CACHE"), g_strdup("false"));
+
+    settings = cp_settings_new(root, defaults, &error);
+    g_assert_no_error(error);
+    porttree = cp_porttree_new(settings, &error);
+    g_assert_no_error(error);
+
+    assert_match("app-misc/qux::snap", "app-misc/qux-1");
+    assert_metadata("app-misc/qux", "amd64", "0");
+    /* Snapshot inherits foo eclass from its master */
+    assert_stale("app-misc/foo-2::test app-misc/foo-3::test");
+
+    cp_porttree_unref(porttree);
+    porttree = unpacked;
+    cp_settings_unref(settings);
+    g_tree_unref(defaults);
+    g_free(root);
+}
+
+int
+main(int argc, char *argv[]) {
+    GTree *defaults;
+    CPSettings settings;
+    char *root;
+    GError *error = NULL;
+    int result;
+
+    g_test_init(&argc, &argv, NULL);
+
+    g_assert(argc == 2);
+    dir = argv[1];
+
+    root = g_build_filename(dir, "roots/porttree", NULL);
+    /* PORTDIR defaults to usr/portage inside root */
+    defaults = g_tree_new_full((GCompareDataFunc)strcmp, NULL, g_free, g_free);
+    g_tree_insert(defaults, g_strdup("CPORTAGE_PORTTREE_CACHE"), g_strdup("false"));
+
+    settings = cp_settings_new(root, defaults, &error);
+    g_assert_no_error(error);
+    porttree = cp_porttree_new(settings, &error);
+    g_assert_no_error(error);
+    atom_factory = cp_atom_factory_new();
+
+    g_test_add_func("/porttree/find_packages", find_packages);
+    g_test_add_func("/porttree/metadata", metadata);
+    g_test_add_func("/porttree/foreach", foreach);
+    g_test_add_func("/porttree/find_pattern", find_pattern);
+    g_test_add_func("/porttree/cache", cache);
+    g_test_add_func("/porttree/overlay", overlay);
+    g_test_add_func("/porttree/validate_cache", validate_cache);
+    g_test_add_func("/porttree/snapshot", snapshot);
+
+    result = g_test_run();
+
+    cp_atom_factory_unref(atom_factory);
+    cp_porttree_unref(porttree);
+    cp_settings_unref(settings);
+    g_tree_unref(defaults);
+    g_free(root);
+
+    return result;
+}
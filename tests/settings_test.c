@@ -20,11 +20,12 @@
 #include <string.h>
 
 #include <cportage.h>
+#include <cportage/settings.h>
 
 static char *dir;
 
-static void
-test_var(const char *test_dir, const char *var, const char *expected_value) {
+static CPSettings
+new_settings(const char *test_dir) {
     char *root = g_build_filename(dir, test_dir, NULL);
     GError *error = NULL;
     CPSettings settings;
@@ -42,10 +43,18 @@ test_var(const char *test_dir, const char *var, const char *expected_value) {
     g_tree_unref(defaults);
 
     g_assert_no_error(error);
+
+    g_free(root);
+    return settings;
+}
+
+static void
+test_var(const char *test_dir, const char *var, const char *expected_value) {
+    CPSettings settings = new_settings(test_dir);
+
     g_assert_cmpstr(cp_settings_get(settings, var), ==, expected_value);
 
     cp_settings_unref(settings);
-    g_free(root);
 }
 
 static void
@@ -60,12 +69,29 @@ profiles_order(void) {
 
 static void
 incrementals(void) {
+    CPSettings settings;
+
     test_var("roots/incrementals", "USE", "use1 use3 use5");
+
+    /* Negations are kept for IUSE defaults, see cp_use_new() */
+    settings = new_settings("roots/incrementals");
+    g_assert_cmpstr(cp_settings_disabled_use(settings), ==, "use2 use4 use6");
+    g_assert(cp_settings_get(settings, "CPORTAGE_USE_DISABLED") == NULL);
+    cp_settings_unref(settings);
 }
 
 static void
 use_mask(void) {
+    CPSettings settings;
+
     test_var("roots/use_mask", "USE", "normal unmasked");
+
+    /* USE engine applies use.mask per package, see cp_use_new() */
+    settings = new_settings("roots/use_mask");
+    g_assert_cmpstr(cp_settings_configured_use(settings), ==,
+        "masked normal parent_masked unmasked");
+    g_assert(cp_settings_get(settings, "CPORTAGE_USE_CONFIGURED") == NULL);
+    cp_settings_unref(settings);
 }
 
 static void
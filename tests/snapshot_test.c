@@ -0,0 +1,247 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include <cportage.h>
+#include <cportage/repository.h>
+#include <cportage/snapshot.h>
+
+#define LONG_NAME "a-license-with-a-name-longer-than-one-hundred-characters" \
+    "-which-needs-a-gnu-long-name-header-in-tar-archives"
+
+static char *dir;
+
+static void
+assert_list(CPSnapshot snapshot, const char *path, const char *expected) {
+    char **names;
+    char *actual;
+    GError *error = NULL;
+
+    names = cp_snapshot_list(snapshot, path, &error);
+    g_assert_no_error(error);
+    cp_strings_sort(names);
+    actual = g_strjoinv(" ", names);
+    g_assert_cmpstr(actual, ==, expected);
+
+    g_free(actual);
+    g_strfreev(names);
+}
+
+static void
+assert_contents(CPSnapshot snapshot, const char *path, const char *expected) {
+    GBytes *bytes;
+    gsize length;
+    const char *data;
+    GError *error = NULL;
+
+    bytes = cp_snapshot_read(snapshot, path, &error);
+    g_assert_no_error(error);
+    data = g_bytes_get_data(bytes, &length);
+    g_assert_cmpuint(length, ==, strlen(expected));
+    g_assert(memcmp(data, expected, length) == 0);
+
+    g_bytes_unref(bytes);
+}
+
+static void
+read_members(void) {
+    CPSnapshot snapshot;
+    CPTimestamp mtime;
+    gboolean is_dir;
+    char *path;
+    GError *error = NULL;
+
+    path = g_build_filename(dir, "roots/snapshot.tar", NULL);
+    snapshot = cp_snapshot_open(path, &error);
+    g_assert_no_error(error);
+
+    /* Top-level portage/ directory is entered */
+    assert_list(snapshot, "", "app-misc licenses metadata profiles");
+    assert_list(snapshot, "metadata/md5-cache/app-misc", "qux-1");
+    assert_list(snapshot, "licenses", LONG_NAME);
+
+    g_assert(cp_snapshot_stat(snapshot, "app-misc/qux", &mtime, &is_dir));
+    g_assert(is_dir);
+    g_assert_cmpuint(mtime.sec, ==, 1400000000);
+    g_assert(cp_snapshot_stat(snapshot, "profiles/repo_name", &mtime, &is_dir));
+    g_assert(!is_dir);
+    g_assert(!cp_snapshot_stat(snapshot, "portage", &mtime, &is_dir));
+
+    assert_contents(snapshot, "profiles/repo_name", "snap\n");
+    assert_contents(snapshot, "licenses/" LONG_NAME, "Long name\n");
+
+    g_assert(cp_snapshot_read(snapshot, "nonexistent", &error) == NULL);
+    g_assert_error(error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+    g_clear_error(&error);
+    g_assert(cp_snapshot_read(snapshot, "profiles", &error) == NULL);
+    g_assert_error(error, G_FILE_ERROR, G_FILE_ERROR_ISDIR);
+    g_clear_error(&error);
+    g_assert(cp_snapshot_list(snapshot, "profiles/repo_name", &error) == NULL);
+    g_assert_error(error, G_FILE_ERROR, G_FILE_ERROR_NOTDIR);
+    g_clear_error(&error);
+
+    cp_snapshot_destroy(snapshot);
+    g_free(path);
+}
+
+static void
+repository(void) {
+    CPRepository repo;
+    char **masters;
+    char **lines;
+    char *path;
+    GError *error = NULL;
+
+    path = g_build_filename(dir, "roots/snapshot.tar", NULL);
+    repo = cp_repository_new(path);
+
+    g_assert(cp_repository_is_snapshot(repo));
+    g_assert_cmpstr(cp_repository_name(repo), ==, "snap");
+    masters = cp_repository_masters(repo);
+    g_assert(masters != NULL);
+    g_assert_cmpstr(masters[0], ==, "test");
+    g_assert(masters[1] == NULL);
+
+    lines = cp_repository_getlines(repo, "profiles/categories", &error);
+    g_assert_no_error(error);
+    g_assert_cmpstr(lines[0], ==, "app-misc");
+    g_assert(lines[1] == NULL);
+
+    g_strfreev(lines);
+    cp_repository_unref(repo);
+    g_free(path);
+}
+
+/** Appends ustar header of member \a name to \a tar. */
+static void
+append_header(GString *tar, const char *name, char type, gsize size) {
+    char header[512];
+    guint sum = 0;
+    gsize i;
+
+    memset(header, 0, sizeof(header));
+    strcpy(header, name);
+    (void)g_snprintf(&header[100], 8, "%07o", 0644);
+    (void)g_snprintf(&header[124], 12, "%011o", (guint)size);
+    (void)g_snprintf(&header[136], 12, "%011o", 1400000000U);
+    header[156] = type;
+    memcpy(&header[257], "ustar\0" "00", 8);
+    memset(&header[148], ' ', 8);
+    for (i = 0; i < sizeof(header); ++i) {
+        sum += (guchar)header[i];
+    }
+    (void)g_snprintf(&header[148], 8, "%06o", sum);
+
+    (void)g_string_append_len(tar, header, (gssize)sizeof(header));
+}
+
+/** Appends \a data padded to whole blocks to \a tar. */
+static void
+append_data(GString *tar, const char *data) {
+    gsize len = strlen(data);
+
+    (void)g_string_append_len(tar, data, (gssize)len);
+    while (tar->len % 512 != 0) {
+        (void)g_string_append_c(tar, '\0');
+    }
+}
+
+/**
+ * Opens archive of file "file" preceded by pax header of \a records.
+ *
+ * \return snapshot or %NULL if it couldn't be opened
+ */
+static CPSnapshot
+open_pax(const char *records, GError **error) {
+    GString *tar = g_string_new("");
+    CPSnapshot result;
+    char *path = NULL;
+    GError *tmp_error = NULL;
+    int fd;
+
+    append_header(tar, "PaxHeader", 'x', strlen(records));
+    append_data(tar, records);
+    append_header(tar, "file", '0', 5);
+    append_data(tar, "data\n");
+    /* End of archive is two zero blocks */
+    (void)g_string_set_size(tar, tar->len + 1024);
+    memset(&tar->str[tar->len - 1024], 0, 1024);
+
+    fd = g_file_open_tmp("snapshot_test.XXXXXX", &path, &tmp_error);
+    g_assert_no_error(tmp_error);
+    (void)close(fd);
+    g_assert(g_file_set_contents(path, tar->str, (gssize)tar->len, &tmp_error));
+    g_assert_no_error(tmp_error);
+
+    result = cp_snapshot_open(path, error);
+
+    (void)g_unlink(path);
+    g_free(path);
+    (void)g_string_free(tar, TRUE);
+    return result;
+}
+
+static void
+malformed_pax(void) {
+    static const char * const malformed[] = {
+        /* Record ends before key and value */
+        "5 path=foo\n",
+        /* Record doesn't end with newline */
+        "11 path=foo\n",
+        /* No '=' inside the record */
+        "12 pathfoox\n",
+        /* Longer than header */
+        "99 path=foo\n",
+        /* No length */
+        " path=foo\n",
+        NULL
+    };
+    CPSnapshot snapshot;
+    GError *error = NULL;
+    guint i;
+
+    snapshot = open_pax("12 path=foo\n", &error);
+    g_assert_no_error(error);
+    assert_contents(snapshot, "foo", "data\n");
+    cp_snapshot_destroy(snapshot);
+
+    for (i = 0; malformed[i] != NULL; ++i) {
+        g_assert(open_pax(malformed[i], &error) == NULL);
+        g_assert_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+        g_clear_error(&error);
+    }
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_assert(argc == 2);
+    dir = argv[1];
+
+    g_test_add_func("/snapshot/read", read_members);
+    g_test_add_func("/snapshot/repository", repository);
+    g_test_add_func("/snapshot/malformed_pax", malformed_pax);
+
+    return g_test_run();
+}
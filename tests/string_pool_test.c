@@ -0,0 +1,139 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include <cportage/string_pool.h>
+
+static void
+intern(void) {
+    CPStringPool pool = cp_string_pool_new();
+    CPStringRef gpl;
+    CPStringRef mit;
+    CPStringRef found;
+
+    g_assert_cmpuint(cp_string_pool_intern(pool, "", 0), ==, 0);
+    g_assert_cmpstr(cp_string_pool_get(pool, 0), ==, "");
+
+    /* Only first len bytes are stored */
+    gpl = cp_string_pool_intern(pool, "GPL-2 MIT", 5);
+    mit = cp_string_pool_intern(pool, "MIT", 3);
+    g_assert_cmpuint(gpl, !=, mit);
+    g_assert_cmpstr(cp_string_pool_get(pool, gpl), ==, "GPL-2");
+    g_assert_cmpstr(cp_string_pool_get(pool, mit), ==, "MIT");
+    g_assert_cmpuint(cp_string_pool_intern(pool, "GPL-2", 5), ==, gpl);
+
+    g_assert(cp_string_pool_lookup(pool, "MIT", &found));
+    g_assert_cmpuint(found, ==, mit);
+    g_assert(!cp_string_pool_lookup(pool, "GPL", &found));
+
+    cp_string_pool_destroy(pool);
+}
+
+static void
+many(void) {
+    CPStringPool pool = cp_string_pool_new();
+    GString *big = g_string_new("");
+    CPStringRef *refs = g_new(CPStringRef, 10000);
+    CPStringRef big_ref;
+    gsize memory;
+    guint i;
+
+    /* Fills several chunks and grows index */
+    for (i = 0; i < 10000; ++i) {
+        char *str = g_strdup_printf("dev-libs/foo-%u", i);
+
+        refs[i] = cp_string_pool_intern(pool, str, strlen(str));
+        g_free(str);
+    }
+
+    /* Bigger than a chunk */
+    while (big->len < 100000) {
+        g_string_append(big, ">=dev-libs/glib-2.36:2 ");
+    }
+    big_ref = cp_string_pool_intern(pool, big->str, big->len);
+
+    memory = cp_string_pool_memory(pool);
+    for (i = 0; i < 10000; ++i) {
+        char *str = g_strdup_printf("dev-libs/foo-%u", i);
+
+        g_assert_cmpstr(cp_string_pool_get(pool, refs[i]), ==, str);
+        g_assert_cmpuint(cp_string_pool_intern(pool, str, strlen(str)), ==, refs[i]);
+        g_free(str);
+    }
+    g_assert_cmpstr(cp_string_pool_get(pool, big_ref), ==, big->str);
+    g_assert_cmpuint(cp_string_pool_intern(pool, big->str, big->len), ==, big_ref);
+    g_assert_cmpuint(cp_string_pool_memory(pool), ==, memory);
+
+    g_string_free(big, TRUE);
+    g_free(refs);
+    cp_string_pool_destroy(pool);
+}
+
+static void
+dedup(void) {
+    CPStringPool pool = cp_string_pool_new();
+    gsize raw = 0;
+    guint i;
+
+    /* md5-cache entries of a category share most of their values */
+    for (i = 0; i < 2000; ++i) {
+        char *entry = g_strdup_printf(
+            "DEFINED_PHASES=compile configure install prepare test\n"
+            "DEPEND=>=dev-libs/glib-2.36:2 virtual/pkgconfig sys-devel/gettext\n"
+            "DESCRIPTION=Package number %u\n"
+            "EAPI=5\n"
+            "HOMEPAGE=https://www.gentoo.org/\n"
+            "KEYWORDS=~alpha amd64 arm ~hppa ~ia64 ppc ppc64 sparc x86\n"
+            "LICENSE=GPL-2\n"
+            "RDEPEND=>=dev-libs/glib-2.36:2\n"
+            "SLOT=0\n"
+            "_eclasses_=eutils 06133990e861be0fe60c2b428fd025d9"
+            " multilib 165fc17c38d1b11dac2008280dab6e80\n"
+            "_md5_=%032x\n", i, i);
+        const char *line = entry;
+
+        while (*line != '\0') {
+            const char *eol = strchr(line, '\n');
+            const char *eq = memchr(line, '=', (size_t)(eol - line));
+
+            (void)cp_string_pool_intern(pool, line, (size_t)(eq - line));
+            (void)cp_string_pool_intern(pool, eq + 1, (size_t)(eol - eq - 1));
+            line = eol + 1;
+        }
+
+        raw += strlen(entry);
+        g_free(entry);
+    }
+
+    g_assert_cmpuint(cp_string_pool_memory(pool), <, raw);
+
+    cp_string_pool_destroy(pool);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/string_pool/intern", intern);
+    g_test_add_func("/string_pool/many", many);
+    g_test_add_func("/string_pool/dedup", dedup);
+
+    return g_test_run();
+}
@@ -0,0 +1,197 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include <cportage.h>
+#include <cportage/dep_eval.h>
+#include <cportage/use.h>
+
+static char *dir;
+
+static CPPorttree porttree;
+
+static CPUse use;
+
+static CPAtomFactory atom_factory;
+
+static CPSettings
+new_settings(const char *use_default) {
+    GTree *defaults;
+    CPSettings settings;
+    char *root;
+    GError *error = NULL;
+
+    root = g_build_filename(dir, "roots/use", NULL);
+    defaults = g_tree_new_full((GCompareDataFunc)strcmp, NULL, g_free, g_free);
+    g_tree_insert(defaults, g_strdup("CPORTAGE_PORTTREE_CACHE"), g_strdup("false"));
+    if (use_default != NULL) {
+        g_tree_insert(defaults, g_strdup("USE"), g_strdup(use_default));
+    }
+
+    settings = cp_settings_new(root, defaults, &error);
+    g_assert_no_error(error);
+
+    g_tree_unref(defaults);
+    g_free(root);
+
+    return settings;
+}
+
+static CPPackage
+find_package(const char *atom_str) {
+    CPAtom atom;
+    CPTree tree;
+    CPPackage result;
+    GSList *match = NULL;
+    GError *error = NULL;
+
+    atom = cp_atom_new(atom_factory, CP_EAPI_LATEST, atom_str, &error);
+    g_assert_no_error(error);
+    tree = cp_porttree_get_tree(porttree);
+    g_assert(cp_tree_find_packages(tree, atom, FALSE, &match, &error));
+    g_assert_no_error(error);
+    g_assert(match != NULL);
+
+    result = cp_package_ref(match->data);
+
+    cp_package_list_free(match);
+    cp_tree_unref(tree);
+    cp_atom_unref(atom);
+    return result;
+}
+
+static void
+assert_flags(const char *atom_str, const char *expected) {
+    CPPackage package = find_package(atom_str);
+    GError *error = NULL;
+    char **flags;
+    char *actual;
+
+    g_assert(cp_use_get_flags(use, package, &flags, &error));
+    g_assert_no_error(error);
+
+    actual = g_strjoinv(" ", flags);
+    g_assert_cmpstr(actual, ==, expected);
+
+    g_free(actual);
+    g_strfreev(flags);
+    cp_package_unref(package);
+}
+
+static void
+flags(void) {
+    /*
+      IUSE defaults lose to "-dflt" in make.conf and to package.use,
+      stable-only mask doesn't apply to testing version,
+      "-gmasked" in package.use.mask and "-gforced" in package.use.force
+      lift use.mask and use.force for foo-1 only
+     */
+    assert_flags("=app-misc/foo-1",
+        "amd64 base gmasked idflt pforced pkguse video_cards_radeon");
+    assert_flags("=app-misc/foo-2",
+        "amd64 gforced idflt pforced pkguse stablemasked video_cards_radeon");
+    /* "-*" in package.use clears global USE, but not forced flags */
+    assert_flags("sys-libs/bar", "bar gforced");
+}
+
+static void
+reload(void) {
+    CPSettings settings = new_settings("-*");
+    CPSettings original = new_settings(NULL);
+    guint64 fingerprint = cp_use_fingerprint(use);
+    GError *error = NULL;
+
+    /* "-*" in USE turns off all IUSE defaults */
+    g_assert(cp_use_reload(use, settings, &error));
+    g_assert_no_error(error);
+    g_assert(cp_use_fingerprint(use) != fingerprint);
+    assert_flags("=app-misc/foo-1",
+        "amd64 base gmasked pforced pkguse video_cards_radeon");
+
+    g_assert(cp_use_reload(use, original, &error));
+    g_assert_no_error(error);
+    g_assert(cp_use_fingerprint(use) == fingerprint);
+    flags();
+
+    cp_settings_unref(original);
+    cp_settings_unref(settings);
+}
+
+static void
+flatten(void) {
+    CPDepTable table = cp_use_get_dep_table(use);
+    CPDepEval eval = cp_dep_eval_new(table, 1024 * 1024);
+    CPPackage package = find_package("=app-misc/foo-1");
+    const GArray *bitset;
+    const CPDepId *nodes;
+    CPDepId id;
+    CPDepId expected;
+    GError *error = NULL;
+    guint n;
+
+    g_assert(cp_dep_table_parse(table, CP_EAPI_LATEST,
+        "pkguse? ( dev-libs/a ) !base? ( dev-libs/b ) gforced? ( dev-libs/c )",
+        &id, &error));
+    g_assert_no_error(error);
+    g_assert(cp_dep_table_parse(table, CP_EAPI_LATEST, "dev-libs/a", &expected, &error));
+    g_assert_no_error(error);
+
+    /* Bitsets of USE are over flag IDs of the same table */
+    g_assert(cp_use_get_bitset(use, package, &bitset, &error));
+    g_assert_no_error(error);
+    nodes = cp_dep_eval_flatten(eval, id, bitset, &n);
+    g_assert_cmpuint(n, ==, 1);
+    g_assert_cmpuint(nodes[0], ==, expected);
+
+    cp_package_unref(package);
+    cp_dep_eval_destroy(eval);
+}
+
+int
+main(int argc, char *argv[]) {
+    CPSettings settings;
+    GError *error = NULL;
+    int result;
+
+    g_test_init(&argc, &argv, NULL);
+
+    g_assert(argc == 2);
+    dir = argv[1];
+
+    settings = new_settings(NULL);
+    porttree = cp_porttree_new(settings, &error);
+    g_assert_no_error(error);
+    use = cp_use_new(settings, porttree, &error);
+    g_assert_no_error(error);
+    atom_factory = cp_atom_factory_new();
+
+    g_test_add_func("/use/flags", flags);
+    g_test_add_func("/use/reload", reload);
+    g_test_add_func("/use/flatten", flatten);
+
+    result = g_test_run();
+
+    cp_atom_factory_unref(atom_factory);
+    cp_use_unref(use);
+    cp_porttree_unref(porttree);
+    cp_settings_unref(settings);
+
+    return result;
+}
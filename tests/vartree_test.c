@@ -0,0 +1,799 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include <stdarg.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include <cportage.h>
+#include <cportage/error.h>
+
+static char *dir;
+
+static char *root;
+
+static CPVartree vartree;
+
+static CPAtomFactory atom_factory;
+
+/**
+ * Creates vartree for \a config_root, followed by %NULL-terminated pairs
+ * of variable names and values to set. PORTDIR is always set.
+ */
+static /*@null@*/ CPVartree G_GNUC_NULL_TERMINATED
+new_vartree(const char *config_root, GError **error, ...) {
+    GTree *defaults;
+    CPSettings settings;
+    CPVartree result;
+    const char *key;
+    va_list args;
+
+    defaults = g_tree_new_full((GCompareDataFunc)strcmp, NULL, g_free, g_free);
+    g_tree_insert(defaults, g_strdup("PORTDIR"), g_strdup("/tmp"));
+
+    va_start(args, error);
+    while ((key = va_arg(args, const char *)) != NULL) {
+        const char *value = va_arg(args, const char *);
+
+        g_tree_insert(defaults, g_strdup(key), g_strdup(value));
+    }
+    va_end(args);
+
+    settings = cp_settings_new(config_root, defaults, error);
+    g_assert_no_error(*error);
+    result = cp_vartree_new(settings, error);
+
+    cp_settings_unref(settings);
+    g_tree_unref(defaults);
+    return result;
+}
+
+/** Writes \a contents to \a file of installed package \a cpv in \a vdb_root. */
+static void
+write_vdb_file(
+    const char *vdb_root,
+    const char *cpv,
+    const char *file,
+    const char *contents
+) {
+    char *pkg_dir = g_build_filename(vdb_root, "var", "db", "pkg", cpv, NULL);
+    char *path = g_build_filename(pkg_dir, file, NULL);
+    GError *error = NULL;
+
+    g_assert(g_mkdir_with_parents(pkg_dir, 0755) == 0);
+    g_assert(g_file_set_contents(path, contents, -1, &error));
+    g_assert_no_error(error);
+
+    g_free(path);
+    g_free(pkg_dir);
+}
+
+static void
+add_vdb_package(const char *vdb_root, const char *cpv, const char *slot) {
+    char *contents = g_strconcat(slot, "\n", NULL);
+
+    write_vdb_file(vdb_root, cpv, "SLOT", contents);
+    write_vdb_file(vdb_root, cpv, "repository", "gentoo\n");
+
+    g_free(contents);
+}
+
+static void
+remove_tree(const char *path) {
+    if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+        GError *error = NULL;
+        GDir *gdir = g_dir_open(path, 0, &error);
+        const char *name;
+
+        g_assert_no_error(error);
+        while ((name = g_dir_read_name(gdir)) != NULL) {
+            char *child = g_build_filename(path, name, NULL);
+
+            remove_tree(child);
+            g_free(child);
+        }
+        g_dir_close(gdir);
+        g_assert(g_rmdir(path) == 0);
+    } else {
+        g_assert(g_unlink(path) == 0);
+    }
+}
+
+/** \return space-separated installed packages matching \a atom_str */
+static /*@only@*/ char *
+list_installed(CPVartree self, const char *atom_str) {
+    CPTree tree = cp_vartree_get_tree(self);
+    CPAtom atom;
+    GSList *match = NULL;
+    GString *result = g_string_new("");
+    GError *error = NULL;
+
+    atom = cp_atom_new(atom_factory, CP_EAPI_LATEST, atom_str, &error);
+    g_assert_no_error(error);
+    g_assert(cp_tree_find_packages(tree, atom, TRUE, &match, &error));
+    g_assert_no_error(error);
+
+    CP_GSLIST_ITER(match, pkg) {
+        if (result->len > 0) {
+            g_string_append_c(result, ' ');
+        }
+        g_string_append(result, cp_package_str(pkg));
+    } end_CP_GSLIST_ITER
+
+    cp_package_list_free(match);
+    cp_atom_unref(atom);
+    cp_tree_unref(tree);
+    return g_string_free(result, FALSE);
+}
+
+static void
+assert_installed(CPVartree self, const char *atom_str, const char *expected) {
+    char *actual = list_installed(self, atom_str);
+
+    g_assert_cmpstr(actual, ==, expected);
+    g_free(actual);
+}
+
+static void
+assert_metadata(const char *atom_str, const char *key, const char *expected) {
+    CPAtom atom;
+    CPTree tree;
+    GSList *match = NULL;
+    const char *value;
+    GError *error = NULL;
+
+    atom = cp_atom_new(atom_factory, CP_EAPI_LATEST, atom_str, &error);
+    g_assert_no_error(error);
+    tree = cp_vartree_get_tree(vartree);
+    g_assert(cp_tree_find_packages(tree, atom, FALSE, &match, &error));
+    g_assert_no_error(error);
+    g_assert(match != NULL);
+
+    g_assert(cp_vartree_get_metadata(vartree, match->data, key, &value, &error));
+    g_assert_no_error(error);
+    g_assert_cmpstr(value, ==, expected);
+
+    cp_package_list_free(match);
+    cp_tree_unref(tree);
+    cp_atom_unref(atom);
+}
+
+static void
+metadata(void) {
+    assert_metadata("app-misc/foo", "USE", "doc nls");
+    assert_metadata("sys-libs/bar", "USE", "nls");
+    /* Missing key */
+    assert_metadata("virtual/baz", "USE", NULL);
+    /* Different column */
+    assert_metadata("sys-libs/bar", "SLOT", "0");
+}
+
+static void
+assert_tree_pattern(CPTree tree, const char *pattern_str, const char *expected) {
+    CPPattern pattern;
+    GSList *match = NULL;
+    GString *actual = g_string_new("");
+    GError *error = NULL;
+
+    pattern = cp_pattern_new(pattern_str, &error);
+    g_assert_no_error(error);
+    g_assert(cp_tree_find_pattern(tree, pattern, TRUE, &match, &error));
+    g_assert_no_error(error);
+
+    CP_GSLIST_ITER(match, pkg) {
+        g_assert(cp_pattern_matches(pattern, pkg));
+        if (actual->len > 0) {
+            g_string_append_c(actual, ' ');
+        }
+        g_string_append(actual, cp_package_str(pkg));
+    } end_CP_GSLIST_ITER
+
+    g_assert_cmpstr(actual->str, ==, expected);
+
+    g_string_free(actual, TRUE);
+    cp_package_list_free(match);
+    cp_pattern_destroy(pattern);
+}
+
+static void
+assert_pattern(const char *pattern_str, const char *expected) {
+    CPTree tree = cp_vartree_get_tree(vartree);
+
+    assert_tree_pattern(tree, pattern_str, expected);
+    cp_tree_unref(tree);
+}
+
+static void
+find_pattern(void) {
+    assert_pattern("app-misc/foo", "app-misc/foo-1.0");
+    assert_pattern("foo", "app-misc/foo-1.0");
+    assert_pattern("*/bar", "sys-libs/bar-2");
+    assert_pattern("sys-libs/*", "sys-libs/bar-2");
+    assert_pattern("*/ba*", "sys-libs/bar-2 virtual/baz-1");
+    assert_pattern("*-*/*", "app-misc/foo-1.0 sys-libs/bar-2");
+    assert_pattern("*/?a?", "sys-libs/bar-2 virtual/baz-1");
+    assert_pattern("*/*", "app-misc/foo-1.0 sys-libs/bar-2 virtual/baz-1");
+    assert_pattern("virtual/foo", "");
+    assert_pattern("nonexistent/*", "");
+}
+
+static void
+invalid_pattern(void) {
+    const char *data[] = { "", "/", "app-misc/", "app misc/foo", "a/b/c", "*/[ab]" };
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(data); ++i) {
+        GError *error = NULL;
+        CPPattern pattern = cp_pattern_new(data[i], &error);
+
+        g_assert(pattern == NULL);
+        g_assert(error != NULL);
+        g_error_free(error);
+    }
+}
+
+static gboolean
+collect_package(const CPPackage package, void *user_data) {
+    GString *actual = user_data;
+
+    if (actual->len > 0) {
+        g_string_append_c(actual, ' ');
+    }
+    g_string_append(actual, cp_package_str(package));
+
+    /* Stop after second package */
+    return strchr(actual->str, ' ') == NULL;
+}
+
+static gboolean
+collect_all(const CPPackage package, void *user_data) {
+    (void)collect_package(package, user_data);
+    return TRUE;
+}
+
+static void
+assert_foreach(CPVartree self) {
+    CPTree tree = cp_vartree_get_tree(self);
+    GString *actual = g_string_new("");
+    GError *error = NULL;
+
+    g_assert(cp_tree_foreach(tree, collect_all, actual, &error));
+    g_assert_no_error(error);
+    g_assert_cmpstr(actual->str, ==, "app-misc/foo-1.0 sys-libs/bar-2 virtual/baz-1");
+
+    g_string_truncate(actual, 0);
+    g_assert(cp_tree_foreach(tree, collect_package, actual, &error));
+    g_assert_no_error(error);
+    g_assert_cmpstr(actual->str, ==, "app-misc/foo-1.0 sys-libs/bar-2");
+
+    g_string_free(actual, TRUE);
+    cp_tree_unref(tree);
+}
+
+static void
+foreach(void) {
+    assert_foreach(vartree);
+}
+
+static void
+foreach_parallel(void) {
+    CPVartree parallel;
+    GError *error = NULL;
+
+    parallel = new_vartree(root, &error, "CPORTAGE_VARTREE_JOBS", "4", NULL);
+    g_assert_no_error(error);
+
+    assert_foreach(parallel);
+
+    cp_vartree_unref(parallel);
+}
+
+static void
+jobs(void) {
+    char *vdb_root;
+    CPVartree serial;
+    CPVartree parallel;
+    GError *error = NULL;
+
+    vdb_root = g_dir_make_tmp("vartree_test.XXXXXX", &error);
+    g_assert_no_error(error);
+    add_vdb_package(vdb_root, "app-misc/foo-1", "0");
+    add_vdb_package(vdb_root, "app-misc/foo-2", "0");
+    add_vdb_package(vdb_root, "dev-libs/baz-1", "0");
+    add_vdb_package(vdb_root, "sys-libs/bar-2", "0");
+
+    serial = new_vartree(vdb_root, &error, "CPORTAGE_VARTREE_LAZY", "false", NULL);
+    g_assert_no_error(error);
+    parallel = new_vartree(vdb_root, &error, "CPORTAGE_VARTREE_LAZY", "false",
+        "CPORTAGE_VARTREE_JOBS", "4", NULL);
+    g_assert_no_error(error);
+
+    assert_installed(serial, "app-misc/foo", "app-misc/foo-1 app-misc/foo-2");
+    assert_installed(parallel, "app-misc/foo", "app-misc/foo-1 app-misc/foo-2");
+    assert_installed(serial, "dev-libs/baz", "dev-libs/baz-1");
+    assert_installed(parallel, "dev-libs/baz", "dev-libs/baz-1");
+    assert_installed(serial, "sys-libs/bar", "sys-libs/bar-2");
+    assert_installed(parallel, "sys-libs/bar", "sys-libs/bar-2");
+    assert_installed(parallel, "nonexistent/bar", "");
+
+    cp_vartree_unref(parallel);
+    cp_vartree_unref(serial);
+
+    g_assert(new_vartree(vdb_root, &error, "CPORTAGE_VARTREE_JOBS", "4x", NULL) == NULL);
+    g_assert_error(error, CP_ERROR, CP_ERROR_SETTINGS_INVALID_VALUE);
+    g_clear_error(&error);
+
+    g_assert(new_vartree(vdb_root, &error, "CPORTAGE_VARTREE_JOBS", "-1", NULL) == NULL);
+    g_assert_error(error, CP_ERROR, CP_ERROR_SETTINGS_INVALID_VALUE);
+    g_clear_error(&error);
+
+    remove_tree(vdb_root);
+    g_free(vdb_root);
+}
+
+/** \return the only installed package matching \a atom_str */
+static CPPackage
+find_installed(CPVartree self, const char *atom_str) {
+    CPTree tree = cp_vartree_get_tree(self);
+    CPAtom atom;
+    GSList *match = NULL;
+    CPPackage result;
+    GError *error = NULL;
+
+    atom = cp_atom_new(atom_factory, CP_EAPI_LATEST, atom_str, &error);
+    g_assert_no_error(error);
+    g_assert(cp_tree_find_packages(tree, atom, FALSE, &match, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(g_slist_length(match), ==, 1);
+
+    result = cp_package_ref(match->data);
+
+    cp_package_list_free(match);
+    cp_atom_unref(atom);
+    cp_tree_unref(tree);
+    return result;
+}
+
+static void
+assert_slot(CPVartree self, const char *atom_str, const char *expected) {
+    CPPackage package = find_installed(self, atom_str);
+
+    g_assert_cmpstr(cp_package_slot(package), ==, expected);
+    cp_package_unref(package);
+}
+
+static /*@null@*/ CPVartree
+new_indexed_vartree(const char *vdb_root, GError **error) {
+    return new_vartree(vdb_root, error, "CPORTAGE_VARTREE_INDEX", "true",
+        "CPORTAGE_VARTREE_LAZY", "false", NULL);
+}
+
+static void
+save_and_unref(CPVartree self) {
+    GError *error = NULL;
+
+    g_assert(cp_vartree_save_index(self, &error));
+    g_assert_no_error(error);
+    cp_vartree_unref(self);
+}
+
+static void
+assert_package_metadata(
+    CPVartree self,
+    const char *atom_str,
+    const char *key,
+    const char *expected
+) {
+    CPPackage package = find_installed(self, atom_str);
+    const char *value;
+    GError *error = NULL;
+
+    g_assert(cp_vartree_get_metadata(self, package, key, &value, &error));
+    g_assert_no_error(error);
+    g_assert_cmpstr(value, ==, expected);
+    cp_package_unref(package);
+}
+
+static void
+index_warm_start(void) {
+    char *vdb_root;
+    char *index_path;
+    char *column_path;
+    CPVartree self;
+    GError *error = NULL;
+
+    vdb_root = g_dir_make_tmp("vartree_test.XXXXXX", &error);
+    g_assert_no_error(error);
+    add_vdb_package(vdb_root, "app-misc/foo-1", "0");
+    index_path = g_build_filename(vdb_root, "var", "db", "pkg.cportage-index", NULL);
+    column_path = g_strconcat(index_path, ".SLOT", NULL);
+
+    /* Index is opt-in */
+    self = new_vartree(vdb_root, &error, "CPORTAGE_VARTREE_LAZY", "false", NULL);
+    g_assert_no_error(error);
+    g_assert(cp_vartree_save_index(self, &error));
+    g_assert_no_error(error);
+    cp_vartree_unref(self);
+    g_assert(!g_file_test(index_path, G_FILE_TEST_EXISTS));
+
+    /* Releasing vartree never writes index */
+    self = new_indexed_vartree(vdb_root, &error);
+    g_assert_no_error(error);
+    assert_package_metadata(self, "app-misc/foo", "SLOT", "0");
+    cp_vartree_unref(self);
+    g_assert(!g_file_test(index_path, G_FILE_TEST_EXISTS));
+    g_assert(!g_file_test(column_path, G_FILE_TEST_EXISTS));
+
+    /* Cold: index is written on request once vdb is read */
+    self = new_indexed_vartree(vdb_root, &error);
+    g_assert_no_error(error);
+    assert_slot(self, "app-misc/foo", "0");
+    assert_package_metadata(self, "app-misc/foo", "SLOT", "0");
+    save_and_unref(self);
+    g_assert(g_file_test(index_path, G_FILE_TEST_IS_REGULAR));
+    g_assert(g_file_test(column_path, G_FILE_TEST_IS_REGULAR));
+
+    /*
+      Warm: rewriting a file of a package doesn't change mtime
+      of category directory, so package comes from index as it was
+     */
+    write_vdb_file(vdb_root, "app-misc/foo-1", "SLOT", "1\n");
+    self = new_indexed_vartree(vdb_root, &error);
+    g_assert_no_error(error);
+    assert_slot(self, "app-misc/foo", "0");
+    save_and_unref(self);
+
+    /* New package invalidates its category */
+    add_vdb_package(vdb_root, "app-misc/foo-2", "2");
+    self = new_indexed_vartree(vdb_root, &error);
+    g_assert_no_error(error);
+    assert_slot(self, "=app-misc/foo-1", "1");
+    assert_slot(self, "=app-misc/foo-2", "2");
+    save_and_unref(self);
+
+    /* New category invalidates list of categories */
+    add_vdb_package(vdb_root, "dev-libs/baz-1", "0");
+    self = new_indexed_vartree(vdb_root, &error);
+    g_assert_no_error(error);
+    assert_installed(self, "app-misc/foo", "app-misc/foo-1 app-misc/foo-2");
+    assert_installed(self, "dev-libs/baz", "dev-libs/baz-1");
+    save_and_unref(self);
+
+    remove_tree(vdb_root);
+    g_free(column_path);
+    g_free(index_path);
+    g_free(vdb_root);
+}
+
+static void
+dirfd_load(void) {
+    char *vdb_root;
+    char *path;
+    CPVartree self;
+    CPPackage package;
+    GError *error = NULL;
+
+    vdb_root = g_dir_make_tmp("vartree_test.XXXXXX", &error);
+    g_assert_no_error(error);
+    add_vdb_package(vdb_root, "app-misc/foo-1", "1/1.2");
+    write_vdb_file(vdb_root, "app-misc/foo-1", "EAPI", "4\n");
+    add_vdb_package(vdb_root, "app-misc/foo-2", "2");
+    write_vdb_file(vdb_root, "app-misc/foo-2", "repository", "overlay\n");
+    /* Neither of these is a package */
+    write_vdb_file(vdb_root, "app-misc/notes", "README", "");
+    path = g_build_filename(vdb_root, "var", "db", "pkg", "app-misc", "foo-3", NULL);
+    g_assert(g_file_set_contents(path, "", -1, &error));
+    g_assert_no_error(error);
+
+    /* Without index every package is read relative to category descriptor */
+    self = new_vartree(vdb_root, &error, "CPORTAGE_VARTREE_LAZY", "false", NULL);
+    g_assert_no_error(error);
+    assert_installed(self, "app-misc/foo", "app-misc/foo-1 app-misc/foo-2");
+    assert_installed(self, "app-misc/notes", "");
+
+    package = find_installed(self, "=app-misc/foo-1");
+    g_assert_cmpstr(cp_package_slot(package), ==, "1");
+    g_assert_cmpstr(cp_package_subslot(package), ==, "1.2");
+    g_assert_cmpstr(cp_package_repo(package), ==, "gentoo");
+    g_assert_cmpint(cp_package_eapi(package), ==, CP_EAPI_4);
+    cp_package_unref(package);
+
+    package = find_installed(self, "=app-misc/foo-2");
+    g_assert_cmpstr(cp_package_repo(package), ==, "overlay");
+    cp_package_unref(package);
+
+    cp_vartree_unref(self);
+
+    remove_tree(vdb_root);
+    g_free(path);
+    g_free(vdb_root);
+}
+
+static void
+assert_synced(
+    CPVartree self,
+    guint64 *generation,
+    const char *atom_str,
+    const char *expected
+) {
+    GError *error = NULL;
+
+    g_assert(cp_vartree_sync(self, &error));
+    g_assert_no_error(error);
+#if HAVE_INOTIFY_INIT1
+    g_assert_cmpuint(cp_vartree_generation(self), >, *generation);
+#endif
+    *generation = cp_vartree_generation(self);
+
+    assert_installed(self, atom_str, expected);
+}
+
+static void
+watch(void) {
+    char *vdb_root;
+    char *path;
+    CPVartree self;
+    guint64 generation;
+    GError *error = NULL;
+
+    vdb_root = g_dir_make_tmp("vartree_test.XXXXXX", &error);
+    g_assert_no_error(error);
+    add_vdb_package(vdb_root, "app-misc/foo-1", "0");
+
+    self = new_vartree(vdb_root, &error, "CPORTAGE_VARTREE_LAZY", "false",
+        "CPORTAGE_VARTREE_WATCH", "true", NULL);
+    g_assert_no_error(error);
+    generation = cp_vartree_generation(self);
+
+    /* Nothing happened, nothing changes */
+    g_assert(cp_vartree_sync(self, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(cp_vartree_generation(self), ==, generation);
+
+#if HAVE_INOTIFY_INIT1
+    add_vdb_package(vdb_root, "app-misc/foo-2", "0");
+    assert_synced(self, &generation, "app-misc/foo", "app-misc/foo-1 app-misc/foo-2");
+
+    add_vdb_package(vdb_root, "dev-libs/baz-1", "0");
+    assert_synced(self, &generation, "dev-libs/baz", "dev-libs/baz-1");
+
+    path = g_build_filename(vdb_root, "var", "db", "pkg", "app-misc", "foo-1", NULL);
+    remove_tree(path);
+    g_free(path);
+    assert_synced(self, &generation, "app-misc/foo", "app-misc/foo-2");
+
+    path = g_build_filename(vdb_root, "var", "db", "pkg", "dev-libs", NULL);
+    remove_tree(path);
+    g_free(path);
+    assert_synced(self, &generation, "dev-libs/baz", "");
+#else
+    /* Without inotify sync is a no-op */
+    add_vdb_package(vdb_root, "app-misc/foo-2", "0");
+    assert_synced(self, &generation, "app-misc/foo", "app-misc/foo-1");
+    (void)path;
+#endif
+
+    cp_vartree_unref(self);
+
+    remove_tree(vdb_root);
+    g_free(vdb_root);
+}
+
+static guint
+count_atom(CPTree tree, const CPAtom atom) {
+    GSList *match = NULL;
+    guint result;
+    GError *error = NULL;
+
+    g_assert(cp_tree_find_packages(tree, atom, FALSE, &match, &error));
+    g_assert_no_error(error);
+
+    result = g_slist_length(match);
+
+    cp_package_list_free(match);
+    return result;
+}
+
+static guint
+count_in_tree(CPTree tree, const char *atom_str) {
+    CPAtom atom;
+    guint result;
+    GError *error = NULL;
+
+    atom = cp_atom_new(atom_factory, CP_EAPI_LATEST, atom_str, &error);
+    g_assert_no_error(error);
+
+    result = count_atom(tree, atom);
+
+    cp_atom_unref(atom);
+    return result;
+}
+
+static guint
+count_packages(CPVartree self, const char *atom_str) {
+    CPTree tree = cp_vartree_get_tree(self);
+    guint result = count_in_tree(tree, atom_str);
+
+    cp_tree_unref(tree);
+    return result;
+}
+
+static void
+on_demand(void) {
+    CPVartree self;
+    GError *error = NULL;
+
+    self = new_vartree(root, &error, "CPORTAGE_VARTREE_ONDEMAND", "true", NULL);
+    g_assert_no_error(error);
+
+    g_assert_cmpuint(count_packages(self, "sys-libs/bar"), ==, 1);
+    g_assert_cmpuint(count_packages(self, "nonexistent/bar"), ==, 0);
+    /* Negative cache */
+    g_assert_cmpuint(count_packages(self, "nonexistent/bar"), ==, 0);
+    /* Whole vdb is still visible to operations that need it */
+    assert_foreach(self);
+    g_assert_cmpuint(count_packages(self, "app-misc/foo"), ==, 1);
+
+    cp_vartree_unref(self);
+}
+
+static void *
+snapshot_reader(void *data) {
+    CPVartree self = data;
+    /* Atom factory isn't thread-safe, each reader needs its own */
+    CPAtomFactory factory = cp_atom_factory_new();
+    CPAtom foo;
+    CPAtom bar;
+    int i;
+    GError *error = NULL;
+
+    foo = cp_atom_new(factory, CP_EAPI_LATEST, "app-misc/foo", &error);
+    g_assert_no_error(error);
+    bar = cp_atom_new(factory, CP_EAPI_LATEST, "sys-libs/bar", &error);
+    g_assert_no_error(error);
+
+    for (i = 0; i < 1000; ++i) {
+        CPVartreeSnapshot snapshot = cp_vartree_snapshot_acquire(self);
+        CPTree tree = cp_vartree_snapshot_get_tree(snapshot);
+
+        /* Snapshot is either initial empty one or complete */
+        if (count_atom(tree, foo) > 0) {
+            g_assert_cmpuint(count_atom(tree, bar), ==, 1);
+        }
+
+        cp_tree_unref(tree);
+        cp_vartree_snapshot_unref(snapshot);
+    }
+
+    cp_atom_unref(bar);
+    cp_atom_unref(foo);
+    cp_atom_factory_unref(factory);
+    return NULL;
+}
+
+static void
+snapshot(void) {
+    CPVartreeSnapshot empty;
+    CPVartreeSnapshot published;
+    CPTree tree;
+    GThread *threads[4];
+    GError *error = NULL;
+    size_t i;
+
+    empty = cp_vartree_snapshot_acquire(vartree);
+    tree = cp_vartree_snapshot_get_tree(empty);
+    g_assert_cmpuint(count_in_tree(tree, "sys-libs/bar"), ==, 0);
+    cp_tree_unref(tree);
+
+    g_assert(cp_vartree_publish(vartree, &error));
+    g_assert_no_error(error);
+    published = cp_vartree_snapshot_acquire(vartree);
+    g_assert(published != empty);
+
+    /* Old snapshot stays valid after publication */
+    tree = cp_vartree_snapshot_get_tree(empty);
+    g_assert_cmpuint(count_in_tree(tree, "sys-libs/bar"), ==, 0);
+    cp_tree_unref(tree);
+    cp_vartree_snapshot_unref(empty);
+
+    tree = cp_vartree_snapshot_get_tree(published);
+    g_assert_cmpuint(count_in_tree(tree, "sys-libs/bar"), ==, 1);
+    g_assert_cmpuint(count_in_tree(tree, "nonexistent/bar"), ==, 0);
+    cp_tree_unref(tree);
+
+    for (i = 0; i < G_N_ELEMENTS(threads); ++i) {
+        threads[i] = g_thread_new("reader", snapshot_reader, vartree);
+    }
+    for (i = 0; i < 100; ++i) {
+        g_assert(cp_vartree_publish(vartree, &error));
+        g_assert_no_error(error);
+    }
+    for (i = 0; i < G_N_ELEMENTS(threads); ++i) {
+        (void)g_thread_join(threads[i]);
+    }
+
+    cp_vartree_snapshot_unref(published);
+}
+
+static void
+snapshot_tree(void) {
+    CPVartreeSnapshot published;
+    CPTree tree;
+    GString *actual = g_string_new("");
+    GError *error = NULL;
+
+    g_assert(cp_vartree_publish(vartree, &error));
+    g_assert_no_error(error);
+    published = cp_vartree_snapshot_acquire(vartree);
+    tree = cp_vartree_snapshot_get_tree(published);
+
+    g_assert(cp_tree_foreach(tree, collect_all, actual, &error));
+    g_assert_no_error(error);
+    g_assert_cmpstr(actual->str, ==, "app-misc/foo-1.0 sys-libs/bar-2 virtual/baz-1");
+
+    assert_tree_pattern(tree, "foo", "app-misc/foo-1.0");
+    assert_tree_pattern(tree, "*/ba*", "sys-libs/bar-2 virtual/baz-1");
+    assert_tree_pattern(tree, "sys-libs/*", "sys-libs/bar-2");
+    assert_tree_pattern(tree, "virtual/foo", "");
+
+    g_string_free(actual, TRUE);
+    cp_tree_unref(tree);
+    cp_vartree_snapshot_unref(published);
+}
+
+int
+main(int argc, char *argv[]) {
+    GError *error = NULL;
+    int result;
+
+    g_test_init(&argc, &argv, NULL);
+
+    g_assert(argc == 2);
+    dir = argv[1];
+
+    /* Shares installed packages with owners test */
+    root = g_build_filename(dir, "roots/owners", NULL);
+    vartree = new_vartree(root, &error, NULL);
+    g_assert_no_error(error);
+    atom_factory = cp_atom_factory_new();
+
+    g_test_add_func("/vartree/metadata", metadata);
+    g_test_add_func("/vartree/find_pattern", find_pattern);
+    g_test_add_func("/vartree/invalid_pattern", invalid_pattern);
+    g_test_add_func("/vartree/foreach", foreach);
+    g_test_add_func("/vartree/foreach_parallel", foreach_parallel);
+    g_test_add_func("/vartree/jobs", jobs);
+    g_test_add_func("/vartree/index_warm_start", index_warm_start);
+    g_test_add_func("/vartree/dirfd_load", dirfd_load);
+    g_test_add_func("/vartree/watch", watch);
+    g_test_add_func("/vartree/on_demand", on_demand);
+    g_test_add_func("/vartree/snapshot", snapshot);
+    g_test_add_func("/vartree/snapshot_tree", snapshot_tree);
+
+    result = g_test_run();
+
+    cp_atom_factory_unref(atom_factory);
+    cp_vartree_unref(vartree);
+    g_free(root);
+
+    return result;
+}
@@ -0,0 +1,250 @@
+/*
+    Copyright 2009-2014, Marat Radchenko
+
+    This file is part of cportage.
+
+    cportage is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cportage is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cportage.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include <cportage.h>
+
+static char *dir;
+
+static CPPorttree porttree;
+
+static CPVisibility visibility;
+
+static CPAtomFactory atom_factory;
+
+static CPSettings
+new_license_settings(
+    const char *accept_keywords,
+    const char *accept_license,
+    const char *use
+) {
+    GTree *defaults;
+    CPSettings settings;
+    char *root;
+    GError *error = NULL;
+
+    root = g_build_filename(dir, "roots/porttree", NULL);
+    defaults = g_tree_new_full((GCompareDataFunc)strcmp, NULL, g_free, g_free);
+    g_tree_insert(defaults, g_strdup("CPORTAGE_PORTTREE_CACHE"), g_strdup("false"));
+    g_tree_insert(defaults, g_strdup("ACCEPT_KEYWORDS"), g_strdup(accept_keywords));
+    if (accept_license != NULL) {
+        g_tree_insert(defaults, g_strdup("ACCEPT_LICENSE"), g_strdup(accept_license));
+    }
+    if (use != NULL) {
+        g_tree_insert(defaults, g_strdup("USE"), g_strdup(use));
+    }
+
+    settings = cp_settings_new(root, defaults, &error);
+    g_assert_no_error(error);
+
+    g_tree_unref(defaults);
+    g_free(root);
+
+    return settings;
+}
+
+static CPSettings
+new_settings(const char *accept_keywords) {
+    return new_license_settings(accept_keywords, NULL, NULL);
+}
+
+static CPPackage
+find_package(const char *atom_str) {
+    CPAtom atom;
+    CPTree tree;
+    CPPackage result;
+    GSList *match = NULL;
+    GError *error = NULL;
+
+    atom = cp_atom_new(atom_factory, CP_EAPI_LATEST, atom_str, &error);
+    g_assert_no_error(error);
+    tree = cp_porttree_get_tree(porttree);
+    g_assert(cp_tree_find_packages(tree, atom, FALSE, &match, &error));
+    g_assert_no_error(error);
+    g_assert(match != NULL);
+
+    result = cp_package_ref(match->data);
+
+    cp_package_list_free(match);
+    cp_tree_unref(tree);
+    cp_atom_unref(atom);
+    return result;
+}
+
+static void
+assert_reason(const char *atom_str, CPMaskReason expected) {
+    CPPackage package = find_package(atom_str);
+    CPMaskReason reason;
+    GError *error = NULL;
+
+    g_assert(cp_visibility_check(visibility, package, &reason, &error));
+    g_assert_no_error(error);
+    g_assert_cmpint(reason, ==, expected);
+
+    cp_package_unref(package);
+}
+
+static void
+assert_best(const char *atom_str, const char *expected) {
+    CPAtom atom;
+    CPPackage best;
+    GError *error = NULL;
+
+    atom = cp_atom_new(atom_factory, CP_EAPI_LATEST, atom_str, &error);
+    g_assert_no_error(error);
+    g_assert(cp_visibility_best_visible(visibility, atom, &best, &error));
+    g_assert_no_error(error);
+
+    if (expected == NULL) {
+        g_assert(best == NULL);
+    } else {
+        g_assert(best != NULL);
+        g_assert_cmpstr(cp_package_str(best), ==, expected);
+    }
+
+    cp_package_unref(best);
+    cp_atom_unref(atom);
+}
+
+static void
+check(void) {
+    assert_reason("=app-misc/foo-1.0", CP_MASK_NONE);
+    assert_reason("=app-misc/foo-2", CP_MASK_PACKAGE_MASK | CP_MASK_KEYWORDS);
+    /* Unmasked by user, no KEYWORDS accepted by package.accept_keywords */
+    assert_reason("sys-libs/bar", CP_MASK_NONE);
+}
+
+static void
+best_visible(void) {
+    GError *error = NULL;
+
+    g_assert(cp_visibility_compute(visibility, &error));
+    g_assert_no_error(error);
+
+    assert_best("app-misc/foo", "app-misc/foo-1.0");
+    assert_best(">app-misc/foo-1.0", NULL);
+    assert_best("sys-libs/bar", "sys-libs/bar-1");
+}
+
+static void
+reload(void) {
+    CPSettings testing = new_settings("amd64 ~amd64");
+    CPSettings stable = new_settings("amd64");
+    guint64 fingerprint = cp_visibility_fingerprint(visibility);
+    GError *error = NULL;
+
+    g_assert(cp_visibility_reload(visibility, testing, &error));
+    g_assert_no_error(error);
+    g_assert(cp_visibility_fingerprint(visibility) != fingerprint);
+    assert_reason("=app-misc/foo-2", CP_MASK_PACKAGE_MASK);
+
+    g_assert(cp_visibility_reload(visibility, stable, &error));
+    g_assert_no_error(error);
+    g_assert(cp_visibility_fingerprint(visibility) == fingerprint);
+    check();
+
+    cp_settings_unref(stable);
+    cp_settings_unref(testing);
+}
+
+static void
+reload_license(const char *accept_license, const char *use) {
+    CPSettings settings = new_license_settings("amd64", accept_license, use);
+    GError *error = NULL;
+
+    g_assert(cp_visibility_reload(visibility, settings, &error));
+    g_assert_no_error(error);
+
+    cp_settings_unref(settings);
+}
+
+static void
+license(void) {
+    CPSettings stable = new_settings("amd64");
+    GError *error = NULL;
+
+    /* FREE includes MIT and GPL-2 through nested OSI-APPROVED group */
+    reload_license("-* @FREE", NULL);
+    assert_reason("=app-misc/foo-1.0", CP_MASK_NONE);
+    assert_reason("=app-misc/foo-2",
+        CP_MASK_PACKAGE_MASK | CP_MASK_KEYWORDS | CP_MASK_LICENSE);
+    assert_reason("sys-libs/bar", CP_MASK_NONE);
+
+    /* Negated group survives incremental stacking */
+    reload_license("* -@EULA", "doc");
+    assert_reason("=app-misc/foo-1.0", CP_MASK_LICENSE);
+    assert_reason("sys-libs/bar", CP_MASK_NONE);
+
+    reload_license("* -@EULA", "-doc");
+    assert_reason("=app-misc/foo-1.0", CP_MASK_NONE);
+
+    reload_license("-* Foo-EULA", NULL);
+    assert_reason("=app-misc/foo-1.0", CP_MASK_LICENSE);
+    assert_reason("sys-libs/bar", CP_MASK_NONE);
+
+    reload_license("-*", NULL);
+    assert_reason("sys-libs/bar", CP_MASK_LICENSE);
+
+    /* LOOP-B is expanded through LOOP-A cycle first, but still gets MIT */
+    g_test_expect_message(G_LOG_DOMAIN, G_LOG_LEVEL_WARNING,
+        "License group 'LOOP-A' includes itself");
+    reload_license("-* -@LOOP-A @LOOP-B", NULL);
+    g_test_assert_expected_messages();
+    assert_reason("sys-libs/bar", CP_MASK_NONE);
+
+    g_assert(cp_visibility_reload(visibility, stable, &error));
+    g_assert_no_error(error);
+    check();
+
+    cp_settings_unref(stable);
+}
+
+int
+main(int argc, char *argv[]) {
+    CPSettings settings;
+    GError *error = NULL;
+    int result;
+
+    g_test_init(&argc, &argv, NULL);
+
+    g_assert(argc == 2);
+    dir = argv[1];
+
+    settings = new_settings("amd64");
+    porttree = cp_porttree_new(settings, &error);
+    g_assert_no_error(error);
+    visibility = cp_visibility_new(settings, porttree, &error);
+    g_assert_no_error(error);
+    atom_factory = cp_atom_factory_new();
+
+    g_test_add_func("/visibility/check", check);
+    g_test_add_func("/visibility/best_visible", best_visible);
+    g_test_add_func("/visibility/reload", reload);
+    g_test_add_func("/visibility/license", license);
+
+    result = g_test_run();
+
+    cp_atom_factory_unref(atom_factory);
+    cp_visibility_unref(visibility);
+    cp_porttree_unref(porttree);
+    cp_settings_unref(settings);
+
+    return result;
+}